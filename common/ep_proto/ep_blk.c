@@ -0,0 +1,315 @@
+#include "ep_blk.h"
+#include "ep_proto.h"
+#include <string.h>
+
+enum {
+    EP_BLK_TX_START = 0,
+    EP_BLK_TX_DATA,
+    EP_BLK_TX_DONE,
+    EP_BLK_TX_FAIL,
+};
+
+// ======== small helpers ========
+static int popcount32(uint32_t v) {
+    int n = 0;
+    while (v) { v &= v - 1; ++n; }
+    return n;
+}
+
+static int highest_bit(uint32_t v) {
+    int n = -1;
+    while (v) { ++n; v >>= 1; }
+    return n;
+}
+
+static uint32_t shift_window(uint32_t map, uint16_t delta) {
+    return delta >= EP_BLK_ACK_BITS ? 0 : (map >> delta);
+}
+
+// ======== frame ========
+size_t ep_blk_pack_start(const EPBlkStart *s, uint8_t out[EP_BLK_START_LEN]) {
+    ep_put_le16(&out[0], s->blob_id);
+    out[2] = s->kind;
+    out[3] = s->flags;
+    ep_put_le32(&out[4], s->total_len);
+    out[8] = s->chunk_size;
+    return EP_BLK_START_LEN;
+}
+
+bool ep_blk_parse_start(const uint8_t *msg, uint16_t len, EPBlkStart *out) {
+    if (!msg || !out || len < EP_BLK_START_LEN) return false;
+    out->blob_id    = ep_get_le16(&msg[0]);
+    out->kind       = msg[2];
+    out->flags      = msg[3];
+    out->total_len  = ep_get_le32(&msg[4]);
+    out->chunk_size = msg[8];
+    return true;
+}
+
+size_t ep_blk_pack_ack(const EPBlkAck *a, uint8_t out[EP_BLK_ACK_LEN]) {
+    ep_put_le16(&out[0], a->blob_id);
+    out[2] = a->status;
+    ep_put_le16(&out[3], a->base);
+    ep_put_le32(&out[5], a->bitmap);
+    return EP_BLK_ACK_LEN;
+}
+
+bool ep_blk_parse_ack(const uint8_t *msg, uint16_t len, EPBlkAck *out) {
+    if (!msg || !out || len < EP_BLK_ACK_LEN) return false;
+    out->blob_id = ep_get_le16(&msg[0]);
+    out->status  = msg[2];
+    out->base    = ep_get_le16(&msg[3]);
+    out->bitmap  = ep_get_le32(&msg[5]);
+    return true;
+}
+
+// ======== receiver ========
+static bool rx_has(const EPBlkRx *rx, uint16_t idx) {
+    return (rx->map[idx >> 3] >> (idx & 7)) & 1;
+}
+
+static void rx_fill_ack(const EPBlkRx *rx, EPBlkAck *ack, uint8_t flags) {
+    ack->blob_id = rx->blob_id;
+    ack->status  = (uint8_t)((rx->complete ? EP_BLK_ST_DONE : EP_BLK_ST_OK) | flags);
+    ack->base    = rx->base;
+    ack->bitmap  = 0;
+    for (uint16_t i = 0; i < EP_BLK_ACK_BITS; ++i) {
+        uint16_t idx = (uint16_t)(rx->base + i);
+        if (idx >= rx->n_chunks) break;
+        if (rx_has(rx, idx)) ack->bitmap |= (1u << i);
+    }
+}
+
+void ep_blk_rx_init(EPBlkRx *rx, uint8_t *buf, uint32_t cap) {
+    if (!rx) return;
+    memset(rx, 0, sizeof(*rx));
+    rx->buf = buf;
+    rx->cap = cap;
+    rx->unknown_blob = 0xFFFFFFFFu;
+}
+
+void ep_blk_rx_start(EPBlkRx *rx, const EPBlkStart *s, EPBlkAck *ack) {
+    const bool same = rx->active && rx->blob_id == s->blob_id && rx->kind == s->kind
+                   && rx->total_len == s->total_len && rx->chunk_size == s->chunk_size;
+
+    memset(ack, 0, sizeof(*ack));
+    ack->blob_id = s->blob_id;
+
+    if (s->flags & EP_BLK_FLAG_POLL) {
+        if (same) rx_fill_ack(rx, ack, EP_BLK_ST_F_SYNC);
+        else      ack->status = EP_BLK_ST_UNKNOWN | EP_BLK_ST_F_SYNC;
+        return;
+    }
+
+    if (!same) {
+        uint16_t n = ep_blk_chunk_count(s->total_len, s->chunk_size);
+        if (s->chunk_size == 0 || s->total_len == 0 || s->total_len > rx->cap || n > EP_BLK_MAX_CHUNKS) {
+            ack->status = EP_BLK_ST_NOMEM | EP_BLK_ST_F_SYNC;
+            return;
+        }
+        rx->active     = true;
+        rx->complete   = false;
+        rx->blob_id    = s->blob_id;
+        rx->kind       = s->kind;
+        rx->total_len  = s->total_len;
+        rx->chunk_size = s->chunk_size;
+        rx->n_chunks   = n;
+        rx->base       = 0;
+        rx->since_ack  = 0;
+        rx->unknown_blob = 0xFFFFFFFFu;
+        memset(rx->map, 0, sizeof(rx->map));
+    }
+    // same blob -> resume: giữ nguyên bitmap, gateway chỉ gửi phần thiếu
+    rx->since_ack = 0;
+    rx_fill_ack(rx, ack, EP_BLK_ST_F_SYNC);
+}
+
+bool ep_blk_rx_data(EPBlkRx *rx, const uint8_t *msg, uint16_t len, EPBlkAck *ack) {
+    if (!rx || !msg || !ack || len < EP_BLK_DATA_HDR_LEN) return false;
+    uint16_t blob = ep_get_le16(&msg[0]);
+    uint16_t idx  = ep_get_le16(&msg[2]);
+
+    if (!rx->active || blob != rx->blob_id) {
+        if (rx->unknown_blob == blob) return false;
+        rx->unknown_blob = blob;
+        memset(ack, 0, sizeof(*ack));
+        ack->blob_id = blob;
+        ack->status  = EP_BLK_ST_UNKNOWN;
+        return true;
+    }
+    if (idx >= rx->n_chunks) return false;
+
+    uint32_t off  = (uint32_t)idx * rx->chunk_size;
+    uint32_t want = (idx == rx->n_chunks - 1) ? (rx->total_len - off) : rx->chunk_size;
+    if ((uint32_t)(len - EP_BLK_DATA_HDR_LEN) != want) return false;
+
+    if (rx_has(rx, idx)) {
+        // nhận trùng = gateway đang gửi lại, đồng bộ bitmap ngay
+        rx->since_ack = 0;
+        rx_fill_ack(rx, ack, 0);
+        return true;
+    }
+
+    memcpy(rx->buf + off, &msg[EP_BLK_DATA_HDR_LEN], want);
+    rx->map[idx >> 3] |= (uint8_t)(1u << (idx & 7));
+    rx->since_ack++;
+    while (rx->base < rx->n_chunks && rx_has(rx, rx->base)) rx->base++;
+
+    if (rx->base == rx->n_chunks) {
+        rx->complete = true;
+        rx->since_ack = 0;
+        rx_fill_ack(rx, ack, 0);
+        return true;
+    }
+    if (rx->since_ack >= EP_BLK_ACK_EVERY) {
+        rx->since_ack = 0;
+        rx_fill_ack(rx, ack, 0);
+        return true;
+    }
+    return false;
+}
+
+// ======== sender ========
+void ep_blk_tx_init(EPBlkTx *tx, uint16_t dst, uint16_t blob_id, uint8_t kind,
+                    const uint8_t *data, uint32_t len, uint8_t chunk_size, uint32_t now_ms) {
+    memset(tx, 0, sizeof(*tx));
+    tx->dst        = dst;
+    tx->blob_id    = blob_id;
+    tx->kind       = kind;
+    tx->data       = data;
+    tx->total_len  = len;
+    tx->chunk_size = chunk_size ? chunk_size : EP_BLK_CHUNK_DEFAULT;
+    tx->n_chunks   = ep_blk_chunk_count(len, tx->chunk_size);
+    tx->state      = EP_BLK_TX_START;
+    tx->deadline_ms   = now_ms;
+    tx->backoff_ms    = EP_BLK_POLL_MS;
+    tx->last_heard_ms = now_ms;
+}
+
+uint8_t ep_blk_tx_inflight(const EPBlkTx *tx) {
+    return (uint8_t)popcount32(tx->sent & ~tx->acked);
+}
+
+static EPBlkAct tx_send_start(EPBlkTx *tx, uint32_t now_ms) {
+    tx->deadline_ms  = now_ms + tx->backoff_ms;
+    tx->backoff_ms   = tx->backoff_ms * 2 > EP_BLK_POLL_MAX_MS ? EP_BLK_POLL_MAX_MS : tx->backoff_ms * 2;
+    return EP_BLK_ACT_START;
+}
+
+EPBlkAct ep_blk_tx_next(EPBlkTx *tx, uint32_t now_ms, uint16_t *idx) {
+    if (tx->state == EP_BLK_TX_DONE) return EP_BLK_ACT_DONE;
+    if (tx->state == EP_BLK_TX_FAIL) return EP_BLK_ACT_FAIL;
+
+    if ((int32_t)(now_ms - tx->last_heard_ms) > EP_BLK_EXPIRE_MS) {
+        tx->state = EP_BLK_TX_FAIL;
+        return EP_BLK_ACT_FAIL;
+    }
+
+    if (tx->state == EP_BLK_TX_START) {
+        if ((int32_t)(now_ms - tx->deadline_ms) < 0) return EP_BLK_ACT_NONE;
+        return tx_send_start(tx, now_ms);
+    }
+
+    // DATA: chunk chưa gửi đầu tiên trong cửa sổ, nếu còn chỗ
+    if (ep_blk_tx_inflight(tx) < EP_BLK_WINDOW) {
+        uint16_t span = (uint16_t)(tx->n_chunks - tx->base);
+        if (span > EP_BLK_ACK_BITS) span = EP_BLK_ACK_BITS;
+        uint32_t busy = tx->sent | tx->acked;
+        for (uint16_t i = 0; i < span; ++i) {
+            if (busy & (1u << i)) continue;
+            tx->sent |= (1u << i);
+            tx->chunks_sent++;
+            tx->deadline_ms = now_ms + tx->backoff_ms;
+            *idx = (uint16_t)(tx->base + i);
+            return EP_BLK_ACT_DATA;
+        }
+    }
+
+    // cửa sổ đầy hoặc hết chunk: quá hạn ACK -> POLL để lấy bitmap đầy đủ
+    if ((int32_t)(now_ms - tx->deadline_ms) >= 0) {
+        tx->poll = true;
+        return tx_send_start(tx, now_ms);
+    }
+    return EP_BLK_ACT_NONE;
+}
+
+void ep_blk_tx_on_ack(EPBlkTx *tx, const EPBlkAck *ack, uint32_t now_ms) {
+    if (!tx || !ack || ack->blob_id != tx->blob_id) return;
+    if (tx->state == EP_BLK_TX_DONE || tx->state == EP_BLK_TX_FAIL) return;
+
+    const uint8_t st   = ack->status & EP_BLK_ST_MASK;
+    const bool    sync = (ack->status & EP_BLK_ST_F_SYNC) != 0;
+
+    tx->last_heard_ms = now_ms;
+    tx->backoff_ms    = EP_BLK_POLL_MS;
+    tx->deadline_ms   = now_ms + EP_BLK_POLL_MS;
+
+    switch (st) {
+    case EP_BLK_ST_NOMEM:
+        tx->state = EP_BLK_TX_FAIL;
+        return;
+    case EP_BLK_ST_UNKNOWN:
+        // tag mất phiên (reboot): mở lại, tag sẽ báo lại từ đầu
+        tx->state = EP_BLK_TX_START;
+        tx->poll = false;
+        tx->base = 0;
+        tx->acked = tx->sent = 0;
+        tx->deadline_ms = now_ms;
+        return;
+    case EP_BLK_ST_DONE:
+        tx->state = EP_BLK_TX_DONE;
+        return;
+    default:
+        break;
+    }
+
+    if (tx->state == EP_BLK_TX_START) tx->state = EP_BLK_TX_DATA;
+
+    if (ack->base >= tx->base) {
+        uint16_t delta = (uint16_t)(ack->base - tx->base);
+        tx->acked = shift_window(tx->acked, delta);
+        tx->sent  = shift_window(tx->sent, delta);
+    } else {
+        // tag lùi base (khởi động lại phiên) -> tin bitmap của tag
+        tx->acked = tx->sent = 0;
+    }
+    tx->base   = ack->base;
+    tx->acked |= ack->bitmap;
+
+    uint32_t lost;
+    if (sync) {
+        // trả lời START/POLL: mọi chunk đã gửi mà chưa có trong bitmap là mất
+        lost = tx->sent & ~tx->acked;
+    } else {
+        // ACK định kỳ: chỉ coi là mất các lỗ nằm dưới chunk cao nhất đã nhận
+        int hi = highest_bit(tx->acked);
+        uint32_t below = hi <= 0 ? 0 : (hi >= 31 ? 0x7FFFFFFFu : ((1u << hi) - 1));
+        lost = tx->sent & ~tx->acked & below;
+    }
+    tx->sent &= ~lost;
+    tx->chunks_resent += (uint32_t)popcount32(lost);
+
+    if (tx->base >= tx->n_chunks) tx->state = EP_BLK_TX_DONE;
+}
+
+size_t ep_blk_tx_start_frame(const EPBlkTx *tx, uint8_t out[EP_BLK_START_LEN]) {
+    EPBlkStart s = {
+        .blob_id    = tx->blob_id,
+        .kind       = tx->kind,
+        .flags      = tx->poll ? EP_BLK_FLAG_POLL : 0,
+        .total_len  = tx->total_len,
+        .chunk_size = tx->chunk_size,
+    };
+    return ep_blk_pack_start(&s, out);
+}
+
+size_t ep_blk_tx_data_frame(const EPBlkTx *tx, uint16_t idx, uint8_t *out, size_t cap) {
+    if (idx >= tx->n_chunks) return 0;
+    uint32_t off = (uint32_t)idx * tx->chunk_size;
+    uint32_t n   = (idx == tx->n_chunks - 1) ? (tx->total_len - off) : tx->chunk_size;
+    if (cap < EP_BLK_DATA_HDR_LEN + n) return 0;
+    ep_put_le16(&out[0], tx->blob_id);
+    ep_put_le16(&out[2], idx);
+    memcpy(&out[EP_BLK_DATA_HDR_LEN], tx->data + off, n);
+    return EP_BLK_DATA_HDR_LEN + n;
+}
@@ -0,0 +1,169 @@
+#ifndef EP_BLK_H
+#define EP_BLK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Block transfer qua vendor model: gửi payload lớn (ảnh, template, font...)
+// thành các chunk có chỉ số, ACK chọn lọc theo cửa sổ 32 chunk.
+//
+//   gw  --BLK_START(blob, kind, len, chunk)-->  tag
+//   gw  <--BLK_ACK(base, bitmap)------------   tag   (base = chunk thiếu đầu tiên)
+//   gw  --BLK_DATA(idx)--> x W (pipeline) -->  tag
+//   gw  <--BLK_ACK mỗi EP_BLK_ACK_EVERY chunk / khi đủ / khi nhận trùng
+//
+// Resume: blob id = hash nội dung, tag giữ trạng thái theo blob id, nên
+// một BLK_START mới (kể cả sau khi gateway/tag mất liên lạc) chỉ gửi tiếp
+// các chunk còn thiếu. Phần logic ở đây thuần C, không gọi mesh stack.
+
+// ============ Config ============
+#ifndef EP_BLK_CHUNK_DEFAULT
+#define EP_BLK_CHUNK_DEFAULT   96    // 96 + 4 header + 3 opcode + 4 MIC = 9 segment
+#endif
+#ifndef EP_BLK_MAX_CHUNKS
+#define EP_BLK_MAX_CHUNKS      256   // bitmap phía nhận
+#endif
+#ifndef EP_BLK_WINDOW
+#define EP_BLK_WINDOW          6     // số chunk chưa ACK tối đa mỗi node
+#endif
+#ifndef EP_BLK_ACK_EVERY
+#define EP_BLK_ACK_EVERY       4
+#endif
+#ifndef EP_BLK_POLL_MS
+#define EP_BLK_POLL_MS         1500  // chờ ACK trước khi hỏi lại (x2 mỗi lần)
+#endif
+#ifndef EP_BLK_POLL_MAX_MS
+#define EP_BLK_POLL_MAX_MS     20000
+#endif
+#ifndef EP_BLK_EXPIRE_MS
+#define EP_BLK_EXPIRE_MS       (10 * 60 * 1000)  // bỏ phiên nếu im lặng quá lâu
+#endif
+
+#define EP_BLK_ACK_BITS        32
+
+// ============ Frame ============
+#define EP_BLK_START_LEN       9    // blob(2) kind(1) flags(1) total(4) chunk(1)
+#define EP_BLK_DATA_HDR_LEN    4    // blob(2) idx(2)
+#define EP_BLK_ACK_LEN         9    // blob(2) status(1) base(2) bitmap(4)
+
+typedef enum {
+    EP_BLK_KIND_RAW      = 0,
+    EP_BLK_KIND_TITLE    = 1,
+    EP_BLK_KIND_IMAGE    = 2,   // stream epd_codec
+    EP_BLK_KIND_TEMPLATE = 3,
+    EP_BLK_KIND_FONT     = 4,
+} EPBlkKind;
+
+#define EP_BLK_FLAG_POLL  0x01      // chỉ hỏi trạng thái, không mở phiên mới
+
+typedef enum {
+    EP_BLK_ST_OK      = 0,          // đang nhận
+    EP_BLK_ST_DONE    = 1,          // đủ blob
+    EP_BLK_ST_NOMEM   = 2,          // blob quá lớn cho tag
+    EP_BLK_ST_UNKNOWN = 3,          // tag không có phiên cho blob này
+} EPBlkStatus;
+
+#define EP_BLK_ST_MASK    0x7F
+#define EP_BLK_ST_F_SYNC  0x80      // ACK trả lời BLK_START: bitmap là trạng thái đầy đủ
+
+typedef struct {
+    uint16_t blob_id;
+    uint8_t  kind;
+    uint8_t  flags;
+    uint32_t total_len;
+    uint8_t  chunk_size;
+} EPBlkStart;
+
+typedef struct {
+    uint16_t blob_id;
+    uint8_t  status;
+    uint16_t base;      // mọi chunk < base đã nhận
+    uint32_t bitmap;    // bit i = chunk (base + i) đã nhận
+} EPBlkAck;
+
+size_t ep_blk_pack_start(const EPBlkStart *s, uint8_t out[EP_BLK_START_LEN]);
+bool   ep_blk_parse_start(const uint8_t *msg, uint16_t len, EPBlkStart *out);
+size_t ep_blk_pack_ack(const EPBlkAck *a, uint8_t out[EP_BLK_ACK_LEN]);
+bool   ep_blk_parse_ack(const uint8_t *msg, uint16_t len, EPBlkAck *out);
+
+static inline uint16_t ep_blk_chunk_count(uint32_t total, uint8_t chunk) {
+    return chunk ? (uint16_t)((total + chunk - 1) / chunk) : 0;
+}
+
+// ============ Phía nhận (tag) ============
+typedef struct {
+    uint8_t  *buf;              // do app cấp, giữ nguyên giữa các phiên
+    uint32_t  cap;
+
+    bool      active;
+    bool      complete;
+    uint16_t  blob_id;
+    uint8_t   kind;
+    uint32_t  total_len;
+    uint8_t   chunk_size;
+    uint16_t  n_chunks;
+    uint16_t  base;
+    uint16_t  since_ack;
+    uint32_t  unknown_blob;     // blob đã trả UNKNOWN (tránh trả lặp), >0xFFFF = chưa có
+    uint8_t   map[EP_BLK_MAX_CHUNKS / 8];
+} EPBlkRx;
+
+void ep_blk_rx_init(EPBlkRx *rx, uint8_t *buf, uint32_t cap);
+
+// Xử lý BLK_START; luôn điền *ack để gửi lại gateway.
+void ep_blk_rx_start(EPBlkRx *rx, const EPBlkStart *s, EPBlkAck *ack);
+
+// Xử lý BLK_DATA. Trả true nếu cần gửi *ack ngay.
+bool ep_blk_rx_data(EPBlkRx *rx, const uint8_t *msg, uint16_t len, EPBlkAck *ack);
+
+// ============ Phía gửi (gateway) ============
+typedef enum {
+    EP_BLK_ACT_NONE = 0,        // chưa có gì để làm (chờ ACK / cửa sổ đầy)
+    EP_BLK_ACT_START,           // gửi BLK_START (mở hoặc hỏi lại)
+    EP_BLK_ACT_DATA,            // gửi chunk *idx
+    EP_BLK_ACT_DONE,            // tag đã nhận đủ
+    EP_BLK_ACT_FAIL,            // hết hạn / tag từ chối
+} EPBlkAct;
+
+typedef struct {
+    uint16_t  dst;
+    uint16_t  blob_id;
+    uint8_t   kind;
+    uint8_t   chunk_size;
+    uint32_t  total_len;
+    uint16_t  n_chunks;
+    const uint8_t *data;
+
+    uint8_t   state;            // EP_BLK_TX_*
+    bool      poll;             // START kế tiếp là POLL
+    uint16_t  base;             // mọi chunk < base đã ACK
+    uint32_t  acked;            // bitmap tương đối base
+    uint32_t  sent;             // đã gửi, chưa kết luận mất
+    uint32_t  deadline_ms;      // hết hạn chờ ACK
+    uint32_t  backoff_ms;
+    uint32_t  last_heard_ms;
+
+    uint32_t  chunks_sent;      // thống kê
+    uint32_t  chunks_resent;
+} EPBlkTx;
+
+void     ep_blk_tx_init(EPBlkTx *tx, uint16_t dst, uint16_t blob_id, uint8_t kind,
+                        const uint8_t *data, uint32_t len, uint8_t chunk_size, uint32_t now_ms);
+EPBlkAct ep_blk_tx_next(EPBlkTx *tx, uint32_t now_ms, uint16_t *idx);
+void     ep_blk_tx_on_ack(EPBlkTx *tx, const EPBlkAck *ack, uint32_t now_ms);
+uint8_t  ep_blk_tx_inflight(const EPBlkTx *tx);
+
+// Khung START/DATA cho chunk idx của phiên; trả về độ dài.
+size_t   ep_blk_tx_start_frame(const EPBlkTx *tx, uint8_t out[EP_BLK_START_LEN]);
+size_t   ep_blk_tx_data_frame(const EPBlkTx *tx, uint16_t idx, uint8_t *out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EP_BLK_H
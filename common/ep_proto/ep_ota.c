@@ -0,0 +1,107 @@
+#include "ep_ota.h"
+#include "ep_proto.h"
+#include <string.h>
+
+// ======== frame ========
+size_t ep_ota_pack_start(const EPOtaStart *s, uint8_t out[EP_OTA_START_LEN]) {
+    ep_put_le32(&out[0], s->fw_id);
+    ep_put_le32(&out[4], s->size);
+    out[8] = s->chunk_size;
+    out[9] = s->flags;
+    ep_put_le16(&out[10], s->spread_ms);
+    return EP_OTA_START_LEN;
+}
+
+bool ep_ota_parse_start(const uint8_t *msg, uint16_t len, EPOtaStart *out) {
+    if (!msg || !out || len < EP_OTA_START_LEN) return false;
+    out->fw_id      = ep_get_le32(&msg[0]);
+    out->size       = ep_get_le32(&msg[4]);
+    out->chunk_size = msg[8];
+    out->flags      = msg[9];
+    out->spread_ms  = ep_get_le16(&msg[10]);
+    return out->chunk_size > 0;
+}
+
+size_t ep_ota_pack_data_hdr(uint32_t fw_id, uint16_t idx, uint8_t out[EP_OTA_DATA_HDR_LEN]) {
+    ep_put_le16(&out[0], ep_ota_fw_tag(fw_id));
+    ep_put_le16(&out[2], idx);
+    return EP_OTA_DATA_HDR_LEN;
+}
+
+bool ep_ota_parse_data_hdr(const uint8_t *msg, uint16_t len, uint16_t *fw_tag, uint16_t *idx) {
+    if (!msg || len <= EP_OTA_DATA_HDR_LEN) return false;
+    *fw_tag = ep_get_le16(&msg[0]);
+    *idx    = ep_get_le16(&msg[2]);
+    return true;
+}
+
+size_t ep_ota_pack_status(const EPOtaStatus *s, uint8_t out[EP_OTA_STATUS_MAX_LEN]) {
+    uint8_t n = s->n_ranges > EP_OTA_MAX_RANGES ? EP_OTA_MAX_RANGES : s->n_ranges;
+    ep_put_le32(&out[0], s->fw_id);
+    out[4] = s->status;
+    ep_put_le16(&out[5], s->missing);
+    out[7] = n;
+    uint8_t *p = &out[EP_OTA_STATUS_HDR_LEN];
+    for (uint8_t i = 0; i < n; ++i, p += EP_OTA_RANGE_LEN) {
+        ep_put_le16(&p[0], s->ranges[i].start);
+        ep_put_le16(&p[2], s->ranges[i].count);
+    }
+    return EP_OTA_STATUS_HDR_LEN + (size_t)n * EP_OTA_RANGE_LEN;
+}
+
+bool ep_ota_parse_status(const uint8_t *msg, uint16_t len, EPOtaStatus *out) {
+    if (!msg || !out || len < EP_OTA_STATUS_HDR_LEN) return false;
+    out->fw_id    = ep_get_le32(&msg[0]);
+    out->status   = msg[4];
+    out->missing  = ep_get_le16(&msg[5]);
+    out->n_ranges = msg[7];
+    if (out->n_ranges > EP_OTA_MAX_RANGES) return false;
+    if (len < EP_OTA_STATUS_HDR_LEN + out->n_ranges * EP_OTA_RANGE_LEN) return false;
+    const uint8_t *p = &msg[EP_OTA_STATUS_HDR_LEN];
+    for (uint8_t i = 0; i < out->n_ranges; ++i, p += EP_OTA_RANGE_LEN) {
+        out->ranges[i].start = ep_get_le16(&p[0]);
+        out->ranges[i].count = ep_get_le16(&p[2]);
+    }
+    return true;
+}
+
+// ======== bitmap ========
+uint16_t ep_ota_map_next(const uint8_t *map, uint16_t n_chunks, uint16_t from, bool value) {
+    const uint8_t skip = value ? 0x00 : 0xFF;   // byte không chứa bit cần tìm
+    uint32_t i = from;
+    while (i < n_chunks) {
+        if ((i & 7) == 0 && map[i >> 3] == skip) {
+            i += 8;
+            continue;
+        }
+        if (ep_ota_map_test(map, (uint16_t)i) == value) return (uint16_t)i;
+        ++i;
+    }
+    return n_chunks;
+}
+
+uint16_t ep_ota_map_count(const uint8_t *map, uint16_t n_chunks, bool value) {
+    uint32_t ones = 0;
+    for (uint32_t i = 0; i < n_chunks / 8u; ++i) {
+        uint8_t b = map[i];
+        while (b) { b &= (uint8_t)(b - 1); ++ones; }
+    }
+    for (uint32_t i = n_chunks & ~7u; i < n_chunks; ++i) {
+        ones += ep_ota_map_test(map, (uint16_t)i);
+    }
+    return (uint16_t)(value ? ones : n_chunks - ones);
+}
+
+void ep_ota_map_fill_status(const uint8_t *map, uint16_t n_chunks, EPOtaStatus *st) {
+    st->missing  = ep_ota_map_count(map, n_chunks, false);
+    st->n_ranges = 0;
+
+    uint16_t i = ep_ota_map_next(map, n_chunks, 0, false);
+    while (i < n_chunks && st->n_ranges < EP_OTA_MAX_RANGES) {
+        uint16_t end = ep_ota_map_next(map, n_chunks, i, true);
+        st->ranges[st->n_ranges].start = i;
+        st->ranges[st->n_ranges].count = (uint16_t)(end - i);
+        st->n_ranges++;
+        i = ep_ota_map_next(map, n_chunks, end, false);
+    }
+}
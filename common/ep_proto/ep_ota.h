@@ -0,0 +1,125 @@
+#ifndef EP_OTA_H
+#define EP_OTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// OTA firmware tag qua mesh: gateway phát chunk tới 1 group address, mọi tag
+// nghe cùng 1 lần phát; mỗi tag giữ bitmap chunk đã ghi và chỉ báo lại các
+// dải còn thiếu. Gateway gộp (hợp) các dải thiếu của cả fleet rồi phát lại
+// đúng những chunk đó, nên thời gian ~ kích thước image, không nhân số tag.
+//
+//   gw  --OTA_START(QUERY)----> group   tag mở/tiếp tục phiên, trả STATUS sau jitter
+//   gw  <--OTA_STATUS(ranges)--- tag     (unicast, các dải thiếu đầu tiên)
+//   gw  --OTA_DATA(idx) x N---> group   chỉ chunk còn ai thiếu
+//   ... lặp QUERY/DATA tới khi mọi tag COMPLETE
+//   gw  --OTA_START(APPLY)----> group   tag đã verify -> đổi boot partition, reboot
+//
+// fw_id = ep_hash32 của cả image: tag dùng làm khoá resume và để verify.
+
+// ============ Config ============
+#ifndef EP_OTA_GROUP_ADDR
+#define EP_OTA_GROUP_ADDR      0xC0F0
+#endif
+#ifndef EP_OTA_CHUNK_DEFAULT
+#define EP_OTA_CHUNK_DEFAULT   96     // như block transfer: 9 segment / chunk
+#endif
+#ifndef EP_OTA_MAX_CHUNKS
+#define EP_OTA_MAX_CHUNKS      16384  // 1.5 MB ở chunk 96 B, bitmap 2 KB
+#endif
+#ifndef EP_OTA_MAX_RANGES
+#define EP_OTA_MAX_RANGES      8      // số dải thiếu tối đa trong 1 STATUS
+#endif
+#ifndef EP_OTA_REPLY_SPREAD_MS
+#define EP_OTA_REPLY_SPREAD_MS 4000   // tag trả STATUS ngẫu nhiên trong khoảng này
+#endif
+
+// ============ Frame ============
+#define EP_OTA_START_LEN       12   // fw_id(4) size(4) chunk(1) flags(1) spread_ms(2)
+#define EP_OTA_DATA_HDR_LEN    4    // fw_tag(2) idx(2)
+#define EP_OTA_STATUS_HDR_LEN  8    // fw_id(4) status(1) missing(2) n_ranges(1)
+#define EP_OTA_RANGE_LEN       4    // start(2) count(2)
+#define EP_OTA_STATUS_MAX_LEN  (EP_OTA_STATUS_HDR_LEN + EP_OTA_MAX_RANGES * EP_OTA_RANGE_LEN)
+
+#define EP_OTA_F_QUERY   0x01       // trả STATUS (sau jitter)
+#define EP_OTA_F_APPLY   0x02       // image đủ + verify xong -> boot vào image mới
+
+typedef enum {
+    EP_OTA_ST_RECEIVING = 0,        // đang nhận, ranges = các dải thiếu
+    EP_OTA_ST_COMPLETE  = 1,        // đủ và verify OK, chờ APPLY
+    EP_OTA_ST_NOSPACE   = 2,        // image lớn hơn partition OTA
+    EP_OTA_ST_ERROR     = 3,        // lỗi flash / verify sai (đã reset bitmap)
+    EP_OTA_ST_RUNNING   = 4,        // đang chạy đúng fw_id này
+} EPOtaStatusCode;
+
+typedef struct {
+    uint32_t fw_id;
+    uint32_t size;
+    uint8_t  chunk_size;
+    uint8_t  flags;
+    uint16_t spread_ms;
+} EPOtaStart;
+
+typedef struct {
+    uint16_t start;
+    uint16_t count;
+} EPOtaRange;
+
+typedef struct {
+    uint32_t   fw_id;
+    uint8_t    status;
+    uint16_t   missing;             // tổng số chunk thiếu (có thể > tổng ranges)
+    uint8_t    n_ranges;
+    EPOtaRange ranges[EP_OTA_MAX_RANGES];
+} EPOtaStatus;
+
+static inline uint32_t ep_ota_chunk_count(uint32_t size, uint8_t chunk) {
+    return chunk ? (size + chunk - 1) / chunk : 0;
+}
+
+// DATA chỉ mang 16 bit của fw_id cho đỡ tốn byte
+static inline uint16_t ep_ota_fw_tag(uint32_t fw_id) {
+    return (uint16_t)(fw_id ^ (fw_id >> 16));
+}
+
+size_t ep_ota_pack_start(const EPOtaStart *s, uint8_t out[EP_OTA_START_LEN]);
+bool   ep_ota_parse_start(const uint8_t *msg, uint16_t len, EPOtaStart *out);
+size_t ep_ota_pack_data_hdr(uint32_t fw_id, uint16_t idx, uint8_t out[EP_OTA_DATA_HDR_LEN]);
+bool   ep_ota_parse_data_hdr(const uint8_t *msg, uint16_t len, uint16_t *fw_tag, uint16_t *idx);
+size_t ep_ota_pack_status(const EPOtaStatus *s, uint8_t out[EP_OTA_STATUS_MAX_LEN]);
+bool   ep_ota_parse_status(const uint8_t *msg, uint16_t len, EPOtaStatus *out);
+
+// ============ Bitmap (1 bit / chunk) ============
+#define EP_OTA_MAP_BYTES(n)    (((n) + 7) / 8)
+
+static inline bool ep_ota_map_test(const uint8_t *map, uint16_t idx) {
+    return (map[idx >> 3] >> (idx & 7)) & 1;
+}
+
+static inline void ep_ota_map_set(uint8_t *map, uint16_t idx) {
+    map[idx >> 3] |= (uint8_t)(1u << (idx & 7));
+}
+
+static inline void ep_ota_map_clear(uint8_t *map, uint16_t idx) {
+    map[idx >> 3] &= (uint8_t)~(1u << (idx & 7));
+}
+
+// Chỉ số >= from đầu tiên có bit == value; trả n_chunks nếu không có.
+uint16_t ep_ota_map_next(const uint8_t *map, uint16_t n_chunks, uint16_t from, bool value);
+
+uint16_t ep_ota_map_count(const uint8_t *map, uint16_t n_chunks, bool value);
+
+// Điền các dải bit 0 (chunk thiếu) đầu tiên vào st->ranges, cập nhật
+// st->missing và st->n_ranges.
+void     ep_ota_map_fill_status(const uint8_t *map, uint16_t n_chunks, EPOtaStatus *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EP_OTA_H
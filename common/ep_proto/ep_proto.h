@@ -0,0 +1,169 @@
+#ifndef EP_PROTO_H
+#define EP_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Giao thức vendor model giữa gateway (client) và tag (server).
+// Header thuần C, không phụ thuộc ESP-IDF: mỗi bên tự bọc opcode bằng
+// ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_xxx, EP_CID).
+
+// ============ Model ============
+#define EP_CID                  0x02E5   // CID_ESP
+#define EP_VND_MODEL_ID_CLIENT  0x0000
+#define EP_VND_MODEL_ID_SERVER  0x0001
+
+// ============ Opcode (byte thấp của opcode 3 byte) ============
+#define EP_VND_OP_SEND          0x00     // gw -> tag: giá 14B (+ mở rộng)
+#define EP_VND_OP_STATUS        0x01     // tag -> gw: ACK theo TID
+#define EP_VND_OP_BLK_START     0x02     // gw -> tag: mở/hỏi phiên block transfer
+#define EP_VND_OP_BLK_DATA      0x03     // gw -> tag: 1 chunk (không cần phản hồi)
+#define EP_VND_OP_BLK_ACK       0x04     // tag -> gw: selective-ACK bitmap
+#define EP_VND_OP_OTA_START     0x05     // gw -> group: mở/hỏi/apply phiên OTA
+#define EP_VND_OP_OTA_DATA      0x06     // gw -> group: 1 chunk firmware
+#define EP_VND_OP_OTA_STATUS    0x07     // tag -> gw: dải chunk còn thiếu
+#define EP_VND_OP_DIGEST_GET    0x08     // gw -> tag: hỏi digest nội dung đang hiển thị
+#define EP_VND_OP_DIGEST        0x09     // tag -> gw: digest (anti-entropy)
+#define EP_VND_OP_FPROV_SET     0x0A     // gw -> tag: làm provisioner tạm cho 1 dải địa chỉ
+#define EP_VND_OP_FPROV_STATUS  0x0B     // tag -> gw: trạng thái phiên fast prov
+#define EP_VND_OP_FPROV_NODE    0x0C     // tag -> gw: 1 tag mới đã provision + cấu hình xong
+#define EP_VND_OP_FPROV_NODE_ACK 0x0D    // gw -> tag: đã ghi sổ FPROV_NODE
+
+// TTL cố định tag dùng cho mọi gói gửi về gateway: gateway suy ra số hop
+// = EP_NODE_REPLY_TTL - TTL nhận (mỗi relay trừ 1).
+#define EP_NODE_REPLY_TTL       7
+
+// ============ Payload SEND (legacy) ============
+// TID(2) + PRICE(4) + BCD(7) + SALE(1)
+#define EP_SEND_LEGACY_LEN      14
+#define EP_SEND_MIN_LEN         13
+// Mở rộng (tuỳ chọn): TLEN(1) + tên nén ep_title; tag cũ bỏ qua phần dư
+#define EP_SEND_TITLE_OFF       14
+
+// ============ Payload STATUS ============
+// TID(2): tag đã nhận lệnh. Lệnh unicast còn được báo lần 2 khi màn hình vẽ
+// xong: TID(2) + FLAGS(1) + RENDER_MS(2, thời gian vẽ). Gateway cũ chỉ đọc TID.
+#define EP_STATUS_LEN           2
+#define EP_STATUS_EXT_LEN       5
+#define EP_STATUS_F_RENDERED    0x01
+
+// ============ Payload DIGEST ============
+// DIGEST_GET: rỗng. DIGEST: CONTENT_H(4) + TITLE_H(4) + RENDERS(2) + FLAGS(1)
+//   CONTENT_H = ep_content_hash(gói SEND cuối cùng tag nhận), 0 = chưa có từ lúc boot
+//   TITLE_H   = ep_hash32 của tên nén đang dùng, 0 = không có tên
+//   RENDERS   = số lần vẽ giá xong từ lúc boot (giảm -> tag đã reboot)
+// Tag ngủ sâu gửi DIGEST tự phát (F_AWAKE) mỗi lần thức: gateway còn lệnh
+// chưa tới tag thì gửi ngay trong cửa sổ thức.
+#define EP_DIGEST_LEN           11
+#define EP_DIGEST_F_RENDERING   0x01     // còn lệnh chờ vẽ
+#define EP_DIGEST_F_AWAKE       0x02     // tag ngủ sâu vừa thức, đang nghe
+
+// ============ Fast provisioning qua tag (delegate) ============
+// Gateway giao cho 1 tag đã provision một dải unicast riêng; tag bật vai trò
+// provisioner (ESP-IDF fast prov) cho các tag cùng prefix UUID trong tầm của
+// nó, cấu hình AppKey + bind vendor server, rồi báo từng tag mới về gateway.
+// FPROV_SET:      UNICAST_MIN(2) + UNICAST_MAX(2) + DURATION_S(2), 0 s = dừng ngay
+// FPROV_STATUS:   STATE(1) + COUNT(1, số tag đã báo) + NEXT(2, địa chỉ kế tiếp chưa dùng)
+//                 trả ngay khi nhận SET và 1 lần nữa khi phiên kết thúc (DONE)
+// FPROV_NODE:     ADDR(2) + ELEMS(1) + UUID(16); tag gửi lại tới khi có NODE_ACK
+// FPROV_NODE_ACK: ADDR(2)
+#define EP_FPROV_SET_LEN        6
+#define EP_FPROV_STATUS_LEN     4
+#define EP_FPROV_NODE_LEN       19
+#define EP_FPROV_NODE_ACK_LEN   2
+#define EP_FPROV_ST_ACTIVE      1
+#define EP_FPROV_ST_DONE        2
+#define EP_FPROV_ST_REJECTED    3        // không hỗ trợ / đang bận / dải sai
+
+// ============ ACK nhóm (SEND tới group address) ============
+// Gói SEND gửi group luôn có TLEN (0 = không kèm tên) và thêm 1 byte GACK =
+// log2(số slot) ngay sau tên. Tag không trả STATUS ngay mà trễ tới slot suy
+// từ địa chỉ của mình (+ jitter nhỏ), nên 500 tag không trả lời cùng lúc.
+// Địa chỉ unicast liền nhau -> slot khác nhau khi nhóm <= số slot.
+#define EP_GACK_SLOT_MS         25       // ~1 STATUS (3 lần phát) + relay
+#define EP_GACK_SLOTS_LOG_MIN   3
+#define EP_GACK_SLOTS_LOG_MAX   10       // 1024 slot = 25.6 s
+
+// Vị trí byte GACK trong gói SEND, 0 nếu gói không có (gửi unicast / tag cũ).
+static inline uint16_t ep_send_gack_off(const uint8_t *msg, uint16_t len) {
+    if (len <= EP_SEND_TITLE_OFF) return 0;
+    uint16_t off = (uint16_t)(EP_SEND_TITLE_OFF + 1 + msg[EP_SEND_TITLE_OFF]);
+    return off < len ? off : 0;
+}
+
+// Số slot nhỏ nhất đủ cho n tag (log2, kẹp trong [MIN, MAX]).
+static inline uint8_t ep_gack_slots_log(uint32_t n) {
+    uint8_t l = EP_GACK_SLOTS_LOG_MIN;
+    while (l < EP_GACK_SLOTS_LOG_MAX && (1u << l) < n) ++l;
+    return l;
+}
+
+static inline uint32_t ep_gack_window_ms(uint8_t slots_log) {
+    return (1u << slots_log) * EP_GACK_SLOT_MS;
+}
+
+// Độ trễ trả STATUS của tag addr; rnd: số ngẫu nhiên bất kỳ (jitter trong slot).
+static inline uint32_t ep_gack_delay_ms(uint16_t addr, uint8_t slots_log, uint32_t rnd) {
+    if (slots_log > EP_GACK_SLOTS_LOG_MAX) slots_log = EP_GACK_SLOTS_LOG_MAX;
+    uint32_t slot = addr & ((1u << slots_log) - 1u);
+    return slot * EP_GACK_SLOT_MS + rnd % (EP_GACK_SLOT_MS / 2);
+}
+
+// ============ Hash dùng chung ============
+// FNV-1a 32 bit: blob id, digest nội dung tag, fw_id.
+#define EP_HASH32_INIT  2166136261u
+
+// Nối tiếp hash qua nhiều mẩu (kết quả không phụ thuộc cách chia mẩu).
+static inline uint32_t ep_hash32_update(uint32_t h, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t ep_hash32(const void *data, size_t len, uint32_t seed) {
+    return ep_hash32_update(seed ? seed : EP_HASH32_INIT, data, len);
+}
+
+// Digest phần giá của gói SEND: PRICE(4) + BCD(7) + SALE(1) (gói 13B: SALE = 0xFF).
+// 0 dành cho "chưa có".
+static inline uint32_t ep_content_hash(const uint8_t *send, uint16_t len) {
+    uint8_t sale = len >= EP_SEND_LEGACY_LEN ? send[13] : 0xFF;
+    uint32_t h = ep_hash32_update(EP_HASH32_INIT, &send[2], 11);
+    h = ep_hash32_update(h, &sale, 1);
+    return h ? h : 1;
+}
+
+// ============ LE helpers ============
+static inline void ep_put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void ep_put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)((v >> 24) & 0xFF);
+}
+
+static inline uint16_t ep_get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t ep_get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+         | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EP_PROTO_H
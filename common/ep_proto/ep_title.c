@@ -0,0 +1,183 @@
+#include "ep_title.h"
+#include <string.h>
+
+#define EP_TITLE_N_LETTERS  62
+#define EP_TITLE_WORD_BASE  0x80
+
+// Chữ hoa có dấu: mã 0x02..0x1F rồi 0x60..0x7F (5 chữ hiếm nhất đi đường thô).
+static const struct { char utf8[4]; char base; } TITLE_LETTERS[EP_TITLE_N_LETTERS] = {
+    {"À",'A'}, {"Á",'A'}, {"Ả",'A'}, {"Ã",'A'}, {"Ạ",'A'}, {"Ă",'A'}, {"Ằ",'A'}, {"Ắ",'A'},
+    {"Ặ",'A'}, {"Â",'A'}, {"Ầ",'A'}, {"Ấ",'A'}, {"Ẩ",'A'}, {"Ậ",'A'}, {"Đ",'D'}, {"È",'E'},
+    {"É",'E'}, {"Ẻ",'E'}, {"Ẽ",'E'}, {"Ẹ",'E'}, {"Ê",'E'}, {"Ề",'E'}, {"Ế",'E'}, {"Ể",'E'},
+    {"Ễ",'E'}, {"Ệ",'E'}, {"Ì",'I'}, {"Í",'I'}, {"Ỉ",'I'}, {"Ĩ",'I'}, {"Ị",'I'}, {"Ò",'O'},
+    {"Ó",'O'}, {"Ỏ",'O'}, {"Õ",'O'}, {"Ọ",'O'}, {"Ô",'O'}, {"Ồ",'O'}, {"Ố",'O'}, {"Ổ",'O'},
+    {"Ỗ",'O'}, {"Ộ",'O'}, {"Ơ",'O'}, {"Ờ",'O'}, {"Ớ",'O'}, {"Ở",'O'}, {"Ỡ",'O'}, {"Ợ",'O'},
+    {"Ù",'U'}, {"Ú",'U'}, {"Ủ",'U'}, {"Ũ",'U'}, {"Ụ",'U'}, {"Ư",'U'}, {"Ừ",'U'}, {"Ứ",'U'},
+    {"Ử",'U'}, {"Ữ",'U'}, {"Ự",'U'}, {"Ỳ",'Y'}, {"Ý",'Y'}, {"Ỵ",'Y'},
+};
+
+// Từ điển 0x80..0xFF: thương hiệu, loại hàng, dung lượng hay gặp trên kệ.
+static const char *const TITLE_WORDS[128] = {
+    "IPHONE", "SAMSUNG", "GALAXY", "XIAOMI", "REDMI", "OPPO", "VIVO", "REALME", "NOKIA",
+    "APPLE", "IPAD", "MACBOOK", "AIRPODS", "WATCH", "PRO", "MAX", "PLUS", "ULTRA", "MINI",
+    "LITE", "AIR", "NOTE", "SMART", "SONY", "TOSHIBA", "PANASONIC", "SHARP", "PHILIPS",
+    "ELECTROLUX", "TIVI", "TỦ", "LẠNH", "MÁY", "GIẶT", "LỌC", "NƯỚC", "ĐIỆN", "THOẠI",
+    "ĐIỀU", "HÒA", "QUẠT", "NỒI", "CƠM", "CHIÊN", "KHÔNG", "BÌNH", "SIÊU", "TỐC", "BẾP",
+    "SỮA", "TƯƠI", "CHUA", "BỘT", "GẠO", "MÌ", "MẮM", "ĂN", "LIỀN", "BÁNH", "KẸO", "CÀ", "PHÊ",
+    "TRÀ", "XANH", "BIA", "DẦU", "GỘI", "XẢ", "KEM", "ĐÁNH", "RĂNG", "TẮM", "GIẤY", "VỆ",
+    "SINH", "KHĂN", "RỬA", "CHÉN", "THỊT", "HEO", "BÒ", "GÀ", "CÁ", "TRỨNG", "RAU", "TRÁI",
+    "CÂY", "HỘP", "GÓI", "CHAI", "LON", "THÙNG", "TÚI", "ĐƯỜNG", "VỊ", "CAM", "DÂU", "SOCOLA",
+    "VINAMILK", "NESTLE", "OMO", "HẢO", "HẠNG", "CHINSU", "COCA", "PEPSI", "64GB", "128GB",
+    "256GB", "512GB", "1TB", "180ML", "250ML", "330ML", "500ML", "1L", "1.5L", "5L", "1KG",
+    "5KG", "500G", "100G", "200G", "INCH", "GB", "ML", "KG", "LOẠI",
+};
+
+// ======== small helpers ========
+static uint8_t letter_code(int i) {
+    return (uint8_t)(i < 30 ? 0x02 + i : 0x60 + (i - 30));
+}
+
+static int code_letter(uint8_t c) {
+    if (c >= 0x02 && c <= 0x1F) return c - 0x02;
+    if (c >= 0x60 && c <= 0x7F) return 30 + (c - 0x60);
+    return -1;
+}
+
+// Độ dài ký tự UTF-8 bắt đầu tại s (1 nếu byte lỗi -> đi đường thô từng byte).
+static size_t utf8_len(const char *s, size_t left) {
+    uint8_t c = (uint8_t)s[0];
+    size_t n = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+    if (n > left) return 1;
+    for (size_t i = 1; i < n; ++i) {
+        if (((uint8_t)s[i] & 0xC0) != 0x80) return 1;
+    }
+    return n;
+}
+
+static int find_letter(const char *s, size_t n) {
+    for (int i = 0; i < EP_TITLE_N_LETTERS; ++i) {
+        if (strlen(TITLE_LETTERS[i].utf8) == n && memcmp(TITLE_LETTERS[i].utf8, s, n) == 0) return i;
+    }
+    return -1;
+}
+
+// Ghi chuỗi UTF-8 s (có thể bỏ dấu) vào out[*pos..cap-1).
+static int emit(char *out, size_t cap, size_t *pos, const char *s, size_t n, uint8_t flags) {
+    size_t i = 0;
+    while (i < n) {
+        size_t k = utf8_len(s + i, n - i);
+        const char *src = s + i;
+        size_t      len = k;
+        char        folded;
+        if ((flags & EP_TITLE_F_ASCII) && k > 1) {
+            int li = find_letter(s + i, k);
+            folded = li >= 0 ? TITLE_LETTERS[li].base : '?';
+            src = &folded;
+            len = 1;
+        }
+        if (*pos + len >= cap) return -1;
+        memcpy(out + *pos, src, len);
+        *pos += len;
+        i += k;
+    }
+    return 0;
+}
+
+// ======== encoder ========
+int ep_title_encode(const char *utf8, uint8_t *out, size_t cap) {
+    if (!utf8 || !out) return -1;
+    const size_t n = strlen(utf8);
+    if (n >= EP_TITLE_MAX_LEN) return -1;
+
+    // cost[i] = số byte tối thiểu để mã hoá utf8[i..n); quét ngược
+    uint8_t cost[EP_TITLE_MAX_LEN + 1];
+    uint8_t step[EP_TITLE_MAX_LEN];     // số byte input tiêu thụ ở i
+    int16_t code[EP_TITLE_MAX_LEN];     // token ở i (-1 = thô)
+    cost[n] = 0;
+
+    for (size_t i = n; i-- > 0;) {
+        size_t k = utf8_len(utf8 + i, n - i);
+        // mặc định: 1 đoạn thô ESC n <bytes> (chữ thường nằm liền nhau rẻ hơn từng ký tự)
+        unsigned best = 0xFFFF;
+        for (size_t j = i + k; j <= n; j += utf8_len(utf8 + j, n - j)) {
+            if (2 + (j - i) + cost[j] < best) {
+                best = (unsigned)(2 + (j - i) + cost[j]);
+                step[i] = (uint8_t)(j - i);
+            }
+            if (j == n) break;
+        }
+        code[i] = -1;
+
+        uint8_t c = (uint8_t)utf8[i];
+        if (k == 1 && c >= 0x20 && c <= 0x5F && 1u + cost[i + 1] < best) {
+            best = 1 + cost[i + 1];
+            step[i] = 1;
+            code[i] = c;
+        } else if (k > 1) {
+            int li = find_letter(utf8 + i, k);
+            if (li >= 0 && 1u + cost[i + k] < best) {
+                best = 1 + cost[i + k];
+                step[i] = (uint8_t)k;
+                code[i] = letter_code(li);
+            }
+        }
+        for (int w = 0; w < 128; ++w) {
+            size_t wl = strlen(TITLE_WORDS[w]);
+            if (wl <= n - i && memcmp(utf8 + i, TITLE_WORDS[w], wl) == 0 && 1u + cost[i + wl] < best) {
+                best = 1 + cost[i + wl];
+                step[i] = (uint8_t)wl;
+                code[i] = (int16_t)(EP_TITLE_WORD_BASE + w);
+            }
+        }
+        cost[i] = best > 0xFF ? 0xFF : (uint8_t)best;
+    }
+    if (cost[0] > cap) return -1;
+
+    size_t o = 0;
+    for (size_t i = 0; i < n; i += step[i]) {
+        if (code[i] >= 0) {
+            out[o++] = (uint8_t)code[i];
+        } else {
+            out[o++] = EP_TITLE_ESC;
+            out[o++] = step[i];
+            memcpy(out + o, utf8 + i, step[i]);
+            o += step[i];
+        }
+    }
+    return (int)o;
+}
+
+// ======== decoder ========
+int ep_title_decode(const uint8_t *in, size_t len, char *out, size_t cap, uint8_t flags) {
+    if (!in || !out || cap == 0) return -1;
+    size_t pos = 0;
+    out[0] = '\0';
+
+    for (size_t i = 0; i < len;) {
+        uint8_t c = in[i++];
+        int     r;
+        int     li;
+        if (c >= EP_TITLE_WORD_BASE) {
+            const char *w = TITLE_WORDS[c - EP_TITLE_WORD_BASE];
+            r = emit(out, cap, &pos, w, strlen(w), flags);
+        } else if ((li = code_letter(c)) >= 0) {
+            const char *l = TITLE_LETTERS[li].utf8;
+            r = emit(out, cap, &pos, l, strlen(l), flags);
+        } else if (c >= 0x20) {
+            char ch = (char)c;
+            r = emit(out, cap, &pos, &ch, 1, flags);
+        } else if (c == EP_TITLE_ESC && i < len && in[i] > 0 && i + 1 + in[i] <= len) {
+            size_t k = in[i++];
+            r = emit(out, cap, &pos, (const char *)in + i, k, flags);
+            i += k;
+        } else {
+            r = -1;
+        }
+        if (r < 0) {
+            out[pos] = '\0';
+            return -1;
+        }
+    }
+    out[pos] = '\0';
+    return (int)pos;
+}
@@ -0,0 +1,46 @@
+#ifndef EP_TITLE_H
+#define EP_TITLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tên sản phẩm nén theo từ điển tĩnh (dùng chung gateway/tag), 1 byte/token:
+//
+//   0x01 n <n byte>   UTF-8 thô (chữ thường, dấu hiếm...)
+//   0x02..0x1F        chữ hoa có dấu tiếng Việt (bảng 1)
+//   0x20..0x5F        ASCII nguyên văn: khoảng trắng, số, A-Z, dấu câu
+//   0x60..0x7F        chữ hoa có dấu tiếng Việt (bảng 2)
+//   0x80..0xFF        128 từ hay gặp: thương hiệu, loại hàng, dung lượng
+//
+// Encoder chọn cách tách tối ưu (quy hoạch động), tên bán lẻ thường
+// còn 8-12 byte -> thêm tối đa 1 segment vào gói SEND.
+
+// ============ Config ============
+#ifndef EP_TITLE_MAX_LEN
+#define EP_TITLE_MAX_LEN   48    // UTF-8 đã giải, kể cả NUL
+#endif
+#ifndef EP_TITLE_ENC_MAX
+#define EP_TITLE_ENC_MAX   32    // byte sau nén
+#endif
+
+#define EP_TITLE_ESC       0x01
+
+// Cờ giải nén
+#define EP_TITLE_F_ASCII   0x01  // bỏ dấu (Ữ -> U) cho font GFX 7-bit
+
+// Nén chuỗi UTF-8. Trả số byte ghi vào out, hoặc -1 nếu quá cap / quá dài.
+int ep_title_encode(const char *utf8, uint8_t *out, size_t cap);
+
+// Giải nén vào out (luôn NUL-terminate). Không cấp phát heap.
+// Trả độ dài chuỗi (không gồm NUL), hoặc -1 nếu dữ liệu hỏng / thiếu chỗ.
+int ep_title_decode(const uint8_t *in, size_t len, char *out, size_t cap, uint8_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EP_TITLE_H
@@ -0,0 +1,68 @@
+// Host check cho ep_title: encode -> decode phải ra đúng chuỗi gốc, trên tên
+// ngẫu nhiên trộn từ điển, chữ hoa có dấu, chữ thường có dấu và ASCII.
+//
+// Build (trên PC, từ thư mục common/ep_proto):
+//   cc -O2 -I. host/ep_title_bench.c ep_title.c -o ept_bench
+//
+// Chạy:
+//   ./ept_bench              -> 200000 tên, seed 1
+//   ./ept_bench 1000000 7    -> số tên, seed
+#include "ep_title.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mẩu ghép tên: từ trong từ điển, chữ có dấu (có và không có trong bảng),
+// ASCII (cả chữ thường -> đường thô)
+static const char *const PIECES[] = {
+    "IPHONE", "SAMSUNG", "GALAXY", "TỦ", "LẠNH", "SỮA", "TƯƠI", "128GB", "1.5L", "LOẠI",
+    "Ữ", "Ự", "Đ", "Ê", "Ơ", "Ư", "Ỳ", "Ỹ", "Ỷ", "Ẵ", "Ẳ",
+    "ữ", "é", "ạ", "đ", "ơ", "ư", "ỹ",
+    "A", "B", "X", "Z", "0", "9", " ", "-", "%", "/", ".",
+    "a", "b", "o", "z", "~", "{", "|",
+};
+#define N_PIECES (sizeof(PIECES) / sizeof(PIECES[0]))
+
+static void random_title(char *out, size_t cap) {
+    size_t len = 0;
+    int parts = 1 + rand() % 14;
+    out[0] = '\0';
+    for (int i = 0; i < parts; ++i) {
+        const char *p = PIECES[rand() % N_PIECES];
+        size_t n = strlen(p);
+        if (len + n >= cap) break;
+        memcpy(out + len, p, n + 1);
+        len += n;
+    }
+}
+
+int main(int argc, char **argv) {
+    long     iters = argc > 1 ? atol(argv[1]) : 200000;
+    unsigned seed  = argc > 2 ? (unsigned)atoi(argv[2]) : 1;
+    long     fails = 0, encoded = 0, too_long = 0;
+    size_t   raw_sum = 0, enc_sum = 0;
+    srand(seed);
+
+    for (long k = 0; k < iters; ++k) {
+        char    title[EP_TITLE_MAX_LEN];
+        uint8_t enc[2 * EP_TITLE_MAX_LEN];
+        char    dec[EP_TITLE_MAX_LEN];
+        random_title(title, sizeof(title));
+
+        int n = ep_title_encode(title, enc, sizeof(enc));
+        if (n < 0) { ++too_long; continue; }
+        int d = ep_title_decode(enc, (size_t)n, dec, sizeof(dec), 0);
+        if (d < 0 || strcmp(dec, title) != 0) {
+            if (fails < 10) printf("FAIL \"%s\" -> \"%s\" (%d B)\n", title, d < 0 ? "<error>" : dec, n);
+            ++fails;
+            continue;
+        }
+        ++encoded;
+        raw_sum += strlen(title);
+        enc_sum += (size_t)n;
+    }
+    printf("%ld titles: %ld ok, %ld fail, %ld not encodable; avg %.1f B -> %.1f B\n",
+           iters, encoded, fails, too_long,
+           encoded ? (double)raw_sum / encoded : 0.0, encoded ? (double)enc_sum / encoded : 0.0);
+    return fails ? 1 : 0;
+}
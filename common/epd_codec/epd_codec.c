@@ -0,0 +1,252 @@
+#include "epd_codec.h"
+#include <string.h>
+
+// Bảng literal tĩnh: các byte residual hay gặp nhất ở mép chữ / vạch EAN
+// (đo trên tag render thật bằng host/epd_codec_bench.c).
+static const uint8_t EPC_COMMON[8] = {
+    0xFF, 0xFC, 0x03, 0x3F, 0x1F, 0xF8, 0xE0, 0x07
+};
+
+#define EPC_MAGIC0  'E'
+#define EPC_MAGIC1  'C'
+#define EPC_VERSION 1
+
+// ======== small helpers ========
+static int common_index(uint8_t v) {
+    for (int i = 0; i < 8; ++i) {
+        if (EPC_COMMON[i] == v) return i;
+    }
+    return -1;
+}
+
+static int bit_len(uint32_t v) {
+    int n = 0;
+    while (v) { ++n; v >>= 1; }
+    return n;
+}
+
+// ======== encoder ========
+typedef struct {
+    uint8_t *out;
+    size_t   cap;
+    size_t   pos;
+    uint64_t acc;
+    uint8_t  nacc;
+    bool     overflow;
+} bit_writer_t;
+
+static void bw_put(bit_writer_t *w, uint32_t bits, uint8_t n) {
+    // run = 1: gamma không có số 0 nào; dịch 64 bit là UB. Đã tràn: acc còn
+    // >= 8 bit chưa ghi, dịch tiếp sẽ âm -> bỏ luôn (kết quả encode là lỗi)
+    if (n == 0 || w->overflow) return;
+    w->acc |= (uint64_t)bits << (64 - w->nacc - n);
+    w->nacc += n;
+    while (w->nacc >= 8) {
+        if (w->pos >= w->cap) { w->overflow = true; return; }
+        w->out[w->pos++] = (uint8_t)(w->acc >> 56);
+        w->acc <<= 8;
+        w->nacc -= 8;
+    }
+}
+
+static void bw_flush(bit_writer_t *w) {
+    if (w->nacc > 0) {
+        if (w->pos >= w->cap) { w->overflow = true; return; }
+        w->out[w->pos++] = (uint8_t)(w->acc >> 56);
+        w->acc = 0;
+        w->nacc = 0;
+    }
+}
+
+static void put_run(bit_writer_t *w, uint32_t run) {
+    while (run > 0) {
+        uint32_t n = run > EPC_MAX_RUN ? EPC_MAX_RUN : run;
+        int nb = bit_len(n);
+        bw_put(w, 0, 1);                 // prefix '0'
+        bw_put(w, 0, (uint8_t)(nb - 1)); // gamma: nb-1 số 0
+        bw_put(w, n, (uint8_t)nb);       // rồi n (có bit 1 dẫn đầu)
+        run -= n;
+    }
+}
+
+static void put_literal(bit_writer_t *w, uint8_t v) {
+    int ci = common_index(v);
+    if (ci >= 0) bw_put(w, (0x2u << 3) | (uint32_t)ci, 5);  // 10 + idx
+    else         bw_put(w, (0x3u << 8) | v, 10);            // 11 + byte
+}
+
+size_t epc_encode_bound(uint8_t row_bytes, uint16_t rows, uint8_t planes) {
+    size_t n = (size_t)row_bytes * rows * planes;
+    return EPC_HDR_LEN + (n * 10 + 7) / 8 + 1;
+}
+
+int epc_encode(const uint8_t *black, const uint8_t *red,
+               uint8_t row_bytes, uint16_t rows,
+               uint8_t *out, size_t out_cap) {
+    if (!black || !out) return EPC_ERR_NULL;
+    if (row_bytes == 0 || row_bytes > EPC_MAX_ROW_BYTES || rows == 0) return EPC_ERR_SIZE;
+    if (out_cap < EPC_HDR_LEN) return EPC_ERR_OVERFLOW;
+
+    const uint8_t planes = red ? 2 : 1;
+    const uint8_t *src[2] = { black, red };
+
+    out[0] = EPC_MAGIC0;
+    out[1] = EPC_MAGIC1;
+    out[2] = EPC_VERSION;
+    out[3] = planes;
+    out[4] = row_bytes;
+    out[5] = (uint8_t)(rows & 0xFF);
+    out[6] = (uint8_t)(rows >> 8);
+    out[7] = 0;
+
+    bit_writer_t w = { .out = out, .cap = out_cap, .pos = EPC_HDR_LEN };
+    uint32_t run = 0;
+
+    for (uint16_t r = 0; r < rows; ++r) {
+        for (uint8_t p = 0; p < planes; ++p) {
+            const uint8_t *cur  = src[p] + (size_t)r * row_bytes;
+            const uint8_t *prev = r ? cur - row_bytes : NULL;
+            for (uint8_t c = 0; c < row_bytes; ++c) {
+                uint8_t res = cur[c] ^ (prev ? prev[c] : 0xFF);
+                if (res == 0) { ++run; continue; }
+                if (run) { put_run(&w, run); run = 0; }
+                put_literal(&w, res);
+            }
+        }
+        if (w.overflow) return EPC_ERR_OVERFLOW;
+    }
+    if (run) put_run(&w, run);
+    bw_flush(&w);
+    if (w.overflow) return EPC_ERR_OVERFLOW;
+    return (int)w.pos;
+}
+
+// ======== decoder ========
+void epc_dec_init(EPCDecoder *d, epc_row_cb_t cb, void *user) {
+    if (!d) return;
+    memset(d, 0, sizeof(*d));
+    d->cb = cb;
+    d->user = user;
+    memset(d->prev, 0xFF, sizeof(d->prev));
+}
+
+bool epc_dec_done(const EPCDecoder *d) {
+    return d && d->hdr_got == EPC_HDR_LEN && d->row >= d->rows;
+}
+
+// Tiến 1 byte; hết hàng của plane cuối -> emit hàng.
+static void dec_advance_col(EPCDecoder *d) {
+    if (++d->col < d->row_bytes) return;
+    d->col = 0;
+    if (++d->plane < d->planes) return;
+    d->plane = 0;
+    if (d->cb) {
+        d->cb(d->user, d->row, d->prev[0],
+              d->planes > 1 ? d->prev[1] : NULL, d->row_bytes);
+    }
+    ++d->row;
+}
+
+static EPCStatus dec_run(EPCDecoder *d, uint32_t n) {
+    while (n > 0) {
+        if (d->row >= d->rows) return EPC_ERR_OVERFLOW;
+        uint32_t room = (uint32_t)(d->row_bytes - d->col);
+        uint32_t step = n < room ? n : room;
+        // residual 0 -> hàng giữ nguyên so với hàng trước
+        d->col += (uint8_t)(step - 1);
+        dec_advance_col(d);
+        n -= step;
+    }
+    return EPC_OK;
+}
+
+static EPCStatus dec_literal(EPCDecoder *d, uint8_t v) {
+    if (d->row >= d->rows) return EPC_ERR_OVERFLOW;
+    d->prev[d->plane][d->col] ^= v;
+    dec_advance_col(d);
+    return EPC_OK;
+}
+
+static EPCStatus dec_header(EPCDecoder *d) {
+    const uint8_t *h = d->hdr;
+    if (h[0] != EPC_MAGIC0 || h[1] != EPC_MAGIC1 || h[2] != EPC_VERSION) return EPC_ERR_FORMAT;
+    d->planes    = h[3];
+    d->row_bytes = h[4];
+    d->rows      = (uint16_t)(h[5] | (h[6] << 8));
+    if (d->planes < 1 || d->planes > 2) return EPC_ERR_SIZE;
+    if (d->row_bytes == 0 || d->row_bytes > EPC_MAX_ROW_BYTES || d->rows == 0) return EPC_ERR_SIZE;
+    return EPC_OK;
+}
+
+// Giải 1 token từ acc. Trả 0 nếu chưa đủ bit, 1 nếu đã tiêu thụ, <0 nếu lỗi.
+static int dec_token(EPCDecoder *d) {
+    const uint64_t a = d->acc;
+    const uint8_t  n = d->nacc;
+    if (n < 1) return 0;
+
+    if ((a >> 63) == 0) {
+        // '0' + gamma(run)
+        // bit chưa nạp luôn = 0, nên chỉ kết luận lỗi khi đã thấy đủ bit thật
+        const int max_z = bit_len(EPC_MAX_RUN) - 1;
+        uint64_t rest = a << 1;
+        int z = rest ? __builtin_clzll(rest) : 64;
+        if (z > max_z) return (n > 1 + max_z) ? EPC_ERR_FORMAT : 0;
+        int len = 1 + 2 * z + 1;
+        if (n < len) return 0;
+        uint32_t run = (uint32_t)(rest >> (64 - (2 * z + 1)));
+        d->acc <<= len;
+        d->nacc -= (uint8_t)len;
+        EPCStatus s = dec_run(d, run);
+        return s < 0 ? s : 1;
+    }
+
+    if (n < 2) return 0;
+    if (((a >> 62) & 1) == 0) {
+        // '10' + idx3
+        if (n < 5) return 0;
+        uint8_t idx = (uint8_t)((a >> 59) & 0x7);
+        d->acc <<= 5;
+        d->nacc -= 5;
+        EPCStatus s = dec_literal(d, EPC_COMMON[idx]);
+        return s < 0 ? s : 1;
+    }
+
+    // '11' + byte
+    if (n < 10) return 0;
+    uint8_t v = (uint8_t)((a >> 54) & 0xFF);
+    d->acc <<= 10;
+    d->nacc -= 10;
+    EPCStatus s = dec_literal(d, v);
+    return s < 0 ? s : 1;
+}
+
+EPCStatus epc_dec_feed(EPCDecoder *d, const uint8_t *data, size_t len) {
+    if (!d || (!data && len)) return EPC_ERR_NULL;
+    size_t i = 0;
+
+    // header thô (không mã hoá bit)
+    while (d->hdr_got < EPC_HDR_LEN && i < len) {
+        d->hdr[d->hdr_got++] = data[i++];
+        if (d->hdr_got == EPC_HDR_LEN) {
+            EPCStatus s = dec_header(d);
+            if (s != EPC_OK) return s;
+        }
+    }
+    if (d->hdr_got < EPC_HDR_LEN) return EPC_OK;
+
+    for (;;) {
+        if (d->row >= d->rows) return EPC_DONE;   // phần còn lại là padding
+
+        while (i < len && d->nacc <= 56) {
+            d->acc |= (uint64_t)data[i++] << (56 - d->nacc);
+            d->nacc += 8;
+        }
+
+        int r = dec_token(d);
+        if (r < 0) return (EPCStatus)r;
+        if (r == 0) {
+            if (i >= len) return EPC_OK;           // chờ mẩu tiếp theo
+            if (d->nacc > 56) return EPC_ERR_FORMAT;
+        }
+    }
+}
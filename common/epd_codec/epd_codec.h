@@ -0,0 +1,93 @@
+#ifndef EPD_CODEC_H
+#define EPD_CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Codec ảnh 1-bpp cho tag e-paper (dùng chung gateway + node).
+// Dữ liệu vào/ra là byte "controller-ready": row-major, MSB trước,
+// 1 = trắng (giống buffer GxEPD2, plane đỏ: 0 = đỏ).
+//
+// Pipeline mã hoá (theo từng hàng, 2 plane xen kẽ black/red):
+//   1) XOR với hàng trước (hàng "-1" coi như toàn trắng 0xFF)
+//   2) run-length cho các byte 0 (vùng không đổi)
+//   3) mã tiền tố tĩnh:
+//        0  + gamma(n)   : n byte 0 liên tiếp
+//        10 + 3 bit      : literal nằm trong bảng EPC_COMMON[8]
+//        11 + 8 bit      : literal thô
+//
+// Bộ giải mã streaming: bộ nhớ cố định (2 hàng), nạp từng mẩu dữ liệu
+// tuỳ ý, trả từng hàng qua callback ngay khi đủ.
+
+// ============ Config ============
+#ifndef EPC_MAX_ROW_BYTES
+#define EPC_MAX_ROW_BYTES 32   // đủ cho panel 2.13" (128 px = 16 byte)
+#endif
+
+#define EPC_HDR_LEN   8
+#define EPC_MAX_RUN   4095     // gamma(4095) = 23 bit, vừa accumulator 64 bit
+
+// ============ Status code ============
+typedef enum {
+    EPC_OK          = 0,
+    EPC_DONE        = 1,       // đã giải mã đủ ảnh
+    EPC_ERR_NULL    = -1,
+    EPC_ERR_FORMAT  = -2,
+    EPC_ERR_OVERFLOW= -3,      // buffer ra không đủ / dữ liệu thừa
+    EPC_ERR_SIZE    = -4       // row_bytes/rows/planes không hỗ trợ
+} EPCStatus;
+
+// ============ Encoder (one-shot, phía gateway) ============
+
+// Cận trên số byte đầu ra (header + trường hợp xấu nhất 10 bit/byte).
+size_t epc_encode_bound(uint8_t row_bytes, uint16_t rows, uint8_t planes);
+
+// red có thể NULL (ảnh 1 plane). Trả về số byte đã ghi hoặc <0 nếu lỗi.
+int epc_encode(const uint8_t *black, const uint8_t *red,
+               uint8_t row_bytes, uint16_t rows,
+               uint8_t *out, size_t out_cap);
+
+// ============ Streaming decoder (phía node) ============
+
+// Gọi 1 lần mỗi hàng; red = NULL nếu ảnh chỉ có 1 plane.
+typedef void (*epc_row_cb_t)(void *user, uint16_t row,
+                             const uint8_t *black, const uint8_t *red,
+                             uint8_t row_bytes);
+
+typedef struct {
+    epc_row_cb_t cb;
+    void        *user;
+
+    uint8_t  hdr[EPC_HDR_LEN];
+    uint8_t  hdr_got;
+    uint8_t  planes;
+    uint8_t  row_bytes;
+    uint16_t rows;
+
+    uint16_t row;              // vị trí hiện tại
+    uint8_t  plane;
+    uint8_t  col;
+
+    uint64_t acc;              // bit buffer (MSB trước)
+    uint8_t  nacc;
+
+    uint8_t  prev[2][EPC_MAX_ROW_BYTES];  // hàng trước = hàng đang dựng
+} EPCDecoder;
+
+void epc_dec_init(EPCDecoder *d, epc_row_cb_t cb, void *user);
+
+// Nạp thêm dữ liệu. EPC_OK = cần thêm, EPC_DONE = xong, <0 = lỗi.
+EPCStatus epc_dec_feed(EPCDecoder *d, const uint8_t *data, size_t len);
+
+bool epc_dec_done(const EPCDecoder *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EPD_CODEC_H
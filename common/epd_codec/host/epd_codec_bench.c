@@ -0,0 +1,236 @@
+// Host benchmark cho epd_codec: tỉ lệ nén + tốc độ giải mã (MB/s).
+//
+// Build (trên PC, từ thư mục common/epd_codec):
+//   cc -O2 -I. host/epd_codec_bench.c epd_codec.c -o epc_bench
+//
+// Chạy:
+//   ./epc_bench                      -> render vài tag mẫu theo layout của
+//                                       PriceTagEPD (250x122, rotation 3)
+//   ./epc_bench black.pbm red.pbm    -> dùng ảnh thật (PBM P4, 128x250
+//                                       controller-ready, 1 = đen như PBM)
+#include "epd_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROW_BYTES 16     // GxEPD2_213_Z98c::WIDTH / 8
+#define ROWS      250    // GxEPD2_213_Z98c::HEIGHT
+#define DISP_W    250    // sau rotation 3
+#define DISP_H    122
+
+#define PLANE_SIZE (ROW_BYTES * ROWS)
+
+// ======== mini renderer (xấp xỉ drawTagLayout) ========
+typedef struct {
+    uint8_t black[PLANE_SIZE];   // 1 = trắng
+    uint8_t red[PLANE_SIZE];     // 1 = không đỏ
+} tag_img_t;
+
+// Toạ độ hiển thị (rotation 3) -> toạ độ controller, giống GxEPD2_3C::drawPixel
+static void put_px(uint8_t *plane, int x, int y, int on) {
+    if (x < 0 || y < 0 || x >= DISP_W || y >= DISP_H) return;
+    int cx = y;
+    int cy = ROWS - x - 1;
+    uint8_t *b = &plane[cy * ROW_BYTES + cx / 8];
+    uint8_t m = (uint8_t)(0x80 >> (cx & 7));
+    if (on) *b &= (uint8_t)~m; else *b |= m;
+}
+
+static void fill_rect(uint8_t *plane, int x, int y, int w, int h, int on) {
+    for (int j = y; j < y + h; ++j)
+        for (int i = x; i < x + w; ++i) put_px(plane, i, j, on);
+}
+
+static void draw_rect(uint8_t *plane, int x, int y, int w, int h) {
+    fill_rect(plane, x, y, w, 1, 1);
+    fill_rect(plane, x, y + h - 1, w, 1, 1);
+    fill_rect(plane, x, y, 1, h, 1);
+    fill_rect(plane, x + w - 1, y, 1, h, 1);
+}
+
+// glcdfont 5x7 (cột, LSB ở trên) cho ký tự dùng trên tag
+static const uint8_t *glyph(char c) {
+    static const uint8_t digits[10][5] = {
+        {0x3E,0x51,0x49,0x45,0x3E},{0x00,0x42,0x7F,0x40,0x00},{0x72,0x49,0x49,0x49,0x46},
+        {0x21,0x41,0x49,0x4D,0x33},{0x18,0x14,0x12,0x7F,0x10},{0x27,0x45,0x45,0x45,0x39},
+        {0x3C,0x4A,0x49,0x49,0x31},{0x41,0x21,0x11,0x09,0x07},{0x36,0x49,0x49,0x49,0x36},
+        {0x46,0x49,0x49,0x29,0x1E},
+    };
+    static const uint8_t upper[26][5] = {
+        {0x7C,0x12,0x11,0x12,0x7C},{0x7F,0x49,0x49,0x49,0x36},{0x3E,0x41,0x41,0x41,0x22},
+        {0x7F,0x41,0x41,0x41,0x3E},{0x7F,0x49,0x49,0x49,0x41},{0x7F,0x09,0x09,0x09,0x01},
+        {0x3E,0x41,0x41,0x51,0x73},{0x7F,0x08,0x08,0x08,0x7F},{0x00,0x41,0x7F,0x41,0x00},
+        {0x20,0x40,0x41,0x3F,0x01},{0x7F,0x08,0x14,0x22,0x41},{0x7F,0x40,0x40,0x40,0x40},
+        {0x7F,0x02,0x1C,0x02,0x7F},{0x7F,0x04,0x08,0x10,0x7F},{0x3E,0x41,0x41,0x41,0x3E},
+        {0x7F,0x09,0x09,0x09,0x06},{0x3E,0x41,0x51,0x21,0x5E},{0x7F,0x09,0x19,0x29,0x46},
+        {0x26,0x49,0x49,0x49,0x32},{0x03,0x01,0x7F,0x01,0x03},{0x3F,0x40,0x40,0x40,0x3F},
+        {0x1F,0x20,0x40,0x20,0x1F},{0x3F,0x40,0x38,0x40,0x3F},{0x63,0x14,0x08,0x14,0x63},
+        {0x03,0x04,0x78,0x04,0x03},{0x61,0x59,0x49,0x4D,0x43},
+    };
+    static const uint8_t dot[5]  = {0x00,0x60,0x60,0x00,0x00};
+    static const uint8_t pct[5]  = {0x23,0x13,0x08,0x64,0x62};
+    static const uint8_t dash[5] = {0x08,0x08,0x08,0x08,0x08};
+    static const uint8_t sp[5]   = {0};
+    if (c >= '0' && c <= '9') return digits[c - '0'];
+    if (c >= 'A' && c <= 'Z') return upper[c - 'A'];
+    if (c == '.') return dot;
+    if (c == '%') return pct;
+    if (c == '-') return dash;
+    return sp;
+}
+
+// Trả về bề rộng đã vẽ
+static int draw_text(uint8_t *plane, int x, int y, const char *s, int scale, int on) {
+    int cx = x;
+    for (; *s; ++s) {
+        const uint8_t *g = glyph(*s);
+        for (int col = 0; col < 5; ++col)
+            for (int row = 0; row < 7; ++row)
+                if (g[col] & (1 << row))
+                    fill_rect(plane, cx + col * scale, y + row * scale, scale, scale, on);
+        cx += 6 * scale;
+    }
+    return cx - x;
+}
+
+static void draw_ean13(uint8_t *plane, int x, int y_base, const char *d) {
+    static const char *A[10] = {"0001101","0011001","0010011","0111101","0100011",
+                                "0110001","0101111","0111011","0110111","0001011"};
+    static const char *B[10] = {"0100111","0110011","0011011","0100001","0011101",
+                                "0111001","0000101","0010001","0001001","0010111"};
+    static const char *C[10] = {"1110010","1100110","1101100","1000010","1011100",
+                                "1001110","1010000","1000100","1001000","1110100"};
+    static const char *P[10] = {"AAAAAA","AABABB","AABBAB","AABBBA","ABAABB",
+                                "ABBAAB","ABBBAA","ABABAB","ABABBA","ABBABA"};
+    char pat[96] = "101";
+    const char *par = P[d[0] - '0'];
+    for (int i = 1; i <= 6; ++i) strcat(pat, par[i - 1] == 'A' ? A[d[i] - '0'] : B[d[i] - '0']);
+    strcat(pat, "01010");
+    for (int i = 7; i <= 12; ++i) strcat(pat, C[d[i] - '0']);
+    strcat(pat, "101");
+    for (int i = 0; i < 95; ++i) {
+        int h = 40;
+        if (i <= 2 || (i >= 45 && i <= 49) || i >= 92) h += 6;
+        if (pat[i] == '1') fill_rect(plane, x + i, y_base - h, 1, h, 1);
+    }
+}
+
+static void render_tag(tag_img_t *t, const char *title, const char *sale,
+                       const char *top, const char *bot, const char *ean) {
+    memset(t->black, 0xFF, sizeof(t->black));
+    memset(t->red, 0xFF, sizeof(t->red));
+
+    int tw = draw_text(t->black, 18, 16, title, 3, 1);
+    draw_rect(t->black, 10, 10, tw + 16, 33);
+
+    if (sale && *sale) {
+        int sx = 10 + tw + 28;
+        fill_rect(t->red, sx, 13, 70, 40, 1);
+        draw_text(t->red, sx + 8, 16, "SALE", 2, 0);
+        draw_text(t->red, sx + 20, 34, sale, 2, 0);
+    }
+    if (top && *top) {
+        int w = (int)strlen(top) * 18;
+        draw_text(t->black, DISP_W - 22 - w, 54, top, 3, 1);
+        fill_rect(t->black, DISP_W - 22 - w, 64, w, 2, 1);
+    }
+    int w = (int)strlen(bot) * 18;
+    draw_text(t->red, DISP_W - 22 - w, 82, bot, 3, 1);
+    draw_ean13(t->black, 17, DISP_H - 20, ean);
+}
+
+// ======== PBM P4 ========
+static int load_pbm(const char *path, uint8_t *plane) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    int w = 0, h = 0;
+    if (fscanf(f, "P4 %d %d", &w, &h) != 2 || w != ROW_BYTES * 8 || h != ROWS) { fclose(f); return -1; }
+    fgetc(f);
+    size_t n = fread(plane, 1, PLANE_SIZE, f);
+    fclose(f);
+    if (n != PLANE_SIZE) return -1;
+    for (size_t i = 0; i < PLANE_SIZE; ++i) plane[i] = (uint8_t)~plane[i];  // PBM 1 = đen
+    return 0;
+}
+
+// ======== bench ========
+typedef struct {
+    const tag_img_t *ref;
+    int mismatches;
+} verify_ctx_t;
+
+static void verify_row(void *user, uint16_t row, const uint8_t *black, const uint8_t *red, uint8_t rb) {
+    verify_ctx_t *v = user;
+    if (memcmp(black, v->ref->black + row * rb, rb) != 0) v->mismatches++;
+    if (red && memcmp(red, v->ref->red + row * rb, rb) != 0) v->mismatches++;
+}
+
+static void sink_row(void *user, uint16_t row, const uint8_t *black, const uint8_t *red, uint8_t rb) {
+    (void)row; (void)rb;
+    *(volatile uint8_t *)user ^= black[0] ^ (red ? red[0] : 0);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench_one(const char *name, const tag_img_t *t) {
+    static uint8_t enc[EPC_HDR_LEN + 2 * PLANE_SIZE * 2];
+    int n = epc_encode(t->black, t->red, ROW_BYTES, ROWS, enc, sizeof(enc));
+    if (n < 0) { printf("%-28s encode error %d\n", name, n); return 1; }
+
+    // roundtrip, nạp từng mẩu 96 B giống chunk mesh
+    EPCDecoder d;
+    verify_ctx_t v = { t, 0 };
+    epc_dec_init(&d, verify_row, &v);
+    EPCStatus s = EPC_OK;
+    for (int off = 0; off < n && s == EPC_OK; off += 96) {
+        int len = (n - off) < 96 ? (n - off) : 96;
+        s = epc_dec_feed(&d, enc + off, (size_t)len);
+    }
+    if (s != EPC_DONE || v.mismatches) {
+        printf("%-28s ROUNDTRIP FAIL (status %d, mismatches %d)\n", name, s, v.mismatches);
+        return 1;
+    }
+
+    const int iters = 2000;
+    volatile uint8_t sink = 0;
+    double t0 = now_s();
+    for (int k = 0; k < iters; ++k) {
+        epc_dec_init(&d, sink_row, (void *)&sink);
+        epc_dec_feed(&d, enc, (size_t)n);
+    }
+    double dt = now_s() - t0;
+    double raw = 2.0 * PLANE_SIZE;
+    printf("%-28s raw %5.0f B -> %4d B  ratio %6.1fx  decode %7.1f MB/s\n",
+           name, raw, n, raw / n, raw * iters / dt / 1e6);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static tag_img_t t;
+    int fails = 0;
+
+    if (argc == 3) {
+        memset(t.red, 0xFF, sizeof(t.red));
+        if (load_pbm(argv[1], t.black) || load_pbm(argv[2], t.red)) {
+            fprintf(stderr, "need 128x250 P4 PBM files\n");
+            return 2;
+        }
+        return bench_one(argv[1], &t);
+    }
+
+    render_tag(&t, "IPHONE 17", "20%", "29.990.000", "23.992.000", "8934563138165");
+    fails += bench_one("iphone, sale", &t);
+    render_tag(&t, "SUA TUOI TH", "", "", "32.500", "8935217400015");
+    fails += bench_one("milk, no sale", &t);
+    render_tag(&t, "GAO ST25 5KG", "15%", "185.000", "157.250", "8936079120108");
+    fails += bench_one("rice, sale", &t);
+    memset(t.black, 0xFF, sizeof(t.black));
+    memset(t.red, 0xFF, sizeof(t.red));
+    fails += bench_one("blank", &t);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+#include "blk_xfer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ep_proto.h"
+
+static const char *TAG = "blk_xfer";
+
+typedef struct {
+    bool      used;
+    EPBlkTx   tx;
+    uint8_t  *data;          // bản copy, free khi xong
+    int64_t   t_start_us;
+} blk_session_t;
+
+static blk_session_t      s_sess[BLK_XFER_MAX_SESSIONS];
+static SemaphoreHandle_t  s_lock;
+static blk_xfer_send_fn_t s_send;
+static uint8_t            s_rr;   // phiên được phục vụ đầu tiên ở tick kế
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void session_free(blk_session_t *s) {
+    free(s->data);
+    memset(s, 0, sizeof(*s));
+}
+
+static blk_session_t *session_find(uint16_t dst) {
+    for (int i = 0; i < BLK_XFER_MAX_SESSIONS; ++i) {
+        if (s_sess[i].used && s_sess[i].tx.dst == dst) return &s_sess[i];
+    }
+    return NULL;
+}
+
+// Thực hiện 1 bước của phiên; trả true nếu đã gửi gì đó lên mesh.
+static bool session_step(blk_session_t *s, uint32_t now) {
+    uint8_t  frame[EP_BLK_DATA_HDR_LEN + 255];
+    uint16_t idx = 0;
+    size_t   n;
+
+    switch (ep_blk_tx_next(&s->tx, now, &idx)) {
+    case EP_BLK_ACT_START:
+        n = ep_blk_tx_start_frame(&s->tx, frame);
+        s_send(s->tx.dst, EP_VND_OP_BLK_START, frame, (uint16_t)n);
+        return true;
+    case EP_BLK_ACT_DATA:
+        n = ep_blk_tx_data_frame(&s->tx, idx, frame, sizeof(frame));
+        if (n == 0 || s_send(s->tx.dst, EP_VND_OP_BLK_DATA, frame, (uint16_t)n) != ESP_OK) {
+            // không gửi được (hết buffer) -> coi như mất, ACK/POLL sẽ gửi lại
+            ESP_LOGW(TAG, "dst 0x%04x chunk %u send failed", s->tx.dst, idx);
+        }
+        return true;
+    case EP_BLK_ACT_DONE:
+        ESP_LOGI(TAG, "dst 0x%04x blob 0x%04x done: %" PRIu32 " B, %u chunks, %" PRIu32 " resent, %lld ms",
+                 s->tx.dst, s->tx.blob_id, s->tx.total_len, s->tx.n_chunks, s->tx.chunks_resent,
+                 (esp_timer_get_time() - s->t_start_us) / 1000);
+        session_free(s);
+        return false;
+    case EP_BLK_ACT_FAIL:
+        ESP_LOGE(TAG, "dst 0x%04x blob 0x%04x failed at chunk %u/%u",
+                 s->tx.dst, s->tx.blob_id, s->tx.base, s->tx.n_chunks);
+        session_free(s);
+        return false;
+    default:
+        return false;
+    }
+}
+
+static void blk_xfer_task(void *arg) {
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(BLK_XFER_TICK_MS));
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint32_t now    = now_ms();
+        int      budget = BLK_XFER_SENDS_PER_TICK;
+        bool     progress = true;
+        // round-robin: mỗi vòng mỗi phiên tối đa 1 frame, lặp tới khi hết budget
+        while (budget > 0 && progress) {
+            progress = false;
+            for (int k = 0; k < BLK_XFER_MAX_SESSIONS && budget > 0; ++k) {
+                blk_session_t *s = &s_sess[(s_rr + k) % BLK_XFER_MAX_SESSIONS];
+                if (!s->used) continue;
+                if (session_step(s, now)) {
+                    --budget;
+                    progress = true;
+                }
+            }
+            s_rr = (uint8_t)((s_rr + 1) % BLK_XFER_MAX_SESSIONS);
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+esp_err_t blk_xfer_init(blk_xfer_send_fn_t send) {
+    if (!send) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_send = send;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(blk_xfer_task, "blk_xfer", 4096, NULL, 5, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t blk_xfer_start(uint16_t dst, uint8_t kind, const uint8_t *data, uint32_t len) {
+    if (!s_lock || !data || len == 0) return ESP_ERR_INVALID_STATE;
+    if (ep_blk_chunk_count(len, EP_BLK_CHUNK_DEFAULT) > EP_BLK_MAX_CHUNKS) return ESP_ERR_INVALID_SIZE;
+
+    uint8_t *copy = malloc(len);
+    if (!copy) return ESP_ERR_NO_MEM;
+    memcpy(copy, data, len);
+
+    // blob id từ nội dung: gửi lại cùng nội dung (kể cả sau reboot) sẽ resume
+    uint16_t blob_id = (uint16_t)ep_hash32(copy, len, 0);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    blk_session_t *s = session_find(dst);
+    if (s) {
+        ESP_LOGW(TAG, "dst 0x%04x: replace blob 0x%04x", dst, s->tx.blob_id);
+        session_free(s);
+    } else {
+        for (int i = 0; i < BLK_XFER_MAX_SESSIONS; ++i) {
+            if (!s_sess[i].used) { s = &s_sess[i]; break; }
+        }
+    }
+    if (!s) {
+        xSemaphoreGive(s_lock);
+        free(copy);
+        return ESP_ERR_NO_MEM;
+    }
+    s->used = true;
+    s->data = copy;
+    s->t_start_us = esp_timer_get_time();
+    ep_blk_tx_init(&s->tx, dst, blob_id, kind, copy, len, EP_BLK_CHUNK_DEFAULT, now_ms());
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "dst 0x%04x blob 0x%04x kind %u: %" PRIu32 " B in %u chunks",
+             dst, blob_id, kind, len, ep_blk_chunk_count(len, EP_BLK_CHUNK_DEFAULT));
+    return ESP_OK;
+}
+
+void blk_xfer_on_ack(uint16_t src, const uint8_t *msg, uint16_t len) {
+    EPBlkAck ack;
+    if (!s_lock || !ep_blk_parse_ack(msg, len, &ack)) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    blk_session_t *s = session_find(src);
+    if (s) ep_blk_tx_on_ack(&s->tx, &ack, now_ms());
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGD(TAG, "ACK from 0x%04x blob 0x%04x st 0x%02x base %u map 0x%08" PRIx32,
+             src, ack.blob_id, ack.status, ack.base, ack.bitmap);
+}
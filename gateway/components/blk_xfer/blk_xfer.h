@@ -0,0 +1,33 @@
+#ifndef __BLK_XFER_H
+#define __BLK_XFER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "ep_blk.h"
+
+// Phiên block transfer phía gateway: mỗi node 1 phiên, nhiều chunk
+// in-flight mỗi phiên, các phiên được xen kẽ round-robin để 1 tag chậm
+// không chặn các tag khác.
+
+#ifndef BLK_XFER_MAX_SESSIONS
+#define BLK_XFER_MAX_SESSIONS   8
+#endif
+#ifndef BLK_XFER_TICK_MS
+#define BLK_XFER_TICK_MS        20
+#endif
+#ifndef BLK_XFER_SENDS_PER_TICK
+#define BLK_XFER_SENDS_PER_TICK 2     // tổng chunk/tick cho mọi phiên (giữ ADV buffer)
+#endif
+
+// op = EP_VND_OP_BLK_xxx; main.c bọc thành opcode vendor và gửi qua mesh.
+typedef esp_err_t (*blk_xfer_send_fn_t)(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len);
+
+esp_err_t blk_xfer_init(blk_xfer_send_fn_t send);
+
+// Copy data; phiên cũ cùng dst (nếu có) bị thay thế.
+esp_err_t blk_xfer_start(uint16_t dst, uint8_t kind, const uint8_t *data, uint32_t len);
+
+// BLK_ACK từ node
+void blk_xfer_on_ack(uint16_t src, const uint8_t *msg, uint16_t len);
+
+#endif
@@ -0,0 +1,31 @@
+#include "boot_ts.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "boot";
+
+static const char *const s_names[BOOT_TS_COUNT] = {
+    "app_main", "nvs", "bt", "mesh_ready", "wifi_start", "wifi_ip", "mqtt", "first_send",
+};
+
+// ghi từ nhiều task nhưng mỗi mốc chỉ 1 nơi gọi: không cần lock
+static volatile uint32_t s_ms[BOOT_TS_COUNT];
+
+void boot_ts_mark(boot_ts_stage_t stage) {
+    if ((unsigned)stage >= BOOT_TS_COUNT || s_ms[stage]) return;
+    uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+    s_ms[stage] = ms ? ms : 1;
+    ESP_LOGI(TAG, "%-10s %6u ms", s_names[stage], (unsigned)s_ms[stage]);
+
+    if (stage == BOOT_TS_FIRST_SEND) {
+        for (int i = 0; i < BOOT_TS_COUNT; ++i) {
+            if (s_ms[i]) ESP_LOGI(TAG, "  %-10s +%6u ms", s_names[i], (unsigned)(s_ms[i] - s_ms[BOOT_TS_APP_MAIN]));
+            else         ESP_LOGI(TAG, "  %-10s  (not reached)", s_names[i]);
+        }
+    }
+}
+
+uint32_t boot_ts_get(boot_ts_stage_t stage) {
+    return (unsigned)stage < BOOT_TS_COUNT ? s_ms[stage] : 0;
+}
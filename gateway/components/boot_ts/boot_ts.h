@@ -0,0 +1,27 @@
+#ifndef __BOOT_TS_H
+#define __BOOT_TS_H
+
+#include <stdint.h>
+
+// Mốc thời gian khởi động (ms từ lúc chip chạy), mỗi mốc ghi 1 lần đầu tiên.
+// Wi-Fi/MQTT và BLE Mesh khởi động song song nên thứ tự mốc không cố định;
+// BOOT_TS_FIRST_SEND in thêm bảng tổng kết (boot-to-first-send).
+
+typedef enum {
+    BOOT_TS_APP_MAIN = 0,
+    BOOT_TS_NVS,
+    BOOT_TS_BT,
+    BOOT_TS_MESH_READY,
+    BOOT_TS_WIFI_START,
+    BOOT_TS_WIFI_IP,
+    BOOT_TS_MQTT,
+    BOOT_TS_FIRST_SEND,
+    BOOT_TS_COUNT,
+} boot_ts_stage_t;
+
+void     boot_ts_mark(boot_ts_stage_t stage);
+
+// ms, 0 nếu chưa tới mốc
+uint32_t boot_ts_get(boot_ts_stage_t stage);
+
+#endif
@@ -0,0 +1,309 @@
+#include "ep_cbor.h"
+#include <string.h>
+#include <ctype.h>
+
+// ======== helper ========
+
+#define MT_UINT     0
+#define MT_NINT     1
+#define MT_BYTES    2
+#define MT_TEXT     3
+#define MT_ARRAY    4
+#define MT_MAP      5
+#define MT_TAG      6
+#define MT_SIMPLE   7
+
+#define SKIP_DEPTH  4
+
+// Đọc đầu mục: major type + giá trị (độ dài / số). Không nhận indefinite.
+static EPStatus head(const uint8_t **p, const uint8_t *end, uint8_t *mt, uint64_t *val) {
+    if (*p >= end) return EP_ERR_FORMAT;
+    uint8_t ib = *(*p)++;
+    uint8_t ai = ib & 0x1F;
+    *mt = ib >> 5;
+    if (ai < 24) {
+        *val = ai;
+        return EP_OK;
+    }
+    if (ai > 27) return EP_ERR_FORMAT;
+    size_t n = (size_t)1 << (ai - 24);          // 1, 2, 4, 8 byte
+    if ((size_t)(end - *p) < n) return EP_ERR_FORMAT;
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) v = (v << 8) | *(*p)++;
+    *val = v;
+    return EP_OK;
+}
+
+// Bỏ qua 1 mục bất kỳ (key lạ).
+static EPStatus skip(const uint8_t **p, const uint8_t *end, int depth) {
+    uint8_t  mt;
+    uint64_t v;
+    EPStatus s = head(p, end, &mt, &v);
+    if (s != EP_OK) return s;
+    switch (mt) {
+    case MT_BYTES:
+    case MT_TEXT:
+        if ((uint64_t)(end - *p) < v) return EP_ERR_FORMAT;
+        *p += v;
+        return EP_OK;
+    case MT_ARRAY:
+    case MT_MAP:
+        if (depth >= SKIP_DEPTH) return EP_ERR_FORMAT;
+        if (mt == MT_MAP) v *= 2;
+        for (uint64_t i = 0; i < v; ++i) {
+            s = skip(p, end, depth + 1);
+            if (s != EP_OK) return s;
+        }
+        return EP_OK;
+    case MT_TAG:
+        if (depth >= SKIP_DEPTH) return EP_ERR_FORMAT;
+        return skip(p, end, depth + 1);
+    default:
+        return EP_OK;                           // số, true/false/null
+    }
+}
+
+static EPStatus get_uint(const uint8_t **p, const uint8_t *end, uint64_t max, uint64_t *out) {
+    uint8_t mt;
+    EPStatus s = head(p, end, &mt, out);
+    if (s != EP_OK) return s;
+    if (mt != MT_UINT) return EP_ERR_FORMAT;
+    return *out <= max ? EP_OK : EP_ERR_OVERFLOW;
+}
+
+static EPStatus get_text(const uint8_t **p, const uint8_t *end, char *buf, size_t buflen) {
+    uint8_t  mt;
+    uint64_t n;
+    EPStatus s = head(p, end, &mt, &n);
+    if (s != EP_OK) return s;
+    if (mt != MT_TEXT) return EP_ERR_FORMAT;
+    if ((uint64_t)(end - *p) < n) return EP_ERR_FORMAT;
+    if (n >= buflen) return EP_ERR_OVERFLOW;
+    memcpy(buf, *p, (size_t)n);
+    buf[n] = '\0';
+    *p += n;
+    return EP_OK;
+}
+
+// barcode: số nguyên (không có số 0 đầu) hoặc chuỗi chữ số
+static EPStatus get_barcode(const uint8_t **p, const uint8_t *end, char *buf, size_t buflen) {
+    if (*p < end && (**p >> 5) == MT_TEXT) return get_text(p, end, buf, buflen);
+    uint64_t v;
+    EPStatus s = get_uint(p, end, UINT64_MAX, &v);
+    if (s != EP_OK) return s;
+    char   tmp[21];
+    size_t n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (n >= buflen) return EP_ERR_OVERFLOW;
+    for (size_t i = 0; i < n; ++i) buf[i] = tmp[n - 1 - i];
+    buf[n] = '\0';
+    return EP_OK;
+}
+
+static size_t put_head(uint8_t *buf, size_t cap, uint8_t mt, uint64_t v) {
+    uint8_t ib = (uint8_t)(mt << 5);
+    size_t  n;
+    if (v < 24)              { n = 0; ib |= (uint8_t)v; }
+    else if (v <= 0xFF)      { n = 1; ib |= 24; }
+    else if (v <= 0xFFFF)    { n = 2; ib |= 25; }
+    else if (v <= 0xFFFFFFFF){ n = 4; ib |= 26; }
+    else                     { n = 8; ib |= 27; }
+    if (cap < 1 + n) return 0;
+    buf[0] = ib;
+    for (size_t i = 0; i < n; ++i) buf[1 + i] = (uint8_t)(v >> (8 * (n - 1 - i)));
+    return 1 + n;
+}
+
+static size_t put_text(uint8_t *buf, size_t cap, const char *s) {
+    size_t len = strlen(s);
+    size_t h   = put_head(buf, cap, MT_TEXT, len);
+    if (!h || cap < h + len) return 0;
+    memcpy(buf + h, s, len);
+    return h + len;
+}
+
+// ======== public ========
+
+EPStatus ep_cbor_parse_one(const uint8_t **p, const uint8_t *end, EPData *out) {
+    if (!p || !*p || !end || !out) return EP_ERR_NULL;
+
+    const uint8_t *start = *p;
+    uint8_t  mt;
+    uint64_t pairs;
+    EPStatus s = head(p, end, &mt, &pairs);
+    if (s != EP_OK) return s;
+    if (mt != MT_MAP) {
+        // không phải map: lùi về đầu mục (head có thể đã ăn 1-9 byte) rồi
+        // bỏ qua cả mục để lô đọc tiếp được
+        *p = start;
+        s = skip(p, end, 0);
+        return s != EP_OK ? s : EP_ERR_FORMAT;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->prio = EP_PRIO_NORMAL;
+    bool has_add = false, has_price = false, has_barcode = false;
+    EPStatus err = EP_OK;           // lỗi giá trị: vẫn đọc hết map
+
+    for (uint64_t i = 0; i < pairs; ++i) {
+        uint64_t key, v;
+        s = get_uint(p, end, 0xFF, &key);
+        if (s != EP_OK) {
+            // key không phải số nhỏ: không còn biết ranh giới an toàn
+            return EP_ERR_FORMAT;
+        }
+        const uint8_t *vstart = *p;
+        switch (key) {
+        case EP_CBOR_K_ADD:
+            s = get_uint(p, end, 0xFFFF, &v);
+            if (s == EP_OK) { out->add = (uint16_t)v; has_add = true; }
+            break;
+        case EP_CBOR_K_PRICE: {
+            uint8_t m2;
+            s = head(p, end, &m2, &v);
+            if (s == EP_OK) {
+                if (m2 == MT_UINT && v <= 2147483647ull)     out->price = (int32_t)v;
+                else if (m2 == MT_NINT && v <= 2147483647ull) out->price = -1 - (int32_t)v;
+                else s = (m2 == MT_UINT || m2 == MT_NINT) ? EP_ERR_OVERFLOW : EP_ERR_FORMAT;
+            }
+            has_price = (s == EP_OK);
+            break;
+        }
+        case EP_CBOR_K_BARCODE:
+            s = get_barcode(p, end, out->barcode, sizeof(out->barcode));
+            has_barcode = (s == EP_OK);
+            break;
+        case EP_CBOR_K_SALE:
+            s = get_uint(p, end, 100, &v);
+            if (s == EP_OK) { out->sale = (uint8_t)v; out->has_sale = true; }
+            else if (s == EP_ERR_OVERFLOW) s = EP_ERR_VALUE;
+            break;
+        case EP_CBOR_K_TITLE:
+            s = get_text(p, end, out->title, sizeof(out->title));
+            out->has_title = (s == EP_OK && out->title[0] != '\0');
+            break;
+        case EP_CBOR_K_PRIO:
+            s = get_uint(p, end, EP_PRIO_BULK, &v);
+            if (s == EP_OK) out->prio = (uint8_t)v;
+            else if (s == EP_ERR_OVERFLOW) s = EP_ERR_VALUE;
+            break;
+        case EP_CBOR_K_CID:
+            s = get_uint(p, end, 0xFFFFFFFFull, &v);
+            if (s == EP_OK) out->cid = (uint32_t)v;
+            break;
+        default:
+            s = skip(p, end, 0);
+            break;
+        }
+        if (s != EP_OK) {
+            // giá trị sai kiểu / ngoài dải: bỏ cả mục, đọc tiếp key sau
+            *p = vstart;
+            if (skip(p, end, 0) != EP_OK) return EP_ERR_FORMAT;
+            if (err == EP_OK) err = s;
+        }
+    }
+    if (err != EP_OK) return err;
+
+    // cùng luật với ep_parse
+    if (!has_add) return EP_ERR_KEY;
+    if (has_price != has_barcode) return EP_ERR_KEY;
+    if (!has_price && !out->has_sale && !out->has_title) return EP_ERR_KEY;
+    out->partial = !has_price;
+    if (out->partial) {
+        out->price = 0;
+        out->barcode[0] = '\0';
+    }
+    if (!ep_validate(out)) return EP_ERR_VALUE;
+    return EP_OK;
+}
+
+int ep_cbor_parse(const uint8_t *buf, size_t len, ep_cbor_rec_fn cb, void *arg, int *bad) {
+    if (bad) *bad = 0;
+    if (!buf || len == 0) return EP_ERR_NULL;
+
+    const uint8_t *p   = buf;
+    const uint8_t *end = buf + len;
+    uint64_t n = 1;
+    bool     batch = (*p >> 5) == MT_ARRAY;
+    if (batch) {
+        uint8_t  mt;
+        EPStatus s = head(&p, end, &mt, &n);
+        if (s != EP_OK) return s;
+        if (n > EP_CBOR_BATCH_MAX) return EP_ERR_OVERFLOW;
+    }
+
+    int ok = 0;
+    EPData rec;
+    for (uint64_t i = 0; i < n; ++i) {
+        const uint8_t *before = p;
+        EPStatus s = ep_cbor_parse_one(&p, end, &rec);
+        if (s == EP_OK) {
+            ++ok;
+            if (cb) cb(&rec, arg);
+        } else {
+            if (bad) ++*bad;
+            if (p == before || p >= end) {
+                // không đi tiếp được: các bản ghi còn lại coi như hỏng
+                if (bad) *bad += (int)(n - i - 1);
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+int ep_cbor_encode(const EPData *in, uint8_t *buf, size_t cap) {
+    if (!in || !buf) return EP_ERR_NULL;
+    uint8_t pairs = 1 + (in->partial ? 0 : 2) + (in->has_sale ? 1 : 0) + (in->has_title ? 1 : 0)
+                  + (in->prio != EP_PRIO_NORMAL ? 1 : 0) + (in->cid ? 1 : 0);
+    size_t n = 0, w;
+
+#define PUT(expr) do { w = (expr); if (!w) return EP_ERR_OVERFLOW; n += w; } while (0)
+    PUT(put_head(buf + n, cap - n, MT_MAP, pairs));
+    PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_ADD));
+    PUT(put_head(buf + n, cap - n, MT_UINT, in->add));
+    if (!in->partial) {
+        PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_PRICE));
+        PUT(in->price >= 0 ? put_head(buf + n, cap - n, MT_UINT, (uint64_t)in->price)
+                           : put_head(buf + n, cap - n, MT_NINT, (uint64_t)(-1 - (int64_t)in->price)));
+        PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_BARCODE));
+        // số nguyên nếu không mất số 0 đầu và vừa 64 bit, ngược lại text
+        size_t blen = strlen(in->barcode);
+        bool   as_uint = blen > 0 && blen <= 19 && in->barcode[0] != '0';
+        for (size_t i = 0; as_uint && i < blen; ++i) as_uint = isdigit((unsigned char)in->barcode[i]);
+        if (as_uint) {
+            uint64_t v = 0;
+            for (size_t i = 0; i < blen; ++i) v = v * 10 + (uint64_t)(in->barcode[i] - '0');
+            PUT(put_head(buf + n, cap - n, MT_UINT, v));
+        } else {
+            PUT(put_text(buf + n, cap - n, in->barcode));
+        }
+    }
+    if (in->has_sale) {
+        PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_SALE));
+        PUT(put_head(buf + n, cap - n, MT_UINT, in->sale));
+    }
+    if (in->has_title) {
+        PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_TITLE));
+        PUT(put_text(buf + n, cap - n, in->title));
+    }
+    if (in->prio != EP_PRIO_NORMAL) {
+        PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_PRIO));
+        PUT(put_head(buf + n, cap - n, MT_UINT, in->prio));
+    }
+    if (in->cid) {
+        PUT(put_head(buf + n, cap - n, MT_UINT, EP_CBOR_K_CID));
+        PUT(put_head(buf + n, cap - n, MT_UINT, in->cid));
+    }
+#undef PUT
+    return (int)n;
+}
+
+int ep_cbor_encode_batch_hdr(uint32_t n, uint8_t *buf, size_t cap) {
+    if (!buf) return EP_ERR_NULL;
+    size_t w = put_head(buf, cap, MT_ARRAY, n);
+    return w ? (int)w : EP_ERR_OVERFLOW;
+}
@@ -0,0 +1,61 @@
+#ifndef EP_CBOR_H
+#define EP_CBOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ep_data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Lệnh giá dạng CBOR (RFC 8949), song song với JSON của ep_parse.
+//
+// 1 bản ghi = map, key là số nhỏ (1 byte) thay cho tên field:
+//   0 add (uint)      1 price (int)       2 barcode (uint hoặc text chữ số)
+//   3 sale (uint)     4 title (text)      5 prio (uint)     6 cid (uint)
+// 1 lô = array các map. Ví dụ {0:5, 1:99000, 2:8934567890120, 3:20}:
+//   A4 00 05 01 1A 00 01 82 B8 02 1B 00 00 08 20 3D BE CC C8 03 14   (21 B)
+//
+// Giải mã thẳng vào EPData (không dựng chuỗi JSON trung gian); cùng luật
+// bắt buộc / partial / ep_validate như ep_parse. Không hỗ trợ độ dài
+// indefinite; key lạ được bỏ qua (mở rộng về sau).
+//
+// Codec riêng cho schema này, không dùng tinycbor: espressif__cbor chỉ có
+// trong managed_components của node (kéo theo arduino-esp32), gateway không
+// phụ thuộc; schema chỉ cần uint/nint/text/array/map nên decoder tay đi
+// thẳng vào EPData, không qua CborValue/iterator.
+
+#define EP_CBOR_K_ADD       0
+#define EP_CBOR_K_PRICE     1
+#define EP_CBOR_K_BARCODE   2
+#define EP_CBOR_K_SALE      3
+#define EP_CBOR_K_TITLE     4
+#define EP_CBOR_K_PRIO      5
+#define EP_CBOR_K_CID       6
+
+#ifndef EP_CBOR_BATCH_MAX
+#define EP_CBOR_BATCH_MAX   256
+#endif
+
+// Gọi cho từng bản ghi hợp lệ của lô (bản ghi lỗi bị bỏ qua, không dừng lô).
+typedef void (*ep_cbor_rec_fn)(const EPData *rec, void *arg);
+
+// buf: 1 map hoặc 1 array các map. Trả số bản ghi hợp lệ, hoặc EPStatus < 0
+// nếu khung ngoài hỏng. *bad (tuỳ chọn): số bản ghi bị bỏ.
+int      ep_cbor_parse(const uint8_t *buf, size_t len, ep_cbor_rec_fn cb, void *arg, int *bad);
+
+// Giải mã 1 map tại *p (di chuyển *p qua map kể cả khi lỗi giá trị).
+EPStatus ep_cbor_parse_one(const uint8_t **p, const uint8_t *end, EPData *out);
+
+// Mã hoá 1 bản ghi (back office / host bench). Trả số byte, <0 nếu lỗi.
+int      ep_cbor_encode(const EPData *in, uint8_t *buf, size_t cap);
+
+// Đầu lô: array n phần tử. Trả số byte.
+int      ep_cbor_encode_batch_hdr(uint32_t n, uint8_t *buf, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -100,11 +100,52 @@ static bool is_all_digits(const char* s) {
     return true;
 }
 
+static EPStatus parse_prio(const char* v, uint8_t* out) {
+    if (!v || !out) return EP_ERR_NULL;
+    if (*v == '\"') {
+        static const char *const names[] = { "urgent", "normal", "bulk" };
+        for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+            size_t n = strlen(names[i]);
+            if (strncmp(v + 1, names[i], n) == 0 && v[1 + n] == '\"') {
+                *out = i;
+                return EP_OK;
+            }
+        }
+        return EP_ERR_VALUE;
+    }
+    if (!isdigit((unsigned char)*v)) return EP_ERR_FORMAT;
+    if (v[0] > '2' || isdigit((unsigned char)v[1])) return EP_ERR_VALUE;
+    *out = (uint8_t)(v[0] - '0');
+    return EP_OK;
+}
+
+// số nguyên dương 32 bit, cho phép bọc trong "..."
+static EPStatus parse_cid(const char* v, uint32_t* out) {
+    if (!v || !out) return EP_ERR_NULL;
+    const char* p = skip_ws(v);
+    bool quoted = (*p == '\"');
+    if (quoted) ++p;
+    if (!isdigit((unsigned char)*p)) return EP_ERR_FORMAT;
+    uint64_t val = 0;
+    for (; isdigit((unsigned char)*p); ++p) {
+        val = val*10 + (uint64_t)(*p - '0');
+        if (val > 0xFFFFFFFFull) return EP_ERR_OVERFLOW;
+    }
+    if (quoted && *p != '\"') return EP_ERR_FORMAT;
+    if (val == 0) return EP_ERR_VALUE;
+    *out = (uint32_t)val;
+    return EP_OK;
+}
+
 // ======== public ========
 
 bool ep_validate(const EPData *in) {
     if (!in) return false;
 
+    if (in->prio > EP_PRIO_BULK) return false;
+
+    if (in->partial) return !in->has_sale || in->sale <= 100;
+
     // price hợp lệ
     if (in->price < 0) return false;
 
@@ -129,19 +170,30 @@ EPStatus ep_parse(const char *json, EPData *out) {
     const char* v_price   = find_key_value_start(json, "price");
     const char* v_barcode = find_key_value_start(json, "barcode");
     const char* v_sale    = find_key_value_start(json, "sale");
+    const char* v_title   = find_key_value_start(json, "title");
+    const char* v_prio    = find_key_value_start(json, "prio");
+    const char* v_cid     = find_key_value_start(json, "cid");
 
-    if (!v_add || !v_price || !v_barcode) return EP_ERR_KEY;
+    if (!v_add) return EP_ERR_KEY;
+    // price/barcode đi cùng nhau; thiếu cả hai chỉ hợp lệ khi có gì đó để đổi
+    if (!v_price != !v_barcode) return EP_ERR_KEY;
+    if (!v_price && !v_sale && !v_title) return EP_ERR_KEY;
 
     EPStatus s;
 
     s = parse_uint16(v_add, &out->add);
     if (s != EP_OK) return s;
 
-    s = parse_int32(v_price, &out->price);
-    if (s != EP_OK) return s;
+    out->partial = (v_price == NULL);
+    out->price = 0;
+    out->barcode[0] = '\0';
+    if (!out->partial) {
+        s = parse_int32(v_price, &out->price);
+        if (s != EP_OK) return s;
 
-    s = parse_string(v_barcode, out->barcode, sizeof(out->barcode));
-    if (s != EP_OK) return s;
+        s = parse_string(v_barcode, out->barcode, sizeof(out->barcode));
+        if (s != EP_OK) return s;
+    }
 
     out->has_sale = false;
     out->sale = 0;
@@ -153,6 +205,26 @@ EPStatus ep_parse(const char *json, EPData *out) {
         out->sale = p;
     }
 
+    out->has_title = false;
+    out->title[0] = '\0';
+    if (v_title) {
+        s = parse_string(v_title, out->title, sizeof(out->title));
+        if (s != EP_OK) return s;
+        out->has_title = (out->title[0] != '\0');
+    }
+
+    out->prio = EP_PRIO_NORMAL;
+    if (v_prio) {
+        s = parse_prio(v_prio, &out->prio);
+        if (s != EP_OK) return s;
+    }
+
+    out->cid = 0;
+    if (v_cid) {
+        s = parse_cid(v_cid, &out->cid);
+        if (s != EP_OK) return s;
+    }
+
     if (!ep_validate(out)) return EP_ERR_VALUE;
 
     return EP_OK;
@@ -162,18 +234,42 @@ int ep_to_json(const EPData *in, char *buf, size_t buflen) {
     if (!in || !buf || buflen==0) return EP_ERR_NULL;
     // output DEC cho add để khớp thói quen nhập
     int n;
-    if (in->has_sale) {
+    if (in->partial) {
+        n = in->has_sale
+          ? snprintf(buf, buflen, "{\"add\":%u,\"sale\":%u", (unsigned)in->add, (unsigned)in->sale)
+          : snprintf(buf, buflen, "{\"add\":%u", (unsigned)in->add);
+    } else if (in->has_sale) {
         n = snprintf(buf, buflen,
-            "{\"add\":%u,\"price\":%d,\"barcode\":\"%s\",\"sale\":%u}",
+            "{\"add\":%u,\"price\":%d,\"barcode\":\"%s\",\"sale\":%u",
             (unsigned)in->add, (int)in->price, in->barcode, (unsigned)in->sale);
     } else {
         n = snprintf(buf, buflen,
-            "{\"add\":%u,\"price\":%d,\"barcode\":\"%s\"}",
+            "{\"add\":%u,\"price\":%d,\"barcode\":\"%s\"",
             (unsigned)in->add, (int)in->price, in->barcode);
     }
     if (n < 0) return EP_ERR_FORMAT;
     if ((size_t)n >= buflen) return EP_ERR_OVERFLOW;
-    return n; // số byte đã ghi (không tính NUL)
+
+    if (in->has_title) {
+        int t = snprintf(buf + n, buflen - (size_t)n, ",\"title\":\"%s\"", in->title);
+        if (t < 0) return EP_ERR_FORMAT;
+        n += t;
+        if ((size_t)n >= buflen) return EP_ERR_OVERFLOW;
+    }
+
+    if (in->cid) {
+        int c = snprintf(buf + n, buflen - (size_t)n, ",\"cid\":%lu", (unsigned long)in->cid);
+        if (c < 0) return EP_ERR_FORMAT;
+        n += c;
+        if ((size_t)n >= buflen) return EP_ERR_OVERFLOW;
+    }
+
+    int m = in->prio != EP_PRIO_NORMAL
+          ? snprintf(buf + n, buflen - (size_t)n, ",\"prio\":%u}", (unsigned)in->prio)
+          : snprintf(buf + n, buflen - (size_t)n, "}");
+    if (m < 0) return EP_ERR_FORMAT;
+    if ((size_t)(n + m) >= buflen) return EP_ERR_OVERFLOW;
+    return n + m; // số byte đã ghi (không tính NUL)
 }
 
 int32_t ep_unit_price_after_sale(const EPData *in) {
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include "ep_title.h"   // EP_TITLE_MAX_LEN (giới hạn tên theo gói mesh)
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +15,13 @@ extern "C" {
 #define EP_BARCODE_MAX_LEN 64  // đủ dài cho EAN13/UPC/EAN8, v.v.
 #endif
 
+// Lớp ưu tiên khi gửi xuống mesh (cùng thứ tự MESH_TX_PRIO_*)
+typedef enum {
+    EP_PRIO_URGENT = 0,   // sửa giá sai, phải lên kệ ngay
+    EP_PRIO_NORMAL = 1,   // mặc định
+    EP_PRIO_BULK   = 2,   // đồng bộ catalogue hàng loạt
+} EPPrio;
+
 // ============ Status code ============
 typedef enum {
     EP_OK = 0,
@@ -27,17 +35,34 @@ typedef enum {
 // ============ Data model ============
 typedef struct {
     uint16_t add;                          // số lượng
+
+    // Cập nhật một phần: JSON chỉ có add + sale và/hoặc title, giữ nguyên
+    // price/barcode đang hiển thị trên tag (price, barcode không hợp lệ)
+    bool     partial;
+
     int32_t  price;                        // đơn giá (VND)
     char     barcode[EP_BARCODE_MAX_LEN];  // chỉ chữ số, NUL-terminated
 
     // Optional sale (percent 0..100)
     bool     has_sale;
     uint8_t  sale;                         // 0..100 (%)
+
+    // Optional tên sản phẩm (UTF-8, nên viết hoa để nén tốt)
+    bool     has_title;
+    char     title[EP_TITLE_MAX_LEN];
+
+    // Optional "prio": 0..2 hoặc "urgent" / "normal" / "bulk"
+    uint8_t  prio;                         // EPPrio, mặc định EP_PRIO_NORMAL
+
+    // Optional "cid": correlation id (số hoặc chuỗi số, 1..4294967295),
+    // gateway gửi lại trong báo cáo kết quả; 0 = không có
+    uint32_t cid;
 } EPData;
 
 // ============ API ============
 
-// Parse JSON vào struct (yêu cầu có add, price, barcode; sale tùy chọn)
+// Parse JSON vào struct (yêu cầu có add, price, barcode; sale, title, prio, cid tùy chọn).
+// Thiếu cả price lẫn barcode nhưng có sale/title -> partial = true.
 EPStatus ep_parse(const char *json, EPData *out);
 
 // Serialize struct ra JSON. Trả về số byte đã ghi (không gồm NUL) hoặc <0 nếu lỗi.
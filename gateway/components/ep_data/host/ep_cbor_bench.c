@@ -0,0 +1,209 @@
+// Host benchmark: lệnh giá JSON (ep_parse) vs CBOR (ep_cbor_parse), byte /
+// bản ghi và bản ghi / giây.
+//
+// Build (trên PC, từ thư mục gateway/components/ep_data):
+//   cc -O2 -I. -I../../../common/ep_proto host/ep_cbor_bench.c ep_data.c ep_cbor.c -o cbor_bench
+//
+// Chạy:
+//   ./cbor_bench            -> 20000 bản ghi ngẫu nhiên (30% có sale, 20% có title)
+//   ./cbor_bench 100000     -> số bản ghi khác
+#include "ep_data.h"
+#include "ep_cbor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BATCH       32          // bản ghi / message CBOR dạng lô
+#define JSON_MAX    256         // = buffer của app_mqtt
+#define REC_MAX     128
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t s_rng = 12345;
+static uint32_t rnd(void) {
+    s_rng = s_rng * 1103515245u + 12345u;
+    return s_rng >> 8;
+}
+
+static const char *const TITLES[] = {
+    "SUA TUOI VINAMILK 1L", "MI HAO HAO TOM CHUA CAY", "NUOC MAM NAM NGU 500ML",
+    "DAU AN NEPTUNE 1L", "BANH CHOCOPIE HOP 12", "CA PHE G7 3IN1",
+};
+
+static void make_rec(EPData *d) {
+    memset(d, 0, sizeof(*d));
+    d->add  = (uint16_t)(1 + rnd() % 2000);
+    d->prio = EP_PRIO_NORMAL;
+    d->cid  = rnd();
+    if (rnd() % 10 < 1) {
+        // cập nhật một phần: chỉ sale
+        d->partial  = true;
+        d->has_sale = true;
+        d->sale     = (uint8_t)(5 + rnd() % 46);
+        return;
+    }
+    d->price = (int32_t)(1000 * (1 + rnd() % 500));
+    // EAN-13 hợp lệ, prefix 893 (VN)
+    char b[14] = "893";
+    for (int i = 3; i < 12; ++i) b[i] = (char)('0' + rnd() % 10);
+    int sum = 0;
+    for (int i = 0; i < 12; ++i) sum += (b[i] - '0') * ((i & 1) ? 3 : 1);
+    b[12] = (char)('0' + (10 - sum % 10) % 10);
+    b[13] = '\0';
+    memcpy(d->barcode, b, sizeof(b));
+    if (rnd() % 10 < 3) {
+        d->has_sale = true;
+        d->sale     = (uint8_t)(5 + rnd() % 46);
+    }
+    if (rnd() % 10 < 2) {
+        d->has_title = true;
+        snprintf(d->title, sizeof(d->title), "%s", TITLES[rnd() % (sizeof(TITLES) / sizeof(TITLES[0]))]);
+    }
+    if (rnd() % 20 == 0) d->prio = EP_PRIO_URGENT;
+}
+
+static int same(const EPData *a, const EPData *b) {
+    return a->add == b->add && a->partial == b->partial && a->price == b->price &&
+           strcmp(a->barcode, b->barcode) == 0 && a->has_sale == b->has_sale &&
+           (!a->has_sale || a->sale == b->sale) && a->has_title == b->has_title &&
+           strcmp(a->title, b->title) == 0 && a->prio == b->prio && a->cid == b->cid;
+}
+
+typedef struct {
+    const EPData *ref;
+    int           idx;
+    int           mismatches;
+    uint32_t      sink;
+} verify_t;
+
+static void on_rec(const EPData *rec, void *arg) {
+    verify_t *v = (verify_t *)arg;
+    if (v->ref && !same(rec, &v->ref[v->idx])) ++v->mismatches;
+    v->sink += rec->add;
+    ++v->idx;
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+    if (n < BATCH) n = BATCH;
+    n -= n % BATCH;
+
+    EPData  *recs  = malloc(sizeof(EPData) * (size_t)n);
+    char    *json  = malloc((size_t)n * JSON_MAX);
+    uint8_t *cbor  = malloc((size_t)n * REC_MAX);
+    int     *jlen  = malloc(sizeof(int) * (size_t)n);
+    int     *clen  = malloc(sizeof(int) * (size_t)n);
+    int     nb     = n / BATCH;
+    uint8_t *batch = malloc((size_t)nb * (BATCH * REC_MAX + 8));
+    int     *blen  = malloc(sizeof(int) * (size_t)nb);
+    if (!recs || !json || !cbor || !jlen || !clen || !batch || !blen) return 1;
+
+    size_t jbytes = 0, cbytes = 0, bbytes = 0;
+    for (int i = 0; i < n; ++i) {
+        make_rec(&recs[i]);
+        jlen[i] = ep_to_json(&recs[i], json + (size_t)i * JSON_MAX, JSON_MAX);
+        clen[i] = ep_cbor_encode(&recs[i], cbor + (size_t)i * REC_MAX, REC_MAX);
+        if (jlen[i] < 0 || clen[i] < 0) {
+            printf("encode error at %d (json %d, cbor %d)\n", i, jlen[i], clen[i]);
+            return 1;
+        }
+        jbytes += (size_t)jlen[i];
+        cbytes += (size_t)clen[i];
+    }
+    for (int b = 0; b < nb; ++b) {
+        uint8_t *out = batch + (size_t)b * (BATCH * REC_MAX + 8);
+        int len = ep_cbor_encode_batch_hdr(BATCH, out, 8);
+        for (int i = 0; i < BATCH; ++i) {
+            int k = b * BATCH + i;
+            memcpy(out + len, cbor + (size_t)k * REC_MAX, (size_t)clen[k]);
+            len += clen[k];
+        }
+        blen[b] = len;
+        bbytes += (size_t)len;
+    }
+
+    // ---- round-trip ----
+    int bad = 0;
+    for (int i = 0; i < n; ++i) {
+        EPData d;
+        if (ep_parse(json + (size_t)i * JSON_MAX, &d) != EP_OK || !same(&d, &recs[i])) ++bad;
+    }
+    if (bad) printf("JSON ROUNDTRIP FAIL: %d records\n", bad);
+    verify_t v = { .ref = recs };
+    for (int b = 0; b < nb; ++b) {
+        int rb = 0;
+        ep_cbor_parse(batch + (size_t)b * (BATCH * REC_MAX + 8), (size_t)blen[b], on_rec, &v, &rb);
+        bad += rb;
+    }
+    if (v.mismatches || v.idx != n) {
+        printf("CBOR ROUNDTRIP FAIL: %d mismatches, %d/%d records\n", v.mismatches, v.idx, n);
+        return 1;
+    }
+
+    // ---- lô có mục không phải map (đầu mục nhiều byte) ----
+    {
+        uint8_t mix[8 + 3 + 5 + REC_MAX];
+        int len = ep_cbor_encode_batch_hdr(3, mix, 8);
+        mix[len++] = 0x19; mix[len++] = 0x01; mix[len++] = 0x00;        // uint 256
+        mix[len++] = 0x78; mix[len++] = 0x02; mix[len++] = 'a'; mix[len++] = 'b';  // text 8-bit len
+        memcpy(mix + len, cbor, (size_t)clen[0]);
+        len += clen[0];
+        verify_t vm = { .ref = recs };
+        int rb = 0;
+        int ok = ep_cbor_parse(mix, (size_t)len, on_rec, &vm, &rb);
+        if (ok != 1 || rb != 2 || vm.mismatches) {
+            printf("CBOR NON-MAP SKIP FAIL: ok %d, bad %d, mismatches %d\n", ok, rb, vm.mismatches);
+            return 1;
+        }
+    }
+
+    // ---- tốc độ ----
+    const int rounds = 20;
+    uint32_t sink = 0;
+    double t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < n; ++i) {
+            EPData d;
+            if (ep_parse(json + (size_t)i * JSON_MAX, &d) == EP_OK) sink += d.add;
+        }
+    }
+    double t_json = now_s() - t0;
+
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < n; ++i) {
+            const uint8_t *p = cbor + (size_t)i * REC_MAX;
+            EPData d;
+            if (ep_cbor_parse_one(&p, p + clen[i], &d) == EP_OK) sink += d.add;
+        }
+    }
+    double t_cbor = now_s() - t0;
+
+    verify_t vs = {0};
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) {
+        for (int b = 0; b < nb; ++b) {
+            ep_cbor_parse(batch + (size_t)b * (BATCH * REC_MAX + 8), (size_t)blen[b], on_rec, &vs, NULL);
+        }
+    }
+    double t_batch = now_s() - t0;
+
+    double total = (double)n * rounds;
+    printf("%d records (%d rounds)\n", n, rounds);
+    printf("%-22s %6.1f B/rec  %8.0f krec/s\n", "JSON ep_parse",
+           (double)jbytes / n, total / t_json / 1e3);
+    printf("%-22s %6.1f B/rec  %8.0f krec/s\n", "CBOR single",
+           (double)cbytes / n, total / t_cbor / 1e3);
+    char name[24];
+    snprintf(name, sizeof(name), "CBOR batch x%d", BATCH);
+    printf("%-22s %6.1f B/rec  %8.0f krec/s\n", name, (double)bbytes / n, total / t_batch / 1e3);
+    printf("(sink %u)\n", (unsigned)(sink + vs.sink));
+
+    free(recs); free(json); free(cbor); free(jlen); free(clen); free(batch); free(blen);
+    return 0;
+}
@@ -1,5 +1,29 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 esp_err_t example_ble_mesh_send_vendor_message(bool resend);
+
+// Ảnh tag: 2 plane thô (black+red, 2 x 16 x 250 B) hoặc stream epd_codec.
+esp_err_t example_ble_mesh_send_image(uint16_t dst, const uint8_t *data, size_t len);
+
+// Phát firmware đã lưu trong partition nodefw tới mọi tag đã provision.
+esp_err_t example_ble_mesh_start_node_ota(void);
+
+// Đưa các tag vào group (Config Model Sub Add, xếp hàng phía gateway); sau đó
+// lệnh giá có "add" = group được gửi 1 lần cho cả nhóm.
+esp_err_t example_ble_mesh_group_join(uint16_t group, const uint16_t *nodes, uint16_t n);
+
+// Giao dải địa chỉ cho n tag đã provision (0 = FPROV_MGR_DELEGATES_MAX) để
+// chúng tự provision tag mới quanh mình trong duration_s giây (0 = mặc định).
+esp_err_t example_ble_mesh_onboard(uint16_t duration_s, uint8_t n);
+
+// Lệnh giá đã nhận nhưng chưa lên mesh (hàng mesh_tx): app_mqtt dừng nhận
+// (hoãn PUBACK) khi vượt cửa sổ, broker giữ phần còn lại.
+uint16_t  example_ble_mesh_cmd_backlog(void);
+
+// Chờ lệnh vừa gửi được ghi bền (WAL) -> mới ACK broker.
+// ESP_ERR_INVALID_STATE: gateway chạy không có WAL.
+esp_err_t example_ble_mesh_cmd_sync(uint32_t timeout_ms);
@@ -0,0 +1,325 @@
+#include "fprov_mgr.h"
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "ep_proto.h"
+
+static const char *TAG = "fprov_mgr";
+
+#define NVS_NS          "fprov_mgr"
+#define TICK_MS         500
+#define SAVE_GAP_MS     2000    // gộp nhiều FPROV_NODE vào 1 lần ghi sổ
+
+typedef enum {
+    DLG_FREE = 0,
+    DLG_SETTING,            // đã gửi SET, chờ STATUS
+    DLG_ACTIVE,
+    DLG_DONE,
+} dlg_state_t;
+
+typedef struct {
+    uint16_t addr;
+    uint16_t min;
+    uint16_t max;
+    uint8_t  state;
+    uint8_t  tries;
+    uint8_t  count;         // tag delegate báo (STATUS)
+    uint32_t t_ms;          // SETTING: lần gửi SET gần nhất
+} dlg_t;
+
+typedef struct {
+    uint16_t addr;
+    uint16_t via;
+    uint8_t  elems;
+    uint8_t  uuid[16];
+} __attribute__((packed)) reg_t;
+
+static fprov_mgr_ops_t    s_ops;
+static SemaphoreHandle_t  s_lock;
+static TaskHandle_t       s_task;
+static dlg_t              s_dlg[FPROV_MGR_DELEGATES_MAX];
+static reg_t              s_reg[FPROV_MGR_REGISTRY_MAX];
+static fprov_mgr_stats_t  s_stats;
+static uint16_t           s_duration_s;
+static uint32_t           s_round_start_ms;     // 0 = không có đợt
+static uint32_t           s_round_end_ms;
+static bool               s_dirty;
+static uint32_t           s_dirty_ms;
+
+static uint32_t now_ms(void) {
+    uint32_t t = (uint32_t)(esp_timer_get_time() / 1000);
+    return t ? t : 1;
+}
+
+// ============ NVS ============
+static void save(void) {
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    nvs_set_u16(h, "next", s_stats.next_addr);
+    if (s_stats.registry) nvs_set_blob(h, "reg", s_reg, s_stats.registry * sizeof(reg_t));
+    xSemaphoreGive(s_lock);
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+static void load(void) {
+    nvs_handle_t h;
+    s_stats.next_addr = FPROV_MGR_ADDR_BASE;
+    if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK) return;
+    nvs_get_u16(h, "next", &s_stats.next_addr);
+    size_t len = sizeof(s_reg);
+    if (nvs_get_blob(h, "reg", s_reg, &len) == ESP_OK) {
+        s_stats.registry = (uint16_t)(len / sizeof(reg_t));
+    }
+    nvs_close(h);
+    ESP_LOGI(TAG, "%u tags onboarded via delegates, next range 0x%04x",
+             s_stats.registry, s_stats.next_addr);
+}
+
+// ============ Delegate ============
+static dlg_t *dlg_find(uint16_t addr) {
+    for (int i = 0; i < FPROV_MGR_DELEGATES_MAX; ++i) {
+        if (s_dlg[i].state != DLG_FREE && s_dlg[i].addr == addr) return &s_dlg[i];
+    }
+    return NULL;
+}
+
+static int reg_find(uint16_t addr) {
+    for (uint16_t i = 0; i < s_stats.registry; ++i) {
+        if (s_reg[i].addr == addr) return i;
+    }
+    return -1;
+}
+
+static void pack_set(const dlg_t *d, uint16_t duration_s, uint8_t out[EP_FPROV_SET_LEN]) {
+    ep_put_le16(&out[0], d->min);
+    ep_put_le16(&out[2], d->max);
+    ep_put_le16(&out[4], duration_s);
+}
+
+// ============ Task ============
+static void fprov_mgr_task(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TICK_MS));
+        uint32_t now = now_ms();
+
+        // ---- SET chưa có STATUS: gửi lại ----
+        for (int i = 0; i < FPROV_MGR_DELEGATES_MAX; ++i) {
+            uint8_t  set[EP_FPROV_SET_LEN];
+            uint16_t dst = 0;
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            dlg_t *d = &s_dlg[i];
+            if (d->state == DLG_SETTING && now - d->t_ms >= FPROV_MGR_SET_RETRY_MS) {
+                if (d->tries >= FPROV_MGR_SET_TRIES) {
+                    ESP_LOGW(TAG, "0x%04x: no reply to SET, range 0x%04x-0x%04x unused",
+                             d->addr, d->min, d->max);
+                    ++s_stats.lost;
+                    d->state = DLG_DONE;
+                } else {
+                    ++d->tries;
+                    d->t_ms = now;
+                    pack_set(d, s_duration_s, set);
+                    dst = d->addr;
+                }
+            }
+            xSemaphoreGive(s_lock);
+            if (dst) s_ops.send(dst, EP_VND_OP_FPROV_SET, set, sizeof(set));
+        }
+
+        // ---- kết thúc đợt: mọi delegate xong, hoặc quá hạn + grace ----
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_round_start_ms) {
+            uint8_t active = 0;
+            for (int i = 0; i < FPROV_MGR_DELEGATES_MAX; ++i) {
+                active += (s_dlg[i].state == DLG_SETTING || s_dlg[i].state == DLG_ACTIVE) ? 1 : 0;
+            }
+            s_stats.active = active;
+            if (!active || (int32_t)(now - s_round_end_ms) >= 0) {
+                uint32_t ms = now - s_round_start_ms;
+                s_stats.round_ms = ms;
+                ESP_LOGI(TAG, "round done: %" PRIu32 " tags in %" PRIu32 " s (%" PRIu32 " tags/min), "
+                         "%u delegates still running",
+                         s_stats.round_tags, ms / 1000,
+                         ms ? (uint32_t)((uint64_t)s_stats.round_tags * 60000 / ms) : 0, active);
+                memset(s_dlg, 0, sizeof(s_dlg));
+                s_stats.active   = 0;
+                s_round_start_ms = 0;
+            }
+        }
+        bool save_now = s_dirty && now - s_dirty_ms >= SAVE_GAP_MS;
+        if (save_now) s_dirty = false;
+        xSemaphoreGive(s_lock);
+        if (save_now) save();
+    }
+}
+
+// ============ API ============
+esp_err_t fprov_mgr_init(const fprov_mgr_ops_t *ops) {
+    if (!ops || !ops->send) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_ops  = *ops;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    load();
+    if (xTaskCreate(fprov_mgr_task, "fprov_mgr", 3072, NULL, 3, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t fprov_mgr_start(const uint16_t *delegates, uint8_t n, uint16_t duration_s) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (!delegates || !n) return ESP_ERR_INVALID_ARG;
+    if (!duration_s) duration_s = FPROV_MGR_DURATION_S;
+    if (n > FPROV_MGR_DELEGATES_MAX) n = FPROV_MGR_DELEGATES_MAX;
+
+    uint8_t  set[FPROV_MGR_DELEGATES_MAX][EP_FPROV_SET_LEN];
+    uint16_t dst[FPROV_MGR_DELEGATES_MAX];
+    uint8_t  k = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_round_start_ms) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t now = now_ms();
+    memset(s_dlg, 0, sizeof(s_dlg));
+    for (uint8_t i = 0; i < n; ++i) {
+        uint32_t lo = s_stats.next_addr;
+        uint32_t hi = lo + FPROV_MGR_RANGE - 1;
+        if (hi > FPROV_MGR_ADDR_END) {
+            ESP_LOGE(TAG, "delegate address space exhausted at 0x%04" PRIx32, lo);
+            break;
+        }
+        dlg_t *d = &s_dlg[k];
+        d->addr  = delegates[i];
+        d->min   = (uint16_t)lo;
+        d->max   = (uint16_t)hi;
+        d->state = DLG_SETTING;
+        d->tries = 1;
+        d->t_ms  = now;
+        pack_set(d, duration_s, set[k]);
+        dst[k++] = d->addr;
+        s_stats.next_addr = (uint16_t)(hi + 1);
+    }
+    if (k) {
+        s_duration_s     = duration_s;
+        s_round_start_ms = now;
+        s_round_end_ms   = now + (uint32_t)duration_s * 1000 + FPROV_MGR_DONE_GRACE_MS;
+        s_stats.round_tags = 0;
+        s_stats.round_ms   = 0;
+        s_stats.active     = k;
+    }
+    xSemaphoreGive(s_lock);
+    if (!k) return ESP_ERR_NO_MEM;
+
+    // dải đã cấp phải bền trước khi delegate kịp dùng
+    save();
+    for (uint8_t i = 0; i < k; ++i) {
+        ESP_LOGI(TAG, "delegate 0x%04x: range 0x%04x-0x%04x, %u s",
+                 dst[i], ep_get_le16(&set[i][0]), ep_get_le16(&set[i][2]), duration_s);
+        s_ops.send(dst[i], EP_VND_OP_FPROV_SET, set[i], EP_FPROV_SET_LEN);
+    }
+    return ESP_OK;
+}
+
+void fprov_mgr_on_status(uint16_t src, const uint8_t *msg, uint16_t len) {
+    if (!s_lock || !msg || len < EP_FPROV_STATUS_LEN) return;
+    uint8_t  state = msg[0];
+    uint8_t  count = msg[1];
+    uint16_t next  = ep_get_le16(&msg[2]);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    dlg_t *d = dlg_find(src);
+    if (!d) {
+        xSemaphoreGive(s_lock);
+        return;     // đợt cũ / không phải delegate
+    }
+    if (state == EP_FPROV_ST_ACTIVE && d->state == DLG_SETTING) {
+        d->state = DLG_ACTIVE;
+        ++s_stats.sessions;
+    } else if (state == EP_FPROV_ST_REJECTED && d->state != DLG_DONE) {
+        ESP_LOGW(TAG, "0x%04x rejected range 0x%04x-0x%04x", src, d->min, d->max);
+        d->state = DLG_DONE;
+        ++s_stats.rejected;
+    } else if (state == EP_FPROV_ST_DONE && d->state != DLG_DONE) {
+        d->state = DLG_DONE;
+        d->count = count;
+        ESP_LOGI(TAG, "0x%04x done: %u tags, used 0x%04x-0x%04x", src, count, d->min,
+                 next > d->min ? next - 1 : d->min);
+    }
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_task);
+}
+
+void fprov_mgr_on_node(uint16_t src, const uint8_t *msg, uint16_t len) {
+    if (!s_lock || !msg || len < EP_FPROV_NODE_LEN) return;
+    uint16_t addr  = ep_get_le16(&msg[0]);
+    uint8_t  elems = msg[2];
+    const uint8_t *uuid = &msg[3];
+    bool     fresh = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    dlg_t *d = dlg_find(src);
+    int    r = reg_find(addr);
+    if (r >= 0) {
+        ++s_stats.duplicates;       // ACK trước bị mất: ACK lại
+    } else if (d && addr >= d->min && addr <= d->max) {
+        if (d->state == DLG_SETTING) {
+            d->state = DLG_ACTIVE;      // STATUS ACTIVE bị mất
+            ++s_stats.sessions;
+        }
+        if (s_stats.registry < FPROV_MGR_REGISTRY_MAX) {
+            reg_t *e = &s_reg[s_stats.registry++];
+            e->addr  = addr;
+            e->via   = src;
+            e->elems = elems;
+            memcpy(e->uuid, uuid, 16);
+            ++s_stats.onboarded;
+            ++s_stats.round_tags;
+            s_dirty    = true;
+            s_dirty_ms = now_ms();
+            fresh = true;
+        } else {
+            ESP_LOGE(TAG, "registry full, 0x%04x not recorded", addr);
+        }
+    } else {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "0x%04x reported 0x%04x outside its range", src, addr);
+        return;     // không ACK: delegate lạ hoặc dải sai
+    }
+    xSemaphoreGive(s_lock);
+
+    uint8_t ack[EP_FPROV_NODE_ACK_LEN];
+    ep_put_le16(ack, addr);
+    s_ops.send(src, EP_VND_OP_FPROV_NODE_ACK, ack, sizeof(ack));
+    if (fresh) {
+        ESP_LOGI(TAG, "0x%04x onboarded via 0x%04x (%u elements)", addr, src, elems);
+        if (s_ops.onboarded) s_ops.onboarded(addr, elems, uuid, src);
+    }
+}
+
+size_t fprov_mgr_registered(uint16_t *out, size_t max) {
+    size_t n = 0;
+    if (!s_lock || !out) return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < s_stats.registry && n < max; ++i) out[n++] = s_reg[i].addr;
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+void fprov_mgr_get_stats(fprov_mgr_stats_t *out) {
+    if (!out) return;
+    if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    if (s_lock) xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,85 @@
+#ifndef __FPROV_MGR_H
+#define __FPROV_MGR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Fast provisioning qua tag (phía gateway): giao cho vài tag đã provision
+// (delegate) mỗi tag 1 dải unicast riêng, tag đó làm provisioner tạm cho các
+// tag mới trong tầm sóng của nó (kể cả ngoài tầm gateway) và báo từng tag
+// mới về đây (EP_VND_OP_FPROV_*, ep_proto.h). Nhiều delegate chạy song song
+// nên thời gian nhận cả cửa hàng gần như không tăng theo diện tích.
+//  - dải cấp tăng dần từ FPROV_MGR_ADDR_BASE, con trỏ lưu NVS: không cấp
+//    trùng sau reboot; phần dải delegate không dùng hết bị bỏ qua
+//  - sổ tag mới (địa chỉ, UUID, delegate) lưu NVS; gateway không có device
+//    key của các tag này nên chỉ nói chuyện với chúng qua AppKey
+//  - SET không có STATUS -> gửi lại, quá FPROV_MGR_SET_TRIES thì bỏ delegate
+
+// ============ Config ============
+#ifndef FPROV_MGR_ADDR_BASE
+#define FPROV_MGR_ADDR_BASE         0x0400  // gateway tự cấp 0x0005.. (CONFIG_BLE_MESH_MAX_PROV_NODES)
+#endif
+#ifndef FPROV_MGR_ADDR_END
+#define FPROV_MGR_ADDR_END          0x7FFF
+#endif
+#ifndef FPROV_MGR_RANGE
+#define FPROV_MGR_RANGE             16      // = FPROV_NODES_MAX phía tag
+#endif
+#ifndef FPROV_MGR_DELEGATES_MAX
+#define FPROV_MGR_DELEGATES_MAX     8
+#endif
+#ifndef FPROV_MGR_REGISTRY_MAX
+#define FPROV_MGR_REGISTRY_MAX      256
+#endif
+#ifndef FPROV_MGR_DURATION_S
+#define FPROV_MGR_DURATION_S        300
+#endif
+#ifndef FPROV_MGR_SET_RETRY_MS
+#define FPROV_MGR_SET_RETRY_MS      3000
+#endif
+#ifndef FPROV_MGR_SET_TRIES
+#define FPROV_MGR_SET_TRIES         5
+#endif
+#ifndef FPROV_MGR_DONE_GRACE_MS
+#define FPROV_MGR_DONE_GRACE_MS     60000   // sau hạn phiên chờ STATUS DONE thêm
+#endif
+
+typedef struct {
+    // vendor message tới delegate (không chờ phản hồi: STATUS / NODE tới dạng publish)
+    esp_err_t (*send)(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len);
+    // tag mới vào sổ lần đầu
+    void      (*onboarded)(uint16_t addr, uint8_t elems, const uint8_t uuid[16], uint16_t via);
+} fprov_mgr_ops_t;
+
+typedef struct {
+    uint32_t sessions;          // delegate đã nhận dải (STATUS ACTIVE)
+    uint32_t rejected;
+    uint32_t lost;              // SET không có phản hồi
+    uint32_t onboarded;
+    uint32_t duplicates;        // FPROV_NODE lặp (ACK bị mất)
+    uint16_t registry;          // tag trong sổ
+    uint16_t next_addr;         // đầu dải kế tiếp
+    uint8_t  active;            // delegate đang chạy
+    // đợt gần nhất
+    uint32_t round_tags;
+    uint32_t round_ms;
+} fprov_mgr_stats_t;
+
+esp_err_t fprov_mgr_init(const fprov_mgr_ops_t *ops);
+
+// Mở 1 đợt: mỗi delegate 1 dải FPROV_MGR_RANGE, chạy duration_s giây.
+// Trả ESP_ERR_INVALID_STATE nếu đợt trước chưa xong.
+esp_err_t fprov_mgr_start(const uint16_t *delegates, uint8_t n, uint16_t duration_s);
+
+// Vendor message từ delegate (callback mesh)
+void      fprov_mgr_on_status(uint16_t src, const uint8_t *msg, uint16_t len);
+void      fprov_mgr_on_node(uint16_t src, const uint8_t *msg, uint16_t len);
+
+// Tag trong sổ (delegate cho đợt sau). Trả số địa chỉ ghi vào out.
+size_t    fprov_mgr_registered(uint16_t *out, size_t max);
+
+void      fprov_mgr_get_stats(fprov_mgr_stats_t *out);
+
+#endif
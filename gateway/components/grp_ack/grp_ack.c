@@ -0,0 +1,480 @@
+#include "grp_ack.h"
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "ep_proto.h"
+#include "relay_mgr.h"
+
+static const char *TAG = "grp_ack";
+
+#define NVS_NS              "grp_ack"
+#define PAYLOAD_MAX         120
+#define JOIN_TIMEOUT_MS     6000    // Sub Add không có status -> sang node kế
+#define JOIN_PASSES         3
+#define REPAIR_BURST        3       // unicast bù mỗi nhịp task (~12/s, hợp bucket mesh_tx)
+#define BITMAP_BYTES        (GRP_ACK_MAX_MEMBERS / 8)
+
+typedef struct {
+    uint16_t group;                         // 0 = slot trống
+    uint16_t n;                             // chỉ thêm vào cuối: index ổn định cho bitmap phiên
+    uint16_t addr[GRP_ACK_MAX_MEMBERS];
+    uint8_t  joined[BITMAP_BYTES];          // đã có Sub Add status OK
+    uint16_t join_cursor;
+    uint8_t  join_pass;
+} grp_t;
+
+typedef enum {
+    SES_FREE = 0,
+    SES_WINDOW,             // chờ STATUS theo slot
+    SES_REPAIR,             // đang/đã gửi unicast bù, chờ STATUS
+    SES_DONE,               // đủ xác nhận, task sẽ đóng phiên
+} ses_phase_t;
+
+typedef struct {
+    uint8_t  phase;
+    uint8_t  prio;
+    uint8_t  rounds;
+    uint8_t  slots_log;
+    uint8_t  g;                             // index trong s_grp
+    uint16_t group;
+    uint16_t tid;
+    uint16_t len;
+    uint16_t expected;
+    uint16_t n_slotted;
+    uint16_t n_repair;
+    uint16_t unicasts;
+    uint16_t cursor;                        // vị trí quét thành viên thiếu khi bù
+    uint32_t start_ms;
+    uint32_t deadline_ms;                   // 0 = đang gửi bù, chưa đặt hạn
+    uint32_t last_ack_ms;
+    uint32_t pdus;
+    uint8_t  want[BITMAP_BYTES];
+    uint8_t  acked[BITMAP_BYTES];
+    uint8_t  payload[PAYLOAD_MAX];
+} session_t;
+
+static grp_ack_ops_t      s_ops;
+static SemaphoreHandle_t  s_lock;
+static TaskHandle_t       s_task;
+static grp_t              s_grp[GRP_ACK_MAX_GROUPS];
+static session_t          s_ses[GRP_ACK_MAX_SESSIONS];
+static grp_ack_report_t   s_report;
+static bool               s_has_report;
+
+// Sub Add đang chờ status
+static uint16_t           s_join_node;
+static uint16_t           s_join_group;
+static uint32_t           s_join_sent_ms;
+
+static uint16_t           s_nvs_buf[1 + GRP_ACK_MAX_MEMBERS];    // không đặt 1 KB lên stack BTC
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static bool bit_get(const uint8_t *bm, uint16_t i) { return bm[i >> 3] & (1u << (i & 7)); }
+static void bit_set(uint8_t *bm, uint16_t i)       { bm[i >> 3] |= (uint8_t)(1u << (i & 7)); }
+
+// Số network PDU của 1 access message (opcode 3B + TransMIC 4B, 12B/segment)
+static uint16_t pdu_count(uint16_t len) {
+    uint16_t total = (uint16_t)(len + 3 + 4);
+    return total <= 15 ? 1 : (uint16_t)((total + 11) / 12);
+}
+
+// ============ Thành viên nhóm ============
+static int grp_find(uint16_t group) {
+    for (int i = 0; i < GRP_ACK_MAX_GROUPS; ++i) {
+        if (s_grp[i].group == group) return i;
+    }
+    return -1;
+}
+
+static int member_find(const grp_t *g, uint16_t addr) {
+    for (uint16_t i = 0; i < g->n; ++i) {
+        if (g->addr[i] == addr) return i;
+    }
+    return -1;
+}
+
+static uint16_t joined_count(const grp_t *g) {
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < g->n; ++i) n += bit_get(g->joined, i) ? 1 : 0;
+    return n;
+}
+
+static void save_group(int gi) {
+    grp_t       *g = &s_grp[gi];
+    uint16_t    *buf = s_nvs_buf;
+    uint16_t     n = 0;
+    char         key[8];
+    nvs_handle_t h;
+
+    buf[n++] = g->group;
+    for (uint16_t i = 0; i < g->n; ++i) {
+        if (bit_get(g->joined, i)) buf[n++] = g->addr[i];
+    }
+    snprintf(key, sizeof(key), "g%d", gi);
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+    if (g->group) nvs_set_blob(h, key, buf, n * sizeof(uint16_t));
+    else          nvs_erase_key(h, key);
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+static void load_groups(void) {
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK) return;
+    for (int gi = 0; gi < GRP_ACK_MAX_GROUPS; ++gi) {
+        uint16_t *buf = s_nvs_buf;
+        size_t    len = sizeof(s_nvs_buf);
+        char      key[8];
+        snprintf(key, sizeof(key), "g%d", gi);
+        if (nvs_get_blob(h, key, buf, &len) != ESP_OK || len < sizeof(uint16_t)) continue;
+
+        grp_t *g = &s_grp[gi];
+        g->group = buf[0];
+        g->n     = (uint16_t)(len / sizeof(uint16_t) - 1);
+        memcpy(g->addr, &buf[1], g->n * sizeof(uint16_t));
+        memset(g->joined, 0xFF, sizeof(g->joined));
+        g->join_pass = JOIN_PASSES;
+        ESP_LOGI(TAG, "group 0x%04x: %u members", g->group, g->n);
+    }
+    nvs_close(h);
+}
+
+// Node kế tiếp cần Sub Add (chưa joined), theo vòng; false nếu không còn.
+static bool join_next(uint16_t *node, uint16_t *group) {
+    for (int gi = 0; gi < GRP_ACK_MAX_GROUPS; ++gi) {
+        grp_t *g = &s_grp[gi];
+        while (g->group && g->join_pass < JOIN_PASSES) {
+            if (g->join_cursor >= g->n) {
+                g->join_cursor = 0;
+                ++g->join_pass;
+                continue;
+            }
+            uint16_t i = g->join_cursor++;
+            if (!bit_get(g->joined, i)) {
+                *node  = g->addr[i];
+                *group = g->group;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// ============ Phiên ============
+static void fill_report(const session_t *s, uint32_t now) {
+    relay_mgr_report_t rr;
+    uint32_t per_pdu = GRP_ACK_PDU_AIRTIME_US;
+    if (relay_mgr_last_report(&rr) && rr.airtime_after_us) per_pdu = rr.airtime_after_us;
+
+    grp_ack_report_t *r = &s_report;
+    memset(r, 0, sizeof(*r));
+    r->group         = s->group;
+    r->tid           = s->tid;
+    r->members       = s->expected;
+    r->acked_slotted = s->n_slotted;
+    r->acked_repair  = s->n_repair;
+    r->missing       = (uint16_t)(s->expected - s->n_slotted - s->n_repair);
+    r->unicasts      = s->unicasts;
+    r->repair_rounds = s->rounds;
+    r->slots_log     = s->slots_log;
+    r->window_ms     = ep_gack_window_ms(s->slots_log);
+    r->confirm_ms    = (r->missing ? now : s->last_ack_ms) - s->start_ms;
+    r->pdus          = s->pdus;
+    r->airtime_us    = s->pdus * per_pdu;
+    s_has_report     = true;
+}
+
+static uint16_t missing_count(const session_t *s) {
+    return (uint16_t)(s->expected - s->n_slotted - s->n_repair);
+}
+
+// Chuẩn bị tối đa REPAIR_BURST đích unicast bù; trả số đích.
+static int repair_pick(session_t *s, uint16_t *out) {
+    const grp_t *g = &s_grp[s->g];
+    int n = 0;
+    while (n < REPAIR_BURST && s->cursor < g->n) {
+        uint16_t i = s->cursor++;
+        if (bit_get(s->want, i) && !bit_get(s->acked, i)) out[n++] = g->addr[i];
+    }
+    return n;
+}
+
+// ============ Task ============
+typedef struct {
+    uint16_t group, tid, missing;
+} done_evt_t;
+
+static void grp_ack_task(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GRP_ACK_JOIN_GAP_MS));
+
+        uint32_t   now = now_ms();
+        done_evt_t done[GRP_ACK_MAX_SESSIONS];
+        int        n_done = 0;
+        uint16_t   rep_dst[GRP_ACK_MAX_SESSIONS][REPAIR_BURST];
+        int        rep_n[GRP_ACK_MAX_SESSIONS] = {0};
+        uint8_t    rep_buf[GRP_ACK_MAX_SESSIONS][PAYLOAD_MAX];
+        uint16_t   rep_len[GRP_ACK_MAX_SESSIONS];
+        uint8_t    rep_prio[GRP_ACK_MAX_SESSIONS];
+        uint16_t   join_node = 0, join_group = 0;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int k = 0; k < GRP_ACK_MAX_SESSIONS; ++k) {
+            session_t *s = &s_ses[k];
+            if (s->phase == SES_FREE) continue;
+
+            bool expired = s->deadline_ms && (int32_t)(now - s->deadline_ms) >= 0;
+            if (s->phase == SES_DONE ||
+                (expired && (missing_count(s) == 0 || s->rounds >= GRP_ACK_MAX_REPAIR))) {
+                fill_report(s, now);
+                ESP_LOGI(TAG, "group 0x%04x tid 0x%04x: %u/%u in window, %u repaired, %u missing, "
+                         "%u unicast, %" PRIu32 " ms, ~%" PRIu32 " PDU / %" PRIu32 " us airtime",
+                         s_report.group, s_report.tid, s_report.acked_slotted, s_report.members,
+                         s_report.acked_repair, s_report.missing, s_report.unicasts,
+                         s_report.confirm_ms, s_report.pdus, s_report.airtime_us);
+                done[n_done++] = (done_evt_t){ s->group, s->tid, s_report.missing };
+                s->phase = SES_FREE;
+                continue;
+            }
+            if (expired) {
+                // hết cửa sổ / hết hạn vòng bù trước -> vòng bù mới cho tag còn thiếu
+                s->phase       = SES_REPAIR;
+                s->deadline_ms = 0;
+                s->cursor      = 0;
+                ++s->rounds;
+                ESP_LOGI(TAG, "group 0x%04x: repair round %u, %u missing",
+                         s->group, s->rounds, missing_count(s));
+            }
+            if (s->phase == SES_REPAIR && s->deadline_ms == 0) {
+                rep_n[k] = repair_pick(s, rep_dst[k]);
+                if (rep_n[k]) {
+                    memcpy(rep_buf[k], s->payload, s->len);
+                    rep_len[k]  = s->len;
+                    rep_prio[k] = s->prio;
+                } else {
+                    s->deadline_ms = now + GRP_ACK_REPAIR_MS;
+                }
+            }
+        }
+
+        if (s_join_node && now - s_join_sent_ms >= JOIN_TIMEOUT_MS) {
+            ESP_LOGW(TAG, "0x%04x: no Sub Add status for 0x%04x", s_join_node, s_join_group);
+            s_join_node = 0;
+        }
+        if (!s_join_node && join_next(&join_node, &join_group)) {
+            s_join_node    = join_node;
+            s_join_group   = join_group;
+            s_join_sent_ms = now;
+        }
+        xSemaphoreGive(s_lock);
+
+        // gửi ngoài lock: callback status của stack cũng lấy lock
+        for (int k = 0; k < GRP_ACK_MAX_SESSIONS; ++k) {
+            for (int j = 0; j < rep_n[k]; ++j) {
+                esp_err_t err = s_ops.send(rep_dst[k][j], rep_buf[k], rep_len[k], false, rep_prio[k]);
+                xSemaphoreTake(s_lock, portMAX_DELAY);
+                session_t *s = &s_ses[k];
+                if (s->phase == SES_REPAIR && s->len == rep_len[k] &&
+                    memcmp(s->payload, rep_buf[k], rep_len[k]) == 0) {
+                    if (err == ESP_OK) {
+                        ++s->unicasts;
+                        s->pdus += pdu_count(rep_len[k]);
+                    } else {
+                        // hàng mesh_tx đầy: lùi con trỏ, nhịp sau gửi lại từ đây
+                        const grp_t *g = &s_grp[s->g];
+                        int i = member_find(g, rep_dst[k][j]);
+                        if (i >= 0 && i < s->cursor) s->cursor = (uint16_t)i;
+                    }
+                }
+                xSemaphoreGive(s_lock);
+                if (err != ESP_OK) break;
+            }
+        }
+        if (join_node && s_ops.sub_add(join_node, join_group) != ESP_OK) {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            if (s_join_node == join_node) s_join_node = 0;
+            xSemaphoreGive(s_lock);
+        }
+        for (int i = 0; i < n_done; ++i) {
+            if (s_ops.done) s_ops.done(done[i].group, done[i].tid, done[i].missing);
+        }
+    }
+}
+
+// ============ API ============
+esp_err_t grp_ack_init(const grp_ack_ops_t *ops) {
+    if (!ops || !ops->sub_add || !ops->send) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_ops  = *ops;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    load_groups();
+    if (xTaskCreate(grp_ack_task, "grp_ack", 4096, NULL, 3, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t grp_ack_join(uint16_t group, const uint16_t *nodes, uint16_t n) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (group < 0xC000 || group >= 0xFF00 || (!nodes && n)) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int gi = grp_find(group);
+    if (gi < 0) {
+        gi = grp_find(0);
+        if (gi < 0) {
+            xSemaphoreGive(s_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        memset(&s_grp[gi], 0, sizeof(s_grp[gi]));
+        s_grp[gi].group = group;
+    }
+    grp_t *g = &s_grp[gi];
+    for (uint16_t k = 0; k < n; ++k) {
+        if (nodes[k] == 0 || nodes[k] >= 0x8000 || member_find(g, nodes[k]) >= 0) continue;
+        if (g->n >= GRP_ACK_MAX_MEMBERS) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        g->addr[g->n++] = nodes[k];
+    }
+    g->join_cursor = 0;
+    g->join_pass   = 0;
+    ESP_LOGI(TAG, "group 0x%04x: %u members (%u joined)", group, g->n, joined_count(g));
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void grp_ack_on_sub_status(uint16_t node, uint16_t group, bool ok) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_join_node == node && s_join_group == group) s_join_node = 0;
+    int gi = grp_find(group);
+    int i  = gi >= 0 ? member_find(&s_grp[gi], node) : -1;
+    if (i >= 0 && ok && !bit_get(s_grp[gi].joined, (uint16_t)i)) {
+        bit_set(s_grp[gi].joined, (uint16_t)i);
+        save_group(gi);
+    } else if (i >= 0 && !ok) {
+        ESP_LOGW(TAG, "0x%04x refused group 0x%04x", node, group);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+uint16_t grp_ack_members(uint16_t group) {
+    if (!s_lock) return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int      gi = grp_find(group);
+    uint16_t n  = gi >= 0 ? joined_count(&s_grp[gi]) : 0;
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+uint8_t grp_ack_slots_log(uint16_t group) {
+    return ep_gack_slots_log(grp_ack_members(group));
+}
+
+esp_err_t grp_ack_start(uint16_t group, uint16_t tid, const uint8_t *payload, uint16_t len, uint8_t prio) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (!payload || len == 0 || len > PAYLOAD_MAX) return ESP_ERR_INVALID_ARG;
+    uint16_t gack = ep_send_gack_off(payload, len);
+    if (!gack) return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int gi = grp_find(group);
+    if (gi < 0 || joined_count(&s_grp[gi]) == 0) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    // lệnh mới thay phiên cũ cùng group; không thì lấy slot trống
+    session_t *s = NULL;
+    for (int k = 0; k < GRP_ACK_MAX_SESSIONS && !s; ++k) {
+        if (s_ses[k].phase != SES_FREE && s_ses[k].group == group) s = &s_ses[k];
+    }
+    for (int k = 0; k < GRP_ACK_MAX_SESSIONS && !s; ++k) {
+        if (s_ses[k].phase == SES_FREE) s = &s_ses[k];
+    }
+    if (!s) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    if (s->phase != SES_FREE) {
+        ESP_LOGI(TAG, "group 0x%04x: tid 0x%04x superseded (%u missing)",
+                 group, s->tid, missing_count(s));
+    }
+
+    const grp_t *g = &s_grp[gi];
+    uint32_t now = now_ms();
+    memset(s, 0, sizeof(*s));
+    memcpy(s->want, g->joined, sizeof(s->want));
+    s->expected    = joined_count(g);
+    s->g           = (uint8_t)gi;
+    s->group       = group;
+    s->tid         = tid;
+    s->prio        = prio;
+    s->len         = len;
+    s->slots_log   = payload[gack];
+    s->start_ms    = now;
+    s->deadline_ms = now + ep_gack_window_ms(s->slots_log) + GRP_ACK_GRACE_MS;
+    s->pdus        = pdu_count(len);
+    s->phase       = SES_WINDOW;
+    memcpy(s->payload, payload, len);
+    xSemaphoreGive(s_lock);
+
+    esp_err_t err = s_ops.send(group, payload, len, true, prio);
+    if (err != ESP_OK) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s->group == group && s->tid == tid) s->phase = SES_FREE;
+        xSemaphoreGive(s_lock);
+    }
+    return err;
+}
+
+bool grp_ack_on_status(uint16_t src, uint16_t tid) {
+    if (!s_lock) return false;
+    bool hit = false, notify = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int k = 0; k < GRP_ACK_MAX_SESSIONS; ++k) {
+        session_t *s = &s_ses[k];
+        if (s->phase == SES_FREE || s->phase == SES_DONE || s->tid != tid) continue;
+        int i = member_find(&s_grp[s->g], src);
+        if (i < 0 || !bit_get(s->want, (uint16_t)i)) continue;
+        hit = true;
+        ++s->pdus;
+        if (bit_get(s->acked, (uint16_t)i)) continue;
+        bit_set(s->acked, (uint16_t)i);
+        if (s->phase == SES_WINDOW) ++s->n_slotted;
+        else                        ++s->n_repair;
+        s->last_ack_ms = now_ms();
+        if (missing_count(s) == 0) {
+            s->phase = SES_DONE;
+            notify   = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (notify) xTaskNotifyGive(s_task);
+    return hit;
+}
+
+bool grp_ack_last_report(grp_ack_report_t *out) {
+    if (!s_lock || !out) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_has_report;
+    if (ok) *out = s_report;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
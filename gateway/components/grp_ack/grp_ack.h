@@ -0,0 +1,89 @@
+#ifndef __GRP_ACK_H
+#define __GRP_ACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Lệnh giá gửi tới group address (nhiều tag cùng hiển thị 1 sản phẩm).
+//
+// Tránh "ACK implosion": gói SEND mang byte GACK (ep_proto.h), mỗi tag trả
+// STATUS trễ theo slot của mình. Gateway gom STATUS vào bitmap theo thành
+// viên; hết cửa sổ slot (+ grace) thì chỉ gửi unicast lại cho tag còn thiếu,
+// tối đa GRP_ACK_MAX_REPAIR vòng. Thời gian xác nhận bị chặn trên bởi
+//   window + GRP_ACK_GRACE_MS + GRP_ACK_MAX_REPAIR * GRP_ACK_REPAIR_MS.
+//
+// Thành viên nhóm học từ Config Model Sub Add status (lưu NVS).
+
+// ============ Config ============
+#ifndef GRP_ACK_MAX_GROUPS
+#define GRP_ACK_MAX_GROUPS      8
+#endif
+#ifndef GRP_ACK_MAX_MEMBERS
+#define GRP_ACK_MAX_MEMBERS     512
+#endif
+#ifndef GRP_ACK_MAX_SESSIONS
+#define GRP_ACK_MAX_SESSIONS    4       // lệnh nhóm đang chờ xác nhận cùng lúc
+#endif
+#ifndef GRP_ACK_GRACE_MS
+#define GRP_ACK_GRACE_MS        2000    // hàng đợi mesh_tx + đường đi nhiều hop
+#endif
+#ifndef GRP_ACK_REPAIR_MS
+#define GRP_ACK_REPAIR_MS       4000    // chờ STATUS sau 1 lượt unicast bù
+#endif
+#ifndef GRP_ACK_MAX_REPAIR
+#define GRP_ACK_MAX_REPAIR      3
+#endif
+#ifndef GRP_ACK_JOIN_GAP_MS
+#define GRP_ACK_JOIN_GAP_MS     250     // giãn Config Model Sub Add
+#endif
+#ifndef GRP_ACK_PDU_AIRTIME_US
+#define GRP_ACK_PDU_AIRTIME_US  1128    // 1 network PDU x 3 kênh adv
+#endif
+
+typedef struct {
+    // Config Model Sub Add cho vendor server của node (status -> grp_ack_on_sub_status)
+    esp_err_t (*sub_add)(uint16_t node, uint16_t group);
+    // Gửi gói SEND đã dựng sẵn; group = false: unicast bù (cần phản hồi)
+    esp_err_t (*send)(uint16_t dst, const uint8_t *data, uint16_t len, bool group, uint8_t prio);
+    // Phiên kết thúc: missing = số tag vẫn chưa xác nhận
+    void      (*done)(uint16_t group, uint16_t tid, uint16_t missing);
+} grp_ack_ops_t;
+
+typedef struct {
+    uint16_t group;
+    uint16_t tid;
+    uint16_t members;
+    uint16_t acked_slotted;     // trả lời trong cửa sổ slot
+    uint16_t acked_repair;      // trả lời sau unicast bù
+    uint16_t missing;
+    uint16_t unicasts;
+    uint8_t  repair_rounds;
+    uint8_t  slots_log;
+    uint32_t window_ms;
+    uint32_t confirm_ms;        // start -> STATUS cuối cùng (hoặc hết hạn)
+    uint32_t pdus;              // network PDU đã phát + nhận (ước lượng)
+    uint32_t airtime_us;        // pdus x airtime x (1 + số relay)
+} grp_ack_report_t;
+
+esp_err_t grp_ack_init(const grp_ack_ops_t *ops);
+
+// Xếp Config Model Sub Add cho các node (giãn GRP_ACK_JOIN_GAP_MS).
+esp_err_t grp_ack_join(uint16_t group, const uint16_t *nodes, uint16_t n);
+void      grp_ack_on_sub_status(uint16_t node, uint16_t group, bool ok);
+
+uint16_t  grp_ack_members(uint16_t group);
+// log2(số slot) gateway ghi vào byte GACK cho nhóm này.
+uint8_t   grp_ack_slots_log(uint16_t group);
+
+// payload: gói SEND đầy đủ (đã có byte GACK). Gửi group rồi theo dõi xác nhận.
+// Lệnh mới cho cùng group thay phiên cũ (latest wins).
+esp_err_t grp_ack_start(uint16_t group, uint16_t tid, const uint8_t *payload, uint16_t len, uint8_t prio);
+
+// STATUS từ tag (phản hồi hoặc publish: lệnh group gửi không chờ phản hồi nên
+// STATUS trễ theo slot tới dạng publish); true nếu thuộc một phiên nhóm đang chờ.
+bool      grp_ack_on_status(uint16_t src, uint16_t tid);
+
+bool      grp_ack_last_report(grp_ack_report_t *out);
+
+#endif
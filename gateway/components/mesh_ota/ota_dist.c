@@ -0,0 +1,371 @@
+#include "ota_dist.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+
+#include "ep_proto.h"
+
+static const char *TAG = "ota_dist";
+
+#define OTA_ST_UNKNOWN  0xFF     // target chưa trả lời lần nào
+#define APP_IMAGE_MAGIC 0xE9     // byte đầu của app image ESP
+#define FLASH_SECTOR    4096
+
+typedef enum {
+    OTA_IDLE = 0,
+    OTA_QUERY,                   // chờ STATUS tới deadline
+    OTA_SEND,                    // phát các chunk trong s_need
+    OTA_APPLY,
+} ota_phase_t;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t  status;             // EPOtaStatusCode / OTA_ST_UNKNOWN
+    uint8_t  silent;             // số vòng liên tiếp không trả lời
+    bool     heard;              // trả lời trong vòng hiện tại
+    bool     dropped;
+    uint16_t missing;
+} ota_target_t;
+
+static ota_dist_send_fn_t     s_send;
+static SemaphoreHandle_t      s_lock;
+static TaskHandle_t           s_task;
+
+// image trong partition nodefw
+static const esp_partition_t *s_part;
+static uint32_t               s_size;
+static uint32_t               s_fw_id;
+static bool                   s_stored;
+static uint32_t               s_erased;        // đã xoá [0, s_erased), xoá dần theo fragment
+
+// phiên phân phối
+static ota_phase_t            s_phase;
+static uint16_t               s_n_chunks;
+static uint8_t               *s_need;          // bitmap chunk cần phát lại
+static uint16_t               s_cursor;
+static uint8_t                s_round;
+static uint16_t               s_spread_ms;
+static uint32_t               s_deadline_ms;
+static ota_target_t           s_t[OTA_DIST_MAX_TARGETS];
+static uint16_t               s_n_t;
+static int64_t                s_t_start_us;
+static uint32_t               s_chunks_sent;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static bool status_done(uint8_t st) {
+    return st == EP_OTA_ST_COMPLETE || st == EP_OTA_ST_RUNNING;
+}
+
+// ============ Lưu image ============
+esp_err_t ota_dist_store_begin(uint32_t total) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (!s_part) {
+        s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                          OTA_DIST_PARTITION_LABEL);
+        if (!s_part) {
+            ESP_LOGE(TAG, "partition '%s' not found", OTA_DIST_PARTITION_LABEL);
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+    if (total == 0 || total > s_part->size ||
+        ep_ota_chunk_count(total, EP_OTA_CHUNK_DEFAULT) > EP_OTA_MAX_CHUNKS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool busy = s_phase != OTA_IDLE;
+    if (!busy) {
+        s_stored = false;
+        s_size   = total;
+        s_erased = 0;
+    }
+    xSemaphoreGive(s_lock);
+    if (busy) return ESP_ERR_INVALID_STATE;
+
+    // không xoá cả dải ở đây: ~1.5 MB mất vài giây, chặn caller (MQTT event
+    // handler: keepalive, PUBACK). Mỗi write chỉ xoá các sector nó cần.
+    ESP_LOGI(TAG, "store: %" PRIu32 " B", total);
+    return ESP_OK;
+}
+
+esp_err_t ota_dist_store_write(uint32_t offset, const uint8_t *data, uint32_t len) {
+    if (!s_part || s_stored || !data) return ESP_ERR_INVALID_STATE;
+    if (offset + len > s_size) return ESP_ERR_INVALID_SIZE;
+    uint32_t need = (offset + len + FLASH_SECTOR - 1) & ~(uint32_t)(FLASH_SECTOR - 1);
+    if (need > s_erased) {
+        esp_err_t err = esp_partition_erase_range(s_part, s_erased, need - s_erased);
+        if (err != ESP_OK) return err;
+        s_erased = need;
+    }
+    return esp_partition_write(s_part, offset, data, len);
+}
+
+esp_err_t ota_dist_store_end(void) {
+    if (!s_part || s_stored) return ESP_ERR_INVALID_STATE;
+
+    uint8_t  buf[512];
+    uint32_t h = EP_HASH32_INIT;
+    for (uint32_t off = 0; off < s_size; off += sizeof(buf)) {
+        uint32_t n = s_size - off < sizeof(buf) ? s_size - off : sizeof(buf);
+        esp_err_t err = esp_partition_read(s_part, off, buf, n);
+        if (err != ESP_OK) return err;
+        if (off == 0 && buf[0] != APP_IMAGE_MAGIC) {
+            ESP_LOGE(TAG, "store: not an app image (magic 0x%02x)", buf[0]);
+            return ESP_ERR_INVALID_ARG;
+        }
+        h = ep_hash32_update(h, buf, n);
+    }
+    s_fw_id  = h;
+    s_stored = true;
+    ESP_LOGI(TAG, "store: %" PRIu32 " B, fw_id 0x%08" PRIx32, s_size, s_fw_id);
+    return ESP_OK;
+}
+
+// ============ Phân phối ============
+static void send_start(uint8_t flags) {
+    uint8_t    frame[EP_OTA_START_LEN];
+    EPOtaStart st = {
+        .fw_id      = s_fw_id,
+        .size       = s_size,
+        .chunk_size = EP_OTA_CHUNK_DEFAULT,
+        .flags      = flags,
+        .spread_ms  = s_spread_ms,
+    };
+    ep_ota_pack_start(&st, frame);
+    if (s_send(EP_OTA_GROUP_ADDR, EP_VND_OP_OTA_START, frame, sizeof(frame)) != ESP_OK) {
+        ESP_LOGW(TAG, "START (flags 0x%02x) send failed", flags);
+    }
+}
+
+static void send_chunk(uint16_t idx) {
+    uint8_t  frame[EP_OTA_DATA_HDR_LEN + EP_OTA_CHUNK_DEFAULT];
+    uint32_t off = (uint32_t)idx * EP_OTA_CHUNK_DEFAULT;
+    uint32_t n   = s_size - off < EP_OTA_CHUNK_DEFAULT ? s_size - off : EP_OTA_CHUNK_DEFAULT;
+
+    ep_ota_pack_data_hdr(s_fw_id, idx, frame);
+    if (esp_partition_read(s_part, off, frame + EP_OTA_DATA_HDR_LEN, n) != ESP_OK) {
+        ESP_LOGE(TAG, "read chunk %u failed", idx);
+        return;
+    }
+    // không gửi được -> tag sẽ báo thiếu ở vòng sau
+    s_send(EP_OTA_GROUP_ADDR, EP_VND_OP_OTA_DATA, frame, (uint16_t)(EP_OTA_DATA_HDR_LEN + n));
+    ++s_chunks_sent;
+}
+
+static void finish(const char *why) {
+    uint16_t done = 0, dropped = 0;
+    for (uint16_t i = 0; i < s_n_t; ++i) {
+        if (s_t[i].dropped) {
+            ++dropped;
+            ESP_LOGW(TAG, "  0x%04x dropped (status %u, missing %u)",
+                     s_t[i].addr, s_t[i].status, s_t[i].missing);
+        } else if (status_done(s_t[i].status)) {
+            ++done;
+        }
+    }
+    ESP_LOGI(TAG, "%s: fw 0x%08" PRIx32 " %u/%u tags, %u dropped, %u rounds, "
+             "%" PRIu32 " chunks sent (image %u), %lld s",
+             why, s_fw_id, done, s_n_t, dropped, s_round, s_chunks_sent, s_n_chunks,
+             (esp_timer_get_time() - s_t_start_us) / 1000000);
+    free(s_need);
+    s_need  = NULL;
+    s_phase = OTA_IDLE;
+}
+
+// Mở 1 vòng QUERY; trả false nếu phiên đã kết thúc.
+static bool begin_query(void) {
+    uint16_t active = 0, pending = 0;
+    for (uint16_t i = 0; i < s_n_t; ++i) {
+        if (s_t[i].dropped) continue;
+        ++active;
+        if (!status_done(s_t[i].status)) ++pending;
+        s_t[i].heard = false;
+    }
+    if (active == 0) {
+        finish("failed");
+        return false;
+    }
+    if (pending == 0) {
+        s_phase = OTA_APPLY;
+        return true;
+    }
+    if (s_round >= OTA_DIST_MAX_ROUNDS) {
+        finish("gave up");
+        return false;
+    }
+
+    // giãn khoảng trả lời theo số tag để STATUS không dồn cùng lúc
+    uint32_t spread = (uint32_t)pending * 150;
+    if (spread < EP_OTA_REPLY_SPREAD_MS) spread = EP_OTA_REPLY_SPREAD_MS;
+    if (spread > 60000) spread = 60000;
+    s_spread_ms = (uint16_t)spread;
+
+    send_start(EP_OTA_F_QUERY);
+    s_deadline_ms = now_ms() + spread + OTA_DIST_QUERY_GRACE_MS
+                  + (s_round == 0 ? OTA_DIST_PREPARE_MS : 0);
+    s_phase = OTA_QUERY;
+    ESP_LOGI(TAG, "round %u: query %u/%u tags", s_round, pending, active);
+    return true;
+}
+
+static void end_query(void) {
+    for (uint16_t i = 0; i < s_n_t; ++i) {
+        ota_target_t *t = &s_t[i];
+        if (t->dropped || t->heard || status_done(t->status)) continue;
+        if (++t->silent >= OTA_DIST_MAX_SILENT) {
+            t->dropped = true;
+            ESP_LOGW(TAG, "0x%04x silent for %u rounds, drop", t->addr, t->silent);
+        }
+    }
+    uint16_t need = ep_ota_map_count(s_need, s_n_chunks, true);
+    ESP_LOGI(TAG, "round %u: resend %u/%u chunks", s_round, need, s_n_chunks);
+    ++s_round;
+    s_cursor = 0;
+    s_phase  = OTA_SEND;
+}
+
+static void ota_dist_task(void *arg) {
+    for (;;) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        ota_phase_t phase = s_phase;
+        xSemaphoreGive(s_lock);
+
+        switch (phase) {
+        case OTA_IDLE:
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            break;
+
+        case OTA_QUERY:
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            if ((int32_t)(now_ms() - s_deadline_ms) >= 0) end_query();
+            xSemaphoreGive(s_lock);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            break;
+
+        case OTA_SEND: {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            uint16_t idx = ep_ota_map_next(s_need, s_n_chunks, s_cursor, true);
+            if (idx < s_n_chunks) {
+                ep_ota_map_clear(s_need, idx);
+                s_cursor = (uint16_t)(idx + 1);
+                send_chunk(idx);
+            } else {
+                begin_query();
+            }
+            xSemaphoreGive(s_lock);
+            vTaskDelay(pdMS_TO_TICKS(idx < s_n_chunks ? OTA_DIST_CHUNK_INTERVAL_MS : 10));
+            break;
+        }
+
+        case OTA_APPLY:
+            // group không có ACK -> lặp vài lần; tag đã apply sẽ reboot và bỏ qua
+            for (int i = 0; i < 3; ++i) {
+                xSemaphoreTake(s_lock, portMAX_DELAY);
+                send_start(EP_OTA_F_APPLY);
+                xSemaphoreGive(s_lock);
+                vTaskDelay(pdMS_TO_TICKS(1000));
+            }
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            finish("applied");
+            xSemaphoreGive(s_lock);
+            break;
+        }
+    }
+}
+
+esp_err_t ota_dist_init(ota_dist_send_fn_t send) {
+    if (!send) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_send = send;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(ota_dist_task, "ota_dist", 4096, NULL, 4, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_dist_start(const uint16_t *targets, uint16_t n_targets) {
+    if (!s_lock || !s_stored) return ESP_ERR_INVALID_STATE;
+    if (!targets || n_targets == 0) return ESP_ERR_INVALID_ARG;
+    if (n_targets > OTA_DIST_MAX_TARGETS) n_targets = OTA_DIST_MAX_TARGETS;
+
+    uint16_t n_chunks = (uint16_t)ep_ota_chunk_count(s_size, EP_OTA_CHUNK_DEFAULT);
+    uint8_t *need = calloc(1, EP_OTA_MAP_BYTES(n_chunks));
+    if (!need) return ESP_ERR_NO_MEM;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_phase != OTA_IDLE) {
+        xSemaphoreGive(s_lock);
+        free(need);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_need        = need;   // rỗng: vòng 0 chỉ QUERY, tag tự báo mình thiếu gì
+    s_n_chunks    = n_chunks;
+    s_round       = 0;
+    s_chunks_sent = 0;
+    s_t_start_us  = esp_timer_get_time();
+    s_n_t         = n_targets;
+    for (uint16_t i = 0; i < n_targets; ++i) {
+        s_t[i] = (ota_target_t){ .addr = targets[i], .status = OTA_ST_UNKNOWN };
+    }
+    begin_query();
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "start: fw 0x%08" PRIx32 ", %" PRIu32 " B / %u chunks -> %u tags",
+             s_fw_id, s_size, n_chunks, n_targets);
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+bool ota_dist_busy(void) {
+    return s_lock && s_phase != OTA_IDLE;
+}
+
+void ota_dist_on_status(uint16_t src, const uint8_t *msg, uint16_t len) {
+    EPOtaStatus st;
+    if (!s_lock || !ep_ota_parse_status(msg, len, &st)) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_phase == OTA_IDLE || st.fw_id != s_fw_id) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    ota_target_t *t = NULL;
+    for (uint16_t i = 0; i < s_n_t; ++i) {
+        if (s_t[i].addr == src) { t = &s_t[i]; break; }
+    }
+    if (t && !t->dropped) {
+        t->heard   = true;
+        t->silent  = 0;
+        t->status  = st.status;
+        t->missing = st.missing;
+        if (st.status == EP_OTA_ST_NOSPACE) {
+            t->dropped = true;
+            ESP_LOGW(TAG, "0x%04x: image too large for OTA partition", src);
+        }
+        // hợp các dải thiếu của mọi tag vào bitmap phát lại
+        for (uint8_t r = 0; r < st.n_ranges; ++r) {
+            uint32_t end = (uint32_t)st.ranges[r].start + st.ranges[r].count;
+            if (end > s_n_chunks) end = s_n_chunks;
+            for (uint32_t i = st.ranges[r].start; i < end; ++i) {
+                ep_ota_map_set(s_need, (uint16_t)i);
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "STATUS 0x%04x: st %u, missing %u (%u ranges)",
+             src, st.status, st.missing, st.n_ranges);
+}
@@ -0,0 +1,55 @@
+#ifndef __OTA_DIST_H
+#define __OTA_DIST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "ep_ota.h"
+
+// Phân phối firmware tag qua mesh (phía gateway). Image được lưu trước vào
+// partition "nodefw" (MQTT tải về), sau đó chạy các vòng:
+//   QUERY (group) -> gom STATUS của các target -> phát lại hợp các dải thiếu
+// cho tới khi mọi target COMPLETE, rồi gửi APPLY.
+
+#ifndef OTA_DIST_PARTITION_LABEL
+#define OTA_DIST_PARTITION_LABEL   "nodefw"
+#endif
+#ifndef OTA_DIST_MAX_TARGETS
+#define OTA_DIST_MAX_TARGETS       64
+#endif
+#ifndef OTA_DIST_CHUNK_INTERVAL_MS
+#define OTA_DIST_CHUNK_INTERVAL_MS 200    // 9 segment/chunk, chừa chỗ cho lệnh giá
+#endif
+#ifndef OTA_DIST_PREPARE_MS
+#define OTA_DIST_PREPARE_MS        20000  // vòng đầu: tag xoá partition OTA
+#endif
+#ifndef OTA_DIST_QUERY_GRACE_MS
+#define OTA_DIST_QUERY_GRACE_MS    2000
+#endif
+#ifndef OTA_DIST_MAX_SILENT
+#define OTA_DIST_MAX_SILENT        3      // số vòng im lặng liên tiếp -> bỏ target
+#endif
+#ifndef OTA_DIST_MAX_ROUNDS
+#define OTA_DIST_MAX_ROUNDS        40
+#endif
+
+// op = EP_VND_OP_OTA_xxx; main.c bọc thành opcode vendor và gửi qua mesh.
+typedef esp_err_t (*ota_dist_send_fn_t)(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len);
+
+esp_err_t ota_dist_init(ota_dist_send_fn_t send);
+
+// Ghi image vào partition nodefw (có thể theo từng mẩu, offset tăng dần).
+// Partition được xoá dần theo từng write (chỉ các sector mẩu đó chạm tới),
+// gọi được từ MQTT event handler mà không chặn lâu.
+esp_err_t ota_dist_store_begin(uint32_t total);
+esp_err_t ota_dist_store_write(uint32_t offset, const uint8_t *data, uint32_t len);
+esp_err_t ota_dist_store_end(void);
+
+// Bắt đầu phân phối image đã lưu tới các tag trong targets.
+esp_err_t ota_dist_start(const uint16_t *targets, uint16_t n_targets);
+bool      ota_dist_busy(void);
+
+// OTA_STATUS từ tag
+void      ota_dist_on_status(uint16_t src, const uint8_t *msg, uint16_t len);
+
+#endif
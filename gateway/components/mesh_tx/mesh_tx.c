@@ -0,0 +1,563 @@
+#include "mesh_tx.h"
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "node_table.h"
+#include "relay_mgr.h"
+
+static const char *TAG = "mesh_tx";
+
+#define ACCESS_OVERHEAD     7       // opcode vendor 3 + TransMIC 4
+#define UNSEG_MAX           15      // access PDU không segment
+#define SEG_PAYLOAD         12
+#define SEG_ACK_BASE_MS     200     // chờ SAR ack: 150 + 50*TTL theo stack, + dự phòng
+#define SEG_ACK_PER_TTL_MS  50
+#define REGION_GROUP        0xFE
+#define STATS_LOG_MS        30000
+
+typedef struct {
+    bool     used;
+    uint8_t  op;
+    uint8_t  flags;
+    uint8_t  region;
+    uint8_t  tries;
+    uint8_t  prio;
+    uint16_t dst;
+    uint16_t len;
+    uint32_t seq;               // thứ tự đến, giữ thứ tự theo đích trong 1 lớp
+    uint32_t enq_ms;
+    uint8_t  data[MESH_TX_MAX_LEN];
+} tx_item_t;
+
+typedef struct {
+    uint16_t dst;               // 0 = trống
+    uint32_t until_ms;          // ước lượng stack giải phóng slot SAR
+} seg_slot_t;
+
+typedef struct {
+    uint16_t dst;               // 0 = trống
+    uint32_t until_ms;          // dự phòng mất TIMEOUT: tự mở
+} rsp_slot_t;
+
+typedef struct {
+    tx_item_t it;               // it.used = false -> trống
+    uint32_t  order;            // thứ tự đưa stack (BTC xử lý theo thứ tự)
+    uint32_t  sent_ms;
+} comp_slot_t;
+
+static tx_item_t          s_items[MESH_TX_QUEUE_LEN];
+static seg_slot_t         s_seg[MESH_TX_SEG_MAX];
+static rsp_slot_t         s_rsp[MESH_TX_RSP_MAX];
+static comp_slot_t        s_comp[MESH_TX_COMP_MAX];
+static uint32_t           s_comp_order;
+static uint8_t            s_xmit_cur = 0xFF; // count net_transmit gói đưa stack gần nhất, 0xFF = chưa gửi
+static uint32_t           s_retry_ms;        // stack báo lỗi -> nghỉ tới mốc này, 0 = không
+static SemaphoreHandle_t  s_lock;
+static TaskHandle_t       s_task;
+static mesh_tx_send_fn_t  s_send;
+static mesh_tx_drop_fn_t  s_drop;
+static uint32_t           s_seq;
+static uint32_t           s_tokens_m;        // token x 1000
+static uint32_t           s_refill_ms;
+static uint8_t            s_last_region = 0xFF;
+static uint8_t            s_normal_run;      // số gói NORMAL liên tiếp (trọng số)
+static mesh_tx_stats_t    s_stats;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static uint16_t seg_count(uint16_t len) {
+    uint16_t pdu = (uint16_t)(len + ACCESS_OVERHEAD);
+    return pdu <= UNSEG_MAX ? 1 : (uint16_t)((pdu + SEG_PAYLOAD - 1) / SEG_PAYLOAD);
+}
+
+static bool is_segmented(const tx_item_t *it) {
+    return it->len + ACCESS_OVERHEAD > UNSEG_MAX;
+}
+
+// Số lần phát adv của gói: segment x (count + 1)
+static uint32_t item_cost(const tx_item_t *it) {
+    return (uint32_t)seg_count(it->len) * (node_table_xmit_count(it->dst) + 1u);
+}
+
+static uint32_t seg_hold_ms(const tx_item_t *it) {
+    uint32_t adv_ms = 1000 / MESH_TX_ADV_PER_SEC;
+    return SEG_ACK_BASE_MS + SEG_ACK_PER_TTL_MS * node_table_ttl(it->dst) + item_cost(it) * adv_ms;
+}
+
+// ============ Token bucket ============
+static void refill(uint32_t now) {
+    uint32_t dt = now - s_refill_ms;
+    s_refill_ms = now;
+    uint32_t add = dt * MESH_TX_ADV_PER_SEC;            // ms x token/s = token x 1000
+    s_tokens_m = s_tokens_m + add > MESH_TX_BUCKET * 1000u ? MESH_TX_BUCKET * 1000u : s_tokens_m + add;
+}
+
+// ============ Slot segmented ============
+static void seg_expire(uint32_t now) {
+    for (int i = 0; i < MESH_TX_SEG_MAX; ++i) {
+        if (s_seg[i].dst && (int32_t)(now - s_seg[i].until_ms) >= 0) s_seg[i].dst = 0;
+    }
+}
+
+static bool seg_busy(uint16_t dst) {
+    for (int i = 0; i < MESH_TX_SEG_MAX; ++i) {
+        if (s_seg[i].dst == dst) return true;
+    }
+    return false;
+}
+
+static seg_slot_t *seg_free_slot(void) {
+    for (int i = 0; i < MESH_TX_SEG_MAX; ++i) {
+        if (!s_seg[i].dst) return &s_seg[i];
+    }
+    return NULL;
+}
+
+static void seg_release(uint16_t dst) {
+    for (int i = 0; i < MESH_TX_SEG_MAX; ++i) {
+        if (s_seg[i].dst == dst) s_seg[i].dst = 0;
+    }
+}
+
+// ============ Chờ phản hồi: 1 request / đích ============
+static void rsp_expire(uint32_t now) {
+    for (int i = 0; i < MESH_TX_RSP_MAX; ++i) {
+        if (s_rsp[i].dst && (int32_t)(now - s_rsp[i].until_ms) >= 0) s_rsp[i].dst = 0;
+    }
+}
+
+static bool rsp_busy(uint16_t dst) {
+    for (int i = 0; i < MESH_TX_RSP_MAX; ++i) {
+        if (s_rsp[i].dst == dst) return true;
+    }
+    return false;
+}
+
+static rsp_slot_t *rsp_free_slot(void) {
+    for (int i = 0; i < MESH_TX_RSP_MAX; ++i) {
+        if (!s_rsp[i].dst) return &s_rsp[i];
+    }
+    return NULL;
+}
+
+static bool rsp_release(uint16_t dst) {
+    bool had = false;
+    for (int i = 0; i < MESH_TX_RSP_MAX; ++i) {
+        if (s_rsp[i].dst == dst) {
+            s_rsp[i].dst = 0;
+            had = true;
+        }
+    }
+    return had;
+}
+
+// ============ Chờ SEND_COMP ============
+static void account_sent(const tx_item_t *it, uint32_t now) {
+    mesh_tx_class_stats_t *c = &s_stats.cls[it->prio];
+    uint32_t d = now - it->enq_ms;
+    ++c->sent;
+    c->delay_sum_ms += d;
+    if (d > c->delay_max_ms) c->delay_max_ms = d;
+    if (it->prio == MESH_TX_PRIO_NORMAL)    ++s_normal_run;
+    else if (it->prio == MESH_TX_PRIO_BULK) s_normal_run = 0;
+}
+
+static void comp_done(comp_slot_t *c, uint32_t now) {
+    ++s_stats.sent;
+    account_sent(&c->it, now);
+    c->it.used = false;
+}
+
+// mất SEND_COMP: coi như đã gửi (không giữ slot mãi)
+static void comp_expire(uint32_t now) {
+    for (int i = 0; i < MESH_TX_COMP_MAX; ++i) {
+        if (s_comp[i].it.used && now - s_comp[i].sent_ms >= MESH_TX_COMP_WAIT_MS) {
+            comp_done(&s_comp[i], now);
+        }
+    }
+}
+
+static bool comp_any(void) {
+    for (int i = 0; i < MESH_TX_COMP_MAX; ++i) {
+        if (s_comp[i].it.used) return true;
+    }
+    return false;
+}
+
+static comp_slot_t *comp_free_slot(void) {
+    for (int i = 0; i < MESH_TX_COMP_MAX; ++i) {
+        if (!s_comp[i].it.used) return &s_comp[i];
+    }
+    return NULL;
+}
+
+// gói đưa stack sớm nhất khớp dst + op
+static comp_slot_t *comp_find(uint16_t dst, uint8_t op) {
+    comp_slot_t *best = NULL;
+    for (int i = 0; i < MESH_TX_COMP_MAX; ++i) {
+        comp_slot_t *c = &s_comp[i];
+        if (c->it.used && c->it.dst == dst && c->it.op == op &&
+            (!best || (int32_t)(c->order - best->order) < 0)) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+// ============ Chọn gói ============
+// Có gói cũ hơn cùng đích, cùng lớp còn trong hàng -> chưa được gửi gói này.
+// Khác lớp thì không chặn: lệnh URGENT vượt được block transfer cùng tag.
+static bool blocked_by_older(const tx_item_t *it) {
+    for (int i = 0; i < MESH_TX_QUEUE_LEN; ++i) {
+        const tx_item_t *o = &s_items[i];
+        if (o->used && o->dst == it->dst && o->prio == it->prio &&
+            (int32_t)(o->seq - it->seq) < 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool eligible(const tx_item_t *it, bool have_seg_slot) {
+    if (!it->used || blocked_by_older(it)) return false;
+    if (is_segmented(it) && (!have_seg_slot || seg_busy(it->dst))) return false;
+    // client đang chờ phản hồi từ đích này -> gửi nữa là EBUSY
+    if ((it->flags & MESH_TX_F_RSP) && (rsp_busy(it->dst) || !rsp_free_slot())) return false;
+    return true;
+}
+
+static int seg_free_count(void) {
+    int n = 0;
+    for (int i = 0; i < MESH_TX_SEG_MAX; ++i) n += s_seg[i].dst == 0;
+    return n;
+}
+
+// Gói cũ nhất đủ điều kiện trong lớp, ưu tiên vùng khác vùng vừa gửi.
+static tx_item_t *pick_class(uint8_t prio, bool have_slot) {
+    tx_item_t *best = NULL, *best_other = NULL;
+    for (int i = 0; i < MESH_TX_QUEUE_LEN; ++i) {
+        tx_item_t *it = &s_items[i];
+        if (it->prio != prio || !eligible(it, have_slot)) continue;
+        if (!best || (int32_t)(it->seq - best->seq) < 0) best = it;
+        if (it->region != s_last_region &&
+            (!best_other || (int32_t)(it->seq - best_other->seq) < 0)) {
+            best_other = it;
+        }
+    }
+    return best_other ? best_other : best;
+}
+
+// URGENT trước hết; NORMAL : BULK = MESH_TX_NORMAL_WEIGHT : 1
+static tx_item_t *pick_next(void) {
+    int free_segs = seg_free_count();
+    tx_item_t *it = pick_class(MESH_TX_PRIO_URGENT, free_segs > 0);
+    if (it) return it;
+    tx_item_t *n = pick_class(MESH_TX_PRIO_NORMAL, free_segs > 0);
+    tx_item_t *b = pick_class(MESH_TX_PRIO_BULK, free_segs > MESH_TX_URGENT_SEGS);
+    if (n && (!b || s_normal_run < MESH_TX_NORMAL_WEIGHT)) return n;
+    return b;
+}
+
+// net_transmit là state chung của stack, đọc lúc BTC xử lý gói (không theo
+// từng gói): gói cần số lần phát khác chờ mọi gói trước về SEND_COMP rồi mới
+// đi, send_fn đổi net_transmit lúc stack không còn gói nào đang xử lý.
+static tx_item_t *pick(void) {
+    if (!comp_free_slot()) return NULL;
+    tx_item_t *it = pick_next();
+    if (it && node_table_xmit_count(it->dst) != s_xmit_cur && comp_any()) return NULL;
+    return it;
+}
+
+static tx_item_t *find_coalesce(uint16_t dst, uint8_t op) {
+    for (int i = 0; i < MESH_TX_QUEUE_LEN; ++i) {
+        tx_item_t *it = &s_items[i];
+        if (it->used && it->dst == dst && it->op == op && (it->flags & MESH_TX_F_COALESCE)) return it;
+    }
+    return NULL;
+}
+
+static uint16_t queued(void) {
+    uint16_t n = 0;
+    for (int i = 0; i < MESH_TX_QUEUE_LEN; ++i) n += s_items[i].used;
+    return n;
+}
+
+static uint16_t queued_class(uint8_t prio) {
+    uint16_t n = 0;
+    for (int i = 0; i < MESH_TX_QUEUE_LEN; ++i) n += s_items[i].used && s_items[i].prio == prio;
+    return n;
+}
+
+// URGENT luôn còn >= 1/4 hàng đợi; BULK tối đa 1/2
+static bool class_has_room(uint8_t prio) {
+    if (prio == MESH_TX_PRIO_URGENT) return true;
+    uint16_t non_urgent = (uint16_t)(queued() - queued_class(MESH_TX_PRIO_URGENT));
+    if (non_urgent >= MESH_TX_QUEUE_LEN * 3 / 4) return false;
+    return prio != MESH_TX_PRIO_BULK || queued_class(MESH_TX_PRIO_BULK) < MESH_TX_QUEUE_LEN / 2;
+}
+
+// Gói stack không nhận: về lại chỗ cũ (seq giữ nguyên) hoặc drop; true = drop.
+// Bản mới hơn cùng đích + opcode đã vào hàng trong lúc gửi -> bỏ bản này.
+static bool requeue(tx_item_t *it) {
+    if ((it->flags & MESH_TX_F_COALESCE) && find_coalesce(it->dst, it->op)) {
+        ++s_stats.coalesced;
+        return false;
+    }
+    if (++it->tries >= MESH_TX_MAX_TRIES) {
+        ++s_stats.dropped;
+        return true;
+    }
+    int i = 0;
+    while (i < MESH_TX_QUEUE_LEN && s_items[i].used) ++i;
+    if (i == MESH_TX_QUEUE_LEN) {
+        ++s_stats.dropped;
+        return true;
+    }
+    s_items[i] = *it;
+    s_items[i].used = true;
+    ++s_stats.retried;
+    return false;
+}
+
+// ============ Task ============
+static void mesh_tx_task(void *arg) {
+    uint32_t  last_log = now_ms();
+    tx_item_t it;
+    comp_slot_t *comp = NULL;
+
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        bool       have = false;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint32_t now = now_ms();
+        refill(now);
+        seg_expire(now);
+        rsp_expire(now);
+        comp_expire(now);
+
+        // stack vừa báo lỗi (hết buffer) -> nghỉ chút
+        if (s_retry_ms && (int32_t)(now - s_retry_ms) >= 0) s_retry_ms = 0;
+        tx_item_t *p = s_retry_ms ? NULL : pick();
+        if (s_retry_ms) {
+            wait = pdMS_TO_TICKS(s_retry_ms - now) + 1;
+        } else if (p) {
+            uint32_t need_m = item_cost(p) * 1000u;
+            if (need_m > MESH_TX_BUCKET * 1000u) need_m = MESH_TX_BUCKET * 1000u;
+            // BULK để lại một phần bucket: URGENT đến là gửi được ngay
+            uint32_t keep_m = p->prio == MESH_TX_PRIO_BULK ? MESH_TX_URGENT_TOKENS * 1000u : 0;
+            if (need_m + keep_m > MESH_TX_BUCKET * 1000u) keep_m = MESH_TX_BUCKET * 1000u - need_m;
+            need_m += keep_m;
+            if (s_tokens_m >= need_m) {
+                s_tokens_m -= need_m - keep_m;
+                it = *p;
+                p->used = false;
+                if (is_segmented(&it)) {
+                    seg_slot_t *slot = seg_free_slot();
+                    slot->dst      = it.dst;
+                    slot->until_ms = now + seg_hold_ms(&it);
+                }
+                // giữ chỗ trước khi gửi: SEND_COMP có thể về trước khi lấy lại lock
+                if (it.flags & MESH_TX_F_RSP) {
+                    rsp_slot_t *r = rsp_free_slot();
+                    r->dst      = it.dst;
+                    r->until_ms = now + MESH_TX_RSP_HOLD_MS;
+                }
+                comp = comp_free_slot();
+                comp->it      = it;
+                comp->it.used = true;
+                comp->order   = s_comp_order++;
+                comp->sent_ms = now;
+                s_xmit_cur    = node_table_xmit_count(it.dst);
+                s_last_region = it.region;
+                have = true;
+                wait = 0;
+            } else {
+                wait = pdMS_TO_TICKS((need_m - s_tokens_m) / MESH_TX_ADV_PER_SEC) + 1;
+            }
+        } else if (queued()) {
+            wait = pdMS_TO_TICKS(20);       // chờ slot segmented / gói cũ hơn / SEND_COMP
+        }
+
+        if (s_stats.sent && now - last_log >= STATS_LOG_MS) {
+            last_log = now;
+            ESP_LOGI(TAG, "sent %" PRIu32 ", retried %" PRIu32 " (%" PRIu32 " late), dropped %" PRIu32
+                     ", rejected %" PRIu32 ", coalesced %" PRIu32 " (%" PRIu32 " adv saved), queued %u",
+                     s_stats.sent, s_stats.retried, s_stats.send_err, s_stats.dropped, s_stats.rejected,
+                     s_stats.coalesced, s_stats.saved_adv, queued());
+            static const char *const names[MESH_TX_PRIO_COUNT] = { "urgent", "normal", "bulk" };
+            for (int c = 0; c < MESH_TX_PRIO_COUNT; ++c) {
+                const mesh_tx_class_stats_t *cs = &s_stats.cls[c];
+                if (!cs->sent) continue;
+                ESP_LOGI(TAG, "  %-6s sent %" PRIu32 ", wait avg %" PRIu32 " ms, max %" PRIu32 " ms, queued %u",
+                         names[c], cs->sent, cs->delay_sum_ms / cs->sent, cs->delay_max_ms,
+                         queued_class((uint8_t)c));
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        if (!have) {
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+
+        esp_err_t err = s_send(it.dst, it.op, it.data, it.len, (it.flags & MESH_TX_F_RSP) != 0);
+
+        // OK: kết quả thật về ở SEND_COMP (mesh_tx_on_send_comp)
+        if (err == ESP_OK) continue;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        comp->it.used = false;
+        if (it.flags & MESH_TX_F_RSP) rsp_release(it.dst);
+        seg_release(it.dst);
+        bool drop = requeue(&it);
+        s_retry_ms = now_ms() + MESH_TX_RETRY_MS;
+        xSemaphoreGive(s_lock);
+        if (drop) {
+            ESP_LOGW(TAG, "drop op 0x%02x -> 0x%04x: %s", it.op, it.dst, esp_err_to_name(err));
+            if (s_drop) s_drop(it.dst, it.op, it.data, it.len, err);
+        }
+    }
+}
+
+// ============ API ============
+esp_err_t mesh_tx_init(mesh_tx_send_fn_t send, mesh_tx_drop_fn_t drop) {
+    if (!send) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_send      = send;
+    s_drop      = drop;
+    s_tokens_m  = MESH_TX_BUCKET * 1000u;
+    s_refill_ms = now_ms();
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(mesh_tx_task, "mesh_tx", 3072, NULL, 6, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t mesh_tx_submit(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len,
+                         uint8_t flags, mesh_tx_prio_t prio) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if ((unsigned)prio >= MESH_TX_PRIO_COUNT) prio = MESH_TX_PRIO_NORMAL;
+    if ((!data && len) || len > MESH_TX_MAX_LEN) return ESP_ERR_INVALID_SIZE;
+
+    // vùng tính ngoài lock (relay_mgr có lock riêng)
+    uint8_t region = dst < 0x8000 ? relay_mgr_region(dst) : REGION_GROUP;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    tx_item_t *slot = (flags & MESH_TX_F_COALESCE) ? find_coalesce(dst, op) : NULL;
+    if (slot) {
+        // chưa bay -> thay payload, giữ seq (không mất lượt trong hàng)
+        ++s_stats.coalesced;
+        s_stats.saved_adv += item_cost(slot);
+        // bản mới gấp hơn -> nâng lớp; thời gian chờ tính từ bản đầu tiên
+        bool upgrade = prio < slot->prio;
+        if (upgrade) slot->prio = (uint8_t)prio;
+        slot->flags = flags;
+        slot->tries = 0;
+        slot->len   = len;
+        if (len) memcpy(slot->data, data, len);
+        ++s_stats.submitted;
+        xSemaphoreGive(s_lock);
+        ESP_LOGD(TAG, "coalesce op 0x%02x -> 0x%04x", op, dst);
+        if (upgrade) xTaskNotifyGive(s_task);
+        return ESP_OK;
+    }
+    if (class_has_room((uint8_t)prio)) {
+        for (int i = 0; i < MESH_TX_QUEUE_LEN; ++i) {
+            if (!s_items[i].used) { slot = &s_items[i]; break; }
+        }
+    }
+    if (!slot) {
+        ++s_stats.rejected;
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    slot->used   = true;
+    slot->op     = op;
+    slot->flags  = flags;
+    slot->region = region;
+    slot->tries  = 0;
+    slot->prio   = (uint8_t)prio;
+    slot->dst    = dst;
+    slot->len    = len;
+    slot->seq    = s_seq++;
+    slot->enq_ms = now_ms();
+    if (len) memcpy(slot->data, data, len);
+    ++s_stats.submitted;
+    xSemaphoreGive(s_lock);
+
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+void mesh_tx_on_rx(uint16_t src) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool had = seg_busy(src);
+    seg_release(src);
+    xSemaphoreGive(s_lock);
+    if (had) xTaskNotifyGive(s_task);
+}
+
+void mesh_tx_on_send_comp(uint16_t dst, uint8_t op, int err_code) {
+    if (!s_lock) return;
+    bool      drop = false;
+    tx_item_t it;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    comp_slot_t *c = comp_find(dst, op);
+    if (!c) {
+        xSemaphoreGive(s_lock);         // đã hết hạn chờ / không qua mesh_tx
+        return;
+    }
+    uint32_t now = now_ms();
+    if (err_code == 0) {
+        comp_done(c, now);
+    } else {
+        // hết adv buffer / client bận: chưa lên sóng -> gửi lại như lỗi đồng bộ
+        it = c->it;
+        c->it.used = false;
+        ++s_stats.send_err;
+        if (it.flags & MESH_TX_F_RSP) rsp_release(dst);
+        seg_release(dst);
+        drop = requeue(&it);
+        s_retry_ms = now + MESH_TX_RETRY_MS;
+    }
+    xSemaphoreGive(s_lock);
+    if (drop) {
+        ESP_LOGW(TAG, "drop op 0x%02x -> 0x%04x: send err %d", op, dst, err_code);
+        if (s_drop) s_drop(it.dst, it.op, it.data, it.len, err_code);
+    }
+    xTaskNotifyGive(s_task);
+}
+
+void mesh_tx_on_rsp_done(uint16_t dst) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool had = rsp_release(dst);
+    xSemaphoreGive(s_lock);
+    if (had) xTaskNotifyGive(s_task);
+}
+
+void mesh_tx_get_stats(mesh_tx_stats_t *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->queued = queued();
+    for (int i = 0; i < MESH_TX_SEG_MAX; ++i) out->seg_inflight += s_seg[i].dst != 0;
+    for (int i = 0; i < MESH_TX_RSP_MAX; ++i) out->rsp_waiting += s_rsp[i].dst != 0;
+    for (int c = 0; c < MESH_TX_PRIO_COUNT; ++c) out->cls[c].queued = queued_class((uint8_t)c);
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,133 @@
+#ifndef __MESH_TX_H
+#define __MESH_TX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Bộ lập lịch gửi vendor message phía gateway. Mọi gói (lệnh giá, block
+// transfer, OTA) đi qua hàng đợi này thay vì gọi thẳng mesh stack:
+//  - token bucket theo số lần phát adv: chi phí 1 gói = số segment x số lần
+//    phát (theo node_table), để không vượt ADV_BUF_COUNT
+//  - giới hạn số gói segmented đang bay (TX_SEG_MSG_COUNT), 1 gói / đích
+//  - xen kẽ đích ở các vùng mesh khác nhau (relay_mgr_region) để các nhánh
+//    relay chạy song song; thứ tự các gói cùng đích được giữ nguyên
+//  - gửi lỗi (hết buffer) -> giữ chỗ trong hàng, thử lại sau. Stack gửi bất
+//    đồng bộ: lỗi báo muộn ở SEND_COMP (mesh_tx_on_send_comp) cũng vậy
+//  - 1 request chờ phản hồi / đích: client model chỉ giữ 1 request mỗi đích
+//    (gửi thêm -> EBUSY), gói MESH_TX_F_RSP sau nằm lại trong hàng tới khi có
+//    phản hồi / timeout (mesh_tx_on_rsp_done; tag LPN giữ tới 35 s)
+//  - gói MESH_TX_F_COALESCE cùng đích + opcode chưa gửi bị thay bằng gói mới
+//    nhất (latest-wins), giữ nguyên vị trí trong hàng
+//  - 3 lớp ưu tiên: URGENT luôn đi trước; NORMAL : BULK theo trọng số. BULK
+//    không dùng phần token / slot segmented / chỗ trong hàng chừa cho URGENT
+//  - số lần phát (net_transmit) là state chung của stack: gói đổi số lần phát
+//    chỉ được gửi khi không còn gói nào chờ SEND_COMP
+
+// ============ Config ============
+#ifndef MESH_TX_QUEUE_LEN
+#define MESH_TX_QUEUE_LEN       48
+#endif
+#ifndef MESH_TX_MAX_LEN
+#define MESH_TX_MAX_LEN         120     // BLK/OTA DATA 100 B, SEND <= 47 B
+#endif
+#ifndef MESH_TX_ADV_PER_SEC
+#define MESH_TX_ADV_PER_SEC     40      // lần phát adv bền vững (~25 ms / adv event)
+#endif
+#ifndef MESH_TX_BUCKET
+#define MESH_TX_BUCKET          30      // burst tối đa (nửa ADV_BUF_COUNT = 60)
+#endif
+#ifndef MESH_TX_SEG_MAX
+#define MESH_TX_SEG_MAX         6       // TX_SEG_MSG_COUNT 10, chừa cho config client
+#endif
+#ifndef MESH_TX_MAX_TRIES
+#define MESH_TX_MAX_TRIES       5
+#endif
+#ifndef MESH_TX_RETRY_MS
+#define MESH_TX_RETRY_MS        100
+#endif
+#ifndef MESH_TX_COMP_MAX
+#define MESH_TX_COMP_MAX        8       // gói đã đưa stack, chờ SEND_COMP
+#endif
+#ifndef MESH_TX_COMP_WAIT_MS
+#define MESH_TX_COMP_WAIT_MS    3000    // mất SEND_COMP -> coi như đã gửi
+#endif
+#ifndef MESH_TX_RSP_MAX
+#define MESH_TX_RSP_MAX         16      // số đích chờ phản hồi cùng lúc
+#endif
+#ifndef MESH_TX_RSP_HOLD_MS
+#define MESH_TX_RSP_HOLD_MS     40000   // dự phòng mất TIMEOUT, > timeout tag LPN
+#endif
+
+#ifndef MESH_TX_NORMAL_WEIGHT
+#define MESH_TX_NORMAL_WEIGHT   4       // 4 gói NORMAL rồi 1 gói BULK (nếu cả hai chờ)
+#endif
+#ifndef MESH_TX_URGENT_TOKENS
+#define MESH_TX_URGENT_TOKENS   8       // BULK chỉ gửi khi bucket còn dư hơn mức này
+#endif
+#ifndef MESH_TX_URGENT_SEGS
+#define MESH_TX_URGENT_SEGS     1       // slot segmented BULK không được dùng
+#endif
+
+typedef enum {
+    MESH_TX_PRIO_URGENT = 0,            // sửa giá sai: phải lên kệ trong vài giây
+    MESH_TX_PRIO_NORMAL,
+    MESH_TX_PRIO_BULK,                  // đồng bộ catalogue, OTA
+    MESH_TX_PRIO_COUNT,
+} mesh_tx_prio_t;
+
+#define MESH_TX_F_RSP           0x01    // cần phản hồi (client chờ STATUS)
+#define MESH_TX_F_COALESCE      0x02    // payload là trạng thái đầy đủ, bản mới thay bản cũ
+
+// main.c gửi thật: đặt TTL/transmit theo đích rồi gọi mesh stack. Lúc gọi, mọi
+// gói trước đó đã về SEND_COMP hoặc cùng số lần phát node_table_xmit_count(dst).
+typedef esp_err_t (*mesh_tx_send_fn_t)(uint16_t dst, uint8_t op, const uint8_t *data,
+                                       uint16_t len, bool need_rsp);
+
+// Gói bị bỏ hẳn (hết MESH_TX_MAX_TRIES / hết chỗ trả về hàng), gọi ngoài lock.
+// err: esp_err_t của send_fn hoặc err_code (errno âm) của SEND_COMP.
+typedef void (*mesh_tx_drop_fn_t)(uint16_t dst, uint8_t op, const uint8_t *data,
+                                  uint16_t len, int err);
+
+typedef struct {
+    uint32_t sent;
+    uint32_t delay_sum_ms;      // thời gian chờ trong hàng (submit -> gửi)
+    uint32_t delay_max_ms;
+    uint16_t queued;
+} mesh_tx_class_stats_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;
+    uint32_t retried;           // mesh stack từ chối, đã thử lại
+    uint32_t send_err;          // trong đó: lỗi báo muộn qua SEND_COMP
+    uint32_t dropped;           // hết lượt thử
+    uint32_t rejected;          // hàng đợi đầy
+    uint32_t coalesced;         // gói bị bản mới hơn thay trước khi gửi
+    uint32_t saved_adv;         // số lần phát adv tiết kiệm được nhờ coalesce
+    uint16_t queued;
+    uint8_t  seg_inflight;
+    uint8_t  rsp_waiting;       // số đích đang chờ phản hồi
+    mesh_tx_class_stats_t cls[MESH_TX_PRIO_COUNT];
+} mesh_tx_stats_t;
+
+esp_err_t mesh_tx_init(mesh_tx_send_fn_t send, mesh_tx_drop_fn_t drop);
+
+// Copy payload vào hàng đợi. ESP_ERR_NO_MEM: đầy / lớp đã dùng hết phần của
+// mình (caller tự xử lý như mất gói).
+esp_err_t mesh_tx_submit(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len,
+                         uint8_t flags, mesh_tx_prio_t prio);
+
+// Có gói từ src: gói segmented tới src chắc chắn đã xong.
+void      mesh_tx_on_rx(uint16_t src);
+
+// SEND_COMP của vendor client cho gói op -> dst (err_code 0 = đã lên adv
+// queue). Lỗi -> gói về lại chỗ cũ trong hàng, hết lượt thử thì drop.
+void      mesh_tx_on_send_comp(uint16_t dst, uint8_t op, int err_code);
+
+// Request chờ phản hồi tới dst đã xong (có phản hồi / client timeout).
+void      mesh_tx_on_rsp_done(uint16_t dst);
+
+void      mesh_tx_get_stats(mesh_tx_stats_t *out);
+
+#endif
@@ -4,11 +4,14 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include "esp_wifi.h"
 #include "esp_system.h"
 #include "nvs_flash.h"
 #include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -21,16 +24,67 @@
 
 #include "esp_log.h"
 #include "mqtt_client.h"
+#if CONFIG_MQTT_PROTOCOL_5
+#include "mqtt5_client.h"
+#endif
 #include "esp_err.h"
 
+#include "ep_cbor.h"
 #include "mesh_vendor_api.h"
+#include "ota_dist.h"
+#include "boot_ts.h"
+#include "outbox.h"
+#include "tag_state.h"
+#include "node_table.h"
 
 
 static const char *TAG = "mqtts_example";
 static esp_mqtt_client_handle_t client ;
+static char s_client_id[32];
 static volatile int s_has_data = 0;   // cờ dữ liệu sẵn sàng
 static CmdMsg s_last;                 // bản ghi cuối
 
+#define TOPIC_ZONE      "store/" APP_MQTT_STORE_ID "/zone/"   // + <z> + TOPIC_CMD[_CBOR]
+#define TOPIC_CMD       "/cmd"
+#define TOPIC_CMD_CBOR  "/cmd/cbor"      // 1 map hoặc array map (ep_cbor.h)
+#define TOPIC_IMAGE     "topic/image/"   // + địa chỉ node, payload nhị phân
+#define TOPIC_NODE_FW   "topic/ota/node" // firmware tag (.bin), phát OTA qua mesh
+#define TOPIC_GROUP     "topic/group/"   // + group address, payload "0x0005,0x0007-0x01F8"
+#define TOPIC_STATUS    "topic/status"   // lô báo cáo từ outbox (QoS 1)
+#define TOPIC_DIGEST    "store/" APP_MQTT_STORE_ID "/digest"   // hỏi "lo-hi/n", trả lời ở + "/" client id
+#define TOPIC_ONBOARD   "store/" APP_MQTT_STORE_ID "/onboard"  // "<giây>[/<số delegate>]"
+#define TOPIC_HEALTH    "store/" APP_MQTT_STORE_ID "/health"   // hỏi (payload bỏ qua), trả ở + "/" client id
+#define GROUP_JOIN_MAX  512
+
+/* Payload lớn hơn buffer MQTT -> đến thành nhiều MQTT_EVENT_DATA; chỉ
+ * fragment đầu có topic nên loại payload được nhớ ở đây */
+typedef enum {
+    BIN_NONE = 0,
+    BIN_IMAGE,
+    BIN_NODE_FW,
+    BIN_CMD_CBOR,
+} bin_kind_t;
+
+typedef enum {
+    CMD_NONE = 0,
+    CMD_JSON,
+    CMD_CBOR,
+} cmd_fmt_t;
+
+static bin_kind_t s_bin;
+static uint8_t  *s_img;
+static int       s_img_total;
+static uint16_t  s_img_dst;
+static bool      s_fw_ok;
+static uint8_t   s_cbor[APP_MQTT_CBOR_MAX];    // lô CBOR ghép từ các fragment
+static bool      s_cbor_ok;
+
+static app_mqtt_stats_t s_stats;
+static volatile bool    s_online;
+static SemaphoreHandle_t s_health_lock;  // handler MQTT và timer dùng chung buffer
+static uint32_t         s_rate_ms;      // mốc log tốc độ
+static uint32_t         s_rate_rx;
+
 bool mqtt_try_get_last(CmdMsg *out) {
     if (!out) return false;
     if (!s_has_data) return false;
@@ -40,6 +94,49 @@ bool mqtt_try_get_last(CmdMsg *out) {
     return true;
 }
 
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/* Hàng mesh đầy: giữ handler (PUBACK chưa đi) tới khi có chỗ */
+static void cmd_window_wait(void)
+{
+    uint32_t t0 = now_ms();
+    if (example_ble_mesh_cmd_backlog() < APP_MQTT_INFLIGHT_MAX) {
+        return;
+    }
+    ++s_stats.window_waits;
+    while (example_ble_mesh_cmd_backlog() >= APP_MQTT_INFLIGHT_MAX &&
+           now_ms() - t0 < APP_MQTT_WINDOW_WAIT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    uint32_t ms = now_ms() - t0;
+    if (ms > s_stats.window_wait_ms_max) s_stats.window_wait_ms_max = ms;
+}
+
+static void cmd_rate_log(void)
+{
+    uint32_t now = now_ms();
+    if (now - s_rate_ms < APP_MQTT_RATE_LOG_MS) {
+        return;
+    }
+    uint32_t n = s_stats.rx - s_rate_rx;
+    ESP_LOGI(TAG, "cmd: %" PRIu32 " in %" PRIu32 " ms (%" PRIu32 "/s), ok %" PRIu32 ", failed %" PRIu32
+             ", window waits %" PRIu32 " (max %" PRIu32 " ms), sync timeouts %" PRIu32
+             ", handle avg %" PRIu32 " us max %" PRIu32 " us",
+             n, now - s_rate_ms, n * 1000 / (now - s_rate_ms), s_stats.ok, s_stats.failed,
+             s_stats.window_waits, s_stats.window_wait_ms_max, s_stats.sync_timeouts,
+             s_stats.rx ? (uint32_t)(s_stats.handle_us_sum / s_stats.rx) : 0, s_stats.handle_us_max);
+    s_rate_ms = now;
+    s_rate_rx = s_stats.rx;
+}
+
+void mqtt_get_stats(app_mqtt_stats_t *out)
+{
+    if (out) *out = s_stats;
+}
+
 static void log_error_if_nonzero(const char *message, int error_code)
 {
     if (error_code != 0) {
@@ -47,6 +144,396 @@ static void log_error_if_nonzero(const char *message, int error_code)
     }
 }
 
+static bool topic_is(const esp_mqtt_event_handle_t event, const char *prefix)
+{
+    size_t n = strlen(prefix);
+    return event->topic_len >= (int)n && memcmp(event->topic, prefix, n) == 0;
+}
+
+/* store/<id>/zone/<z>/cmd[/cbor]; <z> là 1 level bất kỳ (subscribe có thể là "+") */
+static cmd_fmt_t cmd_topic(const esp_mqtt_event_handle_t event)
+{
+    if (!topic_is(event, TOPIC_ZONE)) {
+        return CMD_NONE;
+    }
+    const char *zone = event->topic + strlen(TOPIC_ZONE);
+    const char *end  = event->topic + event->topic_len;
+    const char *sep  = memchr(zone, '/', (size_t)(end - zone));
+    if (!sep || sep == zone) {
+        return CMD_NONE;
+    }
+    size_t n = (size_t)(end - sep);
+    if (n == strlen(TOPIC_CMD) && memcmp(sep, TOPIC_CMD, n) == 0) {
+        return CMD_JSON;
+    }
+    if (n == strlen(TOPIC_CMD_CBOR) && memcmp(sep, TOPIC_CMD_CBOR, n) == 0) {
+        return CMD_CBOR;
+    }
+    return CMD_NONE;
+}
+
+/* Chỉ các khu của gateway này; có share group -> "$share/<group>/..." */
+static void subscribe_zones(esp_mqtt_client_handle_t client)
+{
+    const char *share = APP_MQTT_SHARE_GROUP;
+#if !CONFIG_MQTT_PROTOCOL_5
+    if (share[0]) {
+        ESP_LOGW(TAG, "Shared subscription needs MQTT 5, subscribing zones directly");
+        share = "";
+    }
+#endif
+    char zones[] = APP_MQTT_ZONES;
+    char *save = NULL;
+    int cnt = 0;
+    for (char *z = strtok_r(zones, ", ", &save); z && cnt < APP_MQTT_ZONES_MAX;
+         z = strtok_r(NULL, ", ", &save), ++cnt) {
+        static const char *const suffix[] = { TOPIC_CMD, TOPIC_CMD_CBOR };
+        for (size_t i = 0; i < sizeof(suffix) / sizeof(suffix[0]); ++i) {
+            char topic[96];
+            if (share[0]) {
+                snprintf(topic, sizeof(topic), "$share/%s/" TOPIC_ZONE "%s%s", share, z, suffix[i]);
+            } else {
+                snprintf(topic, sizeof(topic), TOPIC_ZONE "%s%s", z, suffix[i]);
+            }
+            int msg_id = esp_mqtt_client_subscribe(client, topic, 1);
+            ESP_LOGI(TAG, "subscribe %s, msg_id=%d", topic, msg_id);
+        }
+    }
+}
+
+static void handle_image_fragment(esp_mqtt_event_handle_t event)
+{
+    if (event->current_data_offset == 0) {
+        free(s_img);
+        s_img = NULL;
+
+        char addr[8] = {0};
+        int n = event->topic_len - (int)strlen(TOPIC_IMAGE);
+        if (n <= 0 || n >= (int)sizeof(addr)) {
+            ESP_LOGE(TAG, "Image topic without node address");
+            return;
+        }
+        memcpy(addr, event->topic + strlen(TOPIC_IMAGE), n);
+        s_img_dst   = (uint16_t)strtoul(addr, NULL, 0);   // "0x0005" hoặc "5"
+        s_img_total = event->total_data_len;
+        s_img       = malloc(s_img_total);
+        if (!s_img) {
+            ESP_LOGE(TAG, "No memory for image (%d B)", s_img_total);
+            return;
+        }
+    }
+    if (!s_img || event->current_data_offset + event->data_len > s_img_total) {
+        return;
+    }
+
+    memcpy(s_img + event->current_data_offset, event->data, event->data_len);
+    if (event->current_data_offset + event->data_len == s_img_total) {
+        ESP_LOGI(TAG, "Image for 0x%04x: %d B", s_img_dst, s_img_total);
+        esp_err_t err = example_ble_mesh_send_image(s_img_dst, s_img, (size_t)s_img_total);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Image send failed: %s", esp_err_to_name(err));
+        }
+        free(s_img);
+        s_img = NULL;
+    }
+}
+
+/* Firmware tag: ghi thẳng từng fragment vào partition nodefw (không giữ RAM) */
+static void handle_node_fw_fragment(esp_mqtt_event_handle_t event)
+{
+    esp_err_t err;
+    if (event->current_data_offset == 0) {
+        err = ota_dist_store_begin((uint32_t)event->total_data_len);
+        s_fw_ok = (err == ESP_OK);
+        if (!s_fw_ok) {
+            ESP_LOGE(TAG, "Node FW (%d B) rejected: %s", event->total_data_len, esp_err_to_name(err));
+            return;
+        }
+    }
+    if (!s_fw_ok) {
+        return;
+    }
+
+    err = ota_dist_store_write((uint32_t)event->current_data_offset,
+                               (const uint8_t *)event->data, (uint32_t)event->data_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Node FW write failed: %s", esp_err_to_name(err));
+        s_fw_ok = false;
+        return;
+    }
+    if (event->current_data_offset + event->data_len == event->total_data_len) {
+        s_fw_ok = false;
+        err = ota_dist_store_end();
+        if (err == ESP_OK) {
+            err = example_ble_mesh_start_node_ota();
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Node FW OTA not started: %s", esp_err_to_name(err));
+        }
+    }
+}
+
+/* Danh sách thành viên nhóm: địa chỉ hoặc dải a-b, cách nhau bởi ',' / khoảng trắng */
+static void handle_group(esp_mqtt_event_handle_t event)
+{
+    char addr[8] = {0};
+    int n = event->topic_len - (int)strlen(TOPIC_GROUP);
+    if (n <= 0 || n >= (int)sizeof(addr)) {
+        ESP_LOGE(TAG, "Group topic without group address");
+        return;
+    }
+    memcpy(addr, event->topic + strlen(TOPIC_GROUP), n);
+    uint16_t group = (uint16_t)strtoul(addr, NULL, 0);
+
+    static uint16_t nodes[GROUP_JOIN_MAX];
+    uint16_t cnt = 0;
+    const char *p   = event->data;
+    const char *end = event->data + event->data_len;
+    char tok[16];
+    while (p < end && cnt < GROUP_JOIN_MAX) {
+        while (p < end && (*p == ',' || *p == ' ' || *p == '\n' || *p == '\r')) ++p;
+        size_t k = 0;
+        while (p < end && *p != ',' && *p != ' ' && *p != '\n' && *p != '\r' && k < sizeof(tok) - 1) {
+            tok[k++] = *p++;
+        }
+        if (k == 0) continue;
+        tok[k] = '\0';
+        char *dash;
+        unsigned long lo = strtoul(tok, &dash, 0);
+        unsigned long hi = (*dash == '-') ? strtoul(dash + 1, NULL, 0) : lo;
+        for (unsigned long a = lo; a <= hi && a < 0x8000 && cnt < GROUP_JOIN_MAX; ++a) {
+            if (a) nodes[cnt++] = (uint16_t)a;
+        }
+    }
+    esp_err_t err = example_ble_mesh_group_join(group, nodes, cnt);
+    ESP_LOGI(TAG, "Group 0x%04x: join %u tags (%s)", group, cnt, esp_err_to_name(err));
+}
+
+/* 1 lệnh đã parse (JSON hoặc 1 bản ghi CBOR) -> s_last -> hàng mesh */
+static bool cmd_submit(const EPData *d)
+{
+    ++s_stats.rx;
+
+    // ---- GÁN ĐẦY ĐỦ VÀO s_last để bên BLE Mesh lấy ra ----
+    s_last.add = d->add;
+    s_last.partial = d->partial;
+    s_last.price = d->price;
+
+    // copy barcode an toàn, luôn NUL-terminate
+    strncpy(s_last.barcode, d->barcode, sizeof(s_last.barcode));
+    s_last.barcode[sizeof(s_last.barcode) - 1] = '\0';
+
+    // NEW: copy sale (%)
+    s_last.has_sale = d->has_sale;
+    s_last.sale     = d->sale;  // 0..100 nếu has_sale=true
+
+    // tên sản phẩm (tuỳ chọn)
+    s_last.has_title = d->has_title;
+    strncpy(s_last.title, d->title, sizeof(s_last.title));
+    s_last.title[sizeof(s_last.title) - 1] = '\0';
+    s_last.prio = d->prio;
+    s_last.cid  = d->cid;
+
+    // (nếu bạn đang dùng API dạng kho chung)
+    // mqtt_set_last(&s_last);    // <-- dùng khi có hàm này
+
+    // ---- Log rõ ràng ----
+    int32_t unit_after = ep_unit_price_after_sale(d);   // = price nếu không có sale
+    int64_t total      = ep_total_cost(d);
+
+    if (d->partial) {
+        ESP_LOGI(TAG, "Parsed OK: add=%u partial update (sale=%d, title=%s)",
+            (unsigned)d->add, d->has_sale ? (int)d->sale : -1, d->has_title ? d->title : "-");
+    } else if (d->has_sale) {
+        ESP_LOGI(TAG,
+            "Parsed OK: add=%u price=%d barcode=%s sale=%u%% -> unit=%d, total=%lld",
+            (unsigned)d->add, (int)d->price, d->barcode,
+            (unsigned)d->sale, (int)unit_after, (long long)total);
+    } else {
+        ESP_LOGI(TAG,
+            "Parsed OK: add=%u price=%d barcode=%s sale=NA -> unit=%d, total=%lld",
+            (unsigned)d->add, (int)d->price, d->barcode,
+            (int)unit_after, (long long)total);
+    }
+
+    // Đặt cờ có dữ liệu mới (nếu bạn đang dùng cơ chế try_get_last)
+    s_has_data = 1;
+
+    // Gửi luôn; hàng mesh đầy -> chờ trước (PUBACK chưa đi, broker giữ lệnh sau)
+    cmd_window_wait();
+    if (example_ble_mesh_send_vendor_message(false) == ESP_OK) {
+        ++s_stats.ok;
+        return true;
+    }
+    ++s_stats.failed;
+    return false;
+}
+
+/* Hết 1 message lệnh: PUBACK đi khi handler trả về nên lệnh phải nằm trong
+ * WAL trước; cả lô CBOR chung 1 lần chờ commit */
+static void cmd_done(int64_t t_rx, bool queued)
+{
+    if (queued && example_ble_mesh_cmd_sync(APP_MQTT_SYNC_MS) == ESP_ERR_TIMEOUT) {
+        ++s_stats.sync_timeouts;
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t_rx);
+    s_stats.handle_us_sum += us;
+    if (us > s_stats.handle_us_max) s_stats.handle_us_max = us;
+    cmd_rate_log();
+}
+
+static void cbor_rec(const EPData *rec, void *arg)
+{
+    if (cmd_submit(rec)) {
+        ++*(int *)arg;
+    }
+}
+
+/* Lệnh CBOR: lô có thể lớn hơn buffer MQTT -> ghép fragment rồi giải mã 1 lần */
+static void handle_cbor_fragment(esp_mqtt_event_handle_t event)
+{
+    if (event->current_data_offset == 0) {
+        s_cbor_ok = event->total_data_len > 0 && event->total_data_len <= (int)sizeof(s_cbor);
+        if (!s_cbor_ok) {
+            ESP_LOGE(TAG, "CBOR command too large (%d B, max %d)",
+                     event->total_data_len, (int)sizeof(s_cbor));
+            ++s_stats.failed;
+            return;
+        }
+    }
+    if (!s_cbor_ok || event->current_data_offset + event->data_len > event->total_data_len) {
+        return;
+    }
+    memcpy(s_cbor + event->current_data_offset, event->data, event->data_len);
+    if (event->current_data_offset + event->data_len < event->total_data_len) {
+        return;
+    }
+    s_cbor_ok = false;
+
+    int64_t t_rx = esp_timer_get_time();
+    int queued = 0;
+    int bad = 0;
+    int n = ep_cbor_parse(s_cbor, (size_t)event->total_data_len, cbor_rec, &queued, &bad);
+    if (n < 0) {
+        ESP_LOGE(TAG, "CBOR command malformed (%d)", n);
+        ++s_stats.failed;
+    } else {
+        ESP_LOGI(TAG, "CBOR batch: %d records (%d B), queued %d, rejected %d",
+                 n, event->total_data_len, queued, bad);
+        s_stats.rx     += (uint32_t)bad;
+        s_stats.failed += (uint32_t)bad;
+    }
+    ++s_stats.cbor_msgs;
+    cmd_done(t_rx, queued > 0);
+}
+
+/* Đối soát catalogue: "0x0001-0x7FFF/16" -> digest 16 dải con (tag_state.h).
+ * Back office so với digest tính từ catalogue, hỏi tiếp dải lệch (n >= độ
+ * rộng dải = từng tag) rồi chỉ gửi lại các bản ghi khác */
+static void handle_digest(esp_mqtt_event_handle_t event)
+{
+    char req[40];
+    int n = event->data_len < (int)sizeof(req) - 1 ? event->data_len : (int)sizeof(req) - 1;
+    memcpy(req, event->data, n);
+    req[n] = '\0';
+
+    unsigned long lo = 0x0001, hi = 0x7FFF, parts = 16;
+    char *p = req;
+    if (*p && *p != '/') {
+        lo = strtoul(p, &p, 0);
+        hi = (*p == '-') ? strtoul(p + 1, &p, 0) : lo;
+    }
+    if (*p == '/') {
+        parts = strtoul(p + 1, NULL, 0);
+    }
+    if (lo == 0 || lo > hi || hi > 0xFFFF || parts == 0) {
+        ESP_LOGW(TAG, "Bad digest request \"%s\"", req);
+        return;
+    }
+    if (parts > APP_MQTT_DIGEST_PARTS_MAX) parts = APP_MQTT_DIGEST_PARTS_MAX;
+
+    static tag_state_range_t r[APP_MQTT_DIGEST_PARTS_MAX];
+    static char out[64 + APP_MQTT_DIGEST_PARTS_MAX * 32];
+    size_t cnt = tag_state_digest((uint16_t)lo, (uint16_t)hi, (uint16_t)parts, r, APP_MQTT_DIGEST_PARTS_MAX);
+    int len = snprintf(out, sizeof(out), "{\"lo\":%lu,\"hi\":%lu,\"n\":%lu,\"r\":[", lo, hi, parts);
+    for (size_t i = 0; i < cnt; ++i) {
+        len += snprintf(out + len, sizeof(out) - len, "%s[%u,%u,%u,\"%08" PRIx32 "\"]",
+                        i ? "," : "", r[i].lo, r[i].hi, r[i].count, r[i].digest);
+    }
+    len += snprintf(out + len, sizeof(out) - len, "]}");
+
+    char topic[96];
+    snprintf(topic, sizeof(topic), TOPIC_DIGEST "/%s", s_client_id);
+    esp_mqtt_client_publish(event->client, topic, out, len, 0, 0);
+    ESP_LOGI(TAG, "Digest 0x%04lx-0x%04lx/%lu: %u ranges", lo, hi, parts, (unsigned)cnt);
+}
+
+/* Mở 1 đợt nhận tag mới: "300/4" = 4 tag delegate, 300 s. Kết quả từng tag
+ * về topic/status (kind ONBOARDED) */
+static void handle_onboard(esp_mqtt_event_handle_t event)
+{
+    char req[24];
+    int n = event->data_len < (int)sizeof(req) - 1 ? event->data_len : (int)sizeof(req) - 1;
+    memcpy(req, event->data, n);
+    req[n] = '\0';
+
+    char *p = req;
+    unsigned long secs = strtoul(p, &p, 0);
+    unsigned long cnt  = (*p == '/') ? strtoul(p + 1, NULL, 0) : 0;
+    if (secs > 0xFFFF || cnt > 0xFF) {
+        ESP_LOGW(TAG, "Bad onboard request \"%s\"", req);
+        return;
+    }
+    esp_err_t err = example_ble_mesh_onboard((uint16_t)secs, (uint8_t)cnt);
+    ESP_LOGI(TAG, "Onboard %lus x %lu delegates (%s)", secs, cnt, esp_err_to_name(err));
+}
+
+/* Snapshot node_table: 1 mảng / tag, không tên field cho gọn (app_mqtt.h) */
+static void publish_health(void)
+{
+    static node_link_t snap[NODE_TABLE_MAX];
+    static char out[96 + NODE_TABLE_MAX * 48];
+    if (!s_online || !s_health_lock) return;
+
+    xSemaphoreTake(s_health_lock, portMAX_DELAY);
+    size_t cnt = node_table_snapshot(snap, NODE_TABLE_MAX);
+    unsigned by[3] = {0};
+    for (size_t i = 0; i < cnt; ++i) {
+        by[node_table_health(&snap[i])]++;
+    }
+    int len = snprintf(out, sizeof(out), "{\"t\":%" PRIu32 ",\"ok\":%u,\"weak\":%u,\"dead\":%u,\"n\":[",
+                       now_ms() / 1000, by[NODE_HEALTH_OK], by[NODE_HEALTH_WEAK], by[NODE_HEALTH_DEAD]);
+    for (size_t i = 0; i < cnt && len < (int)sizeof(out) - 48; ++i) {
+        const node_link_t *l = &snap[i];
+        uint8_t ack = node_table_ack_pct(l);
+        len += snprintf(out + len, sizeof(out) - len, "%s[%u,%" PRIu32 ",%u,%u,%d,%d,%d,%u]",
+                        i ? "," : "", l->addr, node_table_age_ms(l) / 1000, l->hops_min, l->hops_max,
+                        l->rssi, ack == 0xFF ? -1 : ack, (int)node_table_health(l), l->hbs);
+    }
+    len += snprintf(out + len, sizeof(out) - len, "]}");
+
+    char topic[96];
+    snprintf(topic, sizeof(topic), TOPIC_HEALTH "/%s", s_client_id);
+    /* enqueue: copy vào outbox của esp-mqtt, task MQTT gửi -> timer không chờ socket */
+    esp_mqtt_client_enqueue(client, topic, out, len, 0, 1, true);
+    xSemaphoreGive(s_health_lock);
+    if (by[NODE_HEALTH_DEAD] || by[NODE_HEALTH_WEAK]) {
+        ESP_LOGW(TAG, "Health: %u ok, %u weak, %u dead", by[NODE_HEALTH_OK],
+                 by[NODE_HEALTH_WEAK], by[NODE_HEALTH_DEAD]);
+    }
+}
+
+static void health_timer_cb(void *arg)
+{
+    publish_health();
+}
+
+/* outbox gọi từ task của nó, chỉ khi đang CONNECTED */
+static int status_publish(const char *data, int len)
+{
+    return esp_mqtt_client_publish(client, TOPIC_STATUS, data, len, 1, 0);
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     ESP_LOGD(TAG, "Event dispatched from event loop base=%s, event_id=%" PRIi32, base, event_id);
@@ -56,11 +543,30 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-        msg_id = esp_mqtt_client_subscribe(client, "topic/command", 0);  //topic
+        boot_ts_mark(BOOT_TS_MQTT);
+        /* session bền: lệnh QoS 1 gửi lúc offline được broker giữ, tới ngay sau đây */
+        ESP_LOGI(TAG, "session %s", event->session_present ? "resumed" : "new");
+        subscribe_zones(client);
+        msg_id = esp_mqtt_client_subscribe(client, TOPIC_DIGEST, 0);
+        ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, TOPIC_ONBOARD, 1);
+        ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, TOPIC_HEALTH, 0);
         ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, TOPIC_GROUP "+", 1);
+        ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        /* ảnh / firmware lớn: QoS 0, back office tự gửi lại */
+        msg_id = esp_mqtt_client_subscribe(client, TOPIC_IMAGE "+", 0);
+        ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, TOPIC_NODE_FW, 0);
+        ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        outbox_set_online(status_publish);      // xả backlog lúc offline
+        s_online = true;
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+        s_online = false;
+        outbox_set_online(NULL);
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
@@ -70,12 +576,54 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
         break;
     case MQTT_EVENT_PUBLISHED:
-        ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        outbox_on_published(event->msg_id);
         break;
     case MQTT_EVENT_DATA: {
-        ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-        printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-        printf("DATA=%.*s\r\n", event->data_len, event->data);
+        if (event->current_data_offset == 0) {
+            s_bin = topic_is(event, TOPIC_IMAGE)    ? BIN_IMAGE
+                  : topic_is(event, TOPIC_NODE_FW)  ? BIN_NODE_FW
+                  : cmd_topic(event) == CMD_CBOR    ? BIN_CMD_CBOR
+                  : BIN_NONE;
+        }
+        if (s_bin == BIN_IMAGE) {
+            handle_image_fragment(event);
+            break;
+        }
+        if (s_bin == BIN_CMD_CBOR) {
+            handle_cbor_fragment(event);
+            break;
+        }
+        if (s_bin == BIN_NODE_FW) {
+            handle_node_fw_fragment(event);
+            break;
+        }
+        if (event->current_data_offset > 0) {
+            break;      // JSON lệnh / danh sách nhóm không bao giờ lớn hơn buffer MQTT
+        }
+        if (topic_is(event, TOPIC_GROUP)) {
+            handle_group(event);
+            break;
+        }
+        if (event->topic_len == (int)strlen(TOPIC_DIGEST) && topic_is(event, TOPIC_DIGEST)) {
+            handle_digest(event);
+            break;
+        }
+        if (event->topic_len == (int)strlen(TOPIC_ONBOARD) && topic_is(event, TOPIC_ONBOARD)) {
+            handle_onboard(event);
+            break;
+        }
+        if (event->topic_len == (int)strlen(TOPIC_HEALTH) && topic_is(event, TOPIC_HEALTH)) {
+            publish_health();
+            break;
+        }
+        if (cmd_topic(event) != CMD_JSON) {
+            ESP_LOGW(TAG, "Unexpected topic %.*s", event->topic_len, event->topic);
+            break;
+        }
+        ESP_LOGD(TAG, "MQTT_EVENT_DATA TOPIC=%.*s DATA=%.*s",
+                 event->topic_len, event->topic, event->data_len, event->data);
+        int64_t t_rx = esp_timer_get_time();
 
         // Copy payload sang buffer có NUL-terminator
         char json[256];
@@ -85,47 +633,15 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         json[n] = '\0';
 
         EPData d;
+        bool queued = false;
         if (ep_parse(json, &d) == EP_OK) {
-            // ---- GÁN ĐẦY ĐỦ VÀO s_last để bên BLE Mesh lấy ra ----
-            s_last.add = d.add;
-            s_last.price = d.price;
-
-            // copy barcode an toàn, luôn NUL-terminate
-            strncpy(s_last.barcode, d.barcode, sizeof(s_last.barcode));
-            s_last.barcode[sizeof(s_last.barcode) - 1] = '\0';
-
-            // NEW: copy sale (%)
-            s_last.has_sale = d.has_sale;
-            s_last.sale     = d.sale;  // 0..100 nếu has_sale=true
-
-            // (nếu bạn đang dùng API dạng kho chung)
-            // mqtt_set_last(&s_last);    // <-- dùng khi có hàm này
-
-            // ---- Log rõ ràng ----
-            int32_t unit_after = ep_unit_price_after_sale(&d);   // = price nếu không có sale
-            int64_t total      = ep_total_cost(&d);
-
-            if (d.has_sale) {
-                ESP_LOGI(TAG,
-                    "Parsed OK: add=%u price=%d barcode=%s sale=%u%% -> unit=%d, total=%lld",
-                    (unsigned)d.add, (int)d.price, d.barcode,
-                    (unsigned)d.sale, (int)unit_after, (long long)total);
-            } else {
-                ESP_LOGI(TAG,
-                    "Parsed OK: add=%u price=%d barcode=%s sale=NA -> unit=%d, total=%lld",
-                    (unsigned)d.add, (int)d.price, d.barcode,
-                    (int)unit_after, (long long)total);
-            }
-
-            // Đặt cờ có dữ liệu mới (nếu bạn đang dùng cơ chế try_get_last)
-            s_has_data = 1;
-
-            // Gửi luôn (nếu bạn muốn bắn ngay sau khi nhận MQTT)
-            example_ble_mesh_send_vendor_message(false);
-
+            queued = cmd_submit(&d);
         } else {
             ESP_LOGE(TAG, "Parse fail (payload khong dung format)");
+            ++s_stats.rx;
+            ++s_stats.failed;
         }
+        cmd_done(t_rx, queued);
         break;
     }
     case MQTT_EVENT_ERROR:
@@ -146,13 +662,40 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 
 void mqtt_app_start(void)
 {
+    /* client id cố định theo MAC: broker nối lại đúng session sau reboot */
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(s_client_id, sizeof(s_client_id), APP_MQTT_CLIENT_PREFIX "%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
     const esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = "mqtt://broker.hivemq.com:1883",
+        .broker.address.uri = APP_MQTT_BROKER_URI,
+        .credentials.client_id = s_client_id,
+        .session.disable_clean_session = true,
+#if CONFIG_MQTT_PROTOCOL_5
+        .session.protocol_ver = MQTT_PROTOCOL_V_5,     // shared subscription
+#endif
     };
 
-    ESP_LOGI(TAG, "[APP] Free memory: %" PRIu32 " bytes", esp_get_free_heap_size());
+    ESP_LOGI(TAG, "[APP] Free memory: %" PRIu32 " bytes, client %s", esp_get_free_heap_size(), s_client_id);
     client = esp_mqtt_client_init(&mqtt_cfg);   
+#if CONFIG_MQTT_PROTOCOL_5
+    /* MQTT 5: clean start = false chưa đủ, session hết khi mất kết nối nếu expiry = 0 */
+    esp_mqtt5_connection_property_config_t conn_prop = {
+        .session_expiry_interval = APP_MQTT_SESSION_EXPIRY_S,
+    };
+    esp_mqtt5_client_set_connect_property(client, &conn_prop);
+#endif
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    s_health_lock = xSemaphoreCreateMutex();
+    if (APP_MQTT_HEALTH_MS) {
+        const esp_timer_create_args_t targs = { .callback = health_timer_cb, .name = "mqtt_health" };
+        esp_timer_handle_t t;
+        if (esp_timer_create(&targs, &t) == ESP_OK) {
+            esp_timer_start_periodic(t, (uint64_t)APP_MQTT_HEALTH_MS * 1000);
+        }
+    }
     esp_mqtt_client_start(client);
 }
\ No newline at end of file
@@ -4,14 +4,107 @@
 #include <stdint.h>
 #include "ep_data.h"
 
+// Lệnh giá vào bằng QoS 1, session bền (clean session = false, client id cố
+// định theo MAC): lệnh gửi lúc gateway mất kết nối được broker giữ lại.
+// esp-mqtt gửi PUBACK sau khi handler trả về, nên handler chỉ trả về khi lệnh
+// đã nằm trong WAL (outq) -> broker chỉ xoá lệnh gateway đã ghi bền. Hàng
+// mesh vượt APP_MQTT_INFLIGHT_MAX thì handler chờ (hoãn PUBACK): burst nằm ở
+// broker chứ không nằm trong RAM gateway.
+//
+// Topic lệnh chia theo cửa hàng / khu (zone), gateway chỉ subscribe khu của nó:
+//   store/<id>/zone/<z>/cmd        JSON (ep_parse)
+//   store/<id>/zone/<z>/cmd/cbor   CBOR (ep_cbor.h), 1 bản ghi hoặc 1 lô; cả lô
+//                                  chung 1 lần chờ WAL trước PUBACK
+// Khu quá tải cho 1 gateway: đặt APP_MQTT_SHARE_GROUP giống nhau trên các
+// gateway của khu -> MQTT 5 shared subscription "$share/<group>/...", broker
+// chia lệnh của khu cho các gateway (mỗi lệnh tới đúng 1 gateway). Điều kiện:
+//  - các gateway cùng khu nằm chung 1 mạng mesh (cùng NetKey/AppKey, dải
+//    unicast riêng) để gateway nào cũng tới được mọi tag của khu
+//  - broker không giữ thứ tự giữa các gateway: back office không gửi lệnh
+//    mới cho 1 tag khi lệnh trước chưa có kết quả (topic/status, theo cid)
+//
+// Đối soát sau khi thay gateway / mất kết nối lâu: hỏi store/<id>/digest
+// ("lo-hi/n"), mỗi gateway trả digest theo dải ở store/<id>/digest/<client id>
+// (cách tính: tag_state.h); chỉ gửi lại bản ghi của các dải lệch.
+//
+// Sức khoẻ mesh (node_table.h): mỗi APP_MQTT_HEALTH_MS hoặc khi có message ở
+// store/<id>/health, gateway phát snapshot (retained) ở
+// store/<id>/health/<client id>:
+//   {"t":<uptime s>,"ok":n,"weak":n,"dead":n,
+//    "n":[[addr,tuổi s,hop min,hop max,rssi,ack % (-1 = chưa có),trạng thái,số heartbeat],...]}
+// trạng thái 0 ok / 1 weak / 2 dead.
+
+// ============ Config ============
+#ifndef APP_MQTT_STORE_ID
+#define APP_MQTT_STORE_ID       "1"
+#endif
+#ifndef APP_MQTT_ZONES
+#define APP_MQTT_ZONES          "1"         // "1,2,5"; "+" = mọi khu của cửa hàng
+#endif
+#ifndef APP_MQTT_SHARE_GROUP
+#define APP_MQTT_SHARE_GROUP    ""          // "" = subscribe thường; cần CONFIG_MQTT_PROTOCOL_5
+#endif
+#ifndef APP_MQTT_ZONES_MAX
+#define APP_MQTT_ZONES_MAX      8
+#endif
+#ifndef APP_MQTT_SESSION_EXPIRY_S
+#define APP_MQTT_SESSION_EXPIRY_S  86400    // MQTT 5: broker giữ session (lệnh QoS 1) khi offline
+#endif
+#ifndef APP_MQTT_BROKER_URI
+#define APP_MQTT_BROKER_URI     "mqtt://broker.hivemq.com:1883"   // đo tải: Mosquitto trong LAN
+#endif
+#ifndef APP_MQTT_CLIENT_PREFIX
+#define APP_MQTT_CLIENT_PREFIX  "eslgw-"    // + MAC
+#endif
+#ifndef APP_MQTT_INFLIGHT_MAX
+#define APP_MQTT_INFLIGHT_MAX   24          // gói chờ trong mesh_tx (< phần NORMAL của hàng)
+#endif
+#ifndef APP_MQTT_WINDOW_WAIT_MS
+#define APP_MQTT_WINDOW_WAIT_MS 10000       // quá hạn -> nhận tiếp, mesh_tx tự từ chối nếu đầy
+#endif
+#ifndef APP_MQTT_SYNC_MS
+#define APP_MQTT_SYNC_MS        1000        // chờ WAL commit tối đa
+#endif
+#ifndef APP_MQTT_CBOR_MAX
+#define APP_MQTT_CBOR_MAX       8192        // 1 lô .../cmd/cbor (~30 B/bản ghi)
+#endif
+#ifndef APP_MQTT_DIGEST_PARTS_MAX
+#define APP_MQTT_DIGEST_PARTS_MAX  64       // dải con / 1 lần hỏi digest
+#endif
+#ifndef APP_MQTT_HEALTH_MS
+#define APP_MQTT_HEALTH_MS      60000       // 0 = chỉ khi được hỏi
+#endif
+#ifndef APP_MQTT_RATE_LOG_MS
+#define APP_MQTT_RATE_LOG_MS    10000
+#endif
+
+typedef struct {
+    uint32_t rx;                // lệnh nhận (.../cmd, bản ghi .../cmd/cbor)
+    uint32_t cbor_msgs;         // message .../cmd/cbor
+    uint32_t ok;                // đã xếp hàng mesh
+    uint32_t failed;            // parse / xếp hàng lỗi
+    uint32_t window_waits;      // phải chờ cửa sổ
+    uint32_t window_wait_ms_max;
+    uint32_t sync_timeouts;     // WAL chưa kịp ghi khi hết APP_MQTT_SYNC_MS
+    uint64_t handle_us_sum;     // nhận -> trả về (PUBACK)
+    uint32_t handle_us_max;
+} app_mqtt_stats_t;
+
 void mqtt_app_start(void);
 
+void mqtt_get_stats(app_mqtt_stats_t *out);
+
 typedef struct {
     uint16_t add;
+    bool     partial;    // chỉ sale/title, giữ price/barcode đang có trên tag
     int32_t  price;
     char     barcode[EP_BARCODE_MAX_LEN];
     bool     has_sale;   // true nếu JSON có "sale"
     uint8_t  sale;       // 0..100 (phần trăm)
+    bool     has_title;  // true nếu JSON có "title"
+    char     title[EP_TITLE_MAX_LEN];
+    uint8_t  prio;       // EPPrio: 0 urgent, 1 normal, 2 bulk
+    uint32_t cid;        // correlation id, 0 = không có
 } CmdMsg;
 
 // lấy bản ghi mới nhất (trả true nếu có dữ liệu)
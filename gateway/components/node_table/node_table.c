@@ -0,0 +1,225 @@
+#include "node_table.h"
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "node_table";
+
+typedef struct {
+    node_link_t link;
+    uint8_t     hist[NODE_TABLE_HOP_HIST];
+    uint8_t     hist_pos;
+} node_entry_t;
+
+static node_entry_t      s_tab[NODE_TABLE_MAX];
+static SemaphoreHandle_t s_lock;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static bool is_unicast(uint16_t addr) {
+    return addr != 0 && addr < 0x8000;
+}
+
+static bool fresh(const node_entry_t *e, uint32_t now) {
+    return e->link.samples > 0 && (now - e->link.last_ms) < NODE_TABLE_STALE_MS;
+}
+
+static node_entry_t *find(uint16_t addr) {
+    for (int i = 0; i < NODE_TABLE_MAX; ++i) {
+        if (s_tab[i].link.samples && s_tab[i].link.addr == addr) return &s_tab[i];
+    }
+    return NULL;
+}
+
+// slot trống, hoặc node nghe lâu nhất
+static node_entry_t *alloc(uint16_t addr) {
+    node_entry_t *victim = &s_tab[0];
+    for (int i = 0; i < NODE_TABLE_MAX; ++i) {
+        if (!s_tab[i].link.samples) { victim = &s_tab[i]; break; }
+        if ((int32_t)(s_tab[i].link.last_ms - victim->link.last_ms) < 0) victim = &s_tab[i];
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->link.addr = addr;
+    return victim;
+}
+
+static uint8_t entry_ttl(const node_entry_t *e) {
+    // TTL = số relay + 1 để tới nơi, +1 dự phòng đường vòng; TTL 1 bị cấm
+    unsigned ttl = (unsigned)e->link.hops_max + 2;
+    return (uint8_t)(ttl > NODE_TABLE_TTL_MAX ? NODE_TABLE_TTL_MAX : ttl);
+}
+
+static uint8_t entry_xmit(const node_entry_t *e) {
+    uint8_t n = 1;
+    if (e->link.rssi < NODE_TABLE_RSSI_WEAK) ++n;
+    if (e->link.hops_max >= 2)                ++n;
+    if (e->link.rssi > NODE_TABLE_RSSI_GOOD && e->link.hops_max == 0 && n > 1) --n;
+    return n;
+}
+
+void node_table_init(void) {
+    if (!s_lock) s_lock = xSemaphoreCreateMutex();
+}
+
+static void observe(uint16_t addr, uint8_t init_ttl, uint8_t recv_ttl, int8_t rssi, bool hb) {
+    if (!s_lock || !is_unicast(addr)) return;
+    uint8_t hops = recv_ttl <= init_ttl ? (uint8_t)(init_ttl - recv_ttl) : 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    node_entry_t *e = find(addr);
+    if (!e) e = alloc(addr);
+
+    node_link_t *l = &e->link;
+    uint8_t old_ttl = l->samples ? entry_ttl(e) : 0;
+
+    e->hist[e->hist_pos] = hops;
+    e->hist_pos = (uint8_t)((e->hist_pos + 1) % NODE_TABLE_HOP_HIST);
+    uint8_t n_hist = l->samples + 1 < NODE_TABLE_HOP_HIST ? (uint8_t)(l->samples + 1) : NODE_TABLE_HOP_HIST;
+    l->hops_max = 0;
+    l->hops_min = 0xFF;
+    for (uint8_t i = 0; i < n_hist; ++i) {
+        if (e->hist[i] > l->hops_max) l->hops_max = e->hist[i];
+        if (e->hist[i] < l->hops_min) l->hops_min = e->hist[i];
+    }
+    l->hops    = hops;
+    l->rssi    = l->samples ? (int8_t)((3 * (int)l->rssi + rssi) / 4) : rssi;
+    l->last_ms = now_ms();
+    if (l->samples < 0xFFFF) ++l->samples;
+    if (hb && l->hbs < 0xFFFF) ++l->hbs;
+
+    uint8_t new_ttl = entry_ttl(e);
+    xSemaphoreGive(s_lock);
+
+    if (new_ttl != old_ttl) {
+        ESP_LOGI(TAG, "0x%04x: hops %u (max %u), rssi %d -> ttl %u",
+                 addr, hops, l->hops_max, l->rssi, new_ttl);
+    }
+}
+
+void node_table_observe(uint16_t addr, uint8_t init_ttl, uint8_t recv_ttl, int8_t rssi) {
+    observe(addr, init_ttl, recv_ttl, rssi, false);
+}
+
+void node_table_heartbeat(uint16_t addr, uint8_t init_ttl, uint8_t recv_ttl, int8_t rssi) {
+    observe(addr, init_ttl, recv_ttl, rssi, true);
+}
+
+void node_table_track(uint16_t addr, uint16_t via) {
+    if (!s_lock || !is_unicast(addr)) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (find(addr)) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    node_entry_t *v = find(via);
+    // via chưa biết: hop theo TTL mặc định (TTL = hops + 2)
+    uint8_t hops = v ? (uint8_t)(v->link.hops_max + 1) : (uint8_t)(NODE_TABLE_TTL_DEFAULT - 2);
+    int8_t  rssi = v ? v->link.rssi : NODE_TABLE_RSSI_WEAK;
+    node_entry_t *e = alloc(addr);
+    node_link_t  *l = &e->link;
+    e->hist[0]  = hops;
+    e->hist_pos = 1;
+    l->hops     = hops;
+    l->hops_min = hops;
+    l->hops_max = hops;
+    l->rssi     = rssi;
+    l->samples  = 1;
+    l->last_ms  = now_ms();
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "0x%04x: tracked via 0x%04x, hops ~%u", addr, via, hops);
+}
+
+void node_table_on_ack(uint16_t addr, bool ok) {
+    if (!s_lock || !is_unicast(addr)) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    node_entry_t *e = find(addr);
+    if (e) {
+        node_link_t *l = &e->link;
+        if (l->ack_ok + l->ack_fail >= NODE_TABLE_ACK_WINDOW) {
+            l->ack_ok   = (uint8_t)((l->ack_ok + 1) / 2);
+            l->ack_fail = (uint8_t)(l->ack_fail / 2);
+        }
+        if (ok) ++l->ack_ok;
+        else    ++l->ack_fail;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+uint8_t node_table_ttl(uint16_t dst) {
+    if (!s_lock) return NODE_TABLE_TTL_DEFAULT;
+    uint32_t now = now_ms();
+    uint8_t  ttl = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (is_unicast(dst)) {
+        node_entry_t *e = find(dst);
+        if (e && fresh(e, now)) ttl = entry_ttl(e);
+    } else {
+        // group: phải tới được node xa nhất; chưa biết ai -> mặc định
+        for (int i = 0; i < NODE_TABLE_MAX; ++i) {
+            if (fresh(&s_tab[i], now)) {
+                uint8_t t = entry_ttl(&s_tab[i]);
+                if (t > ttl) ttl = t;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return ttl ? ttl : NODE_TABLE_TTL_DEFAULT;
+}
+
+uint8_t node_table_xmit_count(uint16_t dst) {
+    if (!s_lock || !is_unicast(dst)) return NODE_TABLE_XMIT_DEFAULT;
+    uint8_t n = NODE_TABLE_XMIT_DEFAULT;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    node_entry_t *e = find(dst);
+    if (e && fresh(e, now_ms())) n = entry_xmit(e);
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+bool node_table_get(uint16_t addr, node_link_t *out) {
+    if (!s_lock || !out) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    node_entry_t *e = find(addr);
+    if (e) *out = e->link;
+    xSemaphoreGive(s_lock);
+    return e != NULL;
+}
+
+size_t node_table_snapshot(node_link_t *out, size_t max) {
+    if (!s_lock || !out) return 0;
+    size_t n = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < NODE_TABLE_MAX && n < max; ++i) {
+        if (s_tab[i].link.samples) out[n++] = s_tab[i].link;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+uint8_t node_table_ack_pct(const node_link_t *l) {
+    unsigned n = (unsigned)l->ack_ok + l->ack_fail;
+    return n ? (uint8_t)(l->ack_ok * 100u / n) : 0xFF;
+}
+
+uint32_t node_table_age_ms(const node_link_t *l) {
+    return now_ms() - l->last_ms;
+}
+
+node_health_t node_table_health(const node_link_t *l) {
+    if (node_table_age_ms(l) > NODE_TABLE_DEAD_MS) return NODE_HEALTH_DEAD;
+    uint8_t ack = node_table_ack_pct(l);
+    // ACK chỉ tính khi đủ mẫu: 1 lần hết giờ lúc tag đang vẽ không phải tag yếu
+    if (l->rssi < NODE_TABLE_RSSI_WEAK || l->hops_max >= NODE_TABLE_HOPS_WEAK ||
+        (l->ack_ok + l->ack_fail >= 4 && ack < NODE_TABLE_ACK_WEAK_PCT)) {
+        return NODE_HEALTH_WEAK;
+    }
+    return NODE_HEALTH_OK;
+}
@@ -0,0 +1,107 @@
+#ifndef __NODE_TABLE_H
+#define __NODE_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bảng link theo node phía gateway: học số hop (TTL lúc gửi - TTL nhận) và
+// RSSI từ mọi gói tag gửi về (STATUS, BLK_ACK, OTA_STATUS, heartbeat), rồi
+// chọn TTL và số lần phát lại nhỏ nhất đủ tới từng đích.
+//
+// Cùng bảng là bản đồ sức khoẻ mạng: tag gửi heartbeat định kỳ về gateway
+// (đặt lúc provision, prov_sched), mỗi lệnh cần STATUS được tính ACK / hết
+// giờ. Tag im quá NODE_TABLE_DEAD_MS là DEAD, sóng yếu / nhiều hop / hay mất
+// ACK là WEAK -> back office thấy trước khi cập nhật giá thất bại.
+// Tag nhận qua delegate (fprov_mgr) được ghi vào bảng ngay lúc onboard
+// (node_table_track), chưa từng gửi heartbeat thì cũng thành DEAD.
+
+// ============ Config ============
+#ifndef NODE_TABLE_MAX
+#define NODE_TABLE_MAX          384     // CONFIG_BLE_MESH_MAX_PROV_NODES + FPROV_MGR_REGISTRY_MAX; 16 B link / tag
+#endif
+#ifndef NODE_TABLE_HOP_HIST
+#define NODE_TABLE_HOP_HIST     4       // lấy max trên N mẫu gần nhất (đường đi đổi)
+#endif
+#ifndef NODE_TABLE_TTL_DEFAULT
+#define NODE_TABLE_TTL_DEFAULT  3       // node chưa biết
+#endif
+#ifndef NODE_TABLE_TTL_MAX
+#define NODE_TABLE_TTL_MAX      10
+#endif
+#ifndef NODE_TABLE_XMIT_DEFAULT
+#define NODE_TABLE_XMIT_DEFAULT 2       // = ESP_BLE_MESH_TRANSMIT(2, ..) cũ
+#endif
+#ifndef NODE_TABLE_RSSI_WEAK
+#define NODE_TABLE_RSSI_WEAK    (-80)   // dBm, dưới mức này phát thêm 1 lần
+#endif
+#ifndef NODE_TABLE_RSSI_GOOD
+#define NODE_TABLE_RSSI_GOOD    (-65)
+#endif
+#ifndef NODE_TABLE_STALE_MS
+#define NODE_TABLE_STALE_MS     (30 * 60 * 1000)  // quá lâu không nghe -> về mặc định
+#endif
+#ifndef NODE_TABLE_DEAD_MS
+#define NODE_TABLE_DEAD_MS      (3 * 256 * 1000)  // lỡ 3 heartbeat (RELAY_MGR_HB_PERIOD_LOG)
+#endif
+#ifndef NODE_TABLE_ACK_WINDOW
+#define NODE_TABLE_ACK_WINDOW   32      // đủ mẫu -> chia đôi bộ đếm (ưu tiên gần đây)
+#endif
+#ifndef NODE_TABLE_ACK_WEAK_PCT
+#define NODE_TABLE_ACK_WEAK_PCT 80
+#endif
+#ifndef NODE_TABLE_HOPS_WEAK
+#define NODE_TABLE_HOPS_WEAK    4
+#endif
+
+// Giữ 16 B: quét cả bảng (TTL group, snapshot) đi tuần tự qua 1 mảng liền.
+typedef struct {
+    uint16_t addr;
+    uint8_t  hops;                      // số relay ở mẫu gần nhất
+    uint8_t  hops_min;                  // min / max trên NODE_TABLE_HOP_HIST mẫu gần nhất
+    uint8_t  hops_max;
+    int8_t   rssi;                      // EWMA dBm (chặng cuối tới gateway)
+    uint16_t samples;
+    uint8_t  ack_ok;                    // lệnh có STATUS (cửa sổ NODE_TABLE_ACK_WINDOW)
+    uint8_t  ack_fail;                  // lệnh hết giờ chờ STATUS
+    uint16_t hbs;                       // heartbeat đã nhận
+    uint32_t last_ms;
+} node_link_t;
+
+typedef enum {
+    NODE_HEALTH_OK = 0,
+    NODE_HEALTH_WEAK,
+    NODE_HEALTH_DEAD,
+} node_health_t;
+
+void    node_table_init(void);
+
+// init_ttl: TTL tag dùng khi gửi; recv_ttl: TTL khi tới gateway.
+void    node_table_observe(uint16_t addr, uint8_t init_ttl, uint8_t recv_ttl, int8_t rssi);
+
+// Như observe, cho heartbeat (đếm riêng để biết tag đã được đặt heartbeat).
+void    node_table_heartbeat(uint16_t addr, uint8_t init_ttl, uint8_t recv_ttl, int8_t rssi);
+
+// Tag mới onboard qua delegate via: ghi vào bảng (hop ước lượng = via + 1)
+// để được theo dõi dù chưa nghe gói nào. Đã có trong bảng -> không đổi.
+void    node_table_track(uint16_t addr, uint16_t via);
+
+// Lệnh cần phản hồi tới addr: có STATUS (ok) hoặc client hết giờ chờ.
+void    node_table_on_ack(uint16_t addr, bool ok);
+
+// TTL cho gói tới dst (group -> đủ tới node xa nhất đã biết).
+uint8_t node_table_ttl(uint16_t dst);
+
+// Số lần phát lại (count trong ESP_BLE_MESH_TRANSMIT(count, interval)).
+uint8_t node_table_xmit_count(uint16_t dst);
+
+bool    node_table_get(uint16_t addr, node_link_t *out);
+size_t  node_table_snapshot(node_link_t *out, size_t max);
+
+// Tỉ lệ ACK (%), 0xFF = chưa gửi lệnh nào cần phản hồi.
+uint8_t       node_table_ack_pct(const node_link_t *l);
+// Phân loại 1 bản ghi lấy từ get / snapshot.
+node_health_t node_table_health(const node_link_t *l);
+uint32_t      node_table_age_ms(const node_link_t *l);
+
+#endif
@@ -0,0 +1,434 @@
+#include "outbox.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+
+#include "ep_proto.h"
+#include "outq.h"
+
+static const char *TAG = "outbox";
+
+#define SPILL_PATH          OUTQ_BASE_PATH "/outbox"
+#define REC_LEN             32      // boot(4) seq(4) ts(4) cid(4) v1(4) v2(4) addr(2) tid(2) kind(1) rsv(2) chk(1)
+#define SPILL_AT            (OUTBOX_RAM_RECS * 3 / 4)
+#define SPILL_CHUNK         128
+#define JSON_REC_MAX        82      // "[4294967295,4,65535,65535,4294967295,-2147483648,-2147483648],"
+#define JSON_MAX            (96 + OUTBOX_BATCH_MAX * JSON_REC_MAX)
+#define STATS_LOG_MS        60000
+
+typedef struct {
+    uint32_t boot;
+    uint32_t seq;
+    uint32_t ts_ms;
+    uint32_t cid;
+    int32_t  v1;
+    int32_t  v2;
+    uint16_t addr;
+    uint16_t tid;
+    uint8_t  kind;
+} rec_t;
+
+typedef enum {
+    SRC_NONE = 0,
+    SRC_FILE,
+    SRC_RAM,
+} src_t;
+
+static SemaphoreHandle_t s_lock;
+static volatile outbox_publish_fn_t s_pub;
+static uint32_t          s_boot;
+static uint32_t          s_seq;
+
+static rec_t             s_ring[OUTBOX_RAM_RECS];
+static uint16_t          s_head;                    // vị trí ghi tiếp theo
+static uint16_t          s_count;
+
+// lô đang bay (dưới lock)
+static src_t             s_src;
+static uint16_t          s_inflight_n;
+static uint32_t          s_inflight_bytes;          // SRC_FILE: byte file của lô
+static int               s_inflight_id;
+static uint32_t          s_inflight_ms;
+static int               s_early_id = -1;           // PUBLISHED tới trước khi biết msg_id
+
+// file spill (chỉ task đụng tới I/O; offset đọc dưới lock)
+static bool              s_fs_ok;
+static uint32_t          s_fsize;
+static uint32_t          s_rd_off;
+
+static rec_t             s_batch[OUTBOX_BATCH_MAX];
+static char              s_json[JSON_MAX];
+static outbox_stats_t    s_stats;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static uint16_t ring_at(uint16_t i) {        // i = 0: bản ghi cũ nhất
+    return (uint16_t)((s_head + OUTBOX_RAM_RECS - s_count + i) % OUTBOX_RAM_RECS);
+}
+
+static void rec_pack(const rec_t *r, uint8_t out[REC_LEN]) {
+    ep_put_le32(out, r->boot);
+    ep_put_le32(out + 4, r->seq);
+    ep_put_le32(out + 8, r->ts_ms);
+    ep_put_le32(out + 12, r->cid);
+    ep_put_le32(out + 16, (uint32_t)r->v1);
+    ep_put_le32(out + 20, (uint32_t)r->v2);
+    ep_put_le16(out + 24, r->addr);
+    ep_put_le16(out + 26, r->tid);
+    out[28] = r->kind;
+    out[29] = 0;
+    out[30] = 0;
+    out[31] = (uint8_t)ep_hash32(out, REC_LEN - 1, 0);
+}
+
+static bool rec_unpack(const uint8_t in[REC_LEN], rec_t *r) {
+    if (in[REC_LEN - 1] != (uint8_t)ep_hash32(in, REC_LEN - 1, 0)) return false;
+    r->boot  = ep_get_le32(in);
+    r->seq   = ep_get_le32(in + 4);
+    r->ts_ms = ep_get_le32(in + 8);
+    r->cid   = ep_get_le32(in + 12);
+    r->v1    = (int32_t)ep_get_le32(in + 16);
+    r->v2    = (int32_t)ep_get_le32(in + 20);
+    r->addr  = ep_get_le16(in + 24);
+    r->tid   = ep_get_le16(in + 26);
+    r->kind  = in[28];
+    return true;
+}
+
+// ============ Spill (task) ============
+static void spill(void) {
+    static rec_t   recs[SPILL_CHUNK];
+    static uint8_t raw[SPILL_CHUNK * REC_LEN];
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // lô RAM đang bay nằm ở đầu ring: không tách ra được, đợi ACK
+    if (s_count < SPILL_AT || s_src == SRC_RAM) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    uint16_t n = s_count - SPILL_AT / 2;
+    if (n > SPILL_CHUNK) n = SPILL_CHUNK;
+    uint32_t room = (s_stats.flash_cap > s_fsize) ? (s_stats.flash_cap - s_fsize) / REC_LEN : 0;
+    for (uint16_t i = 0; i < n; ++i) {
+        recs[i] = s_ring[ring_at(i)];
+    }
+    s_count -= n;
+    xSemaphoreGive(s_lock);
+
+    uint16_t keep = (n < room) ? n : (uint16_t)room;
+    uint16_t lost = n - keep;
+    if (keep) {
+        // giữ phần mới hơn nếu file gần đầy
+        for (uint16_t i = 0; i < keep; ++i) {
+            rec_pack(&recs[lost + i], raw + i * REC_LEN);
+        }
+        FILE *fp = fopen(SPILL_PATH, "ab");
+        size_t w = 0;
+        if (fp) {
+            w = fwrite(raw, REC_LEN, keep, fp);
+            fflush(fp);
+            fsync(fileno(fp));
+            fclose(fp);
+        }
+        if (w != keep) {
+            ESP_LOGW(TAG, "spill write %u/%u", (unsigned)w, keep);
+        }
+        lost += keep - (uint16_t)w;
+        keep = (uint16_t)w;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_fsize += (uint32_t)keep * REC_LEN;
+    s_stats.spilled += keep;
+    s_stats.dropped += lost;
+    xSemaphoreGive(s_lock);
+    if (lost) {
+        ESP_LOGW(TAG, "flash backlog full, dropped %u records", lost);
+    }
+}
+
+// ============ Drain (task) ============
+static int json_batch(const rec_t *r, uint16_t n) {
+    int len = snprintf(s_json, sizeof(s_json),
+                       "{\"boot\":\"%08" PRIx32 "\",\"seq\":%" PRIu32 ",\"t0\":%" PRIu32 ",\"r\":[",
+                       r[0].boot, r[0].seq, r[0].ts_ms);
+    for (uint16_t i = 0; i < n && len < (int)sizeof(s_json); ++i) {
+        len += snprintf(s_json + len, sizeof(s_json) - len,
+                        "%s[%" PRIu32 ",%u,%u,%u,%" PRIu32 ",%" PRId32 ",%" PRId32 "]",
+                        i ? "," : "", r[i].ts_ms - r[0].ts_ms, r[i].kind,
+                        r[i].addr, r[i].tid, r[i].cid, r[i].v1, r[i].v2);
+    }
+    if (len < (int)sizeof(s_json)) {
+        len += snprintf(s_json + len, sizeof(s_json) - len, "]}");
+    }
+    return (len < (int)sizeof(s_json)) ? len : -1;
+}
+
+// Đọc tối đa OUTBOX_BATCH_MAX bản ghi hợp lệ, cùng boot, từ offset off.
+// *used = số byte file đã tiêu (kể cả bản ghi hỏng bị bỏ qua).
+static uint16_t file_read(uint32_t off, uint32_t end, uint32_t *used) {
+    static uint8_t raw[OUTBOX_BATCH_MAX * REC_LEN];
+    *used = 0;
+    FILE *fp = fopen(SPILL_PATH, "rb");
+    if (!fp) {
+        *used = end - off;      // file mất -> coi như đã xả
+        return 0;
+    }
+    uint32_t want = end - off;
+    if (want > sizeof(raw)) want = sizeof(raw);
+    size_t got = 0;
+    if (fseek(fp, (long)off, SEEK_SET) == 0) {
+        got = fread(raw, 1, want, fp);
+    }
+    fclose(fp);
+
+    uint16_t n = 0;
+    uint32_t corrupt = 0;
+    for (size_t o = 0; o + REC_LEN <= got; o += REC_LEN) {
+        rec_t r;
+        if (!rec_unpack(raw + o, &r)) {
+            ++corrupt;
+        } else if (n && r.boot != s_batch[0].boot) {
+            break;                  // lô sau bắt đầu từ boot mới
+        } else {
+            s_batch[n++] = r;
+        }
+        *used = (uint32_t)(o + REC_LEN);
+    }
+    if (got < REC_LEN) {
+        *used = end - off;          // đuôi cụt / lỗi đọc
+    }
+    if (corrupt) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.corrupt += corrupt;
+        xSemaphoreGive(s_lock);
+    }
+    return n;
+}
+
+static void drain(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    outbox_publish_fn_t pub = s_pub;
+    if (s_src != SRC_NONE) {
+        if (now_ms() - s_inflight_ms < OUTBOX_PUB_TIMEOUT_MS) {
+            xSemaphoreGive(s_lock);
+            return;
+        }
+        ++s_stats.timeouts;
+        s_src = SRC_NONE;           // bản ghi vẫn còn -> lô sau gửi lại
+    }
+    if (!pub) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    src_t    src;
+    uint16_t n = 0;
+    uint32_t bytes = 0;
+    if (s_rd_off < s_fsize) {
+        uint32_t off = s_rd_off, end = s_fsize;
+        xSemaphoreGive(s_lock);
+        n = file_read(off, end, &bytes);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        src = SRC_FILE;
+        if (n == 0) {               // toàn bản ghi hỏng
+            s_rd_off += bytes;
+            xSemaphoreGive(s_lock);
+            return;
+        }
+    } else {
+        // gom theo cửa sổ: đủ lô hoặc bản ghi cũ nhất đã chờ đủ lâu
+        if (s_count < OUTBOX_BATCH_MAX &&
+            (s_count == 0 || now_ms() - s_ring[ring_at(0)].ts_ms < OUTBOX_WINDOW_MS)) {
+            xSemaphoreGive(s_lock);
+            return;
+        }
+        src = SRC_RAM;
+        n = (s_count < OUTBOX_BATCH_MAX) ? s_count : OUTBOX_BATCH_MAX;
+        for (uint16_t i = 0; i < n; ++i) {
+            rec_t *r = &s_ring[ring_at(i)];
+            if (i && r->boot != s_batch[0].boot) {
+                n = i;
+                break;
+            }
+            s_batch[i] = *r;
+        }
+    }
+    if (n == 0) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    s_src            = src;
+    s_inflight_n     = n;
+    s_inflight_bytes = bytes;
+    s_inflight_id    = -1;
+    s_inflight_ms    = now_ms();
+    s_early_id       = -1;
+    xSemaphoreGive(s_lock);
+
+    int len = json_batch(s_batch, n);
+    int id  = (len > 0) ? pub(s_json, len) : -1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (id < 0) {
+        s_src = SRC_NONE;           // mất kết nối giữa chừng; thử lại nhịp sau
+    } else {
+        s_inflight_id = id;
+        ++s_stats.batches;
+    }
+    bool acked = (id >= 0 && s_early_id == id);
+    xSemaphoreGive(s_lock);
+    if (acked) {
+        outbox_on_published(id);
+    }
+}
+
+static void file_reset_if_drained(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool drained = s_fsize && s_rd_off >= s_fsize && s_src != SRC_FILE;
+    if (drained) {
+        s_fsize  = 0;
+        s_rd_off = 0;
+    }
+    xSemaphoreGive(s_lock);
+    if (drained) {
+        remove(SPILL_PATH);
+    }
+}
+
+static void log_stats(void) {
+    outbox_stats_t st;
+    outbox_get_stats(&st);
+    ESP_LOGI(TAG, "queued %" PRIu32 ", published %" PRIu32 " in %" PRIu32 " batches, spilled %" PRIu32
+             ", dropped %" PRIu32 ", timeouts %" PRIu32 ", backlog ram %u / flash %" PRIu32,
+             st.queued, st.published, st.batches, st.spilled, st.dropped, st.timeouts,
+             st.ram_backlog, st.flash_backlog);
+}
+
+static void outbox_task(void *arg) {
+    uint32_t last_log = now_ms();
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(OUTBOX_DRAIN_MS));
+        if (s_fs_ok) {
+            spill();
+        }
+        drain();
+        if (s_fs_ok) {
+            file_reset_if_drained();
+        }
+        if (now_ms() - last_log >= STATS_LOG_MS) {
+            last_log = now_ms();
+            log_stats();
+        }
+    }
+}
+
+// ============ API ============
+esp_err_t outbox_init(void) {
+    if (s_lock) return ESP_OK;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    s_boot = esp_random();
+
+    size_t total = 0, used = 0;
+    s_fs_ok = outq_fs_info(&total, &used);
+    if (s_fs_ok) {
+        uint32_t cap = (uint32_t)((total - used) / 2);
+        if (cap > OUTBOX_FLASH_MAX) cap = OUTBOX_FLASH_MAX;
+        struct stat st;
+        if (stat(SPILL_PATH, &st) == 0) {
+            // backlog của lần chạy trước: xả trước bản ghi mới
+            s_fsize = (uint32_t)st.st_size - (uint32_t)st.st_size % REC_LEN;
+            cap += s_fsize;
+        }
+        s_stats.flash_cap = cap - cap % REC_LEN;
+        ESP_LOGI(TAG, "flash backlog %" PRIu32 " / %" PRIu32 " records",
+                 s_fsize / REC_LEN, s_stats.flash_cap / REC_LEN);
+    } else {
+        ESP_LOGW(TAG, "no filesystem, RAM-only (%u records)", OUTBOX_RAM_RECS);
+    }
+
+    if (xTaskCreate(outbox_task, "outbox", 4096, NULL, 3, NULL) != pdPASS) {
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void outbox_put(outbox_kind_t kind, uint16_t addr, uint16_t tid, uint32_t cid,
+                int32_t v1, int32_t v2) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_count == OUTBOX_RAM_RECS) {
+        // chỉ xảy ra khi flash hỏng/đầy hoặc lô RAM đang bay: giữ bản ghi cũ
+        ++s_stats.dropped;
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    s_ring[s_head] = (rec_t){
+        .boot  = s_boot,
+        .seq   = s_seq++,
+        .ts_ms = now_ms(),
+        .cid   = cid,
+        .v1    = v1,
+        .v2    = v2,
+        .addr  = addr,
+        .tid   = tid,
+        .kind  = (uint8_t)kind,
+    };
+    s_head = (uint16_t)((s_head + 1) % OUTBOX_RAM_RECS);
+    ++s_count;
+    ++s_stats.queued;
+    xSemaphoreGive(s_lock);
+}
+
+void outbox_set_online(outbox_publish_fn_t publish) {
+    s_pub = publish;
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_src = SRC_NONE;               // publish đang bay coi như mất, gửi lại sau
+    xSemaphoreGive(s_lock);
+}
+
+void outbox_on_published(int msg_id) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_src != SRC_NONE && s_inflight_id < 0) {
+        s_early_id = msg_id;        // publish() chưa trả về
+    } else if (s_src != SRC_NONE && s_inflight_id == msg_id) {
+        if (s_src == SRC_FILE) {
+            s_rd_off += s_inflight_bytes;
+        } else {
+            s_count -= s_inflight_n;
+        }
+        s_stats.published += s_inflight_n;
+        s_src = SRC_NONE;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void outbox_get_stats(outbox_stats_t *out) {
+    if (!out) return;
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->flash_backlog = (s_fsize - s_rd_off) / REC_LEN;
+    out->ram_backlog   = s_count;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,83 @@
+#ifndef __OUTBOX_H
+#define __OUTBOX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Hàng đợi báo cáo gateway -> back office (topic/status), sống qua lúc mất
+// Wi-Fi / broker. Mỗi bản ghi là kết quả 1 chặng của 1 lệnh giá (đã tới tag,
+// đã vẽ, lỗi...), kèm correlation id "cid" của lệnh MQTT.
+//
+//  - outbox_put chỉ ghi 1 bản ghi 32B vào ring RAM (dưới lock, không I/O)
+//  - ring đầy 3/4 -> task chuyển phần cũ nhất xuống file trên partition
+//    LittleFS của outq; trần file = min(OUTBOX_FLASH_MAX, 1/2 chỗ trống lúc init)
+//  - online: task gom tối đa OUTBOX_BATCH_MAX bản ghi thành 1 publish QoS 1,
+//    khi đủ OUTBOX_BATCH_MAX hoặc bản ghi cũ nhất đã chờ OUTBOX_WINDOW_MS
+//    (backlog: mỗi OUTBOX_DRAIN_MS), file trước rồi RAM; 1 publish đang bay, bản ghi
+//    chỉ bị xoá khi có MQTT_EVENT_PUBLISHED đúng msg_id (hết hạn -> gửi lại)
+//  - "nén": JSON theo lô, key 1 lần, thời gian là delta so với bản ghi đầu
+//    {"boot":"5f1c09aa","seq":812,"t0":93412,"r":[[0,0,5,4097,77,12,340],[610,1,5,4097,77,1850,0]]}
+//    r = [dt_ms, kind, addr, tid, cid, v1, v2]; ~30B/bản ghi thay vì ~120B JSON rời
+//
+// Giao nhận at-least-once: reboot giữa lúc drain có thể gửi lặp; back office
+// lọc trùng theo (boot, seq).
+
+// ============ Config ============
+#ifndef OUTBOX_RAM_RECS
+#define OUTBOX_RAM_RECS         1024    // 32 KB RAM
+#endif
+#ifndef OUTBOX_FLASH_MAX
+#define OUTBOX_FLASH_MAX        (128 * 1024)
+#endif
+#ifndef OUTBOX_BATCH_MAX
+#define OUTBOX_BATCH_MAX        64
+#endif
+#ifndef OUTBOX_WINDOW_MS
+#define OUTBOX_WINDOW_MS        1000    // tải thường: <= 1 publish/s
+#endif
+#ifndef OUTBOX_DRAIN_MS
+#define OUTBOX_DRAIN_MS         200     // <= 5 publish/s khi xả backlog
+#endif
+#ifndef OUTBOX_PUB_TIMEOUT_MS
+#define OUTBOX_PUB_TIMEOUT_MS   10000
+#endif
+
+typedef enum {
+    OUTBOX_K_DELIVERED = 0,     // tag đã nhận; v1 = ms xếp hàng, v2 = ms trên mesh
+    OUTBOX_K_RENDERED,          // màn hình vẽ xong; v1 = ms vẽ (tag báo)
+    OUTBOX_K_FAILED,            // không tới tag (xếp hàng / mesh bỏ gói / timeout STATUS); v1 = esp_err_t / errno âm của stack.
+                                // Không phải chốt cuối: sweep / tag ngủ sâu thức dậy gửi lại, tới nơi -> DELIVERED cùng cid
+    OUTBOX_K_GROUP,             // phiên nhóm kết thúc; v1 = số tag thiếu, v2 = ms trên mesh
+    OUTBOX_K_SUPERSEDED,        // cid bị lệnh mới hơn (tid) cho cùng tag thay trước khi tới
+    OUTBOX_K_ONBOARDED,         // tag mới qua delegate; cid = UUID[12..15] LE, v1 = delegate, v2 = số element
+} outbox_kind_t;
+
+// Publish 1 lô (app_mqtt: QoS 1 lên topic/status). Trả msg_id, < 0 nếu lỗi.
+typedef int (*outbox_publish_fn_t)(const char *data, int len);
+
+typedef struct {
+    uint32_t queued;
+    uint32_t published;         // bản ghi đã được broker xác nhận
+    uint32_t batches;
+    uint32_t spilled;           // bản ghi chuyển xuống flash
+    uint32_t dropped;           // ring + file đầy
+    uint32_t corrupt;           // bản ghi file sai checksum
+    uint32_t timeouts;
+    uint32_t flash_cap;
+    uint32_t flash_backlog;     // bản ghi còn trong file
+    uint16_t ram_backlog;
+} outbox_stats_t;
+
+esp_err_t outbox_init(void);
+
+void      outbox_put(outbox_kind_t kind, uint16_t addr, uint16_t tid, uint32_t cid,
+                     int32_t v1, int32_t v2);
+
+// MQTT connected: publish = hàm gửi; disconnected: NULL. Gọi được trước init.
+void      outbox_set_online(outbox_publish_fn_t publish);
+void      outbox_on_published(int msg_id);
+
+void      outbox_get_stats(outbox_stats_t *out);
+
+#endif
@@ -0,0 +1,493 @@
+#include "outq.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_littlefs.h"
+
+#include "ep_proto.h"
+
+static const char *TAG = "outq";
+
+#define LOG_PATH            OUTQ_BASE_PATH "/log"
+#define TMP_PATH            OUTQ_BASE_PATH "/log.tmp"
+
+#define REC_MAGIC           0xEA
+#define REC_CMD             1
+#define REC_ACK             2
+#define HDR_LEN             8       // magic, type, body len (LE16), ep_hash32(body) (LE32)
+#define CMD_FIXED           9       // seq(4) dst(2) tid(2) prio(1)
+#define ACK_LEN             8       // seq(4) dst(2) tid(2)
+#define REC_MAX             (HDR_LEN + CMD_FIXED + OUTQ_PAYLOAD_MAX)
+#define OFF_NONE            UINT32_MAX
+#define REPLAY_RETRY_MS     200
+#define STATS_LOG_MS        60000
+
+typedef struct {
+    uint32_t seq;
+    uint32_t off;           // vị trí bản ghi CMD trong file; OFF_NONE = còn trong buffer
+    uint16_t dst;
+    uint16_t tid;
+    uint16_t rlen;          // độ dài cả bản ghi
+    uint8_t  prio;
+} pend_t;
+
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t      s_task;
+static outq_replay_fn_t  s_replay;
+static FILE             *s_fp;
+
+static uint8_t           s_buf[OUTQ_BUF_SIZE];      // append -> đây (dưới lock)
+static uint8_t           s_wbuf[OUTQ_BUF_SIZE];     // writer ghi từ đây (ngoài lock)
+static uint16_t          s_len;
+static uint32_t          s_size;                    // byte đã commit trong LOG_PATH
+static uint32_t          s_seq;
+static uint32_t          s_durable_seq;             // mọi seq < giá trị này đã fsync
+static SemaphoreHandle_t s_commit_sem;              // báo outq_sync sau mỗi commit
+static bool              s_failed;                  // log hỏng, không phục hồi được: thôi nhận lệnh
+
+static pend_t            s_pend[OUTQ_MAX_PENDING];
+static uint16_t          s_n_pend;
+static pend_t            s_snap[OUTQ_MAX_PENDING];  // replay / compaction (chỉ task writer)
+static outq_stats_t      s_stats;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static pend_t *pend_find(uint16_t dst) {
+    for (uint16_t i = 0; i < s_n_pend; ++i) {
+        if (s_pend[i].dst == dst) return &s_pend[i];
+    }
+    return NULL;
+}
+
+static void pend_remove(pend_t *p) {
+    *p = s_pend[--s_n_pend];
+}
+
+// đầy -> bỏ lệnh cũ nhất khỏi bảng (bản ghi vẫn trong log tới lần compaction)
+static pend_t *pend_upsert(uint16_t dst) {
+    pend_t *p = pend_find(dst);
+    if (p) return p;
+    if (s_n_pend < OUTQ_MAX_PENDING) return &s_pend[s_n_pend++];
+    pend_t *old = &s_pend[0];
+    for (uint16_t i = 1; i < s_n_pend; ++i) {
+        if ((int32_t)(s_pend[i].seq - old->seq) < 0) old = &s_pend[i];
+    }
+    ESP_LOGW(TAG, "pending table full, forget 0x%04x", old->dst);
+    return old;
+}
+
+// ============ Bản ghi ============
+static uint16_t rec_put(uint8_t *out, uint8_t type, uint32_t seq, uint16_t dst, uint16_t tid,
+                        uint8_t prio, const uint8_t *payload, uint16_t len) {
+    uint8_t *b = out + HDR_LEN;
+    ep_put_le32(&b[0], seq);
+    ep_put_le16(&b[4], dst);
+    ep_put_le16(&b[6], tid);
+    uint16_t blen = ACK_LEN;
+    if (type == REC_CMD) {
+        b[8] = prio;
+        memcpy(&b[CMD_FIXED], payload, len);
+        blen = (uint16_t)(CMD_FIXED + len);
+    }
+    out[0] = REC_MAGIC;
+    out[1] = type;
+    ep_put_le16(&out[2], blen);
+    ep_put_le32(&out[4], ep_hash32(b, blen, 0));
+    return (uint16_t)(HDR_LEN + blen);
+}
+
+// Đọc 1 bản ghi tại vị trí hiện tại của f; trả độ dài, 0 nếu hết / hỏng.
+static uint16_t rec_read(FILE *f, uint8_t *rec) {
+    if (fread(rec, 1, HDR_LEN, f) != HDR_LEN) return 0;
+    uint16_t blen = ep_get_le16(&rec[2]);
+    if (rec[0] != REC_MAGIC || (rec[1] != REC_CMD && rec[1] != REC_ACK) ||
+        blen < ACK_LEN || blen > REC_MAX - HDR_LEN) {
+        return 0;
+    }
+    if (fread(rec + HDR_LEN, 1, blen, f) != blen) return 0;
+    if (ep_hash32(rec + HDR_LEN, blen, 0) != ep_get_le32(&rec[4])) return 0;
+    return (uint16_t)(HDR_LEN + blen);
+}
+
+static void commit(void);
+
+// ============ Replay ============
+// Dựng lại bảng pending từ log; cắt đuôi hỏng. Chạy trước khi có task writer.
+static void load_log(void) {
+    FILE *f = fopen(LOG_PATH, "rb");
+    if (!f) return;
+
+    static uint8_t rec[REC_MAX];
+    uint32_t off = 0, n_rec = 0;
+    uint16_t rlen;
+    while ((rlen = rec_read(f, rec)) != 0) {
+        const uint8_t *b   = rec + HDR_LEN;
+        uint32_t       seq = ep_get_le32(&b[0]);
+        uint16_t       dst = ep_get_le16(&b[4]);
+        uint16_t       tid = ep_get_le16(&b[6]);
+        if (rec[1] == REC_CMD) {
+            pend_t *p = pend_upsert(dst);
+            *p = (pend_t){ .seq = seq, .off = off, .dst = dst, .tid = tid, .rlen = rlen, .prio = b[8] };
+        } else {
+            pend_t *p = pend_find(dst);
+            if (p && p->tid == tid) pend_remove(p);
+        }
+        if ((int32_t)(seq + 1 - s_seq) > 0) s_seq = seq + 1;
+        off += rlen;
+        ++n_rec;
+    }
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    fclose(f);
+
+    if (end > (long)off) {
+        ESP_LOGW(TAG, "log tail corrupt at %" PRIu32 " (%ld B), truncate", off, end);
+        truncate(LOG_PATH, (off_t)off);
+    }
+    s_size = off;
+    ESP_LOGI(TAG, "log: %" PRIu32 " records, %" PRIu32 " B, %u pending", n_rec, off, s_n_pend);
+}
+
+static uint16_t snapshot_by_seq(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < s_n_pend; ++i) {
+        if (s_pend[i].off != OFF_NONE) s_snap[n++] = s_pend[i];
+    }
+    xSemaphoreGive(s_lock);
+    // insertion sort theo seq: gửi lại đúng thứ tự đã nhận
+    for (uint16_t i = 1; i < n; ++i) {
+        pend_t t = s_snap[i];
+        uint16_t j = i;
+        while (j > 0 && (int32_t)(s_snap[j - 1].seq - t.seq) > 0) {
+            s_snap[j] = s_snap[j - 1];
+            --j;
+        }
+        s_snap[j] = t;
+    }
+    return n;
+}
+
+static bool still_pending(const pend_t *snap) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    pend_t *p  = pend_find(snap->dst);
+    bool    ok = p && p->seq == snap->seq;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+// Gửi lại các lệnh pending; hàng mesh_tx đầy thì chờ rồi thử lại.
+static void replay_pending(void) {
+    uint16_t n = snapshot_by_seq();
+    if (!n || !s_replay) return;
+
+    FILE *f = fopen(LOG_PATH, "rb");
+    if (!f) return;
+    static uint8_t rec[REC_MAX];
+    uint32_t t0 = now_ms();
+    for (uint16_t i = 0; i < n; ++i) {
+        const pend_t *s = &s_snap[i];
+        if (fseek(f, (long)s->off, SEEK_SET) != 0 || rec_read(f, rec) != s->rlen) continue;
+        const uint8_t *payload = rec + HDR_LEN + CMD_FIXED;
+        uint16_t       len     = (uint16_t)(s->rlen - HDR_LEN - CMD_FIXED);
+        for (;;) {
+            if (!still_pending(s)) break;       // đã có lệnh mới hơn / ACK
+            esp_err_t err = s_replay(s->dst, s->tid, s->prio, payload, len);
+            if (err != ESP_ERR_NO_MEM) {
+                if (err == ESP_OK) ++s_stats.replayed;
+                break;
+            }
+            commit();                           // lệnh mới đến trong lúc replay
+            vTaskDelay(pdMS_TO_TICKS(REPLAY_RETRY_MS));
+        }
+    }
+    fclose(f);
+    ESP_LOGI(TAG, "replayed %" PRIu32 "/%u pending in %" PRIu32 " ms",
+             s_stats.replayed, n, now_ms() - t0);
+}
+
+// ============ Commit / compaction ============
+// Ghi lỗi / ghi thiếu: cắt file về base (không để nửa bản ghi chặn load_log),
+// mở lại. Lô vẫn nằm đầu s_buf, nhịp sau ghi lại. Không cắt / mở lại được ->
+// log hỏng: append / sync báo lỗi, không bao giờ báo bền nữa.
+static void commit_rollback(uint32_t base) {
+    if (s_fp) fclose(s_fp);
+    s_fp = NULL;
+    if (truncate(LOG_PATH, (off_t)base) == 0) s_fp = fopen(LOG_PATH, "ab");
+    if (s_fp) return;
+    ESP_LOGE(TAG, "log unrecoverable, WAL disabled");
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_failed = true;
+    s_len    = 0;
+    xSemaphoreGive(s_lock);
+}
+
+static void commit(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint16_t n    = s_len;
+    uint32_t base = s_size;
+    uint32_t upto = s_seq;
+    // chưa xoá khỏi s_buf: append mới nối phía sau, ghi xong mới bỏ n byte đầu
+    memcpy(s_wbuf, s_buf, n);
+    if (!n && !s_failed) s_durable_seq = upto;
+    xSemaphoreGive(s_lock);
+    if (!n) return;
+    if (!s_fp) {                                // compaction không mở lại được
+        commit_rollback(base);
+        if (!s_fp) return;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    bool ok = fwrite(s_wbuf, 1, n, s_fp) == n && fflush(s_fp) == 0 && fsync(fileno(s_fp)) == 0;
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    if (!ok) {
+        ESP_LOGE(TAG, "commit %u B failed, roll back to %" PRIu32 " B", n, base);
+        ++s_stats.commit_fails;
+        commit_rollback(base);
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_len -= n;
+    memmove(s_buf, &s_buf[n], s_len);
+    // lệnh vừa xuống flash: ghi nhận vị trí để compaction / replay đọc lại
+    for (uint16_t pos = 0; pos + HDR_LEN <= n; ) {
+        const uint8_t *r    = &s_wbuf[pos];
+        uint16_t       rlen = (uint16_t)(HDR_LEN + ep_get_le16(&r[2]));
+        if (r[1] == REC_CMD) {
+            pend_t *p = pend_find(ep_get_le16(&r[HDR_LEN + 4]));
+            if (p && p->seq == ep_get_le32(&r[HDR_LEN])) p->off = base + pos;
+        }
+        pos += rlen;
+    }
+    s_size = base + n;
+    s_durable_seq = upto;
+    ++s_stats.commits;
+    s_stats.commit_bytes  += n;
+    s_stats.commit_us_sum += us;
+    if (us > s_stats.commit_us_max) s_stats.commit_us_max = us;
+    xSemaphoreGive(s_lock);
+    xSemaphoreGive(s_commit_sem);
+}
+
+static uint32_t live_bytes(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t b = 0;
+    for (uint16_t i = 0; i < s_n_pend; ++i) b += s_pend[i].rlen;
+    xSemaphoreGive(s_lock);
+    return b;
+}
+
+// Chép lệnh pending (đã commit) sang file mới rồi rename đè. Append trong lúc
+// này nằm trong s_buf, commit kế tiếp ghi vào file mới.
+static void compact(void) {
+    uint16_t n = snapshot_by_seq();
+    static uint8_t rec[REC_MAX];
+    FILE *in  = fopen(LOG_PATH, "rb");
+    FILE *out = fopen(TMP_PATH, "wb");
+    if (!in || !out) {
+        if (in)  fclose(in);
+        if (out) fclose(out);
+        ESP_LOGE(TAG, "compaction: open failed");
+        return;
+    }
+    uint32_t off = 0;
+    bool     ok  = true;
+    for (uint16_t i = 0; i < n && ok; ++i) {
+        if (fseek(in, (long)s_snap[i].off, SEEK_SET) != 0 || rec_read(in, rec) != s_snap[i].rlen) {
+            s_snap[i].off = OFF_NONE;
+            continue;
+        }
+        ok = fwrite(rec, 1, s_snap[i].rlen, out) == s_snap[i].rlen;
+        s_snap[i].off = off;
+        off += s_snap[i].rlen;
+    }
+    fclose(in);
+    ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    fclose(out);
+    if (!ok) {
+        ESP_LOGE(TAG, "compaction: write failed");
+        remove(TMP_PATH);
+        return;
+    }
+
+    fclose(s_fp);
+    s_fp = NULL;
+    if (rename(TMP_PATH, LOG_PATH) != 0) {
+        ESP_LOGE(TAG, "compaction: rename failed");
+        s_fp = fopen(LOG_PATH, "ab");
+        return;
+    }
+    s_fp = fopen(LOG_PATH, "ab");
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t before = s_size;
+    for (uint16_t i = 0; i < n; ++i) {
+        pend_t *p = pend_find(s_snap[i].dst);
+        if (p && p->seq == s_snap[i].seq) p->off = s_snap[i].off;
+    }
+    s_size = off;
+    ++s_stats.compactions;
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "compacted %" PRIu32 " -> %" PRIu32 " B (%u pending)", before, off, n);
+}
+
+static void outq_task(void *arg) {
+    replay_pending();
+    uint32_t last_log = now_ms();
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OUTQ_COMMIT_MS));
+        commit();
+        if (s_size > OUTQ_COMPACT_BYTES && live_bytes() * 2 < s_size) compact();
+
+        uint32_t now = now_ms();
+        if (s_stats.commits && now - last_log >= STATS_LOG_MS) {
+            last_log = now;
+            ESP_LOGI(TAG, "%" PRIu32 " cmd, %" PRIu32 " ack, %" PRIu32 " commits (%" PRIu32 " per 100 cmd, "
+                     "%" PRIu32 " failed), avg %" PRIu32 " us, max %" PRIu32 " us, log %" PRIu32 " B, %u pending",
+                     s_stats.appended, s_stats.acked, s_stats.commits,
+                     s_stats.appended ? s_stats.commits * 100 / s_stats.appended : 0, s_stats.commit_fails,
+                     s_stats.commit_us_sum / s_stats.commits, s_stats.commit_us_max,
+                     s_size, s_n_pend);
+        }
+    }
+}
+
+// ============ API ============
+esp_err_t outq_init(outq_replay_fn_t replay) {
+#if OUTQ_ENABLED
+    if (s_lock) return ESP_OK;
+    s_replay = replay;
+    s_lock   = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    s_commit_sem = xSemaphoreCreateBinary();
+    if (!s_commit_sem) {
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = OUTQ_BASE_PATH,
+        .partition_label = OUTQ_PARTITION_LABEL,
+        .format_if_mount_failed = true,
+        .dont_mount = false,
+    };
+    esp_err_t err = esp_vfs_littlefs_register(&conf);
+    if (err == ESP_OK) {
+        load_log();
+        s_fp = fopen(LOG_PATH, "ab");
+        if (!s_fp) err = ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        // không có WAL: append trả ESP_ERR_INVALID_STATE, gateway chạy chỉ RAM
+        ESP_LOGE(TAG, "%s unavailable: %s", OUTQ_PARTITION_LABEL, esp_err_to_name(err));
+        vSemaphoreDelete(s_commit_sem);
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+        return err;
+    }
+    if (xTaskCreate(outq_task, "outq", 4096, NULL, 2, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#else
+    (void)replay;
+#endif
+    return ESP_OK;
+}
+
+esp_err_t outq_append(uint16_t dst, uint16_t tid, uint8_t prio, const uint8_t *payload, uint16_t len) {
+    if (!s_lock) return OUTQ_ENABLED ? ESP_ERR_INVALID_STATE : ESP_OK;
+    if (!payload || len == 0 || len > OUTQ_PAYLOAD_MAX) return ESP_ERR_INVALID_ARG;
+
+    bool kick = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_failed) {
+        xSemaphoreGive(s_lock);
+        return ESP_FAIL;
+    }
+    if (s_len + HDR_LEN + CMD_FIXED + len > OUTQ_BUF_SIZE) {
+        ++s_stats.dropped;
+        xSemaphoreGive(s_lock);
+        xTaskNotifyGive(s_task);
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t seq  = s_seq++;
+    uint16_t rlen = rec_put(&s_buf[s_len], REC_CMD, seq, dst, tid, prio, payload, len);
+    s_len += rlen;
+    pend_t *p = pend_upsert(dst);
+    *p = (pend_t){ .seq = seq, .off = OFF_NONE, .dst = dst, .tid = tid, .rlen = rlen, .prio = prio };
+    ++s_stats.appended;
+    kick = s_len > OUTQ_BUF_SIZE * 3 / 4;
+    xSemaphoreGive(s_lock);
+
+    if (kick) xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+esp_err_t outq_sync(uint32_t timeout_ms) {
+    if (!s_lock) return OUTQ_ENABLED ? ESP_ERR_INVALID_STATE : ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t target = s_seq;
+    xSemaphoreGive(s_lock);
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t limit = pdMS_TO_TICKS(timeout_ms);
+    for (;;) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool done   = (int32_t)(s_durable_seq - target) >= 0;
+        bool failed = s_failed;
+        xSemaphoreGive(s_lock);
+        if (failed) return ESP_FAIL;
+        if (done) return ESP_OK;
+        TickType_t spent = xTaskGetTickCount() - start;
+        if (spent >= limit) return ESP_ERR_TIMEOUT;
+        xSemaphoreTake(s_commit_sem, 0);        // bỏ tín hiệu cũ
+        xTaskNotifyGive(s_task);
+        xSemaphoreTake(s_commit_sem, limit - spent);
+    }
+}
+
+void outq_ack(uint16_t dst, uint16_t tid) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    pend_t *p = pend_find(dst);
+    // chỉ ghi ACK khớp lệnh pending: STATUS lặp / TID cũ không làm log phình
+    if (p && p->tid == tid && !s_failed && s_len + HDR_LEN + ACK_LEN <= OUTQ_BUF_SIZE) {
+        s_len += rec_put(&s_buf[s_len], REC_ACK, s_seq++, dst, tid, 0, NULL, 0);
+        pend_remove(p);
+        ++s_stats.acked;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void outq_get_stats(outq_stats_t *out) {
+    if (!out) return;
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->log_bytes = s_size;
+    out->pending   = s_n_pend;
+    xSemaphoreGive(s_lock);
+}
+
+bool outq_fs_info(size_t *total, size_t *used) {
+    size_t t = 0, u = 0;
+    if (!s_lock || esp_littlefs_info(OUTQ_PARTITION_LABEL, &t, &u) != ESP_OK) return false;
+    if (total) *total = t;
+    if (used)  *used  = u;
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef __OUTQ_H
+#define __OUTQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Write-ahead log cho lệnh giá đã nhận (partition LittleFS riêng "outq").
+//
+// Mỗi lệnh được ghi 1 bản ghi CMD (gói SEND đã dựng + đích + TID + lớp ưu
+// tiên), mỗi STATUS đúng TID ghi 1 bản ghi ACK. Khi khởi động, log được đọc
+// lại: lệnh mới nhất của từng đích chưa có ACK được gửi lại theo thứ tự cũ.
+//
+//  - group commit: append chỉ copy vào buffer RAM; task writer ghi + fsync
+//    cả lô mỗi OUTQ_COMMIT_MS -> số lần ghi flash / lệnh << 1, đường gửi
+//    không bao giờ chờ flash. Mất điện chỉ mất tối đa 1 nhịp commit.
+//  - ghi lỗi -> cắt file về trước lô, lô giữ trong RAM và ghi lại nhịp sau;
+//    không phục hồi được -> append / sync trả ESP_FAIL
+//  - mỗi bản ghi có checksum (ep_hash32); đuôi hỏng khi replay bị cắt bỏ
+//  - log vượt OUTQ_COMPACT_BYTES -> chép các lệnh còn pending sang file mới,
+//    rename đè (nguyên tử trên LittleFS)
+//
+// OUTQ_ENABLED 0: chỉ RAM (so sánh throughput), API thành no-op.
+
+// ============ Config ============
+#ifndef OUTQ_ENABLED
+#define OUTQ_ENABLED            1
+#endif
+#ifndef OUTQ_PARTITION_LABEL
+#define OUTQ_PARTITION_LABEL    "outq"
+#endif
+#ifndef OUTQ_BASE_PATH
+#define OUTQ_BASE_PATH          "/outq"
+#endif
+#ifndef OUTQ_COMMIT_MS
+#define OUTQ_COMMIT_MS          100
+#endif
+#ifndef OUTQ_BUF_SIZE
+#define OUTQ_BUF_SIZE           4096    // ~100 lệnh / nhịp commit
+#endif
+#ifndef OUTQ_MAX_PENDING
+#define OUTQ_MAX_PENDING        512     // số đích có lệnh chưa ACK
+#endif
+#ifndef OUTQ_COMPACT_BYTES
+#define OUTQ_COMPACT_BYTES      (64 * 1024)
+#endif
+#ifndef OUTQ_PAYLOAD_MAX
+#define OUTQ_PAYLOAD_MAX        120
+#endif
+
+// Gửi lại 1 lệnh pending khi khởi động (main.c: mesh_tx / grp_ack).
+typedef esp_err_t (*outq_replay_fn_t)(uint16_t dst, uint16_t tid, uint8_t prio,
+                                      const uint8_t *payload, uint16_t len);
+
+typedef struct {
+    uint32_t appended;
+    uint32_t acked;
+    uint32_t dropped;           // buffer đầy -> lệnh không được ghi (vẫn gửi)
+    uint32_t commits;           // số lần ghi + fsync
+    uint32_t commit_fails;      // ghi lỗi, đã cắt file về trước lô và giữ lô trong RAM
+    uint32_t commit_bytes;
+    uint32_t commit_us_max;
+    uint32_t commit_us_sum;
+    uint32_t compactions;
+    uint32_t replayed;
+    uint32_t log_bytes;
+    uint16_t pending;
+} outq_stats_t;
+
+// Mount partition, replay lệnh pending qua replay(), rồi chạy task writer.
+esp_err_t outq_init(outq_replay_fn_t replay);
+
+// Lệnh đã nhận (ghi đè lệnh pending cũ hơn cho cùng đích). Gọi TRƯỚC khi
+// xếp hàng gửi: gói có thể lên mesh ngay sau đó. ESP_ERR_NO_MEM: buffer đầy
+// (flash chậm / đang lỗi); ESP_FAIL: log hỏng.
+esp_err_t outq_append(uint16_t dst, uint16_t tid, uint8_t prio, const uint8_t *payload, uint16_t len);
+
+// Chờ mọi lệnh đã append trước lời gọi này xuống flash (đánh thức writer
+// ngay, không đợi nhịp OUTQ_COMMIT_MS). Chỉ 1 task gọi (app_mqtt: ACK broker
+// sau khi lệnh đã bền). ESP_ERR_INVALID_STATE: không có WAL; ESP_FAIL: log
+// hỏng sau lỗi ghi, lệnh không bền được nữa.
+esp_err_t outq_sync(uint32_t timeout_ms);
+
+// STATUS / nhóm đã xác nhận TID này, hoặc lệnh đã chốt không gửi nữa
+// (xếp hàng lỗi, báo failed).
+void      outq_ack(uint16_t dst, uint16_t tid);
+
+void      outq_get_stats(outq_stats_t *out);
+
+// Partition đã mount (dùng chung cho file khác dưới OUTQ_BASE_PATH)?
+// total / used: byte của cả filesystem.
+bool      outq_fs_info(size_t *total, size_t *used);
+
+#endif
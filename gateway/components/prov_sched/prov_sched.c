@@ -0,0 +1,391 @@
+#include "prov_sched.h"
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "prov_sched";
+
+#define TICK_MS         200
+#define CFG_STALL_MS    15000   // không có status lẫn TIMEOUT_EVT (mất callback) -> coi như timeout
+
+typedef enum {
+    DEV_FREE = 0,
+    DEV_WAIT,               // chờ slot link
+    DEV_LINK,               // đã gọi start, chờ provisioned / link close
+    DEV_BACKOFF,            // link hỏng, nghỉ tới until_ms
+    DEV_DEAD,               // hỏng quá PROV_SCHED_MAX_TRIES
+} dev_state_t;
+
+typedef struct {
+    prov_sched_dev_t info;
+    uint8_t  state;
+    uint8_t  tries;
+    uint32_t seq;           // thứ tự vào hàng (FIFO)
+    uint32_t t_ms;          // LINK: lúc start; BACKOFF: hết nghỉ
+} udev_t;
+
+typedef struct {
+    uint16_t addr;          // 0 = slot trống
+    uint8_t  step;
+    uint8_t  tries;
+    bool     inflight;
+    uint32_t t_ms;          // inflight: lúc gửi; không: lúc được gửi tiếp
+} node_t;
+
+static prov_sched_ops_t   s_ops;
+static SemaphoreHandle_t  s_lock;
+static TaskHandle_t       s_task;
+static udev_t             s_dev[PROV_SCHED_QUEUE];
+static node_t             s_node[PROV_SCHED_NODES];
+static prov_sched_stats_t s_stats;
+static uint32_t           s_seq;
+static uint32_t           s_batch_start_ms;     // 0 = không có đợt
+static uint32_t           s_last_ms;            // việc gần nhất của đợt
+
+static uint32_t now_ms(void) {
+    uint32_t t = (uint32_t)(esp_timer_get_time() / 1000);
+    return t ? t : 1;
+}
+
+static void wake(void) {
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+static const char *step_name(uint8_t step) {
+    switch (step) {
+    case PROV_STEP_COMP_GET:   return "comp get";
+    case PROV_STEP_APPKEY_ADD: return "appkey add";
+    case PROV_STEP_APP_BIND:   return "app bind";
+    case PROV_STEP_HB_PUB:     return "hb pub";
+    default:                   return "done";
+    }
+}
+
+// UUID trong log: 4 byte cuối (phần riêng của tag, prefix 0x3210 giống nhau)
+#define UUID_FMT        "uuid ..%02x%02x%02x%02x"
+#define UUID_ARG(u)     (u)[12], (u)[13], (u)[14], (u)[15]
+
+// ============ Hàng UUID ============
+static int dev_find(const uint8_t uuid[16]) {
+    for (int i = 0; i < PROV_SCHED_QUEUE; ++i) {
+        if (s_dev[i].state != DEV_FREE && memcmp(s_dev[i].info.uuid, uuid, 16) == 0) return i;
+    }
+    return -1;
+}
+
+// Slot trống, hoặc UUID DEAD cũ nhất (cho nó 1 lượt mới về sau)
+static int dev_alloc(void) {
+    int dead = -1;
+    for (int i = 0; i < PROV_SCHED_QUEUE; ++i) {
+        if (s_dev[i].state == DEV_FREE) return i;
+        if (s_dev[i].state == DEV_DEAD && (dead < 0 || s_dev[i].seq < s_dev[dead].seq)) dead = i;
+    }
+    return dead;
+}
+
+// Link hỏng: nghỉ PROV_SCHED_RETRY_MS x số lần hỏng, quá ngưỡng -> DEAD
+static void dev_fail(udev_t *d, uint32_t now, const char *why) {
+    ++s_stats.link_failed;
+    if (++d->tries >= PROV_SCHED_MAX_TRIES) {
+        d->state = DEV_DEAD;
+        ESP_LOGE(TAG, UUID_FMT ": %s, giving up after %u tries", UUID_ARG(d->info.uuid), why, d->tries);
+        return;
+    }
+    d->state = DEV_BACKOFF;
+    d->t_ms  = now + PROV_SCHED_RETRY_MS * d->tries;
+    ESP_LOGW(TAG, UUID_FMT ": %s, retry in %" PRIu32 " ms", UUID_ARG(d->info.uuid), why,
+             (uint32_t)PROV_SCHED_RETRY_MS * d->tries);
+}
+
+// ============ Chuỗi cấu hình ============
+static int node_find(uint16_t addr) {
+    for (int i = 0; i < PROV_SCHED_NODES; ++i) {
+        if (s_node[i].addr == addr) return i;
+    }
+    return -1;
+}
+
+static uint32_t cfg_backoff(uint8_t tries) {
+    uint32_t ms = PROV_SCHED_CFG_BACKOFF_MS;
+    for (uint8_t i = 1; i < tries && ms < PROV_SCHED_CFG_BACKOFF_MAX_MS; ++i) ms *= 2;
+    return ms > PROV_SCHED_CFG_BACKOFF_MAX_MS ? PROV_SCHED_CFG_BACKOFF_MAX_MS : ms;
+}
+
+// Bước hiện tại lỗi / timeout: lùi theo hàm mũ, quá ngưỡng -> bỏ node
+static void node_fail(node_t *n, uint32_t now) {
+    n->inflight = false;
+    if (++n->tries >= PROV_SCHED_CFG_MAX_TRIES) {
+        ESP_LOGE(TAG, "0x%04x: %s failed %u times, node left unconfigured",
+                 n->addr, step_name(n->step), n->tries);
+        ++s_stats.cfg_failed;
+        n->addr = 0;
+        return;
+    }
+    ++s_stats.cfg_retries;
+    n->t_ms = now + cfg_backoff(n->tries);
+    ESP_LOGW(TAG, "0x%04x: %s retry %u in %" PRIu32 " ms",
+             n->addr, step_name(n->step), n->tries, cfg_backoff(n->tries));
+}
+
+// ============ Đợt ============
+static void batch_update(uint32_t now) {
+    uint32_t ms = now - s_batch_start_ms;
+    s_stats.batch_ms      = ms;
+    s_stats.batch_tpm_x10 = ms ? (uint32_t)((uint64_t)s_stats.batch_tags * 600000 / ms) : 0;
+}
+
+static bool busy_locked(void) {
+    for (int i = 0; i < PROV_SCHED_QUEUE; ++i) {
+        if (s_dev[i].state != DEV_FREE && s_dev[i].state != DEV_DEAD) return true;
+    }
+    for (int i = 0; i < PROV_SCHED_NODES; ++i) {
+        if (s_node[i].addr) return true;
+    }
+    return false;
+}
+
+// ============ Task ============
+static void prov_sched_task(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TICK_MS));
+        uint32_t now = now_ms();
+
+        // ---- cấu hình: gửi các bước tới hạn, giữ tối đa CFG_INFLIGHT đang chờ ----
+        for (;;) {
+            uint16_t addr = 0;
+            uint8_t  step = 0;
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            int inflight = 0, pick = -1;
+            for (int i = 0; i < PROV_SCHED_NODES; ++i) {
+                node_t *n = &s_node[i];
+                if (!n->addr) continue;
+                if (n->inflight) {
+                    if (now - n->t_ms >= CFG_STALL_MS) node_fail(n, now);
+                    else ++inflight;
+                } else if ((int32_t)(now - n->t_ms) >= 0 &&
+                           (pick < 0 || (int32_t)(n->t_ms - s_node[pick].t_ms) < 0)) {
+                    pick = i;
+                }
+            }
+            if (pick >= 0 && inflight < PROV_SCHED_CFG_INFLIGHT) {
+                node_t *n = &s_node[pick];
+                n->inflight = true;
+                n->t_ms     = now;
+                addr = n->addr;
+                step = n->step;
+                ++inflight;
+            }
+            s_stats.cfg_inflight = (uint8_t)inflight;
+            xSemaphoreGive(s_lock);
+            if (!addr) break;
+
+            esp_err_t err = s_ops.cfg(addr, (prov_step_t)step);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "0x%04x: %s send failed (%s)", addr, step_name(step), esp_err_to_name(err));
+                prov_sched_on_cfg(addr, (prov_step_t)step, false);
+            }
+        }
+
+        // ---- link PB-ADV: mở tiếp khi còn slot và pipeline cấu hình còn chỗ ----
+        for (;;) {
+            prov_sched_dev_t dev;
+            bool start = false;
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            int links = 0, nodes = 0, queued = 0, pick = -1;
+            for (int i = 0; i < PROV_SCHED_QUEUE; ++i) {
+                udev_t *d = &s_dev[i];
+                if (d->state == DEV_LINK && now - d->t_ms >= PROV_SCHED_LINK_TIMEOUT_MS) {
+                    dev_fail(d, now, "link timeout");
+                }
+                if (d->state == DEV_BACKOFF && (int32_t)(now - d->t_ms) >= 0) {
+                    d->state = DEV_WAIT;
+                }
+                if (d->state == DEV_LINK) ++links;
+                if (d->state == DEV_WAIT) {
+                    ++queued;
+                    if (pick < 0 || d->seq < s_dev[pick].seq) pick = i;
+                }
+            }
+            for (int i = 0; i < PROV_SCHED_NODES; ++i) nodes += s_node[i].addr ? 1 : 0;
+            // mỗi link sẽ thành 1 node cần cấu hình: không mở link khi không còn slot node
+            if (pick >= 0 && links < PROV_SCHED_LINKS && links + nodes < PROV_SCHED_NODES) {
+                udev_t *d = &s_dev[pick];
+                d->state = DEV_LINK;
+                d->t_ms  = now;
+                dev      = d->info;
+                start    = true;
+                ++links;
+                --queued;
+            }
+            s_stats.links_open = (uint8_t)links;
+            s_stats.queued     = (uint16_t)queued;
+            s_stats.nodes      = (uint8_t)nodes;
+            xSemaphoreGive(s_lock);
+            if (!start) break;
+
+            esp_err_t err = s_ops.start(&dev);
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            int i = dev_find(dev.uuid);
+            if (err == ESP_OK) {
+                ++s_stats.links;
+            } else if (i >= 0 && s_dev[i].state == DEV_LINK) {
+                dev_fail(&s_dev[i], now, esp_err_to_name(err));
+            }
+            xSemaphoreGive(s_lock);
+        }
+
+        // ---- kết thúc đợt: hết việc PROV_SCHED_IDLE_MS ----
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_batch_start_ms && !busy_locked() && now - s_last_ms >= PROV_SCHED_IDLE_MS) {
+            if (s_stats.batch_tags) {
+                ESP_LOGI(TAG, "batch done: %" PRIu32 " tags in %" PRIu32 " s (%" PRIu32 ".%" PRIu32 " tags/min), "
+                         "%" PRIu32 " link fails, %" PRIu32 " cfg retries, %" PRIu32 " unconfigured",
+                         s_stats.batch_tags, s_stats.batch_ms / 1000,
+                         s_stats.batch_tpm_x10 / 10, s_stats.batch_tpm_x10 % 10,
+                         s_stats.link_failed, s_stats.cfg_retries, s_stats.cfg_failed);
+            }
+            s_batch_start_ms = 0;
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+// ============ API ============
+esp_err_t prov_sched_init(const prov_sched_ops_t *ops) {
+    if (!ops || !ops->start || !ops->cfg) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_ops  = *ops;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(prov_sched_task, "prov_sched", 3072, NULL, 4, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "links %d, cfg in-flight %d, queue %d",
+             PROV_SCHED_LINKS, PROV_SCHED_CFG_INFLIGHT, PROV_SCHED_QUEUE);
+    return ESP_OK;
+}
+
+void prov_sched_discovered(const prov_sched_dev_t *dev) {
+    if (!s_lock || !dev) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = dev_find(dev->uuid);
+    if (i >= 0) {
+        // beacon lặp lại: cập nhật địa chỉ / bearer nếu còn chờ
+        if (s_dev[i].state == DEV_WAIT) s_dev[i].info = *dev;
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    i = dev_alloc();
+    if (i < 0) {
+        ++s_stats.dropped;
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    uint32_t now = now_ms();
+    if (!s_batch_start_ms) {
+        s_batch_start_ms     = now;
+        s_stats.batch_tags   = 0;
+        s_stats.batch_ms     = 0;
+        s_stats.batch_tpm_x10 = 0;
+    }
+    s_last_ms = now;
+    memset(&s_dev[i], 0, sizeof(s_dev[i]));
+    s_dev[i].info  = *dev;
+    s_dev[i].state = DEV_WAIT;
+    s_dev[i].seq   = ++s_seq;
+    ++s_stats.discovered;
+    xSemaphoreGive(s_lock);
+    wake();
+}
+
+void prov_sched_on_link_open(void) {
+    if (s_lock) s_last_ms = now_ms();
+}
+
+// Sự kiện link close không mang UUID: khi hỏng, trả slot của link mở lâu nhất
+// (link PB-ADV thường đóng theo thứ tự mở; link còn lại vẫn có timeout riêng).
+void prov_sched_on_link_close(bool ok) {
+    if (!s_lock || ok) return;      // ok: đã xử lý ở on_provisioned
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int oldest = -1;
+    for (int i = 0; i < PROV_SCHED_QUEUE; ++i) {
+        if (s_dev[i].state == DEV_LINK && (oldest < 0 || s_dev[i].t_ms < s_dev[oldest].t_ms)) oldest = i;
+    }
+    if (oldest >= 0) dev_fail(&s_dev[oldest], now_ms(), "link closed");
+    xSemaphoreGive(s_lock);
+    wake();
+}
+
+void prov_sched_on_provisioned(const uint8_t uuid[16], uint16_t addr) {
+    if (!s_lock) return;
+    uint32_t now = now_ms();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = dev_find(uuid);
+    if (i >= 0) s_dev[i].state = DEV_FREE;
+    ++s_stats.provisioned;
+    s_last_ms = now;
+
+    int n = node_find(addr);
+    if (n < 0) n = node_find(0);
+    if (n >= 0) {
+        memset(&s_node[n], 0, sizeof(s_node[n]));
+        s_node[n].addr = addr;
+        s_node[n].step = PROV_STEP_COMP_GET;
+        s_node[n].t_ms = now;
+    } else {
+        // chỉ xảy ra khi node tự provision ngoài lịch (link được mở khi còn slot node)
+        ESP_LOGE(TAG, "0x%04x: no config slot", addr);
+        ++s_stats.cfg_failed;
+    }
+    xSemaphoreGive(s_lock);
+    wake();
+}
+
+void prov_sched_on_cfg(uint16_t addr, prov_step_t step, bool ok) {
+    if (!s_lock) return;
+    uint32_t now  = now_ms();
+    bool     done = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = node_find(addr);
+    if (i < 0 || !addr || s_node[i].step != step) {
+        xSemaphoreGive(s_lock);
+        return;     // status muộn / lặp, hoặc node không do lịch quản lý
+    }
+    node_t *n = &s_node[i];
+    s_last_ms = now;
+    if (!ok) {
+        node_fail(n, now);
+    } else if (++n->step == PROV_STEP_DONE) {
+        n->addr = 0;
+        done = true;
+        ++s_stats.configured;
+        ++s_stats.batch_tags;
+        if (s_batch_start_ms) batch_update(now);
+    } else {
+        n->inflight = false;
+        n->tries    = 0;
+        n->t_ms     = now;
+    }
+    uint32_t tags = s_stats.batch_tags, tpm = s_stats.batch_tpm_x10;
+    xSemaphoreGive(s_lock);
+
+    if (done) {
+        ESP_LOGI(TAG, "0x%04x configured (%" PRIu32 " in batch, %" PRIu32 ".%" PRIu32 " tags/min)",
+                 addr, tags, tpm / 10, tpm % 10);
+        if (s_ops.configured) s_ops.configured(addr);
+    }
+    wake();
+}
+
+void prov_sched_get_stats(prov_sched_stats_t *out) {
+    if (!out) return;
+    if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    if (s_lock) xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,120 @@
+#ifndef __PROV_SCHED_H
+#define __PROV_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Lập lịch provisioning khi nhận hàng loạt tag (cả pallet):
+//  - beacon unprov chỉ đưa UUID vào hàng đợi (lọc trùng), không mở link ngay
+//  - tối đa PROV_SCHED_LINKS link PB-ADV cùng lúc (= CONFIG_BLE_MESH_PBA_SAME_TIME)
+//  - node provision xong vào chuỗi cấu hình Composition Get -> AppKey Add ->
+//    Model App Bind -> Heartbeat Pub về gateway (node_table theo dõi sức
+//    khoẻ ngay từ đầu); nhiều node chạy chuỗi song song (tối đa
+//    PROV_SCHED_CFG_INFLIGHT message đang chờ status), xen với link PB-ADV
+//    của các tag kế tiếp
+//  - timeout / lỗi: thử lại sau PROV_SCHED_CFG_BACKOFF_MS x 2^n (trần
+//    PROV_SCHED_CFG_BACKOFF_MAX_MS), tối đa PROV_SCHED_CFG_MAX_TRIES lần
+//  - link hỏng: UUID chờ PROV_SCHED_RETRY_MS x số lần hỏng rồi mới được mở lại
+// Báo thông lượng tag/phút cho mỗi đợt (đợt kết thúc khi hàng rỗng và không
+// còn việc PROV_SCHED_IDLE_MS).
+
+// ============ Config ============
+#ifndef PROV_SCHED_LINKS
+#ifdef CONFIG_BLE_MESH_PBA_SAME_TIME
+#define PROV_SCHED_LINKS            CONFIG_BLE_MESH_PBA_SAME_TIME
+#else
+#define PROV_SCHED_LINKS            2
+#endif
+#endif
+#ifndef PROV_SCHED_QUEUE
+#define PROV_SCHED_QUEUE            64      // UUID đã thấy (chờ / đang chạy / đang nghỉ sau lỗi)
+#endif
+#ifndef PROV_SCHED_NODES
+#define PROV_SCHED_NODES            16      // node đang trong chuỗi cấu hình
+#endif
+#ifndef PROV_SCHED_CFG_INFLIGHT
+#define PROV_SCHED_CFG_INFLIGHT     4
+#endif
+#ifndef PROV_SCHED_LINK_TIMEOUT_MS
+#define PROV_SCHED_LINK_TIMEOUT_MS  45000   // link không xong -> trả slot
+#endif
+#ifndef PROV_SCHED_RETRY_MS
+#define PROV_SCHED_RETRY_MS         10000
+#endif
+#ifndef PROV_SCHED_MAX_TRIES
+#define PROV_SCHED_MAX_TRIES        3       // link hỏng quá số này -> bỏ UUID (tới khi hàng cần chỗ)
+#endif
+#ifndef PROV_SCHED_CFG_BACKOFF_MS
+#define PROV_SCHED_CFG_BACKOFF_MS   500
+#endif
+#ifndef PROV_SCHED_CFG_BACKOFF_MAX_MS
+#define PROV_SCHED_CFG_BACKOFF_MAX_MS 16000
+#endif
+#ifndef PROV_SCHED_CFG_MAX_TRIES
+#define PROV_SCHED_CFG_MAX_TRIES    6
+#endif
+#ifndef PROV_SCHED_IDLE_MS
+#define PROV_SCHED_IDLE_MS          30000
+#endif
+
+typedef enum {
+    PROV_STEP_COMP_GET = 0,
+    PROV_STEP_APPKEY_ADD,
+    PROV_STEP_APP_BIND,
+    PROV_STEP_HB_PUB,
+    PROV_STEP_DONE,
+} prov_step_t;
+
+// Thông tin từ beacon unprov (đủ để esp_ble_mesh_provisioner_add_unprov_dev)
+typedef struct {
+    uint8_t  uuid[16];
+    uint8_t  addr[6];
+    uint8_t  addr_type;
+    uint16_t oob_info;
+    uint8_t  bearer;
+} prov_sched_dev_t;
+
+typedef struct {
+    // add_unprov_dev + mở link ngay
+    esp_err_t (*start)(const prov_sched_dev_t *dev);
+    // gửi 1 bước cấu hình (Config Client, cần status)
+    esp_err_t (*cfg)(uint16_t addr, prov_step_t step);
+    // chuỗi cấu hình xong
+    void      (*configured)(uint16_t addr);
+} prov_sched_ops_t;
+
+typedef struct {
+    uint32_t discovered;        // UUID mới vào hàng
+    uint32_t dropped;           // hàng đầy
+    uint32_t links;             // link đã mở
+    uint32_t link_failed;
+    uint32_t provisioned;
+    uint32_t configured;
+    uint32_t cfg_retries;
+    uint32_t cfg_failed;
+    uint16_t queued;            // UUID chờ link
+    uint8_t  links_open;
+    uint8_t  cfg_inflight;
+    uint8_t  nodes;             // node đang trong chuỗi cấu hình
+    // đợt hiện tại / gần nhất
+    uint32_t batch_tags;
+    uint32_t batch_ms;          // beacon đầu tiên -> node cấu hình xong cuối cùng
+    uint32_t batch_tpm_x10;     // tag / phút x 10
+} prov_sched_stats_t;
+
+esp_err_t prov_sched_init(const prov_sched_ops_t *ops);
+
+// Beacon unprov (UUID đã qua bộ lọc). Gọi từ callback mesh.
+void      prov_sched_discovered(const prov_sched_dev_t *dev);
+
+void      prov_sched_on_link_open(void);
+void      prov_sched_on_link_close(bool ok);
+void      prov_sched_on_provisioned(const uint8_t uuid[16], uint16_t addr);
+
+// Status / timeout của 1 bước cấu hình.
+void      prov_sched_on_cfg(uint16_t addr, prov_step_t step, bool ok);
+
+void      prov_sched_get_stats(prov_sched_stats_t *out);
+
+#endif
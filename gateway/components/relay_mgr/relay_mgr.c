@@ -0,0 +1,603 @@
+#include "relay_mgr.h"
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "node_table.h"
+
+static const char *TAG = "relay_mgr";
+
+#define NVS_NS              "relay_mgr"
+#define OP_QUEUE_LEN        128
+#define HB_TTL              7
+#define COLLECT_GRACE_MS    2000
+#define LOST_CHECK_MS       5000
+
+#define SET_WORDS           ((RELAY_MGR_MAX_NODES + 63) / 64)
+_Static_assert(RELAY_MGR_MAX_NODES < 0xFE, "region id is the node index in a uint8_t");
+
+// Tập node theo index trong s_nodes
+typedef struct {
+    uint64_t w[SET_WORDS];
+} nset_t;
+
+typedef struct {
+    uint16_t addr;          // 0 = slot trống
+    uint8_t  probed;
+    uint8_t  rsv;
+    uint32_t rsv2;
+    nset_t   adj;           // bit j = có cạnh tới s_nodes[j]
+} rm_node_t;                // lưu nguyên mảng vào NVS
+
+typedef enum {
+    OP_SUB_SET = 0,
+    OP_SUB_GET,
+    OP_PUB_PROBE,
+    OP_PUB_PERIODIC,
+    OP_RELAY,
+} op_type_t;
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  arg;
+    uint16_t node;
+    uint16_t src;
+} rm_op_t;
+
+typedef enum {
+    PROBE_IDLE = 0,
+    PROBE_SUBS,             // đang gửi Heartbeat Sub Set cho ứng viên
+    PROBE_PUB,              // đang gửi Heartbeat Pub Set cho X
+    PROBE_WAIT,             // X đang phát heartbeat
+    PROBE_COLLECT,          // đang hỏi Heartbeat Sub Get
+} probe_phase_t;
+
+static relay_mgr_ops_t    s_ops;
+static SemaphoreHandle_t  s_lock;
+static uint16_t           s_gw_addr;
+
+static rm_node_t          s_nodes[RELAY_MGR_MAX_NODES];
+static uint32_t           s_joined_ms[RELAY_MGR_MAX_NODES];
+static uint32_t           s_push_ms[RELAY_MGR_MAX_NODES];
+static nset_t             s_relay_on;                    // tag mặc định bật relay (init: đầy)
+static nset_t             s_relay_known;                 // s_relay_on đúng với tag (đã có Relay Status)
+static nset_t             s_relay_want;
+static uint8_t            s_region[RELAY_MGR_MAX_NODES];
+static bool               s_dirty;
+static bool               s_full;                        // có tag không vào được bảng
+
+static rm_op_t            s_q[OP_QUEUE_LEN];
+static uint16_t           s_q_head, s_q_tail;
+
+static probe_phase_t      s_phase;
+static int                s_probe;            // index đang dò
+static nset_t             s_cand;
+static uint32_t           s_deadline_ms;
+
+static relay_mgr_report_t s_report;
+static bool               s_has_report;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// ============ Tập node ============
+static bool set_has(const nset_t *s, int i) {
+    return (s->w[i >> 6] >> (i & 63)) & 1;
+}
+
+static void set_add(nset_t *s, int i) {
+    s->w[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+static void set_del(nset_t *s, int i) {
+    s->w[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+static void set_fill(nset_t *s) {
+    memset(s, 0xFF, sizeof(*s));
+}
+
+static bool set_any(const nset_t *s) {
+    for (int k = 0; k < SET_WORDS; ++k) {
+        if (s->w[k]) return true;
+    }
+    return false;
+}
+
+static int set_count(const nset_t *s) {
+    int n = 0;
+    for (int k = 0; k < SET_WORDS; ++k) n += __builtin_popcountll(s->w[k]);
+    return n;
+}
+
+// |a & b|
+static int set_count_and(const nset_t *a, const nset_t *b) {
+    int n = 0;
+    for (int k = 0; k < SET_WORDS; ++k) n += __builtin_popcountll(a->w[k] & b->w[k]);
+    return n;
+}
+
+// r = (a & m) | (b & ~m)
+static void set_merge(nset_t *r, const nset_t *a, const nset_t *b, const nset_t *m) {
+    for (int k = 0; k < SET_WORDS; ++k) r->w[k] = (a->w[k] & m->w[k]) | (b->w[k] & ~m->w[k]);
+}
+
+// a & m == b & m
+static bool set_eq_in(const nset_t *a, const nset_t *b, const nset_t *m) {
+    for (int k = 0; k < SET_WORDS; ++k) {
+        if ((a->w[k] ^ b->w[k]) & m->w[k]) return false;
+    }
+    return true;
+}
+
+// ============ Hàng đợi config message ============
+static bool q_empty(void) {
+    return s_q_head == s_q_tail;
+}
+
+static void q_push(uint8_t type, uint16_t node, uint16_t src, uint8_t arg) {
+    uint16_t next = (uint16_t)((s_q_tail + 1) % OP_QUEUE_LEN);
+    if (next == s_q_head) {
+        ESP_LOGW(TAG, "op queue full, drop op %u -> 0x%04x", type, node);
+        return;
+    }
+    s_q[s_q_tail] = (rm_op_t){ .type = type, .arg = arg, .node = node, .src = src };
+    s_q_tail = next;
+}
+
+static bool q_pop(rm_op_t *op) {
+    if (q_empty()) return false;
+    *op = s_q[s_q_head];
+    s_q_head = (uint16_t)((s_q_head + 1) % OP_QUEUE_LEN);
+    return true;
+}
+
+static void run_op(const rm_op_t *op) {
+    esp_err_t err = ESP_OK;
+    switch (op->type) {
+    case OP_SUB_SET:
+        err = s_ops.hb_sub_set(op->node, op->src, RELAY_MGR_HB_GROUP, RELAY_MGR_SUB_PERIOD_LOG);
+        break;
+    case OP_SUB_GET:
+        err = s_ops.hb_sub_get(op->node);
+        break;
+    case OP_PUB_PROBE:
+        // TTL 0: chỉ hàng xóm trực tiếp nghe được
+        err = s_ops.hb_pub_set(op->node, RELAY_MGR_HB_GROUP, RELAY_MGR_PROBE_COUNT_LOG,
+                               RELAY_MGR_PROBE_PERIOD_LOG, 0);
+        break;
+    case OP_PUB_PERIODIC:
+        err = s_ops.hb_pub_set(op->node, s_gw_addr, 0xFF, RELAY_MGR_HB_PERIOD_LOG, HB_TTL);
+        break;
+    case OP_RELAY:
+        err = s_ops.relay_set(op->node, op->arg != 0);
+        break;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "op %u -> 0x%04x failed: %s", op->type, op->node, esp_err_to_name(err));
+    }
+}
+
+// ============ Node ============
+static int node_find(uint16_t addr) {
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (s_nodes[i].addr == addr) return i;
+    }
+    return -1;
+}
+
+static nset_t used_mask(void) {
+    nset_t m = {0};
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (s_nodes[i].addr) set_add(&m, i);
+    }
+    return m;
+}
+
+// hop tới gateway, -1 = chưa biết
+static int node_hops(uint16_t addr) {
+    node_link_t l;
+    return node_table_get(addr, &l) ? l.hops_max : -1;
+}
+
+static uint32_t node_last_heard(int i) {
+    node_link_t l;
+    uint32_t t = s_joined_ms[i];
+    if (node_table_get(s_nodes[i].addr, &l) && (int32_t)(l.last_ms - t) > 0) t = l.last_ms;
+    return t;
+}
+
+static void save_graph(void) {
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+    nvs_set_blob(h, "graph", s_nodes, sizeof(s_nodes));
+    nvs_set_blob(h, "relays", &s_relay_on, sizeof(s_relay_on));
+    nvs_set_blob(h, "known", &s_relay_known, sizeof(s_relay_known));
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+static void load_graph(void) {
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK) return;
+    // kích thước đổi (RELAY_MGR_MAX_NODES) -> bỏ đồ thị cũ, dò lại
+    size_t len = sizeof(s_nodes);
+    if (nvs_get_blob(h, "graph", s_nodes, &len) != ESP_OK || len != sizeof(s_nodes)) {
+        memset(s_nodes, 0, sizeof(s_nodes));
+    }
+    nset_t used = used_mask();
+    len = sizeof(s_relay_on);
+    if (nvs_get_blob(h, "relays", &s_relay_on, &len) != ESP_OK || len != sizeof(s_relay_on)) {
+        set_fill(&s_relay_on);
+    }
+    // bản lưu cũ chưa có "known": coi trạng thái đã lưu của tag trong bảng là đúng
+    len = sizeof(s_relay_known);
+    if (nvs_get_blob(h, "known", &s_relay_known, &len) != ESP_OK || len != sizeof(s_relay_known)) {
+        s_relay_known = used;
+    }
+    nvs_close(h);
+    s_relay_want = s_relay_on;
+
+    uint32_t now = now_ms();
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) s_joined_ms[i] = now;
+    if (set_any(&used)) {
+        ESP_LOGI(TAG, "restore: %d nodes, %d relays", set_count(&used), set_count_and(&s_relay_on, &used));
+        s_dirty = true;
+    }
+}
+
+static void node_remove(int i) {
+    ESP_LOGW(TAG, "0x%04x lost (%d links)", s_nodes[i].addr, set_count(&s_nodes[i].adj));
+    if (s_phase != PROBE_IDLE && s_probe == i) s_phase = PROBE_IDLE;
+    for (int j = 0; j < RELAY_MGR_MAX_NODES; ++j) set_del(&s_nodes[j].adj, i);
+    memset(&s_nodes[i], 0, sizeof(s_nodes[i]));
+    set_del(&s_cand, i);
+    // slot trống: không biết trạng thái relay của tag sẽ vào slot này (có thể
+    // là tag đã bị tắt relay rồi vào lại) -> tag vào sau luôn nhận Relay Set
+    set_del(&s_relay_on, i);
+    set_del(&s_relay_known, i);
+    set_add(&s_relay_want, i);
+    s_push_ms[i]  = 0;
+    s_dirty       = true;
+    save_graph();
+}
+
+// ============ Tập relay ============
+// Greedy connected dominating set (Guha-Khuller) với gateway làm gốc: mỗi
+// bước chọn node đã được phủ mà phủ thêm nhiều node chưa phủ nhất. Tập chọn
+// ra liên thông với gateway theo cách xây, mọi node đã dò hoặc là relay hoặc
+// kề một relay / gateway.
+static nset_t compute_relays(const nset_t *used, uint16_t *unreachable, nset_t *gw_adj) {
+    uint32_t now = now_ms();
+    nset_t   probed = {0};
+    int16_t  hops[RELAY_MGR_MAX_NODES];
+
+    memset(gw_adj, 0, sizeof(*gw_adj));
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        hops[i] = -1;
+        if (!set_has(used, i)) continue;
+        if (s_nodes[i].probed) set_add(&probed, i);
+        node_link_t l;
+        if (node_table_get(s_nodes[i].addr, &l)) {
+            hops[i] = l.hops_max;
+            if (l.hops_max == 0 && (now - l.last_ms) < RELAY_MGR_LOST_MS) set_add(gw_adj, i);
+        }
+    }
+
+    nset_t black   = {0};
+    nset_t covered = *gw_adj;
+    nset_t white;
+    for (int k = 0; k < SET_WORDS; ++k) white.w[k] = used->w[k] & ~covered.w[k];
+    while (set_any(&white)) {
+        int best = -1, best_gain = 0;
+        for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+            if (!set_has(&covered, i) || set_has(&black, i)) continue;
+            int gain = set_count_and(&s_nodes[i].adj, &white);
+            // hoà: ưu tiên node gần gateway hơn
+            if (gain > best_gain || (gain == best_gain && gain > 0 && best >= 0 &&
+                                     hops[i] >= 0 && (hops[best] < 0 || hops[i] < hops[best]))) {
+                best = i;
+                best_gain = gain;
+            }
+        }
+        if (best < 0) break;
+        set_add(&black, best);
+        for (int k = 0; k < SET_WORDS; ++k) {
+            covered.w[k] |= s_nodes[best].adj.w[k] & used->w[k];
+            white.w[k]   &= ~covered.w[k];
+        }
+    }
+
+    *unreachable = (uint16_t)set_count(&white);
+    // chưa dò / chưa thấy cạnh nào: giữ relay bật cho an toàn
+    nset_t want;
+    for (int k = 0; k < SET_WORDS; ++k) {
+        want.w[k] = black.w[k] | white.w[k] | (used->w[k] & ~probed.w[k]);
+    }
+    return want;
+}
+
+// BFS từ các hàng xóm của gateway, chỉ lan qua relay: mỗi tag thuộc vùng
+// của nhánh tới được nó sớm nhất.
+static void compute_regions(const nset_t *used, const nset_t *gw_adj, const nset_t *relays) {
+    memset(s_region, 0xFF, sizeof(s_region));
+    nset_t frontier, seen;
+    for (int k = 0; k < SET_WORDS; ++k) frontier.w[k] = gw_adj->w[k] & used->w[k];
+    seen = frontier;
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (set_has(&frontier, i)) s_region[i] = (uint8_t)i;
+    }
+    while (set_any(&frontier)) {
+        nset_t next = {0};
+        for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+            if (!set_has(&frontier, i) || !set_has(relays, i)) continue;
+            for (int j = 0; j < RELAY_MGR_MAX_NODES; ++j) {
+                if (set_has(&s_nodes[i].adj, j) && set_has(used, j) &&
+                    !set_has(&seen, j) && !set_has(&next, j)) {
+                    s_region[j] = s_region[i];
+                    set_add(&next, j);
+                }
+            }
+        }
+        for (int k = 0; k < SET_WORDS; ++k) seen.w[k] |= next.w[k];
+        frontier = next;
+    }
+}
+
+static uint32_t flood_airtime_us(int relays) {
+    return (uint32_t)(RELAY_MGR_ORIGIN_TX + relays * RELAY_MGR_RELAY_TX) * RELAY_MGR_PDU_AIRTIME_US;
+}
+
+static void evaluate(void) {
+    nset_t   used = used_mask();
+    uint16_t unreachable = 0;
+    nset_t   gw_adj;
+    nset_t   want = compute_relays(&used, &unreachable, &gw_adj);
+
+    s_dirty = false;
+    compute_regions(&used, &gw_adj, &want);
+    if (!set_any(&used)) return;
+    // có tag ngoài bảng: không biết cạnh của nó, tập tính ra có thể cắt mất
+    // đường tới nó -> không tắt relay nào
+    if (s_full) set_fill(&want);
+    if (set_eq_in(&want, &s_relay_want, &used) && s_has_report) return;
+
+    relay_mgr_report_t r = {
+        .nodes         = (uint16_t)set_count(&used),
+        .relays_before = (uint16_t)set_count_and(&s_relay_on, &used),
+        .relays_after  = (uint16_t)set_count_and(&want, &used),
+        .unreachable   = unreachable,
+    };
+    r.airtime_before_us = flood_airtime_us(r.relays_before);
+    r.airtime_after_us  = flood_airtime_us(r.relays_after);
+    s_report     = r;
+    s_has_report = true;
+    set_merge(&s_relay_want, &want, &s_relay_want, &used);
+
+    ESP_LOGI(TAG, "%u nodes: relays %u -> %u (%u unreachable), airtime/PDU %" PRIu32 " -> %" PRIu32 " us",
+             r.nodes, r.relays_before, r.relays_after, r.unreachable,
+             r.airtime_before_us, r.airtime_after_us);
+}
+
+// Chỉ gửi Relay Set cho tag lệch / chưa rõ trạng thái; chưa có status thì gửi lại sau.
+static void push_relays(uint32_t now) {
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (!s_nodes[i].addr) continue;
+        if (set_has(&s_relay_known, i) && set_has(&s_relay_want, i) == set_has(&s_relay_on, i)) continue;
+        if (s_push_ms[i] && (now - s_push_ms[i]) < RELAY_MGR_RETRY_MS) continue;
+        s_push_ms[i] = now ? now : 1;
+        q_push(OP_RELAY, s_nodes[i].addr, 0, set_has(&s_relay_want, i) ? 1 : 0);
+    }
+}
+
+// ============ Dò hàng xóm ============
+static void probe_finish(void) {
+    int x = s_probe;
+    s_nodes[x].probed = 1;
+    q_push(OP_PUB_PERIODIC, s_nodes[x].addr, 0, 0);
+    ESP_LOGI(TAG, "probe 0x%04x: %d/%d candidates are neighbours",
+             s_nodes[x].addr, set_count_and(&s_nodes[x].adj, &s_cand), set_count(&s_cand));
+    s_phase = PROBE_IDLE;
+    s_dirty = true;
+    save_graph();
+}
+
+static void probe_begin(int x) {
+    int hx = node_hops(s_nodes[x].addr);
+
+    s_probe = x;
+    memset(&s_cand, 0, sizeof(s_cand));
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (i == x || !s_nodes[i].addr) continue;
+        int hi = node_hops(s_nodes[i].addr);
+        if (hx < 0 || hi < 0 || (hi - hx <= 1 && hx - hi <= 1)) set_add(&s_cand, i);
+    }
+    if (!set_any(&s_cand)) {
+        probe_finish();
+        return;
+    }
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (set_has(&s_cand, i)) q_push(OP_SUB_SET, s_nodes[i].addr, s_nodes[x].addr, 0);
+    }
+    s_phase = PROBE_SUBS;
+}
+
+static void probe_step(uint32_t now) {
+    switch (s_phase) {
+    case PROBE_IDLE:
+        if (!q_empty()) return;
+        for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+            if (s_nodes[i].addr && !s_nodes[i].probed) {
+                probe_begin(i);
+                return;
+            }
+        }
+        break;
+    case PROBE_SUBS:
+        if (!q_empty()) return;
+        q_push(OP_PUB_PROBE, s_nodes[s_probe].addr, 0, 0);
+        s_phase = PROBE_PUB;
+        break;
+    case PROBE_PUB:
+        if (!q_empty()) return;
+        s_deadline_ms = now + RELAY_MGR_PROBE_WAIT_MS;
+        s_phase = PROBE_WAIT;
+        break;
+    case PROBE_WAIT:
+        if ((int32_t)(now - s_deadline_ms) < 0) return;
+        for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+            if (set_has(&s_cand, i)) q_push(OP_SUB_GET, s_nodes[i].addr, 0, 0);
+        }
+        s_deadline_ms = 0;
+        s_phase = PROBE_COLLECT;
+        break;
+    case PROBE_COLLECT:
+        if (!q_empty()) return;
+        if (!s_deadline_ms) s_deadline_ms = now + COLLECT_GRACE_MS;
+        if ((int32_t)(now - s_deadline_ms) >= 0) probe_finish();
+        break;
+    }
+}
+
+// ============ Task ============
+static void check_lost(uint32_t now) {
+    for (int i = 0; i < RELAY_MGR_MAX_NODES; ++i) {
+        if (s_nodes[i].addr && s_nodes[i].probed &&
+            (now - node_last_heard(i)) > RELAY_MGR_LOST_MS) {
+            node_remove(i);
+        }
+    }
+}
+
+static void relay_mgr_task(void *arg) {
+    uint32_t last_check = now_ms();
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(RELAY_MGR_TX_GAP_MS));
+
+        rm_op_t  op;
+        bool     have;
+        uint32_t now = now_ms();
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        probe_step(now);
+        if (s_phase == PROBE_IDLE && q_empty()) {
+            if (now - last_check >= LOST_CHECK_MS) {
+                last_check = now;
+                check_lost(now);
+            }
+            if (s_dirty) evaluate();
+            push_relays(now);
+        }
+        have = q_pop(&op);
+        xSemaphoreGive(s_lock);
+
+        // gửi ngoài lock: callback status của stack cũng lấy lock
+        if (have) run_op(&op);
+    }
+}
+
+// ============ API ============
+esp_err_t relay_mgr_init(const relay_mgr_ops_t *ops, uint16_t gateway_addr) {
+    if (!ops || !ops->hb_sub_set || !ops->hb_sub_get || !ops->hb_pub_set || !ops->relay_set) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_lock) return ESP_OK;
+    s_ops     = *ops;
+    s_gw_addr = gateway_addr;
+    s_lock    = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    memset(s_region, 0xFF, sizeof(s_region));
+    set_fill(&s_relay_on);
+    set_fill(&s_relay_want);
+    load_graph();
+    if (xTaskCreate(relay_mgr_task, "relay_mgr", 3072, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void relay_mgr_node_join(uint16_t addr) {
+    if (!s_lock || addr == 0 || addr >= 0x8000 || addr == s_gw_addr) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = node_find(addr);
+    if (i < 0) {
+        i = node_find(0);
+        if (i >= 0) {
+            memset(&s_nodes[i], 0, sizeof(s_nodes[i]));
+            s_nodes[i].addr = addr;
+            s_joined_ms[i]  = now_ms();
+            s_push_ms[i]    = 0;
+            set_del(&s_relay_known, i);     // (vào lại) trạng thái relay chưa rõ
+            ESP_LOGI(TAG, "0x%04x joined, probe queued", addr);
+        } else if (!s_full) {
+            ESP_LOGW(TAG, "0x%04x: table full (%d), relays left on everywhere", addr, RELAY_MGR_MAX_NODES);
+            s_full  = true;
+            s_dirty = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void relay_mgr_node_lost(uint16_t addr) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = node_find(addr);
+    if (addr && i >= 0) node_remove(i);
+    xSemaphoreGive(s_lock);
+}
+
+void relay_mgr_on_hb_sub_status(uint16_t node, uint16_t src, uint8_t count_log, uint8_t min_hops) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int y = node_find(node);
+    if (s_phase == PROBE_COLLECT && y >= 0 && set_has(&s_cand, y) &&
+        src == s_nodes[s_probe].addr && count_log >= RELAY_MGR_LINK_MIN_HB && min_hops == 1) {
+        set_add(&s_nodes[s_probe].adj, y);
+        set_add(&s_nodes[y].adj, s_probe);
+        ESP_LOGD(TAG, "link 0x%04x - 0x%04x", src, node);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void relay_mgr_on_relay_status(uint16_t node, bool enabled) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = node_find(node);
+    if (node && i >= 0) {
+        bool before = set_has(&s_relay_on, i);
+        bool known  = set_has(&s_relay_known, i);
+        if (enabled) set_add(&s_relay_on, i);
+        else         set_del(&s_relay_on, i);
+        set_add(&s_relay_known, i);
+        s_push_ms[i] = 0;
+        if (before != enabled || !known) save_graph();
+    }
+    xSemaphoreGive(s_lock);
+}
+
+uint8_t relay_mgr_region(uint16_t addr) {
+    if (!s_lock || !addr) return 0xFF;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int     i = node_find(addr);
+    uint8_t r = i >= 0 ? s_region[i] : 0xFF;
+    xSemaphoreGive(s_lock);
+    return r;
+}
+
+bool relay_mgr_last_report(relay_mgr_report_t *out) {
+    if (!s_lock || !out) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_has_report;
+    if (ok) *out = s_report;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
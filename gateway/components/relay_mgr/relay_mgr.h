@@ -0,0 +1,113 @@
+#ifndef __RELAY_MGR_H
+#define __RELAY_MGR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// Quản lý relay phía gateway: chỉ một tập relay gần tối thiểu (connected
+// dominating set quanh gateway) bật relay, các tag còn lại tắt.
+//
+// Đồ thị kết nối học bằng heartbeat subscription, mỗi tag mới được "dò" 1 lần:
+//   1. các tag ứng viên (lệch <= 1 hop) đặt Heartbeat Sub (src = X, dst = group)
+//   2. X đặt Heartbeat Pub TTL 0 (không relay) tới group, vài nhịp
+//   3. Heartbeat Sub Get từng ứng viên: count > 0, min_hops 1 -> có cạnh X-Y
+// Sau khi dò xong X được đặt heartbeat định kỳ về gateway (dùng phát hiện
+// tag mất). Mỗi lần đồ thị đổi (tag vào / mất) tính lại tập relay và chỉ gửi
+// Config Relay Set cho các tag đổi trạng thái. Tag mới vào bảng (kể cả vào
+// lại sau khi bị coi là mất) chưa rõ trạng thái relay: luôn nhận Relay Set.
+//
+// Bảng đủ cho mọi node gateway provision (CONFIG_BLE_MESH_MAX_PROV_NODES).
+// Tag onboard qua delegate (fprov_mgr) không có trong bảng: gateway không có
+// device key nên không gửi được Config message, tag giữ relay mặc định (bật).
+// Nếu có tag unicast nào không vào được bảng, không tính tập relay thiếu
+// (có thể cắt đường tới tag đó): mọi relay giữ bật.
+
+// ============ Config ============
+#ifndef RELAY_MGR_MAX_NODES
+#ifdef CONFIG_BLE_MESH_MAX_PROV_NODES
+#define RELAY_MGR_MAX_NODES        CONFIG_BLE_MESH_MAX_PROV_NODES
+#else
+#define RELAY_MGR_MAX_NODES        128
+#endif
+#endif
+#ifndef RELAY_MGR_HB_GROUP
+#define RELAY_MGR_HB_GROUP         0xC0F1 // đích heartbeat khi dò
+#endif
+#ifndef RELAY_MGR_PROBE_COUNT_LOG
+#define RELAY_MGR_PROBE_COUNT_LOG  3      // 2^(n-1) = 4 heartbeat
+#endif
+#ifndef RELAY_MGR_PROBE_PERIOD_LOG
+#define RELAY_MGR_PROBE_PERIOD_LOG 1      // 1 s / heartbeat
+#endif
+#ifndef RELAY_MGR_SUB_PERIOD_LOG
+#define RELAY_MGR_SUB_PERIOD_LOG   7      // sub mở 64 s (đủ cho 63 ứng viên) rồi tự đóng
+#endif
+#ifndef RELAY_MGR_PROBE_WAIT_MS
+#define RELAY_MGR_PROBE_WAIT_MS    8000
+#endif
+#ifndef RELAY_MGR_LINK_MIN_HB
+#define RELAY_MGR_LINK_MIN_HB      2      // count log: 2 = nghe >= 2/4 heartbeat mới tính là cạnh
+#endif
+#ifndef RELAY_MGR_HB_PERIOD_LOG
+#define RELAY_MGR_HB_PERIOD_LOG    9      // heartbeat định kỳ về gateway: 256 s
+#endif
+#ifndef RELAY_MGR_LOST_MS
+#define RELAY_MGR_LOST_MS          (3 * 256 * 1000)  // lỡ 3 heartbeat -> coi như mất
+#endif
+#ifndef RELAY_MGR_TX_GAP_MS
+#define RELAY_MGR_TX_GAP_MS        250    // giãn các config message
+#endif
+#ifndef RELAY_MGR_RETRY_MS
+#define RELAY_MGR_RETRY_MS         15000  // Relay Set chưa có status -> gửi lại
+#endif
+
+// relay_retransmit của tag (= node main.cpp), gửi kèm mỗi Relay Set
+#ifndef RELAY_MGR_RELAY_XMIT_COUNT
+#define RELAY_MGR_RELAY_XMIT_COUNT 2
+#endif
+#ifndef RELAY_MGR_RELAY_XMIT_INTERVAL
+#define RELAY_MGR_RELAY_XMIT_INTERVAL 20  // ms
+#endif
+
+// Ước lượng airtime cho báo cáo: 1 network PDU = 3 kênh adv x ~376 us
+#define RELAY_MGR_PDU_AIRTIME_US   1128
+#define RELAY_MGR_RELAY_TX         (RELAY_MGR_RELAY_XMIT_COUNT + 1)
+#define RELAY_MGR_ORIGIN_TX        3
+
+// main.c bọc thành Config Client message (cần phản hồi).
+typedef struct {
+    esp_err_t (*hb_sub_set)(uint16_t node, uint16_t src, uint16_t dst, uint8_t period_log);
+    esp_err_t (*hb_sub_get)(uint16_t node);
+    esp_err_t (*hb_pub_set)(uint16_t node, uint16_t dst, uint8_t count_log,
+                            uint8_t period_log, uint8_t ttl);
+    esp_err_t (*relay_set)(uint16_t node, bool enable);
+} relay_mgr_ops_t;
+
+typedef struct {
+    uint16_t nodes;
+    uint16_t relays_before;
+    uint16_t relays_after;
+    uint16_t unreachable;                 // chưa có cạnh nào -> giữ relay bật
+    uint32_t airtime_before_us;           // mỗi network PDU flood toàn mạng
+    uint32_t airtime_after_us;
+} relay_mgr_report_t;
+
+esp_err_t relay_mgr_init(const relay_mgr_ops_t *ops, uint16_t gateway_addr);
+
+// Tag mới provision xong / nghe lại được (idempotent).
+void      relay_mgr_node_join(uint16_t addr);
+void      relay_mgr_node_lost(uint16_t addr);
+
+// Status từ Config Client
+void      relay_mgr_on_hb_sub_status(uint16_t node, uint16_t src, uint8_t count_log, uint8_t min_hops);
+void      relay_mgr_on_relay_status(uint16_t node, bool enabled);
+
+bool      relay_mgr_last_report(relay_mgr_report_t *out);
+
+// Vùng của tag = hàng xóm trực tiếp của gateway mở nhánh relay dẫn tới tag
+// (0..RELAY_MGR_MAX_NODES-1, < 0xFE); 0xFF = chưa biết. Dùng để xen kẽ đích khi gửi.
+uint8_t   relay_mgr_region(uint16_t addr);
+
+#endif
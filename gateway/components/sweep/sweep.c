@@ -0,0 +1,161 @@
+#include "sweep.h"
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ep_proto.h"
+#include "mesh_tx.h"
+#include "tag_state.h"
+
+static const char *TAG = "sweep";
+
+static sweep_ops_t       s_ops;
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t      s_task;
+static sweep_stats_t     s_stats;
+
+static uint16_t          s_cursor;      // tag hỏi gần nhất (quay vòng theo địa chỉ)
+static uint16_t          s_wait_addr;   // đang chờ DIGEST, 0 = không
+static uint32_t          s_wait_ms;
+static uint16_t          s_resend;      // tag lệch, task gửi lại (không gửi từ callback mesh)
+static mesh_tx_prio_t    s_resend_prio;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static uint32_t foreground_sent(const mesh_tx_stats_t *st) {
+    return st->cls[MESH_TX_PRIO_URGENT].sent + st->cls[MESH_TX_PRIO_NORMAL].sent;
+}
+
+static void sweep_task(void *arg) {
+    mesh_tx_stats_t st;
+    mesh_tx_get_stats(&st);
+    uint32_t fg_last = foreground_sent(&st);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(s_stats.period_ms));
+        uint32_t now = now_ms();
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint16_t       resend = s_resend;
+        mesh_tx_prio_t prio   = s_resend_prio;
+        s_resend = 0;
+        bool waiting = s_wait_addr && now - s_wait_ms < SWEEP_REPLY_MS;
+        if (s_wait_addr && !waiting) {
+            ++s_stats.timeouts;
+            s_wait_addr = 0;
+        }
+        xSemaphoreGive(s_lock);
+
+        if (resend) {
+            esp_err_t err = s_ops.resend(resend, prio);
+            if (err == ESP_OK) {
+                ++s_stats.resent;
+            } else {
+                ESP_LOGW(TAG, "0x%04x: resend failed (%s)", resend, esp_err_to_name(err));
+            }
+        }
+        if (waiting) {
+            continue;
+        }
+
+        // foreground (URGENT/NORMAL) vừa chạy hoặc hàng còn gói -> nhường
+        mesh_tx_get_stats(&st);
+        uint32_t fg = foreground_sent(&st);
+        bool busy = st.queued > 0 || fg != fg_last;
+        fg_last = fg;
+        if (busy) {
+            uint32_t p = s_stats.period_ms * 2;
+            s_stats.period_ms = p > SWEEP_PERIOD_MAX_MS ? SWEEP_PERIOD_MAX_MS : p;
+            ++s_stats.backoffs;
+            continue;
+        }
+        uint32_t p = s_stats.period_ms - s_stats.period_ms / 4;
+        s_stats.period_ms = p < SWEEP_PERIOD_MIN_MS ? SWEEP_PERIOD_MIN_MS : p;
+
+        uint16_t addr = tag_state_next(s_cursor);
+        if (!addr) {
+            continue;
+        }
+        s_cursor = addr;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_wait_addr = addr;
+        s_wait_ms   = now_ms();
+        xSemaphoreGive(s_lock);
+        if (s_ops.probe(addr) == ESP_OK) {
+            ++s_stats.probes;
+        } else {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s_wait_addr = 0;
+            xSemaphoreGive(s_lock);
+        }
+    }
+}
+
+esp_err_t sweep_init(const sweep_ops_t *ops) {
+    if (!ops || !ops->probe || !ops->resend) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_ops  = *ops;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    s_stats.period_ms = SWEEP_PERIOD_MIN_MS;
+    // ưu tiên thấp nhất trong các task gateway: chỉ chạy khi không còn việc gì khác
+    if (xTaskCreate(sweep_task, "sweep", 3072, NULL, 1, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void sweep_on_digest(uint16_t addr, const uint8_t *msg, uint16_t len) {
+    if (!s_lock || !msg || len < EP_DIGEST_LEN) return;
+    uint32_t content_h = ep_get_le32(&msg[0]);
+    uint32_t title_h   = ep_get_le32(&msg[4]);
+    uint16_t renders   = ep_get_le16(&msg[8]);
+    uint8_t  flags     = msg[10];
+    bool     awake     = flags & EP_DIGEST_F_AWAKE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (addr == s_wait_addr) {
+        s_wait_addr = 0;
+        ++s_stats.replies;
+    } else if (!awake) {
+        xSemaphoreGive(s_lock);
+        return;     // trả lời muộn / không phải của mình
+    }
+    if (awake) ++s_stats.wakes;
+    xSemaphoreGive(s_lock);
+
+    if (!content_h) ++s_stats.rebooted;
+    tag_state_check_t res = TAG_STATE_UNKNOWN;     // còn lệnh chờ vẽ: hỏi lại vòng sau
+    if (!(flags & EP_DIGEST_F_RENDERING)) {
+        res = awake ? tag_state_check_latest(addr, content_h, title_h)
+                    : tag_state_check(addr, content_h, title_h);
+    }
+    if (res == TAG_STATE_STALE) {
+        ESP_LOGW(TAG, "0x%04x stale%s (content %08" PRIx32 ", %u renders since boot), resend",
+                 addr, awake ? " on wake" : "", content_h, renders);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        ++s_stats.stale;
+        // tag vừa thức chỉ nghe vài giây: thay lượt gửi lại BULK đang chờ
+        if (!s_resend || awake) {
+            s_resend      = addr;
+            s_resend_prio = awake ? MESH_TX_PRIO_NORMAL : MESH_TX_PRIO_BULK;
+        }
+        xSemaphoreGive(s_lock);
+    }
+    xTaskNotifyGive(s_task);
+}
+
+void sweep_get_stats(sweep_stats_t *out) {
+    if (!out) return;
+    if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    if (s_lock) xSemaphoreGive(s_lock);
+}
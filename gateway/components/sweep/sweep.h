@@ -0,0 +1,58 @@
+#ifndef __SWEEP_H
+#define __SWEEP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "mesh_tx.h"
+
+// Anti-entropy: gateway chỉ biết cái nó đã gửi, tag reboot / mất nguồn / lỡ
+// lệnh thì không ai hay. Lúc mesh_tx rảnh, task này lần lượt hỏi digest từng
+// tag không còn lệnh đang bay (lệnh mới nhất đã xác nhận hoặc đã báo FAILED;
+// EP_VND_OP_DIGEST_GET, lớp BULK, không cần client chờ) rồi so với lệnh mới
+// nhất trong tag_state; chỉ tag lệch mới được gửi lại trạng thái đầy đủ (cũng
+// BULK, mang tiếp cid của lệnh chưa tới).
+//
+// Nhịp thích ứng: mỗi lần thức dậy mà hàng mesh_tx còn gói hoặc có gói
+// URGENT/NORMAL vừa đi -> giãn nhịp x2 (tới SWEEP_PERIOD_MAX_MS); rảnh -> rút
+// 1/4 (tới SWEEP_PERIOD_MIN_MS). 1 lần hỏi đang chờ tại mỗi thời điểm.
+//
+// Tag ngủ sâu gửi DIGEST tự phát (EP_DIGEST_F_AWAKE) mỗi lần thức: so với
+// lệnh mới nhất (kể cả lệnh chưa tới vì tag đang ngủ), lệch -> gửi lại ngay
+// lớp NORMAL cho kịp cửa sổ thức.
+
+// ============ Config ============
+#ifndef SWEEP_PERIOD_MIN_MS
+#define SWEEP_PERIOD_MIN_MS     2000    // ~30 tag / phút khi cả mesh rảnh
+#endif
+#ifndef SWEEP_PERIOD_MAX_MS
+#define SWEEP_PERIOD_MAX_MS     60000
+#endif
+#ifndef SWEEP_REPLY_MS
+#define SWEEP_REPLY_MS          5000    // không trả lời -> sang tag kế
+#endif
+
+typedef struct {
+    esp_err_t (*probe)(uint16_t addr);      // DIGEST_GET qua mesh_tx (BULK)
+    esp_err_t (*resend)(uint16_t addr, mesh_tx_prio_t prio);   // gửi lại trạng thái tag_state
+} sweep_ops_t;
+
+typedef struct {
+    uint32_t probes;
+    uint32_t replies;
+    uint32_t timeouts;
+    uint32_t stale;             // digest lệch
+    uint32_t resent;
+    uint32_t rebooted;          // tag báo chưa nhận giá nào từ lúc boot
+    uint32_t wakes;             // DIGEST F_AWAKE từ tag ngủ sâu
+    uint32_t backoffs;          // lần giãn nhịp vì tải foreground
+    uint32_t period_ms;
+} sweep_stats_t;
+
+esp_err_t sweep_init(const sweep_ops_t *ops);
+
+// EP_VND_OP_DIGEST từ tag (gọi từ callback mesh).
+void      sweep_on_digest(uint16_t addr, const uint8_t *msg, uint16_t len);
+
+void      sweep_get_stats(sweep_stats_t *out);
+
+#endif
@@ -0,0 +1,396 @@
+#include "tag_state.h"
+#include <string.h>
+#include <ctype.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "tag_state";
+
+static tag_state_t       s_tags[TAG_STATE_MAX];
+static SemaphoreHandle_t s_lock;
+
+typedef struct {
+    uint16_t addr;
+    uint32_t leaf;
+} leaf_t;
+
+static leaf_t            s_leaves[TAG_STATE_MAX];   // tag_state_digest, dưới lock
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void lock(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void unlock(void) {
+    xSemaphoreGive(s_lock);
+}
+
+static tag_state_t *find(uint16_t addr) {
+    for (int i = 0; i < TAG_STATE_MAX; ++i) {
+        if (s_tags[i].addr == addr) return &s_tags[i];
+    }
+    return NULL;
+}
+
+// slot trống, hoặc tag lâu nhất không đổi giá
+static tag_state_t *alloc(uint16_t addr) {
+    tag_state_t *victim = &s_tags[0];
+    for (int i = 0; i < TAG_STATE_MAX; ++i) {
+        if (!s_tags[i].addr) { victim = &s_tags[i]; break; }
+        if ((int32_t)(s_tags[i].updated_ms - victim->updated_ms) < 0) victim = &s_tags[i];
+    }
+    if (victim->addr) ESP_LOGW(TAG, "table full, evict 0x%04x", victim->addr);
+    memset(victim, 0, sizeof(*victim));
+    victim->addr = addr;
+    victim->sale = TAG_STATE_NO_SALE;
+    return victim;
+}
+
+// chỉ lấy chữ số, giữ 13 số cuối, pad '0' bên trái
+static void normalize_e13(const char *in, char out[14]) {
+    char   digits[EP_BARCODE_MAX_LEN];
+    size_t m = 0;
+    for (const char *p = in; *p && m < sizeof(digits) - 1; ++p) {
+        if (isdigit((unsigned char)*p)) digits[m++] = *p;
+    }
+    if (m >= 13) {
+        memcpy(out, digits + (m - 13), 13);
+    } else {
+        size_t pad = 13 - m;
+        memset(out, '0', pad);
+        memcpy(out + pad, digits, m);
+    }
+    out[13] = '\0';
+}
+
+static uint32_t leaf_hash(const tag_state_t *t) {
+    uint8_t b[2 + 4 + 13 + 1 + 4];
+    ep_put_le16(&b[0], t->addr);
+    ep_put_le32(&b[2], t->price);
+    memcpy(&b[6], t->e13, 13);
+    b[19] = t->sale;
+    ep_put_le32(&b[20], t->title_hash);
+    uint32_t h = ep_hash32(b, sizeof(b), 0);
+    return h ? h : 1;   // 0 = chưa biết
+}
+
+void tag_state_init(void) {
+    if (!s_lock) s_lock = xSemaphoreCreateMutex();
+}
+
+esp_err_t tag_state_update(uint16_t addr, const EPData *upd) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (!upd || addr == 0) return ESP_ERR_INVALID_ARG;
+
+    uint8_t  enc[EP_TITLE_ENC_MAX];
+    int      enc_len    = 0;
+    uint32_t title_hash = 0;
+    if (upd->has_title) {
+        // nén ngoài lock; gói chỉ mang bản nén
+        enc_len = ep_title_encode(upd->title, enc, sizeof(enc));
+        if (enc_len < 0) {
+            ESP_LOGW(TAG, "Title \"%s\" too long after encoding, skip", upd->title);
+            enc_len = 0;
+        } else {
+            title_hash = ep_hash32(upd->title, strlen(upd->title), 0);
+        }
+    }
+
+    lock();
+    tag_state_t *t = find(addr);
+    if (!t) {
+        if (upd->partial) {
+            unlock();
+            return ESP_ERR_NOT_FOUND;
+        }
+        t = alloc(addr);
+    }
+
+    if (!upd->partial) {
+        t->price = upd->price < 0 ? 0u : (uint32_t)upd->price;
+        normalize_e13(upd->barcode, t->e13);
+        // lệnh đầy đủ không có sale = bỏ sale
+        t->sale = upd->has_sale ? upd->sale : TAG_STATE_NO_SALE;
+    } else if (upd->has_sale) {
+        t->sale = upd->sale;
+    }
+    if (enc_len > 0) {
+        memcpy(t->title_enc, enc, (size_t)enc_len);
+        t->title_len     = (uint8_t)enc_len;
+        t->title_pending = true;
+        t->title_hash    = title_hash;
+    }
+    t->updated_ms = now_ms();
+    unlock();
+    return ESP_OK;
+}
+
+bool tag_state_get(uint16_t addr, tag_state_t *out) {
+    if (!s_lock || !out) return false;
+    lock();
+    tag_state_t *t = find(addr);
+    if (t && addr) *out = *t;
+    unlock();
+    return t && addr;
+}
+
+void tag_state_restore(uint16_t addr, uint16_t tid, const uint8_t *send, uint16_t len) {
+    if (!s_lock || !send || addr == 0 || len < EP_SEND_LEGACY_LEN) return;
+
+    // tên: giải ra UTF-8 để có title_hash như lúc nhận từ MQTT (ngoài lock)
+    uint8_t  tlen       = 0;
+    uint32_t title_hash = 0;
+    if (len > EP_SEND_TITLE_OFF) {
+        uint8_t n = send[EP_SEND_TITLE_OFF];
+        char    title[EP_TITLE_MAX_LEN];
+        if (n && n <= EP_TITLE_ENC_MAX && EP_SEND_TITLE_OFF + 1 + n <= len &&
+            ep_title_decode(&send[EP_SEND_TITLE_OFF + 1], n, title, sizeof(title), 0) >= 0) {
+            tlen       = n;
+            title_hash = ep_hash32(title, strlen(title), 0);
+        }
+    }
+
+    lock();
+    if (find(addr)) {
+        unlock();
+        return;
+    }
+    tag_state_t *t = alloc(addr);
+    t->price = ep_get_le32(&send[2]);
+    for (int i = 0; i < 6; ++i) {
+        t->e13[2 * i]     = (char)('0' + (send[6 + i] >> 4));
+        t->e13[2 * i + 1] = (char)('0' + (send[6 + i] & 0x0F));
+    }
+    t->e13[12] = (char)('0' + (send[12] >> 4));
+    t->e13[13] = '\0';
+    t->sale    = send[13];
+    if (tlen) {
+        memcpy(t->title_enc, &send[EP_SEND_TITLE_OFF + 1], tlen);
+        t->title_len     = tlen;
+        t->title_pending = true;
+        t->title_hash    = title_hash;
+    }
+    t->last_tid   = tid;
+    t->leaf_sent  = leaf_hash(t);
+    t->dig_sent   = ep_content_hash(send, len);
+    t->updated_ms = now_ms();
+    t->queued_ms  = t->updated_ms;
+    unlock();
+}
+
+size_t tag_state_pack_send(uint16_t addr, uint16_t tid, uint8_t *out, size_t cap) {
+    if (!s_lock || !out || cap < EP_SEND_LEGACY_LEN || addr == 0) return 0;
+
+    lock();
+    tag_state_t *t = find(addr);
+    if (!t) {
+        unlock();
+        return 0;
+    }
+    ep_put_le16(&out[0], tid);
+    ep_put_le32(&out[2], t->price);
+    for (int i = 0; i < 6; ++i) {
+        out[6 + i] = (uint8_t)(((t->e13[2 * i] - '0') << 4) | (t->e13[2 * i + 1] - '0'));
+    }
+    out[12] = (uint8_t)(((t->e13[12] - '0') << 4) | 0x0F);
+    out[13] = t->sale;
+
+    size_t len = EP_SEND_LEGACY_LEN;
+    // tên gửi kèm tới khi tag ACK đúng TID mang nó, sau đó tag giữ tên cũ
+    if (t->title_pending && t->title_len && cap >= len + 1 + t->title_len) {
+        out[EP_SEND_TITLE_OFF] = t->title_len;
+        memcpy(&out[EP_SEND_TITLE_OFF + 1], t->title_enc, t->title_len);
+        len += 1 + t->title_len;
+    }
+    t->last_tid  = tid;
+    t->leaf_sent = leaf_hash(t);
+    t->dig_sent  = ep_content_hash(out, (uint16_t)len);
+    unlock();
+    return len;
+}
+
+void tag_state_on_status(uint16_t addr, uint16_t tid) {
+    if (!s_lock) return;
+    lock();
+    tag_state_t *t = find(addr);
+    if (t && addr && t->last_tid == tid) {
+        t->title_pending = false;
+        t->leaf_have     = t->leaf_sent;
+        t->dig_have      = t->dig_sent;
+    }
+    unlock();
+}
+
+uint32_t tag_state_track(uint16_t addr, uint32_t cid) {
+    if (!s_lock) return 0;
+    lock();
+    tag_state_t *t = find(addr);
+    uint32_t prev = 0;
+    if (t && addr) {
+        prev = (t->cid && !t->delivered && !t->closed) ? t->cid : 0;
+        // gửi lại mang tiếp cid đã báo FAILED: vẫn là lệnh đó, không báo lại
+        bool carry = cid && cid == t->cid && !t->delivered;
+        t->closed    = carry && t->closed;
+        t->cid       = cid;
+        t->queued_ms = now_ms();
+        t->sent_ms   = 0;
+        t->delivered = false;
+    }
+    unlock();
+    return prev;
+}
+
+void tag_state_on_sent(uint16_t addr, uint16_t tid) {
+    if (!s_lock) return;
+    lock();
+    tag_state_t *t = find(addr);
+    if (t && addr && t->last_tid == tid && !t->sent_ms) t->sent_ms = now_ms();
+    unlock();
+}
+
+bool tag_state_delivered(uint16_t addr, uint16_t tid, tag_state_outcome_t *out) {
+    if (!s_lock) return false;
+    lock();
+    tag_state_t *t = find(addr);
+    bool first = t && addr && t->last_tid == tid && !t->delivered;
+    if (first) {
+        uint32_t now  = now_ms();
+        uint32_t sent = t->sent_ms ? t->sent_ms : t->queued_ms;
+        t->delivered = true;
+        if (out) {
+            out->cid      = t->cid;
+            out->queue_ms = sent - t->queued_ms;
+            out->air_ms   = now - sent;
+        }
+    }
+    unlock();
+    return first;
+}
+
+bool tag_state_failed(uint16_t addr, uint16_t tid) {
+    if (!s_lock) return false;
+    lock();
+    tag_state_t *t = find(addr);
+    bool first = t && addr && t->last_tid == tid && !t->delivered && !t->closed;
+    if (first) t->closed = true;
+    unlock();
+    return first;
+}
+
+uint32_t tag_state_cid(uint16_t addr, uint16_t tid) {
+    if (!s_lock) return 0;
+    lock();
+    tag_state_t *t = find(addr);
+    uint32_t cid = (t && addr && t->last_tid == tid) ? t->cid : 0;
+    unlock();
+    return cid;
+}
+
+uint16_t tag_state_next(uint16_t after) {
+    if (!s_lock) return 0;
+    uint16_t first = 0, next = 0;
+    lock();
+    for (int i = 0; i < TAG_STATE_MAX; ++i) {
+        const tag_state_t *t = &s_tags[i];
+        // đã có lệnh và không còn lệnh đang bay: đã xác nhận, hoặc đã báo FAILED
+        // (tag lỡ lệnh -> digest lệch -> gửi lại)
+        if (!t->addr || t->addr >= 0x8000 || !t->dig_sent || !(t->delivered || t->closed)) continue;
+        if (!first || t->addr < first) first = t->addr;
+        if (t->addr > after && (!next || t->addr < next)) next = t->addr;
+    }
+    unlock();
+    return next ? next : first;
+}
+
+// lệnh nhóm không đổi entry của từng tag: khớp trạng thái group cũng được
+static bool group_has(uint32_t content_h) {
+    for (int i = 0; i < TAG_STATE_MAX; ++i) {
+        const tag_state_t *g = &s_tags[i];
+        if (g->addr >= 0xC000 && g->dig_have && g->dig_have == content_h) return true;
+    }
+    return false;
+}
+
+// So với lệnh mới nhất (dig_sent). Lệnh đã xác nhận thì dig_sent == dig_have;
+// group mới hơn lệnh unicast chỉ biết được khi lệnh unicast đã xác nhận.
+static tag_state_check_t check_sent(tag_state_t *t, uint32_t content_h, uint32_t title_h) {
+    bool content_ok = content_h == t->dig_sent ||
+                      (t->dig_sent == t->dig_have && group_has(content_h));
+    bool title_ok = !t->title_len ||
+                    title_h == ep_hash32(t->title_enc, t->title_len, 0);
+    if (!title_ok) t->title_pending = true;
+    return (content_ok && title_ok) ? TAG_STATE_MATCH : TAG_STATE_STALE;
+}
+
+tag_state_check_t tag_state_check(uint16_t addr, uint32_t content_h, uint32_t title_h) {
+    if (!s_lock) return TAG_STATE_UNKNOWN;
+    tag_state_check_t res = TAG_STATE_UNKNOWN;
+    lock();
+    tag_state_t *t = find(addr);
+    // lệnh đang bay: chưa biết tag sẽ hiển thị gì
+    if (t && addr && t->dig_sent && (t->delivered || t->closed)) {
+        res = check_sent(t, content_h, title_h);
+    }
+    unlock();
+    return res;
+}
+
+tag_state_check_t tag_state_check_latest(uint16_t addr, uint32_t content_h, uint32_t title_h) {
+    if (!s_lock) return TAG_STATE_UNKNOWN;
+    tag_state_check_t res = TAG_STATE_UNKNOWN;
+    lock();
+    tag_state_t *t = find(addr);
+    if (t && addr && t->dig_sent) res = check_sent(t, content_h, title_h);
+    unlock();
+    return res;
+}
+
+size_t tag_state_digest(uint16_t lo, uint16_t hi, uint16_t parts,
+                        tag_state_range_t *out, size_t max) {
+    if (!s_lock || !out || !max || lo > hi) return 0;
+    uint32_t span = (uint32_t)hi - lo + 1;
+    if (parts == 0) parts = 1;
+    if (parts > span) parts = (uint16_t)span;
+
+    lock();
+    // leaf trong dải, sắp theo địa chỉ (chèn: <= TAG_STATE_MAX phần tử, tệ nhất
+    // ~77k lần dời ở 392 entry, cỡ 1 ms; chỉ chạy khi back office hỏi digest)
+    size_t n = 0;
+    for (int i = 0; i < TAG_STATE_MAX; ++i) {
+        const tag_state_t *t = &s_tags[i];
+        if (!t->addr || !t->leaf_have || t->addr < lo || t->addr > hi) continue;
+        size_t k = n++;
+        while (k > 0 && s_leaves[k - 1].addr > t->addr) {
+            s_leaves[k] = s_leaves[k - 1];
+            --k;
+        }
+        s_leaves[k] = (leaf_t){ .addr = t->addr, .leaf = t->leaf_have };
+    }
+
+    size_t cnt = 0, j = 0;
+    for (uint16_t p = 0; p < parts && j < n && cnt < max; ++p) {
+        uint16_t a = (uint16_t)(lo + (uint32_t)((uint64_t)span * p / parts));
+        uint16_t b = (uint16_t)(lo + (uint32_t)((uint64_t)span * (p + 1) / parts) - 1);
+        if (s_leaves[j].addr > b) continue;
+        tag_state_range_t *r = &out[cnt++];
+        r->lo     = a;
+        r->hi     = b;
+        r->count  = 0;
+        r->digest = EP_HASH32_INIT;
+        for (; j < n && s_leaves[j].addr <= b; ++j) {
+            uint8_t le[4];
+            ep_put_le32(le, s_leaves[j].leaf);
+            r->digest = ep_hash32_update(r->digest, le, sizeof(le));
+            ++r->count;
+        }
+    }
+    unlock();
+    return cnt;
+}
@@ -0,0 +1,140 @@
+#ifndef __TAG_STATE_H
+#define __TAG_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "ep_proto.h"
+#include "ep_title.h"
+#include "ep_data.h"
+
+// Trạng thái mong muốn của từng tag phía gateway. Lệnh MQTT (kể cả cập nhật
+// một phần: chỉ sale / chỉ title) được gộp vào đây, gói SEND luôn dựng từ
+// trạng thái đầy đủ mới nhất -> gói đang chờ trong mesh_tx có thể bị thay
+// bằng bản mới (latest-wins) mà không mất field nào.
+
+// Đối soát catalogue: mỗi tag giữ hash nội dung tag đã xác nhận (STATUS đúng
+// TID), back office tính cùng hash từ catalogue rồi so digest theo dải địa
+// chỉ, chia nhỏ dải lệch tới từng tag -> chỉ gửi lại bản ghi khác nhau.
+//   leaf   = ep_hash32(ADDR(2) PRICE(4) E13(13) SALE(1) TITLE_H(4), seed 0)
+//            (LE; SALE 0xFF = không sale; TITLE_H = ep_hash32 của title UTF-8,
+//             0 = không có tên; leaf 0 đổi thành 1)
+//   digest = ep_hash32 của các leaf (LE32) theo địa chỉ tăng dần
+// Chỉ tính tag unicast và lệnh unicast (lệnh nhóm nằm ở entry của group).
+
+// Mọi tag unicast (gateway provision + delegate fprov_mgr) và mọi group phải
+// có entry riêng: entry bị đẩy ra thì mất cid / dig_sent của lệnh đang bay.
+#ifndef TAG_STATE_MAX
+#define TAG_STATE_MAX       392     // CONFIG_BLE_MESH_MAX_PROV_NODES + FPROV_MGR_REGISTRY_MAX + GRP_ACK_MAX_GROUPS; ~100 B / entry
+#endif
+
+#define TAG_STATE_NO_SALE   0xFF
+
+typedef struct {
+    uint16_t addr;                      // 0 = trống
+    uint32_t price;
+    char     e13[14];                   // barcode chuẩn hoá 13 số
+    uint8_t  sale;                      // 0..100, TAG_STATE_NO_SALE
+    uint8_t  title_len;                 // 0 = chưa có tên
+    uint8_t  title_enc[EP_TITLE_ENC_MAX];
+    bool     title_pending;             // tên chưa được tag ACK -> còn gửi kèm
+    uint32_t title_hash;                // ep_hash32 của title gốc, 0 = chưa có tên
+    uint16_t last_tid;
+    uint32_t updated_ms;
+    // lệnh mới nhất (last_tid) -> kết quả báo lên back office
+    uint32_t cid;                       // correlation id, 0 = không có
+    uint32_t queued_ms;                 // xếp hàng vào mesh_tx / grp_ack
+    uint32_t sent_ms;                   // lần đầu lên mesh, 0 = chưa
+    bool     delivered;
+    bool     closed;                    // đã báo FAILED (timeout / drop), chưa có STATUS;
+                                        // cid giữ nguyên cho lần gửi lại
+    // đối soát
+    uint32_t leaf_sent;                 // leaf của gói last_tid
+    uint32_t leaf_have;                 // leaf tag đã xác nhận, 0 = chưa biết
+    // anti-entropy: ep_content_hash của gói last_tid / gói tag đã xác nhận
+    uint32_t dig_sent;
+    uint32_t dig_have;
+} tag_state_t;
+
+typedef enum {
+    TAG_STATE_MATCH = 0,                // tag hiển thị đúng trạng thái đã xác nhận
+    TAG_STATE_STALE,                    // lệch -> gửi lại trạng thái đầy đủ
+    TAG_STATE_UNKNOWN,                  // không có trạng thái / đang có lệnh đang bay
+} tag_state_check_t;
+
+// Digest 1 dải địa chỉ [lo, hi]
+typedef struct {
+    uint16_t lo;
+    uint16_t hi;
+    uint16_t count;                     // số tag đã xác nhận trong dải
+    uint32_t digest;
+} tag_state_range_t;
+
+// Độ trễ từng chặng của 1 lệnh (ms)
+typedef struct {
+    uint32_t cid;
+    uint32_t queue_ms;                  // xếp hàng -> lên mesh
+    uint32_t air_ms;                    // lên mesh -> STATUS
+} tag_state_outcome_t;
+
+void      tag_state_init(void);
+
+// Gộp cập nhật vào trạng thái tag addr. Partial mà tag chưa có trạng thái
+// đầy đủ -> ESP_ERR_NOT_FOUND.
+esp_err_t tag_state_update(uint16_t addr, const EPData *upd);
+
+bool      tag_state_get(uint16_t addr, tag_state_t *out);
+
+// Lệnh tid replay từ WAL sau reboot (bảng rỗng): dựng lại trạng thái từ
+// payload SEND (giá, barcode, sale, tên) làm lệnh mới nhất, cid 0 (WAL không
+// lưu cid) -> timeout / STATUS của nó được chốt như lệnh thường. Tag đã có
+// trạng thái (MQTT tới trước) -> giữ nguyên.
+void      tag_state_restore(uint16_t addr, uint16_t tid, const uint8_t *send, uint16_t len);
+
+// Dựng payload SEND: TID(2) + PRICE(4) + BCD(7) + SALE(1) [+ TLEN(1) + TITLE].
+// Trả độ dài, 0 nếu chưa có trạng thái.
+size_t    tag_state_pack_send(uint16_t addr, uint16_t tid, uint8_t *out, size_t cap);
+
+// STATUS (ACK theo TID) từ tag
+void      tag_state_on_status(uint16_t addr, uint16_t tid);
+
+// Lệnh last_tid vừa được xếp hàng. Trả cid của lệnh trước nếu nó chưa được
+// xác nhận và chưa báo FAILED (bị lệnh này thay, latest-wins), ngược lại 0.
+// Gửi lại mang tiếp cid cũ giữ trạng thái FAILED (không báo FAILED lần 2).
+uint32_t  tag_state_track(uint16_t addr, uint32_t cid);
+
+// Gói SEND mang tid vừa được phát lên mesh (lần đầu tính cho chặng queue).
+void      tag_state_on_sent(uint16_t addr, uint16_t tid);
+
+// Lệnh tid đã tới tag: true lần đầu (kèm độ trễ), false nếu trùng / lệnh cũ.
+// Lệnh đã báo FAILED vẫn nhận được (tag ngủ sâu thức dậy, sweep gửi lại).
+bool      tag_state_delivered(uint16_t addr, uint16_t tid, tag_state_outcome_t *out);
+
+// Lệnh tid không tới được (timeout / bị bỏ): true lần đầu -> caller báo FAILED.
+// Không đánh dấu delivered: gửi lại sau đó (cùng cid) tới nơi vẫn báo DELIVERED.
+bool      tag_state_failed(uint16_t addr, uint16_t tid);
+
+// cid của lệnh tid nếu còn là lệnh mới nhất, 0 nếu không.
+uint32_t  tag_state_cid(uint16_t addr, uint16_t tid);
+
+// Tag unicast kế tiếp (địa chỉ > after, quay vòng) đã có lệnh và không có
+// lệnh đang bay (lệnh mới nhất đã xác nhận hoặc đã báo FAILED). 0 nếu không có.
+uint16_t  tag_state_next(uint16_t after);
+
+// So digest tag báo (EP_VND_OP_DIGEST) với lệnh mới nhất khi không còn lệnh
+// đang bay (đang bay -> UNKNOWN): tag lỡ lệnh đã báo FAILED cũng thành STALE.
+// Tag đang hiển thị trạng thái đã xác nhận của 1 group cũng tính là khớp.
+// Tên lệch -> đánh dấu gửi kèm tên ở lần gửi tới.
+tag_state_check_t tag_state_check(uint16_t addr, uint32_t content_h, uint32_t title_h);
+
+// Như trên nhưng so với lệnh mới nhất, kể cả lệnh chưa được xác nhận (tag
+// ngủ sâu vừa thức: lệnh gửi lúc tag ngủ không tới được).
+tag_state_check_t tag_state_check_latest(uint16_t addr, uint32_t content_h, uint32_t title_h);
+
+// Chia [lo, hi] thành parts dải đều nhau, ghi digest các dải có tag (dải rỗng
+// bị bỏ). Trả số dải đã ghi.
+size_t    tag_state_digest(uint16_t lo, uint16_t hi, uint16_t parts,
+                           tag_state_range_t *out, size_t max);
+
+#endif
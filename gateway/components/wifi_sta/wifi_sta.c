@@ -1,5 +1,6 @@
 #include "wifi_sta.h"
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -7,8 +8,11 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "app_mqtt.h"
+#include "boot_ts.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -20,21 +24,54 @@
 */
 #define EXAMPLE_ESP_WIFI_SSID      "BaoNguyen"
 #define EXAMPLE_ESP_WIFI_PASS      "30032004"
-#define EXAMPLE_ESP_MAXIMUM_RETRY  5
 #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_WPA2_PSK
 
+/* Mất kết nối -> thử lại mãi, giãn theo cấp số nhân có trần + jitter */
+#define WIFI_BACKOFF_MIN_MS        500
+#define WIFI_BACKOFF_MAX_MS        60000
+
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
 
-/* The event group allows multiple bits for each event, but we only care about two events:
- * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
 
 static const char *TAG = "wifi station";
 
-static int s_retry_num = 0;
+static uint32_t           s_retry_num = 0;
+static esp_timer_handle_t s_retry_timer;
+
+/* MQTT start khi có cả IP lẫn mesh: session bền -> broker đẩy lệnh QoS 1 đang giữ
+ * ngay lúc CONNECT, trước cả subscribe; mesh chưa init thì WAL / mesh_tx chưa có */
+static portMUX_TYPE       s_start_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool               s_have_ip;
+static bool               s_mesh_ready;
+static bool               s_mqtt_started;
+
+static void retry_cb(void *arg)
+{
+    esp_wifi_connect();
+}
+
+static void mqtt_start_if_ready(bool ip, bool mesh)
+{
+    bool go;
+    taskENTER_CRITICAL(&s_start_mux);
+    s_have_ip    |= ip;
+    s_mesh_ready |= mesh;
+    go = s_have_ip && s_mesh_ready && !s_mqtt_started;
+    if (go) s_mqtt_started = true;
+    taskEXIT_CRITICAL(&s_start_mux);
+    /* esp-mqtt tự reconnect khi mạng quay lại: chỉ start 1 lần */
+    if (go) mqtt_app_start();
+}
+
+static uint32_t backoff_ms(uint32_t attempt)
+{
+    uint32_t ms = WIFI_BACKOFF_MIN_MS;
+    while (attempt-- && ms < WIFI_BACKOFF_MAX_MS) ms <<= 1;
+    if (ms > WIFI_BACKOFF_MAX_MS) ms = WIFI_BACKOFF_MAX_MS;
+    return ms + esp_random() % (ms / 4 + 1);   /* nhiều gateway cùng AP không dồn nhịp */
+}
 
 
 static void event_handler(void* arg, esp_event_base_t event_base,
@@ -43,19 +80,18 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(TAG,"connect to the AP fail");
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        uint32_t ms = backoff_ms(s_retry_num++);
+        ESP_LOGI(TAG, "connect to the AP fail, retry #%" PRIu32 " in %" PRIu32 " ms", s_retry_num, ms);
+        esp_timer_stop(s_retry_timer);
+        esp_timer_start_once(s_retry_timer, (uint64_t)ms * 1000);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        boot_ts_mark(BOOT_TS_WIFI_IP);
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        mqtt_start_if_ready(true, false);
     }
 }
 
@@ -63,6 +99,12 @@ void wifi_init_sta(void)
 {
     s_wifi_event_group = xEventGroupCreate();
 
+    const esp_timer_create_args_t retry_args = {
+        .callback = retry_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_retry_timer));
+
     ESP_ERROR_CHECK(esp_netif_init());
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -94,26 +136,17 @@ void wifi_init_sta(void)
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
     ESP_ERROR_CHECK(esp_wifi_start() );
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-        mqtt_app_start();
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-    }
+    boot_ts_mark(BOOT_TS_WIFI_START);
+    ESP_LOGI(TAG, "wifi_init_sta finished, connecting in background");
+}
+
+void wifi_sta_mesh_ready(void)
+{
+    mqtt_start_if_ready(false, true);
+}
+
+bool wifi_sta_connected(void)
+{
+    return s_wifi_event_group &&
+           (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT);
 }
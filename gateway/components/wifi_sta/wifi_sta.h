@@ -1,7 +1,16 @@
 #ifndef __WIFI_STA_H
 #define __WIFI_STA_H
 
+#include <stdbool.h>
+
+// Không chặn: start Wi-Fi rồi trả về; kết nối / thử lại (backoff mũ có trần)
+// chạy nền. MQTT start 1 lần, khi đã có IP và mesh đã init xong
+// (wifi_sta_mesh_ready), thứ tự nào cũng được.
 void wifi_init_sta(void);
 
-#endif
+// Gọi khi ble_mesh_init xong (WAL, mesh_tx, tag_state... đã sẵn sàng nhận lệnh).
+void wifi_sta_mesh_ready(void);
 
+bool wifi_sta_connected(void);
+
+#endif
@@ -6,16 +6,24 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+// lệnh JSON -> store/<id>/zone/<z>/cmd, CBOR -> .../cmd/cbor (app_mqtt.h)
 // {"add":0x0005,"price":99000,"barcode":"12345678","sale":20} 
+// {"add":0x0005,"price":89000,"barcode":"12345678","prio":"urgent"}   (prio: urgent | normal | bulk)
+// {"add":0xC100,"price":89000,"barcode":"12345678"}   add = group: mọi tag trong nhóm (topic/group/0xC100)
+// {"add":0x0005,"price":79000,"barcode":"12345678","cid":4711}   kết quả từng chặng -> topic/status (cid gửi lại)
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "esp_ble_mesh_defs.h"
 #include "esp_ble_mesh_common_api.h"
@@ -29,6 +37,22 @@
 #include "wifi_sta.h"
 
 #include "mesh_vendor_api.h"
+#include "ep_proto.h"
+#include "blk_xfer.h"
+#include "ota_dist.h"
+#include "node_table.h"
+#include "relay_mgr.h"
+#include "mesh_tx.h"
+#include "tag_state.h"
+#include "grp_ack.h"
+#include "outq.h"
+#include "boot_ts.h"
+#include "outbox.h"
+#include "sweep.h"
+#include "prov_sched.h"
+#include "fprov_mgr.h"
+#include "ep_title.h"
+#include "epd_codec.h"
 
 #ifndef PRICE_BARCODE_MAXLEN
 #define PRICE_BARCODE_MAXLEN 31
@@ -36,12 +60,15 @@
 
 #define TAG "EXAMPLE"
 
-#define CID_ESP             0x02E5
+#define CID_ESP             EP_CID
 
 #define PROV_OWN_ADDR       0x0001
 
-#define MSG_SEND_TTL        3
+#define MSG_SEND_TTL        NODE_TABLE_TTL_DEFAULT   /* node chưa học được hop */
+#define MSG_XMIT_INTERVAL   20
+#define HB_PUB_TTL          7       /* heartbeat về gateway: đủ xa, init_ttl cho ra số hop */
 #define MSG_TIMEOUT         0
+#define LPN_MSG_TIMEOUT_MS  35000   /* > poll tối đa của tag LPN (node sdkconfig.lpn: 30 s) */
 #define MSG_ROLE            ROLE_PROVISIONER
 
 #define COMP_DATA_PAGE_0    0x00
@@ -51,24 +78,46 @@
 
 #define COMP_DATA_1_OCTET(msg, offset)      (msg[offset])
 #define COMP_DATA_2_OCTET(msg, offset)      (msg[offset + 1] << 8 | msg[offset])
+#define COMP_FEAT_LOW_POWER                 0x0008      /* Features, byte 8..9 page 0 */
 
-#define ESP_BLE_MESH_VND_MODEL_ID_CLIENT    0x0000
-#define ESP_BLE_MESH_VND_MODEL_ID_SERVER    0x0001
+#define ESP_BLE_MESH_VND_MODEL_ID_CLIENT    EP_VND_MODEL_ID_CLIENT
+#define ESP_BLE_MESH_VND_MODEL_ID_SERVER    EP_VND_MODEL_ID_SERVER
 
-#define ESP_BLE_MESH_VND_MODEL_OP_SEND      ESP_BLE_MESH_MODEL_OP_3(0x00, CID_ESP)
-#define ESP_BLE_MESH_VND_MODEL_OP_STATUS    ESP_BLE_MESH_MODEL_OP_3(0x01, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_SEND      ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_SEND, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_STATUS    ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_STATUS, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_BLK_ACK   ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_BLK_ACK, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_OTA_STATUS ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_OTA_STATUS, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_DIGEST    ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_DIGEST, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_FPROV_STATUS ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_FPROV_STATUS, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_FPROV_NODE   ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_FPROV_NODE, CID_ESP)
+#define VND_OP_OF(opcode)                   ((uint8_t)(((opcode) >> 16) & 0x3F))
+
+/* Ảnh tag thô: 2 plane controller-ready 128x250 (GxEPD2_213_Z98c) */
+#define TAG_IMG_ROW_BYTES   16
+#define TAG_IMG_ROWS        250
+#define TAG_IMG_PLANE_SIZE  (TAG_IMG_ROW_BYTES * TAG_IMG_ROWS)
 
 static uint8_t dev_uuid[ESP_BLE_MESH_OCTET16_LEN];
 
 /* ===== (GIỮ LẠI) Lưu lần node cuối cùng + TID ===== */
 static struct example_info_store {
     uint16_t server_addr;   /* Vendor server unicast address (node cuối cùng) */
-    uint16_t vnd_tid;       /* TID chứa trong vendor message */
+    uint16_t vnd_tid;       /* TID chứa trong vendor message (NVS: cuối lease) */
 } store = {
     .server_addr = ESP_BLE_MESH_ADDR_UNASSIGNED,
     .vnd_tid = 0,
 };
 
+/* TID lease: 1 lần ghi NVS giữ trước TID_LEASE_BLOCK TID; NVS lưu TID cuối
+ * của lease, sau reboot đi tiếp từ đó -> không bao giờ dùng lại TID */
+#define TID_LEASE_BLOCK     256
+
+static uint16_t s_tid_lease_end;
+static uint32_t s_tid_sends;
+static uint32_t s_tid_nvs_writes;
+static uint32_t s_tid_nvs_us_max;
+static SemaphoreHandle_t s_tid_lock;    /* task MQTT + task sweep cùng cấp TID */
+
 static nvs_handle_t NVS_HANDLE;
 static const char * NVS_KEY = "vendor_client";
 
@@ -82,7 +131,7 @@ static esp_ble_mesh_cfg_srv_t config_server = {
     /* 3 transmissions with 20ms interval */
     .net_transmit = ESP_BLE_MESH_TRANSMIT(2, 20),
     .relay = ESP_BLE_MESH_RELAY_DISABLED,
-    .relay_retransmit = ESP_BLE_MESH_TRANSMIT(2, 20),
+    .relay_retransmit = ESP_BLE_MESH_TRANSMIT(RELAY_MGR_RELAY_XMIT_COUNT, RELAY_MGR_RELAY_XMIT_INTERVAL),
     .beacon = ESP_BLE_MESH_BEACON_DISABLED,
 #if defined(CONFIG_BLE_MESH_FRIEND)
     .friend_state = ESP_BLE_MESH_FRIEND_ENABLED,
@@ -105,6 +154,11 @@ static esp_ble_mesh_client_t vendor_client = {
 
 static esp_ble_mesh_model_op_t vnd_op[] = {
     ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_STATUS, 2),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_BLK_ACK, EP_BLK_ACK_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_OTA_STATUS, EP_OTA_STATUS_HDR_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_DIGEST, EP_DIGEST_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_FPROV_STATUS, EP_FPROV_STATUS_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_FPROV_NODE, EP_FPROV_NODE_LEN),
     ESP_BLE_MESH_MODEL_OP_END,
 };
 
@@ -137,7 +191,30 @@ static esp_ble_mesh_prov_t provision = {
 
 static void mesh_example_info_store(void)
 {
-    ble_mesh_nvs_store(NVS_HANDLE, NVS_KEY, &store, sizeof(store));
+    struct example_info_store rec = store;
+    rec.vnd_tid = s_tid_lease_end;
+    int64_t t0 = esp_timer_get_time();
+    ble_mesh_nvs_store(NVS_HANDLE, NVS_KEY, &rec, sizeof(rec));
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    ++s_tid_nvs_writes;
+    if (us > s_tid_nvs_us_max) s_tid_nvs_us_max = us;
+}
+
+/* TID kế tiếp; chỉ ghi NVS khi vượt lease hiện tại */
+static uint16_t tid_next(void)
+{
+    if (s_tid_lock) xSemaphoreTake(s_tid_lock, portMAX_DELAY);
+    ++store.vnd_tid;
+    ++s_tid_sends;
+    if ((int16_t)(store.vnd_tid - s_tid_lease_end) > 0) {
+        s_tid_lease_end = (uint16_t)(store.vnd_tid + TID_LEASE_BLOCK - 1);
+        mesh_example_info_store();
+        ESP_LOGI(TAG, "TID lease 0x%04x..0x%04x: %" PRIu32 " NVS writes / %" PRIu32 " sends, max %" PRIu32 " us",
+                 store.vnd_tid, s_tid_lease_end, s_tid_nvs_writes, s_tid_sends, s_tid_nvs_us_max);
+    }
+    uint16_t tid = store.vnd_tid;
+    if (s_tid_lock) xSemaphoreGive(s_tid_lock);
+    return tid;
 }
 static void mesh_example_info_restore(void)
 {
@@ -149,10 +226,27 @@ static void mesh_example_info_restore(void)
         return;
     }
     if (exist) {
+        /* vnd_tid là cuối lease trước: TID kế tiếp mở lease mới */
+        s_tid_lease_end = store.vnd_tid;
         ESP_LOGI(TAG, "Restore, server_addr 0x%04x, vnd_tid 0x%04x", store.server_addr, store.vnd_tid);
     }
 }
 
+/* Tag LPN (build pin): gói chờ ở Friend tới lần poll kế -> chờ phản hồi lâu
+ * hơn, không đưa vào relay_mgr (không relay, không nghe heartbeat dò) */
+static bool node_is_lpn(const esp_ble_mesh_node_t *node)
+{
+    return node && node->comp_data && node->comp_length >= 10 &&
+           (COMP_DATA_2_OCTET(node->comp_data, 8) & COMP_FEAT_LOW_POWER);
+}
+
+static void relay_join(uint16_t addr)
+{
+    if (!node_is_lpn(esp_ble_mesh_provisioner_get_node_with_addr(addr))) {
+        relay_mgr_node_join(addr);
+    }
+}
+
 static void example_ble_mesh_set_msg_common(esp_ble_mesh_client_common_param_t *common,
                                             esp_ble_mesh_node_t *node,
                                             esp_ble_mesh_model_t *model, uint32_t opcode)
@@ -162,8 +256,8 @@ static void example_ble_mesh_set_msg_common(esp_ble_mesh_client_common_param_t *
     common->ctx.net_idx = prov_key.net_idx;
     common->ctx.app_idx = prov_key.app_idx;
     common->ctx.addr = node->unicast_addr; // địa chỉ node
-    common->ctx.send_ttl = MSG_SEND_TTL;
-    common->msg_timeout = MSG_TIMEOUT;
+    common->ctx.send_ttl = node_table_ttl(node->unicast_addr);
+    common->msg_timeout = node_is_lpn(node) ? LPN_MSG_TIMEOUT_MS : MSG_TIMEOUT;
 #if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
     common->msg_role = MSG_ROLE;
 #endif
@@ -173,9 +267,6 @@ static void example_ble_mesh_set_msg_common(esp_ble_mesh_client_common_param_t *
 static esp_err_t prov_complete(uint16_t node_index, const esp_ble_mesh_octet16_t uuid,
                                uint16_t primary_addr, uint8_t element_num, uint16_t net_idx)
 {
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_ble_mesh_cfg_client_get_state_t get = {0};
-    esp_ble_mesh_node_t *node = NULL;
     char name[10] = {'\0'};
     esp_err_t err;
 
@@ -187,6 +278,9 @@ static esp_err_t prov_complete(uint16_t node_index, const esp_ble_mesh_octet16_t
     store.server_addr = primary_addr;
     mesh_example_info_store();
 
+    /* Trả slot link + xếp node vào chuỗi cấu hình (prov_sched gửi Composition Get) */
+    prov_sched_on_provisioned(uuid, primary_addr);
+
     sprintf(name, "%s%02x", "NODE-", node_index);
     err = esp_ble_mesh_provisioner_set_node_name(node_index, name);
     if (err != ESP_OK) {
@@ -194,21 +288,6 @@ static esp_err_t prov_complete(uint16_t node_index, const esp_ble_mesh_octet16_t
         return ESP_FAIL;
     }
 
-    node = esp_ble_mesh_provisioner_get_node_with_addr(primary_addr);
-    if (node == NULL) {
-        ESP_LOGE(TAG, "Failed to get node 0x%04x info", primary_addr);
-        return ESP_FAIL;
-    }
-
-    /* Lấy Composition → AppKey Add → Model App Bind (giữ nguyên chuỗi cấu hình) */
-    example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
-    get.comp_data_get.page = COMP_DATA_PAGE_0;
-    err = esp_ble_mesh_config_client_get_state(&common, &get);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send Config Composition Data Get");
-        return ESP_FAIL;
-    }
-
     return ESP_OK;
 }
 
@@ -217,31 +296,36 @@ static inline bool uuid_ok(const uint8_t uuid[16]) {
     return uuid[0] == 0x32 && uuid[1] == 0x10;
 }
 
-/* ===== Add unprov device khi quét thấy ===== */
+/* ===== Quét thấy unprov device: chỉ xếp hàng, prov_sched mở link khi có slot ===== */
 static void recv_unprov_adv_pkt(uint8_t dev_uuid[ESP_BLE_MESH_OCTET16_LEN], uint8_t addr[BD_ADDR_LEN],
                                 esp_ble_mesh_addr_type_t addr_type, uint16_t oob_info,
                                 uint8_t adv_type, esp_ble_mesh_prov_bearer_t bearer)
+{
+    prov_sched_dev_t dev = {0};
+
+    memcpy(dev.uuid, dev_uuid, ESP_BLE_MESH_OCTET16_LEN);
+    memcpy(dev.addr, addr, BD_ADDR_LEN);
+    dev.addr_type = (uint8_t)addr_type;
+    dev.oob_info  = oob_info;
+    dev.bearer    = (uint8_t)bearer;
+    prov_sched_discovered(&dev);
+}
+
+static esp_err_t prov_start(const prov_sched_dev_t *dev)
 {
     esp_ble_mesh_unprov_dev_add_t add_dev = {0};
-    esp_err_t err;
 
-    ESP_LOG_BUFFER_HEX("Device address", addr, BD_ADDR_LEN);
-    ESP_LOGI(TAG, "Address type 0x%02x, adv type 0x%02x", addr_type, adv_type);
-    ESP_LOG_BUFFER_HEX("Device UUID", dev_uuid, ESP_BLE_MESH_OCTET16_LEN);
-    ESP_LOGI(TAG, "oob info 0x%04x, bearer %s", oob_info, (bearer & ESP_BLE_MESH_PROV_ADV) ? "PB-ADV" : "PB-GATT");
+    ESP_LOG_BUFFER_HEX("Device UUID", dev->uuid, ESP_BLE_MESH_OCTET16_LEN);
+    ESP_LOGI(TAG, "oob info 0x%04x, bearer %s", dev->oob_info, (dev->bearer & ESP_BLE_MESH_PROV_ADV) ? "PB-ADV" : "PB-GATT");
 
-    memcpy(add_dev.addr, addr, BD_ADDR_LEN);
-    add_dev.addr_type = (esp_ble_mesh_addr_type_t)addr_type;
-    memcpy(add_dev.uuid, dev_uuid, ESP_BLE_MESH_OCTET16_LEN);
-    add_dev.oob_info = oob_info;
-    add_dev.bearer = (esp_ble_mesh_prov_bearer_t)bearer;
+    memcpy(add_dev.addr, dev->addr, BD_ADDR_LEN);
+    add_dev.addr_type = (esp_ble_mesh_addr_type_t)dev->addr_type;
+    memcpy(add_dev.uuid, dev->uuid, ESP_BLE_MESH_OCTET16_LEN);
+    add_dev.oob_info = dev->oob_info;
+    add_dev.bearer = (esp_ble_mesh_prov_bearer_t)dev->bearer;
 
-    /* Tự động add & start provision ngay (như cũ) */
-    err = esp_ble_mesh_provisioner_add_unprov_dev(&add_dev,
+    return esp_ble_mesh_provisioner_add_unprov_dev(&add_dev,
             ADD_DEV_RM_AFTER_PROV_FLAG | ADD_DEV_START_PROV_NOW_FLAG | ADD_DEV_FLUSHABLE_DEV_FLAG);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start provisioning device");
-    }
 }
 
 /* ===== Provisioning callbacks ===== */
@@ -272,10 +356,12 @@ static void example_ble_mesh_provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
     case ESP_BLE_MESH_PROVISIONER_PROV_LINK_OPEN_EVT:
         ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_LINK_OPEN_EVT, bearer %s",
             param->provisioner_prov_link_open.bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT");
+        prov_sched_on_link_open();
         break;
     case ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT:
         ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT, bearer %s, reason 0x%02x",
             param->provisioner_prov_link_close.bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT", param->provisioner_prov_link_close.reason);
+        prov_sched_on_link_close(param->provisioner_prov_link_close.reason == 0);  /* 0 = success */
         break;
     case ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT:
         prov_complete(param->provisioner_prov_complete.node_idx, param->provisioner_prov_complete.device_uuid,
@@ -316,6 +402,24 @@ static void example_ble_mesh_provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
     case ESP_BLE_MESH_PROVISIONER_STORE_NODE_COMP_DATA_COMP_EVT:
         ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_STORE_NODE_COMP_DATA_COMP_EVT, err_code %d", param->provisioner_store_node_comp_data_comp.err_code);
         break;
+    case ESP_BLE_MESH_PROVISIONER_RECV_HEARTBEAT_MESSAGE_EVT:
+        node_table_heartbeat(param->provisioner_recv_heartbeat.hb_src,
+                             param->provisioner_recv_heartbeat.init_ttl,
+                             param->provisioner_recv_heartbeat.rx_ttl,
+                             param->provisioner_recv_heartbeat.rssi);
+        if (esp_ble_mesh_provisioner_get_node_with_addr(param->provisioner_recv_heartbeat.hb_src)) {
+            relay_join(param->provisioner_recv_heartbeat.hb_src);
+        }
+        break;
+#if CONFIG_BLE_MESH_FRIEND
+    case ESP_BLE_MESH_FRIEND_FRIENDSHIP_ESTABLISH_EVT:
+        ESP_LOGI(TAG, "Friend of LPN 0x%04x", param->frnd_friendship_establish.lpn_addr);
+        break;
+    case ESP_BLE_MESH_FRIEND_FRIENDSHIP_TERMINATE_EVT:
+        ESP_LOGW(TAG, "Friendship with LPN 0x%04x ended (reason %d)",
+                 param->frnd_friendship_terminate.lpn_addr, param->frnd_friendship_terminate.reason);
+        break;
+#endif
     default:
         break;
     }
@@ -360,13 +464,110 @@ static void example_ble_mesh_parse_node_comp_data(const uint8_t *data, uint16_t
     ESP_LOGI(TAG, "*********************** Composition Data End ***********************");
 }
 
-/* ===== Config Client callbacks (giữ nguyên logic AppKey Add → Model App Bind) ===== */
-static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
-                                              esp_ble_mesh_cfg_client_cb_param_t *param)
+/* ===== TTL + số lần phát theo đích =====
+ * TTL đi trong ctx nên chính xác theo từng gói. Số lần phát thì không: ctx /
+ * client API của IDF không có transmit riêng từng gói, stack đọc state chung
+ * net_transmit của config server lúc task BTC xử lý gói. Vì vậy chỉ đổi nó
+ * khi stack rảnh: mesh_tx chỉ gọi tới đây với số lần phát khác khi mọi gói
+ * trước đã về SEND_COMP (gói cùng số lần phát thì đi liền nhau). Config
+ * client (prov_sched, relay_mgr) gửi xen vào dùng giá trị đang đặt. */
+static void mesh_tx_params(esp_ble_mesh_msg_ctx_t *ctx, uint16_t dst)
+{
+    ctx->send_ttl = node_table_ttl(dst);
+    config_server.net_transmit = ESP_BLE_MESH_TRANSMIT(node_table_xmit_count(dst), MSG_XMIT_INTERVAL);
+}
+
+/* ===== Nhận heartbeat =====
+ * Heartbeat từ tag mang sẵn init TTL: node_table học hop, relay_mgr dò đồ thị
+ * relay và phát hiện tag mất (relay_mgr_node_lost), bản đồ sức khoẻ. Cần
+ * CONFIG_BLE_MESH_PROVISIONER_RECV_HB; bộ lọc mặc định là accept list rỗng =
+ * bỏ mọi heartbeat, nên đổi sang reject list rỗng = nhận hết. */
+static void hb_recv_init(void)
+{
+    esp_err_t err = esp_ble_mesh_provisioner_recv_heartbeat(true);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to enable heartbeat receiving");
+    }
+    err = esp_ble_mesh_provisioner_set_heartbeat_filter_type(ESP_BLE_MESH_HEARTBEAT_FILTER_REJECTLIST);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set heartbeat filter");
+    }
+}
+
+/* ===== Chuỗi cấu hình node mới: Composition Get → AppKey Add → Model App Bind → Heartbeat Pub =====
+ * prov_sched gửi từng bước (nhiều node song song) và tự thử lại khi timeout. */
+static int prov_step_of(uint32_t opcode)
+{
+    switch (opcode) {
+    case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET: return PROV_STEP_COMP_GET;
+    case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:          return PROV_STEP_APPKEY_ADD;
+    case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:       return PROV_STEP_APP_BIND;
+    case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET:    return PROV_STEP_HB_PUB;
+    default:                                         return -1;
+    }
+}
+
+static esp_err_t prov_cfg_step(uint16_t addr, prov_step_t step)
 {
     esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_get_state_t get = {0};
     esp_ble_mesh_cfg_client_set_state_t set = {0};
+    esp_ble_mesh_node_t *node = esp_ble_mesh_provisioner_get_node_with_addr(addr);
+
+    if (!node) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    switch (step) {
+    case PROV_STEP_COMP_GET:
+        example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
+        get.comp_data_get.page = COMP_DATA_PAGE_0;
+        return esp_ble_mesh_config_client_get_state(&common, &get);
+    case PROV_STEP_APPKEY_ADD:
+        example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
+        set.app_key_add.net_idx = prov_key.net_idx;
+        set.app_key_add.app_idx = prov_key.app_idx;
+        memcpy(set.app_key_add.app_key, prov_key.app_key, ESP_BLE_MESH_OCTET16_LEN);
+        return esp_ble_mesh_config_client_set_state(&common, &set);
+    case PROV_STEP_APP_BIND:
+        example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND);
+        set.model_app_bind.element_addr = node->unicast_addr;
+        set.model_app_bind.model_app_idx = prov_key.app_idx;
+        set.model_app_bind.model_id = ESP_BLE_MESH_VND_MODEL_ID_SERVER;
+        set.model_app_bind.company_id = CID_ESP;
+        return esp_ble_mesh_config_client_set_state(&common, &set);
+    case PROV_STEP_HB_PUB:
+        /* cùng nhịp với heartbeat relay_mgr đặt sau khi dò (ghi đè y hệt) */
+        example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET);
+        set.heartbeat_pub_set.dst = PROV_OWN_ADDR;
+        set.heartbeat_pub_set.count = 0xFF;
+        set.heartbeat_pub_set.period = RELAY_MGR_HB_PERIOD_LOG;
+        set.heartbeat_pub_set.ttl = HB_PUB_TTL;
+        set.heartbeat_pub_set.feature = 0;
+        set.heartbeat_pub_set.net_idx = prov_key.net_idx;
+        return esp_ble_mesh_config_client_set_state(&common, &set);
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+static void prov_configured(uint16_t addr)
+{
+    ESP_LOGW(TAG, "0x%04x: provision and config successfully", addr);
+    relay_join(addr);
+}
+
+static const prov_sched_ops_t prov_ops = {
+    .start      = prov_start,
+    .cfg        = prov_cfg_step,
+    .configured = prov_configured,
+};
+
+/* ===== Config Client callbacks ===== */
+static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
+                                              esp_ble_mesh_cfg_client_cb_param_t *param)
+{
     esp_ble_mesh_node_t *node = NULL;
+    int step = prov_step_of(param->params->opcode);
     esp_err_t err;
 
     ESP_LOGI(TAG, "Config client, err_code %d, event %u, addr 0x%04x, opcode 0x%04" PRIx32,
@@ -374,6 +575,9 @@ static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t
 
     if (param->error_code) {
         ESP_LOGE(TAG, "Send config client message failed, opcode 0x%04" PRIx32, param->params->opcode);
+        if (step >= 0) {
+            prov_sched_on_cfg(param->params->ctx.addr, (prov_step_t)step, false);
+        }
         return;
     }
 
@@ -385,6 +589,13 @@ static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t
 
     switch (event) {
     case ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT:
+        if (param->params->opcode == ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET) {
+            relay_mgr_on_hb_sub_status(node->unicast_addr,
+                                       param->status_cb.heartbeat_sub_status.src,
+                                       param->status_cb.heartbeat_sub_status.count,
+                                       param->status_cb.heartbeat_sub_status.min_hops);
+            break;
+        }
         if (param->params->opcode == ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET) {
             ESP_LOG_BUFFER_HEX("Composition data", param->status_cb.comp_data_status.composition_data->data,
                 param->status_cb.comp_data_status.composition_data->len);
@@ -395,32 +606,19 @@ static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t
                 param->status_cb.comp_data_status.composition_data->len);
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to store node composition data");
-                break;
-            }
-
-            example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
-            set.app_key_add.net_idx = prov_key.net_idx;
-            set.app_key_add.app_idx = prov_key.app_idx;
-            memcpy(set.app_key_add.app_key, prov_key.app_key, ESP_BLE_MESH_OCTET16_LEN);
-            err = esp_ble_mesh_config_client_set_state(&common, &set);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send Config AppKey Add");
             }
+            prov_sched_on_cfg(node->unicast_addr, PROV_STEP_COMP_GET, err == ESP_OK);
         }
         break;
     case ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT:
-        if (param->params->opcode == ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD) {
-            example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND);
-            set.model_app_bind.element_addr = node->unicast_addr;
-            set.model_app_bind.model_app_idx = prov_key.app_idx;
-            set.model_app_bind.model_id = ESP_BLE_MESH_VND_MODEL_ID_SERVER;
-            set.model_app_bind.company_id = CID_ESP;
-            err = esp_ble_mesh_config_client_set_state(&common, &set);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send Config Model App Bind");
-            }
-        } else if (param->params->opcode == ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND) {
-            ESP_LOGW(TAG, "%s, Provision and config successfully", __func__);
+        if (step >= 0) {
+            prov_sched_on_cfg(node->unicast_addr, (prov_step_t)step, true);
+        } else if (param->params->opcode == ESP_BLE_MESH_MODEL_OP_RELAY_SET) {
+            relay_mgr_on_relay_status(node->unicast_addr,
+                param->status_cb.relay_status.relay == ESP_BLE_MESH_RELAY_ENABLED);
+        } else if (param->params->opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD) {
+            grp_ack_on_sub_status(node->unicast_addr, param->status_cb.model_sub_status.sub_addr,
+                                  param->status_cb.model_sub_status.status == 0);
         }
         break;
     case ESP_BLE_MESH_CFG_CLIENT_PUBLISH_EVT:
@@ -430,40 +628,9 @@ static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t
         }
         break;
     case ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT:
-        switch (param->params->opcode) {
-        case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET: {
-            esp_ble_mesh_cfg_client_get_state_t get = {0};
-            example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
-            get.comp_data_get.page = COMP_DATA_PAGE_0;
-            err = esp_ble_mesh_config_client_get_state(&common, &get);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send Config Composition Data Get");
-            }
-            break;
-        }
-        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
-            example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
-            set.app_key_add.net_idx = prov_key.net_idx;
-            set.app_key_add.app_idx = prov_key.app_idx;
-            memcpy(set.app_key_add.app_key, prov_key.app_key, ESP_BLE_MESH_OCTET16_LEN);
-            err = esp_ble_mesh_config_client_set_state(&common, &set);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send Config AppKey Add");
-            }
-            break;
-        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
-            example_ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND);
-            set.model_app_bind.element_addr = node->unicast_addr;
-            set.model_app_bind.model_app_idx = prov_key.app_idx;
-            set.model_app_bind.model_id = ESP_BLE_MESH_VND_MODEL_ID_SERVER;
-            set.model_app_bind.company_id = CID_ESP;
-            err = esp_ble_mesh_config_client_set_state(&common, &set);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send Config Model App Bind");
-            }
-            break;
-        default:
-            break;
+        /* không gửi lại ngay: prov_sched lùi theo hàm mũ, có giới hạn số lần */
+        if (step >= 0) {
+            prov_sched_on_cfg(node->unicast_addr, (prov_step_t)step, false);
         }
         break;
     default:
@@ -480,108 +647,254 @@ esp_err_t example_ble_mesh_send_vendor_message(bool resend)
         return ESP_FAIL;
     }
 
-    if (!resend) store.vnd_tid++;
-    uint16_t tid = store.vnd_tid;
+    uint16_t tid = resend ? store.vnd_tid : tid_next();
 
-    /* ===== LẤY DỮ LIỆU TỪ MQTT ===== */
-    static uint32_t s_price_cache = 0;
-    static char     s_barcode_cache[64] = "";
-    static uint8_t  s_sale_cache = 0xFF; // 0..100, 0xFF = không có
+    /* ===== LẤY DỮ LIỆU TỪ MQTT -> gộp vào trạng thái tag (tag_state) ===== */
     static uint16_t s_dst_cache  = 0x0000; // nhớ địa chỉ lần trước (nếu cần)
+    static uint8_t  s_prio_cache = EP_PRIO_NORMAL;
 
     CmdMsg msg = (CmdMsg){0};
-    if (mqtt_try_get_last(&msg)) {
-        // giá
-        s_price_cache = (msg.price < 0) ? 0u : (uint32_t)msg.price;
-        // barcode
-        size_t n = strnlen(msg.barcode, sizeof(msg.barcode));
-        if (n >= sizeof(s_barcode_cache)) n = sizeof(s_barcode_cache) - 1;
-        memcpy(s_barcode_cache, msg.barcode, n);
-        s_barcode_cache[n] = '\0';
-        // sale
-        if (msg.has_sale && msg.sale <= 100) s_sale_cache = msg.sale;
-        else s_sale_cache = 0xFF;
-        // địa chỉ đích từ add (JSON)
-        s_dst_cache = msg.add; // "add" = unicast đích
+    bool   has_msg = mqtt_try_get_last(&msg);
+    if (has_msg) {
+        s_dst_cache  = msg.add; // "add" = unicast đích
+        s_prio_cache = msg.prio;
     } else {
         ESP_LOGW(TAG, "No new MQTT data, reuse cached values");
     }
 
-    uint32_t    price      = s_price_cache;
-    const char *barcode_in = s_barcode_cache;
-    uint8_t     sale_pct   = s_sale_cache;
-
-    /* ===== CHUẨN HOÁ BARCODE → 13 KÝ TỰ SỐ, PACK BCD ===== */
-    char digits_only[64] = {0};
-    size_t m = 0;
-    for (const char *p = barcode_in; *p && m < sizeof(digits_only)-1; ++p) {
-        if (isdigit((unsigned char)*p)) digits_only[m++] = *p;
-    }
-    char e13[13];
-    if (m >= 13) memcpy(e13, digits_only + (m - 13), 13);
-    else {
-        size_t pad = 13 - m;
-        memset(e13, '0', pad);
-        memcpy(e13 + pad, digits_only, m);
-    }
-    uint8_t bcd[7];
-    for (int i = 0; i < 6; ++i) {
-        uint8_t hi = (uint8_t)(e13[2*i]   - '0');
-        uint8_t lo = (uint8_t)(e13[2*i+1] - '0');
-        bcd[i] = (uint8_t)((hi << 4) | lo);
-    }
-    bcd[6] = (uint8_t)(((uint8_t)(e13[12] - '0') << 4) | 0x0F);
-
     /* ===== CHỌN ĐỊA CHỈ ĐÍCH TỪ add (JSON) ===== */
     uint16_t dst_addr = s_dst_cache ? s_dst_cache : store.server_addr;
 
-    /* === CHECK QUAN TRỌNG: phải là UNICAST hợp lệ === */
-    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(dst_addr)) {
+    /* === CHECK QUAN TRỌNG: UNICAST hợp lệ, hoặc group đã có thành viên === */
+    bool is_group = ESP_BLE_MESH_ADDR_IS_GROUP(dst_addr);
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(dst_addr) && !is_group) {
         ESP_LOGW(TAG, "dst_addr invalid (no 'add' or bad value). Skip send.");
         return ESP_FAIL;
     }
 
-    /* ===== BUILD PAYLOAD 14B: TID(2) + PRICE(4) + BCD(7) + SALE(1) ===== */
-    uint8_t buf[14];
-    buf[0] = (uint8_t)(tid & 0xFF);
-    buf[1] = (uint8_t)((tid >> 8) & 0xFF);
-    buf[2] = (uint8_t)(price & 0xFF);
-    buf[3] = (uint8_t)((price >> 8) & 0xFF);
-    buf[4] = (uint8_t)((price >> 16) & 0xFF);
-    buf[5] = (uint8_t)((price >> 24) & 0xFF);
-    memcpy(&buf[6], bcd, 7);
-    buf[13] = sale_pct;
+    if (has_msg) {
+        EPData upd = {
+            .add       = dst_addr,
+            .partial   = msg.partial,
+            .price     = msg.price,
+            .has_sale  = msg.has_sale && msg.sale <= 100,
+            .sale      = msg.sale,
+            .has_title = msg.has_title,
+        };
+        memcpy(upd.barcode, msg.barcode, sizeof(upd.barcode));
+        memcpy(upd.title, msg.title, sizeof(upd.title));
+        esp_err_t err = tag_state_update(dst_addr, &upd);
+        if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Partial update for 0x%04X without known price/barcode, skip", dst_addr);
+            return err;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
 
-    /* ===== GỬI ===== */
-    esp_ble_mesh_msg_ctx_t ctx = (esp_ble_mesh_msg_ctx_t){0};
-    ctx.net_idx  = prov_key.net_idx;
-    ctx.app_idx  = prov_key.app_idx;
-    ctx.addr     = dst_addr;     // unicast đích từ JSON.add
-    ctx.send_ttl = MSG_SEND_TTL;
+    /* ===== BUILD PAYLOAD 14B: TID(2) + PRICE(4) + BCD(7) + SALE(1) [+ TLEN(1) + TITLE] [+ GACK] ===== */
+    uint8_t buf[EP_SEND_LEGACY_LEN + 1 + EP_TITLE_ENC_MAX + 1];
+    size_t  buf_len = tag_state_pack_send(dst_addr, tid, buf, sizeof(buf) - 1);
+    tag_state_t st;
+    if (buf_len == 0 || !tag_state_get(dst_addr, &st)) {
+        ESP_LOGW(TAG, "No state for 0x%04X yet. Skip send.", dst_addr);
+        return ESP_FAIL;
+    }
+    if (is_group) {
+        /* tag trả STATUS trễ theo slot: luôn có TLEN (0 = giữ tên) rồi byte GACK */
+        if (buf_len == EP_SEND_LEGACY_LEN) buf[buf_len++] = 0;
+        buf[buf_len++] = grp_ack_slots_log(dst_addr);
+    }
 
+    /* ===== GỬI: qua bộ lập lịch mesh_tx; lệnh cũ chưa bay tới cùng tag bị thay,
+     *        lệnh urgent vượt lên trước hàng đồng bộ bulk ===== */
     const uint32_t opcode = ESP_BLE_MESH_VND_MODEL_OP_SEND;
 
-    if (sale_pct != 0xFF) {
-        ESP_LOGI(TAG, "SEND → dst=0x%04X, TID=0x%04X, price=%u, sale=%u%%, barcode13=%.*s",
-                 dst_addr, tid, (unsigned)price, (unsigned)sale_pct, 13, e13);
+    if (st.sale != TAG_STATE_NO_SALE) {
+        ESP_LOGI(TAG, "SEND → dst=0x%04X, TID=0x%04X, price=%u, sale=%u%%, barcode13=%s, prio=%u",
+                 dst_addr, tid, (unsigned)st.price, (unsigned)st.sale, st.e13, s_prio_cache);
     } else {
-        ESP_LOGI(TAG, "SEND → dst=0x%04X, TID=0x%04X, price=%u, sale=NA, barcode13=%.*s",
-                 dst_addr, tid, (unsigned)price, 13, e13);
+        ESP_LOGI(TAG, "SEND → dst=0x%04X, TID=0x%04X, price=%u, sale=NA, barcode13=%s, prio=%u",
+                 dst_addr, tid, (unsigned)st.price, st.e13, s_prio_cache);
+    }
+
+    /* theo dõi trước khi xếp hàng (task mesh_tx có thể gửi ngay);
+     * lệnh mới thay lệnh chưa tới tag: báo lệnh cũ là superseded */
+    if (has_msg) {
+        uint32_t prev = tag_state_track(dst_addr, msg.cid);
+        if (prev) {
+            outbox_put(OUTBOX_K_SUPERSEDED, dst_addr, tid, prev, 0, 0);
+        }
+    }
+
+    /* ghi WAL trước khi xếp hàng (group commit, không chờ flash): gói có thể
+     * lên mesh ngay, reboot trước ACK -> gửi lại */
+    esp_err_t werr = outq_append(dst_addr, tid, s_prio_cache, buf, (uint16_t)buf_len);
+    if (werr != ESP_OK && werr != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "TID 0x%04X not persisted (%s)", tid, esp_err_to_name(werr));
     }
 
-    esp_err_t err = esp_ble_mesh_client_model_send_msg(
-        vendor_client.model, &ctx, opcode,
-        sizeof(buf), buf, MSG_TIMEOUT, true, MSG_ROLE);
+    esp_err_t err = is_group
+        ? grp_ack_start(dst_addr, tid, buf, (uint16_t)buf_len, s_prio_cache)
+        : mesh_tx_submit(dst_addr, EP_VND_OP_SEND, buf, (uint16_t)buf_len,
+                         MESH_TX_F_RSP | MESH_TX_F_COALESCE, (mesh_tx_prio_t)s_prio_cache);
 
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send vendor message 0x%06" PRIx32, (unsigned long)opcode);
+        ESP_LOGE(TAG, "Failed to queue vendor message 0x%06" PRIx32 " (%s)",
+                 (unsigned long)opcode, esp_err_to_name(err));
+        outq_ack(dst_addr, tid);                    /* rút bản ghi WAL: không replay lệnh đã báo failed */
+        if (tag_state_failed(dst_addr, tid)) {      /* không báo superseded / failed lần 2 */
+            outbox_put(OUTBOX_K_FAILED, dst_addr, tid, tag_state_cid(dst_addr, tid), err, 0);
+        }
         return err;
     }
-
-    mesh_example_info_store();
     return ESP_OK;
 }
 
+/* ===== Gửi thật lên mesh — chỉ task mesh_tx gọi ===== */
+static esp_err_t mesh_vnd_send_now(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len, bool need_rsp)
+{
+    if (vendor_client.model == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_ble_mesh_msg_ctx_t ctx = (esp_ble_mesh_msg_ctx_t){0};
+    ctx.net_idx  = prov_key.net_idx;
+    ctx.app_idx  = prov_key.app_idx;
+    ctx.addr     = dst;
+    mesh_tx_params(&ctx, dst);
+
+    int32_t timeout = need_rsp && node_is_lpn(esp_ble_mesh_provisioner_get_node_with_addr(dst))
+                    ? LPN_MSG_TIMEOUT_MS : MSG_TIMEOUT;
+    esp_err_t err = esp_ble_mesh_client_model_send_msg(vendor_client.model, &ctx,
+            ESP_BLE_MESH_MODEL_OP_3(op, CID_ESP), len, (uint8_t *)data,
+            timeout, need_rsp, MSG_ROLE);
+    if (err == ESP_OK) {
+        boot_ts_mark(BOOT_TS_FIRST_SEND);
+        if (op == EP_VND_OP_SEND && len >= 2) {
+            tag_state_on_sent(dst, ep_get_le16(data));
+        }
+    }
+    return err;
+}
+
+/* ===== Lệnh giá tới tag không tới được, không còn lần gửi lại =====
+ * (timeout STATUS, mesh_tx bỏ gói): báo failed, thôi replay sau reboot.
+ * Lệnh vẫn là lệnh mới nhất chưa xác nhận (tag_state giữ cid): sweep so
+ * digest và gửi lại, tag ngủ sâu thức dậy thì gửi lại ngay; tới nơi thì báo
+ * DELIVERED cùng cid. Chỉ lệnh mới nhất chưa chốt: lệnh cũ đã báo
+ * superseded, gói bù của grp_ack mang TID của group (grp_ack tự chốt). */
+static void vnd_send_failed(uint16_t dst, uint16_t tid, int32_t err)
+{
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(dst) || !tag_state_failed(dst, tid)) {
+        return;
+    }
+    ESP_LOGW(TAG, "TID 0x%04X -> 0x%04X failed (%" PRId32 ")", tid, dst, err);
+    outbox_put(OUTBOX_K_FAILED, dst, tid, tag_state_cid(dst, tid), err, 0);
+    outq_ack(dst, tid);
+}
+
+static void mesh_vnd_dropped(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len, int err)
+{
+    if (op == EP_VND_OP_SEND && len >= 2) {
+        vnd_send_failed(dst, ep_get_le16(data), err);
+    }
+}
+
+/* ===== Gửi vendor message thô (block transfer, OTA) — không chờ phản hồi =====
+ * OTA là nền (bulk); block transfer ảnh tag đi cùng lớp với lệnh giá thường. */
+static esp_err_t mesh_vnd_send_raw(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len)
+{
+    bool ota = op == EP_VND_OP_OTA_START || op == EP_VND_OP_OTA_DATA;
+    return mesh_tx_submit(dst, op, data, len, 0, ota ? MESH_TX_PRIO_BULK : MESH_TX_PRIO_NORMAL);
+}
+
+/* ===== Ảnh tag qua block transfer ===== */
+esp_err_t example_ble_mesh_send_image(uint16_t dst, const uint8_t *data, size_t len)
+{
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(dst) || data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Đã nén sẵn (header epd_codec 'E','C') -> gửi nguyên */
+    if (len >= EPC_HDR_LEN && data[0] == 'E' && data[1] == 'C') {
+        return blk_xfer_start(dst, EP_BLK_KIND_IMAGE, data, len);
+    }
+
+    /* Ảnh thô black+red -> nén trước khi lên mesh */
+    if (len != 2 * TAG_IMG_PLANE_SIZE) {
+        ESP_LOGE(TAG, "Image size %u, expect %u raw or epd_codec stream",
+                 (unsigned)len, 2 * TAG_IMG_PLANE_SIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t cap = epc_encode_bound(TAG_IMG_ROW_BYTES, TAG_IMG_ROWS, 2);
+    uint8_t *enc = malloc(cap);
+    if (!enc) {
+        return ESP_ERR_NO_MEM;
+    }
+    int n = epc_encode(data, data + TAG_IMG_PLANE_SIZE, TAG_IMG_ROW_BYTES, TAG_IMG_ROWS, enc, cap);
+    esp_err_t err = ESP_FAIL;
+    if (n > 0) {
+        ESP_LOGI(TAG, "Image 0x%04X: %u B -> %d B", dst, (unsigned)len, n);
+        err = blk_xfer_start(dst, EP_BLK_KIND_IMAGE, enc, (uint32_t)n);
+    }
+    free(enc);
+    return err;
+}
+
+/* ===== OTA firmware tag: mọi node đã provision là target ===== */
+esp_err_t example_ble_mesh_start_node_ota(void)
+{
+    const esp_ble_mesh_node_t **table = esp_ble_mesh_provisioner_get_node_table_entry();
+    uint16_t targets[CONFIG_BLE_MESH_MAX_PROV_NODES];
+    uint16_t n = 0;
+
+    for (int i = 0; table && i < CONFIG_BLE_MESH_MAX_PROV_NODES; i++) {
+        if (table[i] && ESP_BLE_MESH_ADDR_IS_UNICAST(table[i]->unicast_addr)) {
+            targets[n++] = table[i]->unicast_addr;
+        }
+    }
+    if (n == 0) {
+        ESP_LOGW(TAG, "Node OTA: no provisioned nodes");
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ota_dist_start(targets, n);
+}
+
+/* ===== STATUS từ tag (ACK theo TID) =====
+ * Tới dạng phản hồi (khớp request đang chờ) hoặc publish (không khớp), xử lý
+ * như nhau: grp_ack / tag_state / WAL không phân biệt đường tới. STATUS
+ * RENDERED cũng là ACK: STATUS đầu bị mất thì nó là tin đầu tiên báo tag đã
+ * nhận lệnh (các bước ACK bên dưới gọi lại nhiều lần không sao). */
+static void vnd_on_status(uint16_t src, const uint8_t *st, uint16_t len)
+{
+    if (len < EP_STATUS_LEN) {
+        return;
+    }
+    uint16_t st_tid   = ep_get_le16(st);
+    bool     rendered = len >= EP_STATUS_EXT_LEN && (st[2] & EP_STATUS_F_RENDERED);
+    tag_state_outcome_t oc;
+
+    tag_state_on_status(src, st_tid);
+    bool first = tag_state_delivered(src, st_tid, &oc);
+    if (first) {
+        outbox_put(OUTBOX_K_DELIVERED, src, st_tid, oc.cid,
+                   (int32_t)oc.queue_ms, (int32_t)oc.air_ms);
+    }
+    if (!rendered || first) {
+        node_table_on_ack(src, true);
+    }
+    if (!grp_ack_on_status(src, st_tid)) {
+        outq_ack(src, st_tid);
+    }
+    if (rendered) {
+        /* STATUS lần 2: màn hình đã vẽ xong */
+        outbox_put(OUTBOX_K_RENDERED, src, st_tid, tag_state_cid(src, st_tid),
+                   ep_get_le16(&st[3]), 0);
+    }
+}
+
 /* ===== Model callbacks (giữ nguyên) ===== */
 static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event,
                                              esp_ble_mesh_model_cb_param_t *param)
@@ -590,31 +903,378 @@ static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event
 
     switch (event) {
     case ESP_BLE_MESH_MODEL_OPERATION_EVT:  // nhận phản hồi từ node
+        node_table_observe(param->model_operation.ctx->addr, EP_NODE_REPLY_TTL,
+                           param->model_operation.ctx->recv_ttl, param->model_operation.ctx->recv_rssi);
+        mesh_tx_on_rx(param->model_operation.ctx->addr);
+        /* khớp request đang chờ: client đã bỏ node khỏi danh sách -> gửi tiếp được */
+        mesh_tx_on_rsp_done(param->model_operation.ctx->addr);
         if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_STATUS) {
+            vnd_on_status(param->model_operation.ctx->addr,
+                          param->model_operation.msg, param->model_operation.length);
             int64_t end_time = esp_timer_get_time();
             ESP_LOGI(TAG, "Recv 0x06%" PRIx32 ", tid 0x%04x, time %lldus",
                 param->model_operation.opcode, store.vnd_tid, end_time - start_time);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_BLK_ACK) {
+            blk_xfer_on_ack(param->model_operation.ctx->addr,
+                            param->model_operation.msg, param->model_operation.length);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_OTA_STATUS) {
+            ota_dist_on_status(param->model_operation.ctx->addr,
+                               param->model_operation.msg, param->model_operation.length);
         }
         break;
     case ESP_BLE_MESH_MODEL_SEND_COMP_EVT:
+        /* send_msg chỉ đẩy sang BTC: hết adv buffer / client bận (EBUSY) báo ở đây */
+        if (param->model_send_comp.ctx) {
+            mesh_tx_on_send_comp(param->model_send_comp.ctx->addr,
+                                 VND_OP_OF(param->model_send_comp.opcode),
+                                 param->model_send_comp.err_code);
+        }
         if (param->model_send_comp.err_code) {
-            ESP_LOGE(TAG, "Failed to send message 0x%06" PRIx32, param->model_send_comp.opcode);
+            ESP_LOGE(TAG, "Failed to send message 0x%06" PRIx32 " (err %d)",
+                     param->model_send_comp.opcode, param->model_send_comp.err_code);
             break;
         }
         start_time = esp_timer_get_time();
         ESP_LOGI(TAG, "Send 0x%06" PRIx32, param->model_send_comp.opcode);
         break;
     case ESP_BLE_MESH_CLIENT_MODEL_RECV_PUBLISH_MSG_EVT:
+        node_table_observe(param->client_recv_publish_msg.ctx->addr, EP_NODE_REPLY_TTL,
+                           param->client_recv_publish_msg.ctx->recv_ttl,
+                           param->client_recv_publish_msg.ctx->recv_rssi);
+        mesh_tx_on_rx(param->client_recv_publish_msg.ctx->addr);
+        /* BLK_ACK không gắn với request nào -> stack báo dạng publish */
+        if (param->client_recv_publish_msg.opcode == ESP_BLE_MESH_VND_MODEL_OP_BLK_ACK) {
+            blk_xfer_on_ack(param->client_recv_publish_msg.ctx->addr,
+                            param->client_recv_publish_msg.msg, param->client_recv_publish_msg.length);
+            break;
+        }
+        if (param->client_recv_publish_msg.opcode == ESP_BLE_MESH_VND_MODEL_OP_OTA_STATUS) {
+            ota_dist_on_status(param->client_recv_publish_msg.ctx->addr,
+                               param->client_recv_publish_msg.msg, param->client_recv_publish_msg.length);
+            break;
+        }
+        /* STATUS không khớp request nào đang chờ: STATUS trễ theo slot của lệnh
+         * group (gửi không chờ phản hồi), STATUS RENDERED sau khi STATUS đầu đã
+         * đóng request, hoặc STATUS tới sau client timeout */
+        if (param->client_recv_publish_msg.opcode == ESP_BLE_MESH_VND_MODEL_OP_STATUS) {
+            vnd_on_status(param->client_recv_publish_msg.ctx->addr,
+                          param->client_recv_publish_msg.msg, param->client_recv_publish_msg.length);
+            break;
+        }
+        /* DIGEST_GET gửi không chờ phản hồi -> DIGEST cũng đến dạng publish */
+        if (param->client_recv_publish_msg.opcode == ESP_BLE_MESH_VND_MODEL_OP_DIGEST) {
+            sweep_on_digest(param->client_recv_publish_msg.ctx->addr,
+                            param->client_recv_publish_msg.msg, param->client_recv_publish_msg.length);
+            break;
+        }
+        /* delegate fast prov: STATUS / NODE là tin tự phát của tag */
+        if (param->client_recv_publish_msg.opcode == ESP_BLE_MESH_VND_MODEL_OP_FPROV_STATUS) {
+            fprov_mgr_on_status(param->client_recv_publish_msg.ctx->addr,
+                                param->client_recv_publish_msg.msg, param->client_recv_publish_msg.length);
+            break;
+        }
+        if (param->client_recv_publish_msg.opcode == ESP_BLE_MESH_VND_MODEL_OP_FPROV_NODE) {
+            fprov_mgr_on_node(param->client_recv_publish_msg.ctx->addr,
+                              param->client_recv_publish_msg.msg, param->client_recv_publish_msg.length);
+            break;
+        }
         ESP_LOGI(TAG, "Receive publish message 0x%06" PRIx32, param->client_recv_publish_msg.opcode);
         break;
     case ESP_BLE_MESH_CLIENT_MODEL_SEND_TIMEOUT_EVT:
         ESP_LOGW(TAG, "Client message 0x%06" PRIx32 " timeout", param->client_send_timeout.opcode);
+        if (param->client_send_timeout.ctx) {
+            uint16_t    dst = param->client_send_timeout.ctx->addr;
+            tag_state_t st;
+            node_table_on_ack(dst, false);
+            mesh_tx_on_rsp_done(dst);
+            /* 1 request / đích: lệnh đang chờ là last_tid đã lên mesh */
+            if (param->client_send_timeout.opcode == ESP_BLE_MESH_VND_MODEL_OP_SEND &&
+                tag_state_get(dst, &st) && st.sent_ms) {
+                vnd_send_failed(dst, st.last_tid, ESP_ERR_TIMEOUT);
+            }
+        }
         break;
     default:
         break;
     }
 }
 
+/* ===== Relay manager: Config Client ops ===== */
+static esp_err_t relay_cfg_common(uint16_t addr, uint32_t opcode, esp_ble_mesh_client_common_param_t *common)
+{
+    esp_ble_mesh_node_t *node = esp_ble_mesh_provisioner_get_node_with_addr(addr);
+    if (node == NULL || config_client.model == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    example_ble_mesh_set_msg_common(common, node, config_client.model, opcode);
+    return ESP_OK;
+}
+
+static esp_err_t relay_hb_sub_set(uint16_t addr, uint16_t src, uint16_t dst, uint8_t period_log)
+{
+    esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_set_state_t set = {0};
+    esp_err_t err = relay_cfg_common(addr, ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET, &common);
+    if (err != ESP_OK) {
+        return err;
+    }
+    set.heartbeat_sub_set.src = src;
+    set.heartbeat_sub_set.dst = dst;
+    set.heartbeat_sub_set.period = period_log;
+    return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+static esp_err_t relay_hb_sub_get(uint16_t addr)
+{
+    esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_get_state_t get = {0};
+    esp_err_t err = relay_cfg_common(addr, ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET, &common);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_ble_mesh_config_client_get_state(&common, &get);
+}
+
+static esp_err_t relay_hb_pub_set(uint16_t addr, uint16_t dst, uint8_t count_log,
+                                  uint8_t period_log, uint8_t ttl)
+{
+    esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_set_state_t set = {0};
+    esp_err_t err = relay_cfg_common(addr, ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET, &common);
+    if (err != ESP_OK) {
+        return err;
+    }
+    set.heartbeat_pub_set.dst = dst;
+    set.heartbeat_pub_set.count = count_log;
+    set.heartbeat_pub_set.period = period_log;
+    set.heartbeat_pub_set.ttl = ttl;
+    set.heartbeat_pub_set.feature = 0;
+    set.heartbeat_pub_set.net_idx = prov_key.net_idx;
+    return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+static esp_err_t relay_relay_set(uint16_t addr, bool enable)
+{
+    esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_set_state_t set = {0};
+    esp_err_t err = relay_cfg_common(addr, ESP_BLE_MESH_MODEL_OP_RELAY_SET, &common);
+    if (err != ESP_OK) {
+        return err;
+    }
+    set.relay_set.relay = enable ? ESP_BLE_MESH_RELAY_ENABLED : ESP_BLE_MESH_RELAY_DISABLED;
+    set.relay_set.relay_retransmit = ESP_BLE_MESH_TRANSMIT(RELAY_MGR_RELAY_XMIT_COUNT,
+                                                           RELAY_MGR_RELAY_XMIT_INTERVAL);
+    ESP_LOGI(TAG, "Relay Set 0x%04x -> %s", addr, enable ? "on" : "off");
+    return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+static const relay_mgr_ops_t relay_ops = {
+    .hb_sub_set = relay_hb_sub_set,
+    .hb_sub_get = relay_hb_sub_get,
+    .hb_pub_set = relay_hb_pub_set,
+    .relay_set  = relay_relay_set,
+};
+
+/* ===== Nhóm tag: Config Model Sub Add + gửi SEND cho grp_ack ===== */
+static esp_err_t grp_sub_add(uint16_t addr, uint16_t group)
+{
+    esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_set_state_t set = {0};
+    esp_err_t err = relay_cfg_common(addr, ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD, &common);
+    if (err != ESP_OK) {
+        return err;
+    }
+    set.model_sub_add.element_addr = addr;
+    set.model_sub_add.sub_addr = group;
+    set.model_sub_add.model_id = ESP_BLE_MESH_VND_MODEL_ID_SERVER;
+    set.model_sub_add.company_id = CID_ESP;
+    return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+static esp_err_t grp_send(uint16_t dst, const uint8_t *data, uint16_t len, bool group, uint8_t prio)
+{
+    /* gửi group: không chờ phản hồi (grp_ack gom STATUS); unicast bù thì chờ như
+     * lệnh thường nhưng không gộp: bản bù không được đè lệnh mới hơn cho tag */
+    return mesh_tx_submit(dst, EP_VND_OP_SEND, data, len,
+                          group ? MESH_TX_F_COALESCE : MESH_TX_F_RSP, (mesh_tx_prio_t)prio);
+}
+
+static void grp_done(uint16_t group, uint16_t tid, uint16_t missing)
+{
+    /* đã hết vòng bù: không phát lại cả nhóm sau reboot vì vài tag chết */
+    outq_ack(group, tid);
+    tag_state_outcome_t oc = { .cid = tag_state_cid(group, tid) };
+    tag_state_delivered(group, tid, &oc);
+    outbox_put(OUTBOX_K_GROUP, group, tid, oc.cid, missing, (int32_t)oc.air_ms);
+    if (missing == 0) {
+        tag_state_on_status(group, tid);   /* mọi tag đã có tên -> thôi gửi kèm */
+    } else {
+        ESP_LOGW(TAG, "Group 0x%04X TID 0x%04X: %u tags unconfirmed", group, tid, missing);
+    }
+}
+
+static const grp_ack_ops_t grp_ops = {
+    .sub_add = grp_sub_add,
+    .send    = grp_send,
+    .done    = grp_done,
+};
+
+/* ===== WAL: lệnh chưa ACK trước khi reboot ===== */
+static esp_err_t outq_replay(uint16_t dst, uint16_t tid, uint8_t prio, const uint8_t *payload, uint16_t len)
+{
+    ESP_LOGI(TAG, "Replay TID 0x%04X -> 0x%04X", tid, dst);
+    /* tag_state rỗng sau reboot: dựng lại từ payload để timeout / drop của lệnh
+     * replay vẫn được chốt (FAILED + rút WAL) như lệnh thường */
+    tag_state_restore(dst, tid, payload, len);
+    if (ESP_BLE_MESH_ADDR_IS_GROUP(dst)) {
+        return grp_ack_start(dst, tid, payload, len, prio);
+    }
+    return mesh_tx_submit(dst, EP_VND_OP_SEND, payload, len,
+                          MESH_TX_F_RSP | MESH_TX_F_COALESCE, (mesh_tx_prio_t)prio);
+}
+
+/* ===== Anti-entropy: hỏi digest lúc mesh rảnh, chỉ gửi lại tag lệch ===== */
+static esp_err_t sweep_probe(uint16_t addr)
+{
+    return mesh_tx_submit(addr, EP_VND_OP_DIGEST_GET, NULL, 0, 0, MESH_TX_PRIO_BULK);
+}
+
+static esp_err_t sweep_resend(uint16_t addr, mesh_tx_prio_t prio)
+{
+    uint8_t  buf[EP_SEND_LEGACY_LEN + 1 + EP_TITLE_ENC_MAX];
+    /* lệnh MQTT chưa tới (tag ngủ sâu) -> bản gửi lại mang tiếp cid của nó */
+    tag_state_t st;
+    uint32_t cid = tag_state_get(addr, &st) && !st.delivered ? st.cid : 0;
+    uint16_t tid = tid_next();
+    size_t   len = tag_state_pack_send(addr, tid, buf, sizeof(buf));
+    if (len == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGI(TAG, "Sweep resend TID 0x%04X -> 0x%04X", tid, addr);
+    uint32_t prev = tag_state_track(addr, cid);
+    if (prev && prev != cid) {
+        outbox_put(OUTBOX_K_SUPERSEDED, addr, tid, prev, 0, 0);
+    }
+    /* WAL trước, như lệnh MQTT; xếp hàng lỗi -> rút bản ghi */
+    outq_append(addr, tid, prio, buf, (uint16_t)len);
+    esp_err_t err = mesh_tx_submit(addr, EP_VND_OP_SEND, buf, (uint16_t)len,
+                                   MESH_TX_F_RSP | MESH_TX_F_COALESCE, prio);
+    if (err != ESP_OK) {
+        outq_ack(addr, tid);
+        if (tag_state_failed(addr, tid) && cid) {
+            outbox_put(OUTBOX_K_FAILED, addr, tid, cid, err, 0);
+        }
+        return err;
+    }
+    return ESP_OK;
+}
+
+static const sweep_ops_t sweep_ops = {
+    .probe  = sweep_probe,
+    .resend = sweep_resend,
+};
+
+/* ===== Fast provisioning: tag đã provision cấp địa chỉ trong dải được giao ===== */
+static esp_err_t fprov_send(uint16_t dst, uint8_t op, const uint8_t *data, uint16_t len)
+{
+    return mesh_tx_submit(dst, op, data, len, 0, MESH_TX_PRIO_NORMAL);
+}
+
+static void fprov_onboarded(uint16_t addr, uint8_t elems, const uint8_t uuid[16], uint16_t via)
+{
+    /* gateway không có device key của tag này: chỉ nói chuyện qua AppKey,
+     * không đưa vào relay_mgr (cần Config Client tới tag). Delegate đã đặt
+     * heartbeat về gateway -> theo dõi sức khoẻ trong node_table như tag khác */
+    ESP_LOGI(TAG, "Onboarded 0x%04X (%u elems) via 0x%04X", addr, elems, via);
+    node_table_track(addr, via);
+    outbox_put(OUTBOX_K_ONBOARDED, addr, 0, ep_get_le32(&uuid[12]), via, elems);
+}
+
+static const fprov_mgr_ops_t fprov_ops = {
+    .send      = fprov_send,
+    .onboarded = fprov_onboarded,
+};
+
+/* Chọn delegate: tag xa gateway nhất (hops_max) trước, mỗi vùng relay một tag
+ * để các dải phủ nhiều góc cửa hàng; thiếu thì lấp bằng tag còn lại. */
+esp_err_t example_ble_mesh_onboard(uint16_t duration_s, uint8_t n)
+{
+    static uint16_t cand[CONFIG_BLE_MESH_MAX_PROV_NODES + FPROV_MGR_REGISTRY_MAX];
+    static uint8_t  hops[CONFIG_BLE_MESH_MAX_PROV_NODES + FPROV_MGR_REGISTRY_MAX];
+    uint16_t pick[FPROV_MGR_DELEGATES_MAX];
+    uint8_t  used_region[(RELAY_MGR_MAX_NODES + 7) / 8] = {0};
+    size_t   nc = 0;
+    uint8_t  np = 0;
+
+    if (n == 0 || n > FPROV_MGR_DELEGATES_MAX) {
+        n = FPROV_MGR_DELEGATES_MAX;
+    }
+    const esp_ble_mesh_node_t **table = esp_ble_mesh_provisioner_get_node_table_entry();
+    for (int i = 0; table && i < CONFIG_BLE_MESH_MAX_PROV_NODES; i++) {
+        if (table[i] && ESP_BLE_MESH_ADDR_IS_UNICAST(table[i]->unicast_addr)) {
+            cand[nc++] = table[i]->unicast_addr;
+        }
+    }
+    nc += fprov_mgr_registered(&cand[nc], FPROV_MGR_REGISTRY_MAX);
+    if (nc == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* insertion sort theo hops_max giảm dần (nc nhỏ, chạy hiếm) */
+    for (size_t i = 0; i < nc; i++) {
+        node_link_t l;
+        hops[i] = node_table_get(cand[i], &l) ? l.hops_max : 0;
+    }
+    for (size_t i = 1; i < nc; i++) {
+        uint16_t a = cand[i];
+        uint8_t  h = hops[i];
+        size_t   j = i;
+        for (; j > 0 && hops[j - 1] < h; j--) {
+            cand[j] = cand[j - 1];
+            hops[j] = hops[j - 1];
+        }
+        cand[j] = a;
+        hops[j] = h;
+    }
+
+    for (size_t i = 0; i < nc && np < n; i++) {
+        uint8_t r = relay_mgr_region(cand[i]);
+        if (r < RELAY_MGR_MAX_NODES && (used_region[r / 8] & (1u << (r % 8)))) {
+            continue;
+        }
+        if (r < RELAY_MGR_MAX_NODES) {
+            used_region[r / 8] |= 1u << (r % 8);
+        }
+        pick[np++] = cand[i];
+        cand[i] = ESP_BLE_MESH_ADDR_UNASSIGNED;
+    }
+    for (size_t i = 0; i < nc && np < n; i++) {
+        if (cand[i] != ESP_BLE_MESH_ADDR_UNASSIGNED) {
+            pick[np++] = cand[i];
+        }
+    }
+
+    ESP_LOGI(TAG, "Onboard round: %u delegates, %us", np, duration_s);
+    return fprov_mgr_start(pick, np, duration_s);
+}
+
+esp_err_t example_ble_mesh_group_join(uint16_t group, const uint16_t *nodes, uint16_t n)
+{
+    return grp_ack_join(group, nodes, n);
+}
+
+uint16_t example_ble_mesh_cmd_backlog(void)
+{
+    mesh_tx_stats_t st;
+    mesh_tx_get_stats(&st);
+    return st.queued;
+}
+
+esp_err_t example_ble_mesh_cmd_sync(uint32_t timeout_ms)
+{
+    return outq_sync(timeout_ms);
+}
+
 /* ===== BLE Mesh init (GIỮ LỌC UUID PREFIX) ===== */
 static esp_err_t ble_mesh_init(void)
 {
@@ -661,15 +1321,90 @@ static esp_err_t ble_mesh_init(void)
         return err;
     }
 
+    node_table_init();
+    tag_state_init();
+    s_tid_lock = xSemaphoreCreateMutex();
+
+    hb_recv_init();
+
+    err = mesh_tx_init(mesh_vnd_send_now, mesh_vnd_dropped);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start mesh tx scheduler");
+        return err;
+    }
+
+    err = blk_xfer_init(mesh_vnd_send_raw);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start block transfer");
+        return err;
+    }
+
+    err = ota_dist_init(mesh_vnd_send_raw);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start node OTA distributor");
+        return err;
+    }
+
+    err = relay_mgr_init(&relay_ops, PROV_OWN_ADDR);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start relay manager");
+        return err;
+    }
+    err = grp_ack_init(&grp_ops);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start group ACK tracker");
+        return err;
+    }
+
+    /* WAL lỗi (partition hỏng...) không chặn gateway: chạy chỉ RAM */
+    err = outq_init(outq_replay);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Outbound WAL unavailable (%s), RAM-only", esp_err_to_name(err));
+    }
+    /* báo cáo lên back office; spill xuống partition của outq nếu đã mount */
+    err = outbox_init();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Status outbox unavailable (%s)", esp_err_to_name(err));
+    }
+    err = sweep_init(&sweep_ops);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Anti-entropy sweep unavailable (%s)", esp_err_to_name(err));
+    }
+    err = prov_sched_init(&prov_ops);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start provisioning scheduler");
+        return err;
+    }
+    err = fprov_mgr_init(&fprov_ops);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Delegate provisioning unavailable (%s)", esp_err_to_name(err));
+    }
+
+    /* Node đã provision từ trước: dò các node chưa có trong đồ thị */
+    const esp_ble_mesh_node_t **table = esp_ble_mesh_provisioner_get_node_table_entry();
+    for (int i = 0; table && i < CONFIG_BLE_MESH_MAX_PROV_NODES; i++) {
+        if (table[i] && ESP_BLE_MESH_ADDR_IS_UNICAST(table[i]->unicast_addr)) {
+            relay_join(table[i]->unicast_addr);
+        }
+    }
+
     ESP_LOGI(TAG, "ESP BLE Mesh Provisioner initialized (UUID filter on)");
     return ESP_OK;
 }
 
 /* ===== app_main (giữ nguyên + wifi) ===== */
+/* Wi-Fi init chạy song song với BT/mesh init; kết nối chạy nền, MQTT chờ mesh */
+static void wifi_start_task(void *arg)
+{
+    wifi_init_sta();
+    vTaskDelete(NULL);
+}
+
 void app_main(void)
 {
     esp_err_t err;
 
+    boot_ts_mark(BOOT_TS_APP_MAIN);
     ESP_LOGI(TAG, "Initializing...");
 
     err = nvs_flash_init();
@@ -678,14 +1413,19 @@ void app_main(void)
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
+    boot_ts_mark(BOOT_TS_NVS);
+
+    /* mesh không chờ AP: gateway không có Wi-Fi vẫn điều khiển được tag */
+    if (xTaskCreate(wifi_start_task, "wifi_start", 4096, NULL, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start Wi-Fi task");
+    }
 
     err = bluetooth_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "esp32_bluetooth_init failed (err %d)", err);
         return;
     }
-
-    wifi_init_sta();
+    boot_ts_mark(BOOT_TS_BT);
 
     /* Open nvs namespace for storing/restoring mesh example info */
     err = ble_mesh_nvs_open(&NVS_HANDLE);
@@ -699,5 +1439,9 @@ void app_main(void)
     err = ble_mesh_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Bluetooth mesh init failed (err %d)", err);
+        return;
     }
+    boot_ts_mark(BOOT_TS_MESH_READY);
+    /* từ đây mới nhận lệnh MQTT */
+    wifi_sta_mesh_ready();
 }
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tag ngủ sâu theo chu kỳ (build sdkconfig.dsleep, CONFIG_EP_DEEP_SLEEP):
+ * vẽ + ACK xong, hết việc -> panel hibernate, deep sleep tới cửa sổ thức kế
+ * (bội của DSLEEP_PERIOD_MS theo đồng hồ RTC). Thức dậy là 1 lần boot: mesh
+ * khôi phục khoá / địa chỉ / seq / IV từ NVS (SEQ_STORE_RATE 0, ghi ngay),
+ * phần hiển thị (nội dung đang trên panel) và thông tin mesh gọn giữ ở RTC
+ * nên không vẽ lại, không init panel; tag gửi DIGEST F_AWAKE về gateway và
+ * nghe ít nhất DSLEEP_WINDOW_MS.
+ *
+ * Đo: mỗi lần sẵn sàng tính trễ thức -> sẵn sàng (từ mốc hẹn thức theo đồng
+ * hồ RTC, gồm cả ROM / bootloader) và dòng trung bình ước lượng (thời gian
+ * ngủ / thức x I_SLEEP / I_AWAKE), đưa cho ops.report. DSLEEP_MARK_GPIO >= 0:
+ * chân lên 1 khi thức, xuống 0 khi ngủ, xung 0 ngắn lúc sẵn sàng -> đo dòng /
+ * thời gian thức bằng máy đo ngoài.
+ *
+ * Build không có CONFIG_EP_DEEP_SLEEP: các hàm là stub, tag không ngủ. */
+
+#ifndef DSLEEP_PERIOD_MS
+#define DSLEEP_PERIOD_MS      60000     /* chu kỳ cửa sổ thức */
+#endif
+#ifndef DSLEEP_WINDOW_MS
+#define DSLEEP_WINDOW_MS      3000      /* nghe tối thiểu từ lúc sẵn sàng (gateway gửi lệnh đang giữ) */
+#endif
+#ifndef DSLEEP_BOOT_WINDOW_MS
+#define DSLEEP_BOOT_WINDOW_MS 30000     /* boot nguội: hết chuỗi cấu hình / gateway gửi lại sau reboot */
+#endif
+#ifndef DSLEEP_IDLE_MS
+#define DSLEEP_IDLE_MS        1500      /* im lặng tối thiểu trước khi ngủ (gói ACK ra khỏi adv queue) */
+#endif
+#ifndef DSLEEP_MIN_SLEEP_MS
+#define DSLEEP_MIN_SLEEP_MS   1000      /* cửa sổ kế quá gần -> bỏ qua, lấy cửa sổ sau */
+#endif
+#ifndef DSLEEP_CHECK_MS
+#define DSLEEP_CHECK_MS       250
+#endif
+#ifndef DSLEEP_GW_ADDR
+#define DSLEEP_GW_ADDR        0x0001    /* = PROV_OWN_ADDR gateway, khi RTC chưa biết */
+#endif
+#ifndef DSLEEP_MARK_GPIO
+#define DSLEEP_MARK_GPIO      -1        /* chân đánh dấu thức / sẵn sàng, -1 = tắt */
+#endif
+#ifndef DSLEEP_I_SLEEP_UA
+#define DSLEEP_I_SLEEP_UA     150       /* deep sleep cả board: RTC + LDO + panel hibernate (đo trên board) */
+#endif
+#ifndef DSLEEP_I_AWAKE_UA
+#define DSLEEP_I_AWAKE_UA     70000     /* CPU + BLE scan liên tục */
+#endif
+
+/* Mesh giữ ở RTC: địa chỉ của tag để đối chiếu với bản khôi phục từ NVS,
+ * gateway + key để gửi DIGEST F_AWAKE ngay khi thức */
+typedef struct {
+    uint16_t addr;
+    uint16_t gw_addr;
+    uint16_t net_idx;
+    uint16_t app_idx;
+    uint32_t iv_index;          /* IV lúc provision / lần cập nhật gần nhất tag biết */
+} dsleep_mesh_t;
+
+typedef struct {
+    uint32_t wakes;             /* số lần thức từ deep sleep từ lúc cấp nguồn */
+    uint32_t wake_ms;           /* lần gần nhất: mốc hẹn thức -> sẵn sàng */
+    uint32_t wake_ms_avg;
+    uint32_t wake_ms_max;
+    uint32_t last_awake_ms;     /* lần thức trước: thức -> ngủ */
+    uint64_t sleep_ms;          /* tổng từ lúc cấp nguồn */
+    uint64_t awake_ms;
+    uint32_t sleep_ua;          /* DSLEEP_I_SLEEP_UA */
+    uint32_t est_avg_ua;        /* dòng trung bình ước lượng từ lúc cấp nguồn */
+} dsleep_stats_t;
+
+typedef struct {
+    bool (*busy)(void);                         /* còn việc (vẽ, ACK hẹn, OTA) -> chưa ngủ */
+    void (*prepare)(void);                      /* ngay trước deep sleep: panel hibernate */
+    void (*report)(const dsleep_stats_t *st);   /* hook đo, mỗi lần sẵn sàng; NULL = chỉ log */
+} dsleep_ops_t;
+
+esp_err_t dsleep_init(const dsleep_ops_t *ops);
+
+/* Boot này là thức từ deep sleep (dữ liệu RTC còn nguyên) */
+bool      dsleep_woke(void);
+
+/* Mesh giữ ở RTC; false nếu không có (boot nguội / build thường) */
+bool      dsleep_get_mesh(dsleep_mesh_t *out);
+void      dsleep_set_mesh(const dsleep_mesh_t *m);
+
+/* Mesh đã lên (tag đã provision + cấu hình): tính trễ thức, gọi report,
+ * bắt đầu canh ngủ */
+void      dsleep_ready(void);
+
+/* Có gói tới / đi: dời mốc im lặng */
+void      dsleep_touch(void);
+
+void      dsleep_get_stats(dsleep_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
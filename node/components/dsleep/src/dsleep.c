@@ -0,0 +1,228 @@
+#include "dsleep.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_EP_DEEP_SLEEP
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "soc/soc_caps.h"
+#include "esp_rom_sys.h"
+#include "driver/gpio.h"
+#endif
+
+#if CONFIG_EP_DEEP_SLEEP
+static const char *TAG = "dsleep";
+
+#define RTC_MAGIC   0x45504453      /* "EPDS" */
+
+/* Giữ qua deep sleep; boot nguội / reset khác: nạp lại từ image (= 0) */
+typedef struct {
+    uint32_t       magic;
+    bool           has_mesh;
+    dsleep_mesh_t  mesh;
+    int64_t        wake_at_ms;      /* mốc hẹn thức (đồng hồ RTC), 0 = chưa ngủ lần nào */
+    uint64_t       wake_ms_sum;
+    dsleep_stats_t st;
+} rtc_state_t;
+
+static RTC_DATA_ATTR rtc_state_t s_rtc;
+
+static dsleep_ops_t       s_ops;
+static esp_timer_handle_t s_check_timer;
+static bool               s_woke;
+static bool               s_ready;
+static int64_t            s_boot_ms;        /* đồng hồ RTC lúc bắt đầu thức */
+static int64_t            s_ready_us;
+static volatile uint32_t  s_touch_ms;       /* esp_timer, ms */
+
+static int64_t rtc_now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static uint32_t up_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// ============ Chân đánh dấu (đo ngoài) ============
+#if DSLEEP_MARK_GPIO >= 0
+static void mark(int level) {
+    gpio_set_level(DSLEEP_MARK_GPIO, level);
+}
+#endif
+
+static void mark_init(void) {
+#if DSLEEP_MARK_GPIO >= 0
+    gpio_hold_dis(DSLEEP_MARK_GPIO);
+    gpio_reset_pin(DSLEEP_MARK_GPIO);
+    gpio_set_direction(DSLEEP_MARK_GPIO, GPIO_MODE_OUTPUT);
+    mark(1);
+#endif
+}
+
+static void mark_sleep(void) {
+#if DSLEEP_MARK_GPIO >= 0
+    mark(0);
+    gpio_hold_en(DSLEEP_MARK_GPIO);
+#if !SOC_GPIO_SUPPORT_HOLD_SINGLE_IO_IN_DSLP
+    gpio_deep_sleep_hold_en();
+#endif
+#endif
+}
+
+// ============ Ngủ ============
+static void go_sleep(void) {
+    esp_timer_stop(s_check_timer);
+    if (s_ops.prepare) s_ops.prepare();
+
+    int64_t now   = rtc_now_ms();
+    int64_t awake = now - s_boot_ms;
+    if (awake < 0) awake = 0;
+    s_rtc.st.awake_ms      += (uint64_t)awake;
+    s_rtc.st.last_awake_ms  = (uint32_t)awake;
+
+    // cửa sổ kế: bội DSLEEP_PERIOD_MS tính từ mốc hẹn trước, cách now >= MIN_SLEEP
+    int64_t target = now + DSLEEP_MIN_SLEEP_MS;
+    int64_t next   = (s_rtc.wake_at_ms ? s_rtc.wake_at_ms : now) + DSLEEP_PERIOD_MS;
+    if (next < target) {
+        next += (target - next + DSLEEP_PERIOD_MS - 1) / DSLEEP_PERIOD_MS * DSLEEP_PERIOD_MS;
+    }
+    int64_t sleep_ms = next - now;
+    s_rtc.st.sleep_ms += (uint64_t)sleep_ms;
+    s_rtc.wake_at_ms   = next;
+
+    ESP_LOGI(TAG, "awake %" PRId64 " ms, deep sleep %" PRId64 " ms", awake, sleep_ms);
+    mark_sleep();
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_ms * 1000);
+    esp_deep_sleep_start();
+}
+
+static void check_cb(void *arg) {
+    uint32_t now = up_ms();
+    uint32_t window = s_woke ? DSLEEP_WINDOW_MS : DSLEEP_BOOT_WINDOW_MS;
+    if (now - (uint32_t)(s_ready_us / 1000) < window) return;
+    if (now - s_touch_ms < DSLEEP_IDLE_MS) return;
+    if (s_ops.busy && s_ops.busy()) return;
+    go_sleep();
+}
+
+static void report_log(const dsleep_stats_t *st) {
+    ESP_LOGI(TAG, "wake #%" PRIu32 ": ready in %" PRIu32 " ms (avg %" PRIu32 ", max %" PRIu32
+             "), last awake %" PRIu32 " ms, duty %" PRIu64 "/%" PRIu64 " s, est avg %" PRIu32 " uA",
+             st->wakes, st->wake_ms, st->wake_ms_avg, st->wake_ms_max, st->last_awake_ms,
+             st->awake_ms / 1000, (st->awake_ms + st->sleep_ms) / 1000, st->est_avg_ua);
+}
+#endif /* CONFIG_EP_DEEP_SLEEP */
+
+// ============ API ============
+esp_err_t dsleep_init(const dsleep_ops_t *ops) {
+#if CONFIG_EP_DEEP_SLEEP
+    if (s_check_timer) return ESP_OK;
+    if (ops) s_ops = *ops;
+
+    s_woke = esp_reset_reason() == ESP_RST_DEEPSLEEP && s_rtc.magic == RTC_MAGIC;
+    if (!s_woke) {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+        s_rtc.magic       = RTC_MAGIC;
+        s_rtc.st.sleep_ua = DSLEEP_I_SLEEP_UA;
+    }
+    // thức: bắt đầu từ mốc hẹn; boot nguội: từ lúc esp_timer bắt đầu đếm
+    s_boot_ms  = s_woke ? s_rtc.wake_at_ms : rtc_now_ms() - up_ms();
+    s_touch_ms = up_ms();
+    mark_init();
+
+    const esp_timer_create_args_t args = {
+        .callback = check_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "dsleep",
+        .skip_unhandled_events = true,
+    };
+    return esp_timer_create(&args, &s_check_timer);
+#else
+    (void)ops;
+    return ESP_OK;
+#endif
+}
+
+bool dsleep_woke(void) {
+#if CONFIG_EP_DEEP_SLEEP
+    return s_woke;
+#else
+    return false;
+#endif
+}
+
+bool dsleep_get_mesh(dsleep_mesh_t *out) {
+#if CONFIG_EP_DEEP_SLEEP
+    if (!out || !s_rtc.has_mesh) return false;
+    *out = s_rtc.mesh;
+    return true;
+#else
+    (void)out;
+    return false;
+#endif
+}
+
+void dsleep_set_mesh(const dsleep_mesh_t *m) {
+#if CONFIG_EP_DEEP_SLEEP
+    if (!m) return;
+    s_rtc.mesh     = *m;
+    s_rtc.has_mesh = true;
+#else
+    (void)m;
+#endif
+}
+
+void dsleep_ready(void) {
+#if CONFIG_EP_DEEP_SLEEP
+    if (!s_check_timer || s_ready) return;
+    s_ready    = true;
+    s_ready_us = esp_timer_get_time();
+
+    dsleep_stats_t *st = &s_rtc.st;
+    if (s_woke) {
+        int64_t d = rtc_now_ms() - s_rtc.wake_at_ms;
+        st->wake_ms = d > 0 ? (uint32_t)d : 0;
+        ++st->wakes;
+        s_rtc.wake_ms_sum += st->wake_ms;
+        st->wake_ms_avg = (uint32_t)(s_rtc.wake_ms_sum / st->wakes);
+        if (st->wake_ms > st->wake_ms_max) st->wake_ms_max = st->wake_ms;
+    }
+    uint64_t total = st->sleep_ms + st->awake_ms;
+    if (total) {
+        st->est_avg_ua = (uint32_t)(((uint64_t)st->sleep_ua * st->sleep_ms +
+                                     (uint64_t)DSLEEP_I_AWAKE_UA * st->awake_ms) / total);
+    }
+    report_log(st);
+    if (s_ops.report) s_ops.report(st);
+
+#if DSLEEP_MARK_GPIO >= 0
+    // xung 0 ngắn: mốc "sẵn sàng" trên máy đo
+    mark(0);
+    esp_rom_delay_us(50);
+    mark(1);
+#endif
+    esp_timer_start_periodic(s_check_timer, (uint64_t)DSLEEP_CHECK_MS * 1000);
+#endif
+}
+
+void dsleep_touch(void) {
+#if CONFIG_EP_DEEP_SLEEP
+    s_touch_ms = up_ms();
+#endif
+}
+
+void dsleep_get_stats(dsleep_stats_t *out) {
+    if (!out) return;
+#if CONFIG_EP_DEEP_SLEEP
+    *out = s_rtc.st;
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
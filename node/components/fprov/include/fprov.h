@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_ble_mesh_defs.h"
+#include "esp_ble_mesh_provisioning_api.h"
+#include "esp_ble_mesh_config_model_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fast provisioning phía tag (delegate): gateway giao 1 dải unicast qua
+ * EP_VND_OP_FPROV_SET, tag bật vai trò provisioner (ESP-IDF fast prov) cho
+ * các tag cùng prefix UUID mà nó nghe được, tự gửi AppKey Add + Model App
+ * Bind (vendor server) + Heartbeat Pub Set (về gateway) bằng device key vừa
+ * tạo, rồi báo từng tag mới về gateway (FPROV_NODE, gửi lại tới khi có ACK;
+ * gateway đưa tag vào node_table). Hết thời hạn -> thoát fast prov, báo
+ * STATUS DONE. Cần CONFIG_BLE_MESH_FAST_PROV + CFG_CLI; không có
+ * thì SET bị trả REJECTED. */
+
+#ifndef FPROV_NODES_MAX
+#ifdef CONFIG_BLE_MESH_MAX_PROV_NODES
+#define FPROV_NODES_MAX         CONFIG_BLE_MESH_MAX_PROV_NODES
+#else
+#define FPROV_NODES_MAX         16
+#endif
+#endif
+#ifndef FPROV_DURATION_MAX_S
+#define FPROV_DURATION_MAX_S    1800
+#endif
+#ifndef FPROV_CFG_TRIES
+#define FPROV_CFG_TRIES         4       /* AppKey Add / Model App Bind / HB Pub Set timeout */
+#endif
+#ifndef FPROV_HB_PERIOD_LOG
+#define FPROV_HB_PERIOD_LOG     9       /* = RELAY_MGR_HB_PERIOD_LOG gateway: 256 s */
+#endif
+#ifndef FPROV_HB_TTL
+#define FPROV_HB_TTL            7       /* = HB_PUB_TTL gateway */
+#endif
+#ifndef FPROV_REPORT_RETRY_MS
+#define FPROV_REPORT_RETRY_MS   3000
+#endif
+#ifndef FPROV_REPORT_TRIES
+#define FPROV_REPORT_TRIES      20
+#endif
+
+/* Gửi vendor message (FPROV_STATUS / FPROV_NODE) về gateway */
+typedef void (*fprov_send_fn_t)(uint16_t dst, uint16_t net_idx, uint16_t app_idx,
+                                uint8_t op, const uint8_t *data, uint16_t len);
+
+/* uuid: UUID của chính tag (tag mới phải cùng 2 byte đầu).
+ * cfg_cli: Config Client trong composition (NULL nếu không có). */
+esp_err_t fprov_init(fprov_send_fn_t send, const uint8_t uuid[16], esp_ble_mesh_client_t *cfg_cli);
+
+/* Provision xong chính tag này: giữ flags / IV index để cấp cho tag mới
+ * (IV đã tăng từ đó thì tag mới tự bắt kịp qua secure network beacon) */
+void fprov_on_self_provisioned(uint8_t flags, uint32_t iv_index);
+
+/* Từ callback vendor model */
+void fprov_on_set(const esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg, uint16_t len);
+void fprov_on_node_ack(const uint8_t *msg, uint16_t len);
+
+/* Từ callback provisioning / Config Client (event không liên quan bị bỏ qua) */
+void fprov_on_prov_evt(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param);
+void fprov_on_cfg_client_evt(esp_ble_mesh_cfg_client_cb_event_t event,
+                             esp_ble_mesh_cfg_client_cb_param_t *param);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,406 @@
+#include "fprov.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_idf_version.h"
+#include "nvs.h"
+
+#include "esp_ble_mesh_local_data_operation_api.h"
+
+#include "ep_proto.h"
+
+static const char *TAG = "fprov";
+
+#define NVS_NS          "ep_fprov"
+#define TICK_MS         1000
+#define UUID_MATCH_LEN  2       /* prefix lọc giống gateway (0x32 0x10) */
+
+typedef enum {
+    N_CFG_APPKEY = 0,   /* chờ AppKey Status */
+    N_CFG_BIND,         /* chờ Model App Bind Status */
+    N_CFG_HB,           /* chờ Heartbeat Publication Status */
+    N_REPORT,           /* chờ FPROV_NODE_ACK */
+    N_DONE,
+} node_state_t;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t  elems;
+    uint8_t  state;
+    uint8_t  tries;
+    int64_t  due_us;    /* lần gửi lại kế tiếp */
+    uint8_t  uuid[16];
+} fnode_t;
+
+static fprov_send_fn_t        s_send;
+static esp_ble_mesh_client_t *s_cfg_cli;
+static SemaphoreHandle_t      s_lock;
+static esp_timer_handle_t     s_tick;
+static uint8_t                s_uuid_prefix[UUID_MATCH_LEN];
+
+/* provisioning data của chính tag: cấp lại cho tag mới */
+static uint8_t   s_flags;
+static uint32_t  s_iv_index;
+
+/* phiên hiện tại */
+static bool      s_active;
+static uint16_t  s_gw;              /* gateway giao việc, 0 = chưa có */
+static uint16_t  s_net_idx;
+static uint16_t  s_app_idx;
+static uint16_t  s_min;
+static uint16_t  s_max;
+static uint16_t  s_next;            /* địa chỉ kế tiếp chưa dùng */
+static int64_t   s_end_us;
+static uint8_t   s_reported;        /* số tag đã được gateway ACK */
+static bool      s_done_pending;    /* còn phải báo STATUS DONE */
+static fnode_t   s_nodes[FPROV_NODES_MAX];
+static uint8_t   s_n_nodes;
+
+// ============ Gửi về gateway ============
+static void send_status(uint8_t state) {
+    uint8_t st[EP_FPROV_STATUS_LEN];
+    st[0] = state;
+    st[1] = s_reported;
+    ep_put_le16(&st[2], s_next);
+    if (s_gw) s_send(s_gw, s_net_idx, s_app_idx, EP_VND_OP_FPROV_STATUS, st, sizeof(st));
+}
+
+static void send_node(const fnode_t *n) {
+    uint8_t m[EP_FPROV_NODE_LEN];
+    ep_put_le16(&m[0], n->addr);
+    m[2] = n->elems;
+    memcpy(&m[3], n->uuid, 16);
+    s_send(s_gw, s_net_idx, s_app_idx, EP_VND_OP_FPROV_NODE, m, sizeof(m));
+}
+
+#if CONFIG_BLE_MESH_FAST_PROV
+// ============ Config Client tới tag mới ============
+static fnode_t *node_find(uint16_t addr) {
+    for (uint8_t i = 0; i < s_n_nodes; ++i) {
+        if (s_nodes[i].addr == addr) return &s_nodes[i];
+    }
+    return NULL;
+}
+
+static esp_err_t cfg_send(fnode_t *n) {
+    esp_ble_mesh_client_common_param_t common = {0};
+    esp_ble_mesh_cfg_client_set_state_t set = {0};
+
+    common.opcode       = n->state == N_CFG_APPKEY ? ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD :
+                          n->state == N_CFG_BIND   ? ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND
+                                                   : ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET;
+    common.model        = s_cfg_cli->model;
+    common.ctx.net_idx  = s_net_idx;
+    common.ctx.app_idx  = s_app_idx;
+    common.ctx.addr     = n->addr;
+    common.ctx.send_ttl = EP_NODE_REPLY_TTL;
+    common.msg_timeout  = 0;        /* CONFIG_BLE_MESH_CLIENT_MSG_TIMEOUT */
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
+    common.msg_role     = ROLE_FAST_PROV;
+#endif
+
+    if (n->state == N_CFG_APPKEY) {
+        const uint8_t *key = esp_ble_mesh_node_get_local_app_key(s_app_idx);
+        if (!key) return ESP_ERR_NOT_FOUND;
+        set.app_key_add.net_idx = s_net_idx;
+        set.app_key_add.app_idx = s_app_idx;
+        memcpy(set.app_key_add.app_key, key, 16);
+    } else if (n->state == N_CFG_BIND) {
+        set.model_app_bind.element_addr  = n->addr;
+        set.model_app_bind.model_app_idx = s_app_idx;
+        set.model_app_bind.model_id      = EP_VND_MODEL_ID_SERVER;
+        set.model_app_bind.company_id    = EP_CID;
+    } else {
+        /* heartbeat về gateway như tag gateway tự provision: gateway theo dõi
+         * sống / chết, số hop dù không có device key của tag */
+        set.heartbeat_pub_set.dst     = s_gw;
+        set.heartbeat_pub_set.count   = 0xFF;
+        set.heartbeat_pub_set.period  = FPROV_HB_PERIOD_LOG;
+        set.heartbeat_pub_set.ttl     = FPROV_HB_TTL;
+        set.heartbeat_pub_set.feature = 0;
+        set.heartbeat_pub_set.net_idx = s_net_idx;
+    }
+    n->due_us = esp_timer_get_time() + (int64_t)FPROV_REPORT_RETRY_MS * 1000 * 4;  /* lưới an toàn nếu mất cả TIMEOUT_EVT */
+    return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+// Bước cấu hình lỗi / timeout: thử lại, quá FPROV_CFG_TRIES thì bỏ (không báo gateway)
+static void cfg_retry(fnode_t *n) {
+    if (++n->tries >= FPROV_CFG_TRIES) {
+        ESP_LOGE(TAG, "0x%04x: config failed, drop", n->addr);
+        n->state = N_DONE;
+        return;
+    }
+    if (cfg_send(n) != ESP_OK) n->due_us = esp_timer_get_time() + (int64_t)FPROV_REPORT_RETRY_MS * 1000;
+}
+
+static void session_exit(void) {
+    s_active       = false;
+    s_done_pending = true;
+    esp_err_t err = esp_ble_mesh_set_fast_prov_action(FAST_PROV_ACT_EXIT);
+    if (err) ESP_LOGE(TAG, "Fast prov exit failed (err 0x%x)", err);
+    ESP_LOGI(TAG, "Session 0x%04x-0x%04x closed: %u provisioned, next 0x%04x",
+             s_min, s_max, s_n_nodes, s_next);
+}
+#endif
+
+// ============ Nhịp 1 s: hết hạn phiên, gửi lại cấu hình / báo cáo ============
+static void tick(void *arg) {
+    fnode_t report[FPROV_NODES_MAX];
+    uint8_t n_report = 0;
+    bool    done = false;
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+#if CONFIG_BLE_MESH_FAST_PROV
+    if (s_active && now >= s_end_us) session_exit();
+    for (uint8_t i = 0; i < s_n_nodes; ++i) {
+        fnode_t *n = &s_nodes[i];
+        if (n->state == N_DONE || now < n->due_us) continue;
+        if (n->state != N_REPORT) {
+            cfg_retry(n);
+            continue;
+        }
+        if (n->tries >= FPROV_REPORT_TRIES) {
+            ESP_LOGE(TAG, "0x%04x: gateway never ACKed report", n->addr);
+            n->state = N_DONE;
+            continue;
+        }
+        ++n->tries;
+        n->due_us = now + (int64_t)FPROV_REPORT_RETRY_MS * 1000;
+        report[n_report++] = *n;
+    }
+#endif
+    bool pending = false;
+    for (uint8_t i = 0; i < s_n_nodes; ++i) pending |= s_nodes[i].state != N_DONE;
+    /* DONE sau khi mọi báo cáo đã ACK / bỏ, để COUNT là số cuối */
+    if (s_done_pending && !pending) {
+        s_done_pending = false;
+        done = true;
+    }
+    if (!s_active && !pending) esp_timer_stop(s_tick);
+    xSemaphoreGive(s_lock);
+
+    for (uint8_t i = 0; i < n_report; ++i) send_node(&report[i]);
+    if (done) send_status(EP_FPROV_ST_DONE);
+}
+
+// ============ API ============
+esp_err_t fprov_init(fprov_send_fn_t send, const uint8_t uuid[16], esp_ble_mesh_client_t *cfg_cli) {
+    if (!send || !uuid) return ESP_ERR_INVALID_ARG;
+    if (s_lock) return ESP_OK;
+    s_send    = send;
+    s_cfg_cli = cfg_cli;
+    memcpy(s_uuid_prefix, uuid, UUID_MATCH_LEN);
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    const esp_timer_create_args_t args = {
+        .callback = tick,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "fprov",
+        .skip_unhandled_events = true,
+    };
+    esp_err_t err = esp_timer_create(&args, &s_tick);
+    if (err) return err;
+
+    /* tag đã provision từ trước: không có PROV_COMPLETE, lấy lại từ NVS */
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READONLY, &h) == ESP_OK) {
+        nvs_get_u8(h, "flags", &s_flags);
+        nvs_get_u32(h, "ivi", &s_iv_index);
+        nvs_close(h);
+    }
+    return ESP_OK;
+}
+
+void fprov_on_self_provisioned(uint8_t flags, uint32_t iv_index) {
+    s_flags    = flags;
+    s_iv_index = iv_index;
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+    nvs_set_u8(h, "flags", flags);
+    nvs_set_u32(h, "ivi", iv_index);
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+void fprov_on_set(const esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg, uint16_t len) {
+    if (!s_lock || !ctx || !msg || len < EP_FPROV_SET_LEN) return;
+    uint16_t min = ep_get_le16(&msg[0]);
+    uint16_t max = ep_get_le16(&msg[2]);
+    uint16_t dur = ep_get_le16(&msg[4]);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint8_t state = EP_FPROV_ST_REJECTED;
+#if CONFIG_BLE_MESH_FAST_PROV
+    if (dur == 0) {
+        /* dừng sớm; SET lặp lại của phiên đang chạy chỉ được trả STATUS */
+        if (s_active && ctx->addr == s_gw) session_exit();
+        state = s_active ? EP_FPROV_ST_ACTIVE : EP_FPROV_ST_DONE;
+    } else if (s_active && ctx->addr == s_gw && min == s_min && max == s_max) {
+        state = EP_FPROV_ST_ACTIVE;     /* SET gửi lại (STATUS trước bị mất) */
+    } else if (!s_active && !s_done_pending && s_cfg_cli && s_cfg_cli->model &&
+               ESP_BLE_MESH_ADDR_IS_UNICAST(min) && ESP_BLE_MESH_ADDR_IS_UNICAST(max) && min <= max) {
+        esp_ble_mesh_fast_prov_info_t info = {0};
+        info.unicast_min = min;
+        info.unicast_max = max;
+        info.net_idx     = ctx->net_idx;
+        info.flags       = s_flags;
+        info.iv_index    = s_iv_index;
+        info.offset      = 0;
+        info.match_len   = UUID_MATCH_LEN;
+        memcpy(info.match_val, s_uuid_prefix, UUID_MATCH_LEN);
+        esp_err_t err = esp_ble_mesh_set_fast_prov_info(&info);
+        if (!err) err = esp_ble_mesh_set_fast_prov_action(FAST_PROV_ACT_ENTER);
+        if (err) {
+            ESP_LOGE(TAG, "Fast prov enter failed (err 0x%x)", err);
+        } else {
+            s_active   = true;
+            s_gw       = ctx->addr;
+            s_net_idx  = ctx->net_idx;
+            s_app_idx  = ctx->app_idx;
+            s_min      = min;
+            s_max      = max;
+            s_next     = min;
+            s_reported = 0;
+            s_n_nodes  = 0;
+            if (dur > FPROV_DURATION_MAX_S) dur = FPROV_DURATION_MAX_S;
+            s_end_us   = esp_timer_get_time() + (int64_t)dur * 1000000;
+            esp_timer_stop(s_tick);
+            esp_timer_start_periodic(s_tick, (uint64_t)TICK_MS * 1000);
+            state = EP_FPROV_ST_ACTIVE;
+            ESP_LOGI(TAG, "Fast prov 0x%04x-0x%04x for %u s (gateway 0x%04x)", min, max, dur, s_gw);
+        }
+    }
+#else
+    (void)min; (void)max; (void)dur;
+#endif
+    if (state == EP_FPROV_ST_REJECTED) {
+        /* trả lời người hỏi, không đè phiên đang chạy */
+        uint8_t st[EP_FPROV_STATUS_LEN] = { state, 0, 0, 0 };
+        xSemaphoreGive(s_lock);
+        s_send(ctx->addr, ctx->net_idx, ctx->app_idx, EP_VND_OP_FPROV_STATUS, st, sizeof(st));
+        return;
+    }
+    xSemaphoreGive(s_lock);
+    send_status(state);
+}
+
+void fprov_on_node_ack(const uint8_t *msg, uint16_t len) {
+    if (!s_lock || !msg || len < EP_FPROV_NODE_ACK_LEN) return;
+    uint16_t addr = ep_get_le16(msg);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < s_n_nodes; ++i) {
+        if (s_nodes[i].addr == addr && s_nodes[i].state == N_REPORT) {
+            s_nodes[i].state = N_DONE;
+            ++s_reported;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void fprov_on_prov_evt(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param) {
+#if CONFIG_BLE_MESH_FAST_PROV
+    if (!s_lock) return;
+    switch (event) {
+    case ESP_BLE_MESH_SET_FAST_PROV_INFO_COMP_EVT:
+        ESP_LOGI(TAG, "Fast prov info: unicast %u, net_idx %u, match %u",
+                 param->set_fast_prov_info_comp.status_unicast,
+                 param->set_fast_prov_info_comp.status_net_idx,
+                 param->set_fast_prov_info_comp.status_match);
+        break;
+    case ESP_BLE_MESH_SET_FAST_PROV_ACTION_COMP_EVT:
+        ESP_LOGI(TAG, "Fast prov action: status %u", param->set_fast_prov_action_comp.status_action);
+        break;
+    case ESP_BLE_MESH_PROVISIONER_RECV_UNPROV_ADV_PKT_EVT: {
+        const uint8_t *uuid = param->provisioner_recv_unprov_adv_pkt.dev_uuid;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool room = s_active && s_n_nodes < FPROV_NODES_MAX && s_next <= s_max;
+        xSemaphoreGive(s_lock);
+        if (!room || memcmp(uuid, s_uuid_prefix, UUID_MATCH_LEN) != 0) break;
+
+        esp_ble_mesh_unprov_dev_add_t add = {0};
+        memcpy(add.addr, param->provisioner_recv_unprov_adv_pkt.addr, BD_ADDR_LEN);
+        add.addr_type = param->provisioner_recv_unprov_adv_pkt.addr_type;
+        memcpy(add.uuid, uuid, 16);
+        add.oob_info  = param->provisioner_recv_unprov_adv_pkt.oob_info;
+        add.bearer    = param->provisioner_recv_unprov_adv_pkt.bearer;
+        esp_err_t err = esp_ble_mesh_provisioner_add_unprov_dev(&add,
+                ADD_DEV_RM_AFTER_PROV_FLAG | ADD_DEV_START_PROV_NOW_FLAG | ADD_DEV_FLUSHABLE_DEV_FLAG);
+        if (err) ESP_LOGW(TAG, "Add unprov dev failed (err 0x%x)", err);
+        break;
+    }
+    case ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT: {
+        uint16_t addr  = param->provisioner_prov_complete.unicast_addr;
+        uint8_t  elems = param->provisioner_prov_complete.element_num;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_n_nodes >= FPROV_NODES_MAX) {
+            xSemaphoreGive(s_lock);
+            ESP_LOGE(TAG, "0x%04x: node table full", addr);
+            break;
+        }
+        fnode_t *n = &s_nodes[s_n_nodes++];
+        memset(n, 0, sizeof(*n));
+        n->addr  = addr;
+        n->elems = elems;
+        n->state = N_CFG_APPKEY;
+        memcpy(n->uuid, param->provisioner_prov_complete.device_uuid, 16);
+        if ((uint16_t)(addr + elems) > s_next) s_next = (uint16_t)(addr + elems);
+        ESP_LOGI(TAG, "Provisioned 0x%04x (%u elements), %u in session", addr, elems, s_n_nodes);
+        if (cfg_send(n) != ESP_OK) n->due_us = esp_timer_get_time();
+        xSemaphoreGive(s_lock);
+        break;
+    }
+    default:
+        break;
+    }
+#else
+    (void)event; (void)param;
+#endif
+}
+
+void fprov_on_cfg_client_evt(esp_ble_mesh_cfg_client_cb_event_t event,
+                             esp_ble_mesh_cfg_client_cb_param_t *param) {
+#if CONFIG_BLE_MESH_FAST_PROV
+    if (!s_lock) return;
+    uint32_t opcode = param->params->opcode;
+    uint8_t  want;
+    switch (opcode) {
+    case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:        want = N_CFG_APPKEY; break;
+    case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:     want = N_CFG_BIND;   break;
+    case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET:  want = N_CFG_HB;     break;
+    default: return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    fnode_t *n = node_find(param->params->ctx.addr);
+    if (!n || n->state != want) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    if (event == ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT && !param->error_code) {
+        n->tries = 0;
+        if (n->state != N_CFG_HB) {
+            ++n->state;     /* APPKEY -> BIND -> HB */
+            if (cfg_send(n) != ESP_OK) n->due_us = esp_timer_get_time();
+        } else {
+            /* cấu hình xong: báo gateway ngay ở nhịp kế tiếp */
+            n->state  = N_REPORT;
+            n->due_us = 0;
+        }
+    } else if (event == ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT || param->error_code) {
+        cfg_retry(n);
+    }
+    xSemaphoreGive(s_lock);
+#else
+    (void)event; (void)param;
+#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_ble_mesh_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Low Power Node cho tag chạy pin (build sdkconfig.lpn): sau khi provision tag
+ * kết bạn (friendship) với gateway hoặc 1 tag relay cắm điện có
+ * CONFIG_BLE_MESH_FRIEND, tắt scan giữa các lần poll; Friend giữ hộ gói trong
+ * friend queue, mỗi lần poll tag lấy hết (MD = 1 -> poll tiếp ngay).
+ *
+ * Chu kỳ poll:
+ *  - LPN_POLL_MS = 0: stack tự poll, bắt đầu CONFIG_BLE_MESH_LPN_INIT_POLL_TIMEOUT,
+ *    nhân đôi sau mỗi lần không có gì tới trần ~CONFIG_BLE_MESH_LPN_POLL_TIMEOUT
+ *  - LPN_POLL_MS > 0: thêm poll cố định (đo độ trễ / dòng theo từng chu kỳ)
+ *
+ * Đo: mỗi LPN_REPORT_MS log số poll, số gói, trễ poll -> gói tới và dòng trung
+ * bình ước lượng (I_IDLE + thời gian bật radio x I_RADIO). Độ trễ cập nhật
+ * giá đầu-cuối lấy ở gateway (outbox DELIVERED, v2 = ms trên mesh).
+ *
+ * Build không có CONFIG_BLE_MESH_LOW_POWER: các hàm là stub, chỉ log sự kiện
+ * phía Friend (tag relay). */
+
+#ifndef LPN_POLL_MS
+#define LPN_POLL_MS           0         /* 0 = để stack tự poll */
+#endif
+#ifndef LPN_CFG_WAIT_MS
+#define LPN_CFG_WAIT_MS       60000     /* provision xong mà chưa thấy Model App Bind -> vẫn bật LPN */
+#endif
+#ifndef LPN_REPORT_MS
+#define LPN_REPORT_MS         (10 * 60 * 1000)
+#endif
+#ifndef LPN_RECV_WIN_MS
+#define LPN_RECV_WIN_MS       255       /* = CONFIG_BLE_MESH_FRIEND_RECV_WIN của Friend */
+#endif
+#ifndef LPN_POLL_TX_US
+#define LPN_POLL_TX_US        3000      /* 1 Friend Poll: 3 kênh adv x số lần phát */
+#endif
+#ifndef LPN_I_IDLE_UA
+#define LPN_I_IDLE_UA         800       /* light sleep + BT modem sleep (đo trên board) */
+#endif
+#ifndef LPN_I_RADIO_UA
+#define LPN_I_RADIO_UA        100000    /* RX/TX BLE */
+#endif
+
+typedef struct {
+    uint16_t friend_addr;       /* 0 = chưa có friendship */
+    uint32_t friendships;       /* số lần kết bạn thành công */
+    uint32_t lost;              /* friendship bị huỷ */
+    uint32_t polls;             /* poll do LPN_POLL_MS (stack tự poll không đếm được) */
+    uint32_t msgs;              /* gói vendor nhận được */
+    uint32_t rx_delays;         /* số mẫu trễ poll -> gói đầu tiên (chỉ khi LPN_POLL_MS > 0) */
+    uint32_t rx_delay_sum_ms;
+    uint32_t rx_delay_max_ms;
+    uint32_t est_avg_ua;        /* cửa sổ báo cáo gần nhất, 0 = chưa đo được */
+} lpn_stats_t;
+
+esp_err_t lpn_init(void);
+
+/* Provision xong: còn chuỗi cấu hình của gateway (scan liên tục cho nhanh),
+ * bật LPN khi lpn_on_configured() hoặc sau LPN_CFG_WAIT_MS */
+void      lpn_on_provisioned(void);
+/* Model App Bind xong / khôi phục từ NVS: bật LPN (tìm Friend) */
+void      lpn_on_configured(void);
+
+/* Sự kiện LPN / Friend từ prov callback; true nếu đã xử lý */
+bool      lpn_on_prov_evt(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param);
+
+/* Mỗi gói vendor tới (callback model) */
+void      lpn_on_rx(void);
+
+void      lpn_get_stats(lpn_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
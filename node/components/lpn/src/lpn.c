@@ -0,0 +1,272 @@
+#include "lpn.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+#include "esp_ble_mesh_low_power_api.h"
+
+static const char *TAG = "lpn";
+
+#ifdef CONFIG_BLE_MESH_LPN_RECV_DELAY
+#define RECV_DELAY_MS   CONFIG_BLE_MESH_LPN_RECV_DELAY
+#else
+#define RECV_DELAY_MS   100
+#endif
+
+static SemaphoreHandle_t  s_lock;
+static lpn_stats_t        s_stats;
+
+#if CONFIG_BLE_MESH_LOW_POWER
+static esp_timer_handle_t s_poll_timer;
+static esp_timer_handle_t s_report_timer;
+static esp_timer_handle_t s_cfg_timer;
+static bool               s_enabled;
+
+/* cửa sổ đo hiện tại */
+static int64_t   s_win_start_us;
+static uint32_t  s_win_polls;
+static uint32_t  s_win_msgs;
+static uint64_t  s_win_radio_us;
+static int64_t   s_poll_us;             /* poll gần nhất chưa có gói tới, 0 = không có */
+
+static uint32_t since_ms(int64_t t_us) {
+    return (uint32_t)((esp_timer_get_time() - t_us) / 1000);
+}
+
+// ============ Poll cố định (đo) ============
+/* poll trước không có gì tới: radio mở hết receive window */
+static void close_poll_locked(void) {
+    if (s_poll_us) s_win_radio_us += (uint64_t)LPN_RECV_WIN_MS * 1000;
+    s_poll_us = 0;
+}
+
+static void poll_cb(void *arg) {
+    if (!s_stats.friend_addr) return;
+    esp_err_t err = esp_ble_mesh_lpn_poll();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Poll failed (err 0x%x)", err);
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    close_poll_locked();
+    s_poll_us = esp_timer_get_time();
+    s_win_radio_us += LPN_POLL_TX_US;
+    ++s_win_polls;
+    ++s_stats.polls;
+    xSemaphoreGive(s_lock);
+}
+
+// ============ Báo cáo: trễ / dòng trung bình theo chu kỳ poll ============
+static void report_cb(void *arg) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    close_poll_locked();
+    uint32_t win_ms = since_ms(s_win_start_us);
+    uint32_t polls  = s_win_polls;
+    uint32_t msgs   = s_win_msgs;
+    if (LPN_POLL_MS && win_ms) {
+        s_stats.est_avg_ua = LPN_I_IDLE_UA +
+            (uint32_t)((uint64_t)LPN_I_RADIO_UA * (s_win_radio_us / 1000) / win_ms);
+    }
+    uint32_t avg_ua    = s_stats.est_avg_ua;
+    uint32_t delay_avg = s_stats.rx_delays ? s_stats.rx_delay_sum_ms / s_stats.rx_delays : 0;
+    uint32_t delay_max = s_stats.rx_delay_max_ms;
+    s_win_start_us = esp_timer_get_time();
+    s_win_polls = 0;
+    s_win_msgs = 0;
+    s_win_radio_us = 0;
+    xSemaphoreGive(s_lock);
+
+    if (!LPN_POLL_MS) {
+        ESP_LOGI(TAG, "friend 0x%04x: %" PRIu32 " msgs in %" PRIu32 " s (stack-driven polls)",
+                 s_stats.friend_addr, msgs, win_ms / 1000);
+        return;
+    }
+    ESP_LOGI(TAG, "friend 0x%04x, poll %u ms: %" PRIu32 " polls, %" PRIu32 " msgs in %" PRIu32
+             " s, rx delay avg %" PRIu32 " max %" PRIu32 " ms, est avg %" PRIu32 " uA",
+             s_stats.friend_addr, (unsigned)LPN_POLL_MS, polls, msgs, win_ms / 1000,
+             delay_avg, delay_max, avg_ua);
+}
+
+static void on_established(uint16_t friend_addr) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.friend_addr = friend_addr;
+    ++s_stats.friendships;
+    s_win_start_us = esp_timer_get_time();
+    s_win_polls = 0;
+    s_win_msgs = 0;
+    s_win_radio_us = 0;
+    s_poll_us = 0;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Friendship with 0x%04x established", friend_addr);
+    if (s_poll_timer) {
+        esp_timer_stop(s_poll_timer);
+        esp_timer_start_periodic(s_poll_timer, (uint64_t)LPN_POLL_MS * 1000);
+    }
+    if (s_report_timer) {
+        esp_timer_stop(s_report_timer);
+        esp_timer_start_periodic(s_report_timer, (uint64_t)LPN_REPORT_MS * 1000);
+    }
+}
+
+static void on_terminated(uint16_t friend_addr) {
+    if (s_poll_timer) esp_timer_stop(s_poll_timer);
+    if (s_report_timer) esp_timer_stop(s_report_timer);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.friend_addr = 0;
+    ++s_stats.lost;
+    s_poll_us = 0;
+    xSemaphoreGive(s_lock);
+    /* LPN vẫn bật: stack tự gửi Friend Request lại */
+    ESP_LOGW(TAG, "Friendship with 0x%04x terminated, searching again", friend_addr);
+}
+
+static void enable_cb(void *arg) {
+    lpn_on_configured();
+}
+#endif /* CONFIG_BLE_MESH_LOW_POWER */
+
+// ============ API ============
+esp_err_t lpn_init(void) {
+    if (s_lock) return ESP_OK;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+#if CONFIG_PM_ENABLE
+    /* CPU hạ xung / light sleep khi rảnh; BT controller ngủ giữa các lần poll */
+    esp_pm_config_t pm = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t perr = esp_pm_configure(&pm);
+    if (perr != ESP_OK) ESP_LOGW(TAG, "esp_pm_configure failed (%s)", esp_err_to_name(perr));
+#endif
+
+#if CONFIG_BLE_MESH_LOW_POWER
+    esp_err_t err;
+    if (LPN_POLL_MS) {
+        const esp_timer_create_args_t pa = {
+            .callback = poll_cb,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "lpn_poll",
+            .skip_unhandled_events = true,
+        };
+        err = esp_timer_create(&pa, &s_poll_timer);
+        if (err != ESP_OK) return err;
+    }
+    const esp_timer_create_args_t ra = {
+        .callback = report_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "lpn_report",
+        .skip_unhandled_events = true,
+    };
+    err = esp_timer_create(&ra, &s_report_timer);
+    if (err != ESP_OK) return err;
+    const esp_timer_create_args_t ca = {
+        .callback = enable_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "lpn_cfg",
+        .skip_unhandled_events = true,
+    };
+    err = esp_timer_create(&ca, &s_cfg_timer);
+    if (err != ESP_OK) return err;
+#endif
+    return ESP_OK;
+}
+
+void lpn_on_provisioned(void) {
+#if CONFIG_BLE_MESH_LOW_POWER
+    if (s_cfg_timer && !s_enabled) {
+        esp_timer_stop(s_cfg_timer);
+        esp_timer_start_once(s_cfg_timer, (uint64_t)LPN_CFG_WAIT_MS * 1000);
+    }
+#endif
+}
+
+void lpn_on_configured(void) {
+#if CONFIG_BLE_MESH_LOW_POWER
+    if (s_enabled) return;
+    if (s_cfg_timer) esp_timer_stop(s_cfg_timer);
+    esp_err_t err = esp_ble_mesh_lpn_enable();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable LPN (err 0x%x)", err);
+        return;
+    }
+    s_enabled = true;
+#endif
+}
+
+bool lpn_on_prov_evt(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param) {
+    switch (event) {
+#if CONFIG_BLE_MESH_LOW_POWER
+    case ESP_BLE_MESH_LPN_ENABLE_COMP_EVT:
+        ESP_LOGI(TAG, "LPN enabled, err_code %d", param->lpn_enable_comp.err_code);
+        return true;
+    case ESP_BLE_MESH_LPN_POLL_COMP_EVT:
+        if (param->lpn_poll_comp.err_code) {
+            ESP_LOGW(TAG, "Poll err_code %d", param->lpn_poll_comp.err_code);
+        }
+        return true;
+    case ESP_BLE_MESH_LPN_FRIENDSHIP_ESTABLISH_EVT:
+        on_established(param->lpn_friendship_establish.friend_addr);
+        return true;
+    case ESP_BLE_MESH_LPN_FRIENDSHIP_TERMINATE_EVT:
+        on_terminated(param->lpn_friendship_terminate.friend_addr);
+        return true;
+#endif
+#if CONFIG_BLE_MESH_FRIEND
+    case ESP_BLE_MESH_FRIEND_FRIENDSHIP_ESTABLISH_EVT:
+        ESP_LOGI(TAG, "Friend of LPN 0x%04x", param->frnd_friendship_establish.lpn_addr);
+        return true;
+    case ESP_BLE_MESH_FRIEND_FRIENDSHIP_TERMINATE_EVT:
+        ESP_LOGW(TAG, "Friendship with LPN 0x%04x ended (reason %d)",
+                 param->frnd_friendship_terminate.lpn_addr,
+                 param->frnd_friendship_terminate.reason);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+void lpn_on_rx(void) {
+#if CONFIG_BLE_MESH_LOW_POWER
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    ++s_stats.msgs;
+    ++s_win_msgs;
+    if (s_poll_us) {
+        /* gói đầu tiên sau poll: radio mở từ hết receive delay tới lúc gói tới */
+        uint32_t d = since_ms(s_poll_us);
+        ++s_stats.rx_delays;
+        s_stats.rx_delay_sum_ms += d;
+        if (d > s_stats.rx_delay_max_ms) s_stats.rx_delay_max_ms = d;
+        if (d > RECV_DELAY_MS) s_win_radio_us += (uint64_t)(d - RECV_DELAY_MS) * 1000;
+        s_poll_us = 0;
+    }
+    xSemaphoreGive(s_lock);
+#endif
+}
+
+void lpn_get_stats(lpn_stats_t *out) {
+    if (!out) return;
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "ep_ota.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Nhận firmware qua mesh (phía tag): ghi chunk thẳng vào partition OTA kế
+ * tiếp, bitmap chunk đã ghi lưu NVS định kỳ nên reboot / mất sóng giữa chừng
+ * chỉ phải nhận tiếp phần thiếu. Callback mesh chỉ đẩy vào queue; ghi flash,
+ * verify, trả STATUS và apply chạy ở task riêng. */
+
+#ifndef OTA_RX_MAX_CHUNK
+#define OTA_RX_MAX_CHUNK      128
+#endif
+#ifndef OTA_RX_QUEUE_LEN
+#define OTA_RX_QUEUE_LEN      12
+#endif
+#ifndef OTA_RX_PERSIST_EVERY
+#define OTA_RX_PERSIST_EVERY  128   /* số chunk mới giữa 2 lần lưu bitmap */
+#endif
+#ifndef OTA_RX_IDLE_MS
+#define OTA_RX_IDLE_MS        30000 /* phiên dở không có chunk mới -> coi như rảnh */
+#endif
+
+/* Gửi OTA_STATUS (unicast) về gateway */
+typedef void (*ota_rx_send_fn_t)(uint16_t dst, const uint8_t *data, uint16_t len);
+
+esp_err_t ota_rx_init(ota_rx_send_fn_t send);
+
+/* Gọi từ callback vendor model (không block) */
+void ota_rx_on_start(uint16_t src, const uint8_t *msg, uint16_t len);
+void ota_rx_on_data(const uint8_t *msg, uint16_t len);
+
+/* Còn việc: item chờ xử lý, STATUS hẹn giờ, hoặc phiên đang nhận có chunk
+ * trong OTA_RX_IDLE_MS (tag ngủ sâu chờ tới khi rảnh) */
+bool ota_rx_busy(void);
+
+#ifdef __cplusplus
+}
+#endif
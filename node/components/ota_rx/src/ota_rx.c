@@ -0,0 +1,294 @@
+#include "ota_rx.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "nvs.h"
+
+#include "ep_proto.h"
+
+static const char *TAG = "ota_rx";
+
+#define NVS_NS          "ep_ota"
+#define FLASH_SECTOR    4096
+
+typedef enum {
+    ITEM_START = 0,
+    ITEM_DATA,
+} item_type_t;
+
+typedef struct {
+    uint8_t  type;
+    uint16_t src;
+    uint16_t len;
+    uint8_t  data[EP_OTA_DATA_HDR_LEN + OTA_RX_MAX_CHUNK];
+} ota_item_t;
+
+static QueueHandle_t          s_q;
+static ota_rx_send_fn_t       s_send;
+static const esp_partition_t *s_part;
+
+/* phiên hiện tại (fw_id = 0: chưa có) */
+static uint32_t  s_fw_id;
+static uint32_t  s_size;
+static uint8_t   s_chunk;
+static uint16_t  s_n_chunks;
+static uint16_t  s_have;
+static uint16_t  s_unsaved;
+static uint8_t   s_status = EP_OTA_ST_RECEIVING;
+static uint8_t   s_map[EP_OTA_MAP_BYTES(EP_OTA_MAX_CHUNKS)];
+static uint32_t  s_running_id;          /* fw_id đã apply và đang chạy */
+static int64_t   s_last_chunk_us;
+
+/* STATUS hẹn giờ (jitter) */
+static bool      s_reply_pending;
+static uint16_t  s_reply_dst;
+static int64_t   s_reply_at_us;
+
+// ============ NVS ============
+static void save_session(bool with_map) {
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+    nvs_set_u32(h, "fw_id", s_fw_id);
+    nvs_set_u32(h, "size", s_size);
+    nvs_set_u8(h, "chunk", s_chunk);
+    if (with_map) nvs_set_blob(h, "map", s_map, EP_OTA_MAP_BYTES(s_n_chunks));
+    nvs_commit(h);
+    nvs_close(h);
+    s_unsaved = 0;
+}
+
+static void load_session(void) {
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK) return;
+
+    nvs_get_u32(h, "running", &s_running_id);
+    uint32_t fw_id = 0, size = 0;
+    uint8_t  chunk = 0;
+    nvs_get_u32(h, "fw_id", &fw_id);
+    nvs_get_u32(h, "size", &size);
+    nvs_get_u8(h, "chunk", &chunk);
+
+    uint32_t n = ep_ota_chunk_count(size, chunk);
+    size_t   map_len = EP_OTA_MAP_BYTES(n);
+    if (fw_id && fw_id != s_running_id && n > 0 && n <= EP_OTA_MAX_CHUNKS &&
+        nvs_get_blob(h, "map", s_map, &map_len) == ESP_OK) {
+        s_fw_id    = fw_id;
+        s_size     = size;
+        s_chunk    = chunk;
+        s_n_chunks = (uint16_t)n;
+        s_have     = ep_ota_map_count(s_map, s_n_chunks, true);
+        ESP_LOGI(TAG, "resume fw 0x%08" PRIx32 ": %u/%u chunks", s_fw_id, s_have, s_n_chunks);
+    }
+    nvs_close(h);
+}
+
+// ============ Phiên ============
+static bool verify_image(void) {
+    uint8_t  buf[512];
+    uint32_t hash = EP_HASH32_INIT;
+    for (uint32_t off = 0; off < s_size; off += sizeof(buf)) {
+        uint32_t n = s_size - off < sizeof(buf) ? s_size - off : sizeof(buf);
+        if (esp_partition_read(s_part, off, buf, n) != ESP_OK) return false;
+        hash = ep_hash32_update(hash, buf, n);
+    }
+    return hash == s_fw_id;
+}
+
+static void check_complete(void) {
+    if (s_have < s_n_chunks) return;
+    if (verify_image()) {
+        s_status = EP_OTA_ST_COMPLETE;
+        ESP_LOGI(TAG, "fw 0x%08" PRIx32 " complete, verified", s_fw_id);
+    } else {
+        // nhận lại từ đầu; gateway thấy toàn bộ dải thiếu ở vòng sau
+        ESP_LOGE(TAG, "fw 0x%08" PRIx32 " verify failed, restart", s_fw_id);
+        memset(s_map, 0, sizeof(s_map));
+        s_have = 0;
+    }
+    save_session(true);
+}
+
+static void open_session(const EPOtaStart *st) {
+    uint32_t n = ep_ota_chunk_count(st->size, st->chunk_size);
+
+    s_fw_id    = st->fw_id;
+    s_size     = st->size;
+    s_chunk    = st->chunk_size;
+    s_n_chunks = 0;
+    s_have     = 0;
+    memset(s_map, 0, sizeof(s_map));
+
+    if (!s_part || st->chunk_size > OTA_RX_MAX_CHUNK || n == 0 || n > EP_OTA_MAX_CHUNKS ||
+        st->size > s_part->size) {
+        ESP_LOGW(TAG, "fw 0x%08" PRIx32 ": %" PRIu32 " B does not fit", st->fw_id, st->size);
+        s_status = EP_OTA_ST_NOSPACE;
+        return;
+    }
+    s_n_chunks = (uint16_t)n;
+
+    // xoá trước 1 lần: chunk đến theo thứ tự bất kỳ, ghi đè lên vùng đã xoá
+    int64_t  t0    = esp_timer_get_time();
+    uint32_t erase = (s_size + FLASH_SECTOR - 1) & ~(uint32_t)(FLASH_SECTOR - 1);
+    if (esp_partition_erase_range(s_part, 0, erase) != ESP_OK) {
+        ESP_LOGE(TAG, "erase %s failed", s_part->label);
+        s_status = EP_OTA_ST_ERROR;
+        return;
+    }
+    s_status = EP_OTA_ST_RECEIVING;
+    save_session(true);
+    ESP_LOGI(TAG, "open fw 0x%08" PRIx32 ": %" PRIu32 " B / %u chunks, erase %lld ms",
+             s_fw_id, s_size, s_n_chunks, (esp_timer_get_time() - t0) / 1000);
+}
+
+static void apply_image(uint16_t spread_ms) {
+    esp_err_t err = esp_ota_set_boot_partition(s_part);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "set boot partition failed: %s", esp_err_to_name(err));
+        s_status = EP_OTA_ST_ERROR;
+        return;
+    }
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_u32(h, "running", s_fw_id);
+        nvs_erase_key(h, "map");
+        nvs_commit(h);
+        nvs_close(h);
+    }
+    // cả fleet cùng reboot -> giãn ra để mesh không mất hết relay cùng lúc
+    uint32_t delay = spread_ms ? esp_random() % spread_ms : 0;
+    ESP_LOGI(TAG, "apply fw 0x%08" PRIx32 ", reboot in %" PRIu32 " ms", s_fw_id, delay);
+    vTaskDelay(pdMS_TO_TICKS(delay) + 1);
+    esp_restart();
+}
+
+static void send_status(void) {
+    EPOtaStatus st = { .fw_id = s_fw_id, .status = s_status };
+    if (s_fw_id == s_running_id && s_running_id) {
+        st.status = EP_OTA_ST_RUNNING;
+    } else if (s_status == EP_OTA_ST_RECEIVING) {
+        ep_ota_map_fill_status(s_map, s_n_chunks, &st);
+    }
+    uint8_t buf[EP_OTA_STATUS_MAX_LEN];
+    size_t  n = ep_ota_pack_status(&st, buf);
+    if (s_send) s_send(s_reply_dst, buf, (uint16_t)n);
+    ESP_LOGI(TAG, "STATUS -> 0x%04x: st %u, missing %u", s_reply_dst, st.status, st.missing);
+}
+
+static void handle_start(uint16_t src, const uint8_t *msg, uint16_t len) {
+    EPOtaStart st;
+    if (!ep_ota_parse_start(msg, len, &st)) return;
+
+    if (st.fw_id == s_running_id) {
+        s_fw_id = st.fw_id;                 // chỉ để trả RUNNING
+    } else if (st.fw_id != s_fw_id || s_status == EP_OTA_ST_ERROR) {
+        open_session(&st);
+    }
+
+    if ((st.flags & EP_OTA_F_APPLY) && st.fw_id != s_running_id &&
+        s_status == EP_OTA_ST_COMPLETE) {
+        apply_image(st.spread_ms);
+        return;
+    }
+    if (st.flags & EP_OTA_F_QUERY) {
+        uint32_t jitter = st.spread_ms ? esp_random() % st.spread_ms : 0;
+        s_reply_dst     = src;
+        s_reply_at_us   = esp_timer_get_time() + (int64_t)jitter * 1000;
+        s_reply_pending = true;
+    }
+}
+
+static void handle_data(const uint8_t *msg, uint16_t len) {
+    uint16_t tag, idx;
+    if (!ep_ota_parse_data_hdr(msg, len, &tag, &idx)) return;
+    if (s_status != EP_OTA_ST_RECEIVING || s_n_chunks == 0 ||
+        tag != ep_ota_fw_tag(s_fw_id) || idx >= s_n_chunks) {
+        return;
+    }
+    if (ep_ota_map_test(s_map, idx)) return;      // trùng (phát lại cho tag khác)
+
+    uint32_t off  = (uint32_t)idx * s_chunk;
+    uint32_t want = s_size - off < s_chunk ? s_size - off : s_chunk;
+    if ((uint32_t)(len - EP_OTA_DATA_HDR_LEN) != want) return;
+
+    if (esp_partition_write(s_part, off, msg + EP_OTA_DATA_HDR_LEN, want) != ESP_OK) {
+        ESP_LOGE(TAG, "write chunk %u failed", idx);
+        s_status = EP_OTA_ST_ERROR;
+        return;
+    }
+    ep_ota_map_set(s_map, idx);
+    ++s_have;
+    s_last_chunk_us = esp_timer_get_time();
+    if (++s_unsaved >= OTA_RX_PERSIST_EVERY) save_session(true);
+    check_complete();
+}
+
+static void ota_rx_task(void *arg) {
+    ota_item_t it;
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        if (s_reply_pending) {
+            int64_t left_us = s_reply_at_us - esp_timer_get_time();
+            wait = left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) + 1 : 0;
+        }
+        if (xQueueReceive(s_q, &it, wait) == pdTRUE) {
+            if (it.type == ITEM_START) handle_start(it.src, it.data, it.len);
+            else                       handle_data(it.data, it.len);
+        }
+        if (s_reply_pending && esp_timer_get_time() >= s_reply_at_us) {
+            s_reply_pending = false;
+            send_status();
+        }
+    }
+}
+
+esp_err_t ota_rx_init(ota_rx_send_fn_t send) {
+    if (s_q) return ESP_OK;
+    s_send = send;
+    s_part = esp_ota_get_next_update_partition(NULL);
+    if (!s_part) {
+        ESP_LOGW(TAG, "no OTA partition, mesh OTA disabled");
+    }
+    load_session();
+    if (s_n_chunks && s_have == s_n_chunks) check_complete();
+
+    s_q = xQueueCreate(OTA_RX_QUEUE_LEN, sizeof(ota_item_t));
+    if (!s_q) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(ota_rx_task, "ota_rx", 4096, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void enqueue(uint8_t type, uint16_t src, const uint8_t *msg, uint16_t len) {
+    if (!s_q || !msg || len > sizeof(((ota_item_t *)0)->data)) return;
+    ota_item_t it = { .type = type, .src = src, .len = len };
+    memcpy(it.data, msg, len);
+    // đầy -> bỏ, chunk sẽ được báo thiếu và phát lại
+    xQueueSend(s_q, &it, 0);
+}
+
+void ota_rx_on_start(uint16_t src, const uint8_t *msg, uint16_t len) {
+    enqueue(ITEM_START, src, msg, len);
+}
+
+void ota_rx_on_data(const uint8_t *msg, uint16_t len) {
+    enqueue(ITEM_DATA, 0, msg, len);
+}
+
+bool ota_rx_busy(void) {
+    if (!s_q) return false;
+    if (uxQueueMessagesWaiting(s_q) || s_reply_pending) return true;
+    return s_status == EP_OTA_ST_RECEIVING && s_have < s_n_chunks && s_last_chunk_us &&
+           esp_timer_get_time() - s_last_chunk_us < (int64_t)OTA_RX_IDLE_MS * 1000;
+}
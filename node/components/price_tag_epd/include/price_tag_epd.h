@@ -7,6 +7,7 @@
 #include <Adafruit_GFX.h>
 #include <Fonts/FreeSansBold9pt7b.h>
 #include <Fonts/FreeSansBold12pt7b.h>
+#include "epd_codec.h"
 
 #ifdef EPD_PANEL_3C
   #include <GxEPD2_3C.h>
@@ -20,6 +21,8 @@
 class PriceTagEPD {
 public:
   PriceTagEPD(int8_t cs, int8_t dc, int8_t rst, int8_t busy);
+  // initial_full_refresh = false: panel đang giữ hình (thức từ deep sleep),
+  // không xoá màn
   void begin(uint8_t rotation = 3, bool initial_full_refresh = true);
 
   void renderTag(const String& title,
@@ -28,6 +31,15 @@ public:
                  const String& codeBot,
                  const String& ean13);
 
+  // Ảnh nén epd_codec (gateway render sẵn): nạp từng mẩu theo luồng,
+  // mỗi hàng giải xong ghi thẳng vào RAM controller, không cần buffer khung.
+  void beginImage();
+  EPCStatus feedImage(const uint8_t* data, size_t len);   // EPC_DONE khi đủ ảnh
+  void endImage();                                       // refresh toàn màn
+
+  // Tắt nguồn driver + controller deep sleep (thức lại bằng RST ở lần vẽ kế)
+  void hibernate();
+
   Adafruit_GFX* gfx();
   int16_t width()  const;
   int16_t height() const;
@@ -43,11 +55,14 @@ private:
   void drawEAN13HumanReadable(int16_t x, int16_t y, const String& digits);
   void drawSaleBadge(int16_t x, int16_t y, int16_t w, int16_t h, const String& saleTiny);
   void drawTagLayout(const String&, const String&, const String&, const String&, const String&);
+  static void onImageRow(void* user, uint16_t row, const uint8_t* black,
+                         const uint8_t* red, uint8_t row_bytes);
 
 private:
   int8_t pinCS, pinDC, pinRST, pinBUSY;
   uint8_t currentRotation = 3;
   EpdDrv<Panel>* display = nullptr;
+  EPCDecoder imgDec;
 
   const GFXfont* smallFont = &FreeSansBold9pt7b;
   const GFXfont* titleFont = &FreeSansBold12pt7b;
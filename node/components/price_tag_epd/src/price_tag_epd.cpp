@@ -47,6 +47,7 @@ void PriceTagEPD::begin(uint8_t rotation, bool initial_full_refresh) {
   ESP_LOGI(EPD_TAG, "display->init() ok");
 
   currentRotation = rotation;
+  if (!initial_full_refresh) return;
 
   // (tuỳ chọn) 1 vòng refresh rỗng để làm sạch
   display->setFullWindow();
@@ -335,3 +336,41 @@ void PriceTagEPD::renderTag(const String& title,
     drawTagLayout(title, saleTiny, codeTop, codeBot, ean13);
   } while (display->nextPage());
 }
+
+// ====== Ảnh nén (epd_codec) ======
+void PriceTagEPD::onImageRow(void* user, uint16_t row, const uint8_t* black,
+                             const uint8_t* red, uint8_t row_bytes)
+{
+  PriceTagEPD* self = static_cast<PriceTagEPD*>(user);
+  // hàng controller-native: x=0, rộng row_bytes*8, cao 1
+  self->display->epd2.writeImage(black, red, 0, row, row_bytes * 8, 1);
+}
+
+void PriceTagEPD::beginImage()
+{
+  epc_dec_init(&imgDec, &PriceTagEPD::onImageRow, this);
+}
+
+EPCStatus PriceTagEPD::feedImage(const uint8_t* data, size_t len)
+{
+  EPCStatus s = epc_dec_feed(&imgDec, data, len);
+  if (s < 0) ESP_LOGE(EPD_TAG, "image decode error %d (row %u)", (int)s, imgDec.row);
+  return s;
+}
+
+void PriceTagEPD::endImage()
+{
+  if (!epc_dec_done(&imgDec)) {
+    ESP_LOGW(EPD_TAG, "image incomplete (%u/%u rows), skip refresh", imgDec.row, imgDec.rows);
+    return;
+  }
+  display->epd2.refresh(false);
+  ESP_LOGI(EPD_TAG, "image refresh done");
+}
+
+void PriceTagEPD::hibernate()
+{
+  if (!display) return;
+  display->hibernate();
+  ESP_LOGI(EPD_TAG, "hibernate");
+}
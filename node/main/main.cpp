@@ -3,6 +3,10 @@
 #include <Fonts/FreeSansBold9pt7b.h>
 #include <Fonts/FreeSansBold12pt7b.h>
 #include "price_tag_epd.h"
+#include "ota_rx.h"
+#include "fprov.h"
+#include "lpn.h"
+#include "dsleep.h"
 
 extern "C" {
 #include <stdio.h>
@@ -10,6 +14,9 @@ extern "C" {
 #include <inttypes.h>
 
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 
@@ -21,19 +28,38 @@ extern "C" {
 #include "esp_ble_mesh_local_data_operation_api.h"
 
 #include "ble_mesh_example_init.h"
+#include "ep_proto.h"
+#include "ep_blk.h"
+#include "ep_title.h"
 }
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #define TAG "EXAMPLE"
 
-#define CID_ESP     0x02E5
-#define ESP_BLE_MESH_VND_MODEL_ID_CLIENT    0x0000
-#define ESP_BLE_MESH_VND_MODEL_ID_SERVER    0x0001
-#define ESP_BLE_MESH_VND_MODEL_OP_SEND      ESP_BLE_MESH_MODEL_OP_3(0x00, CID_ESP)
-#define ESP_BLE_MESH_VND_MODEL_OP_STATUS    ESP_BLE_MESH_MODEL_OP_3(0x01, CID_ESP)
+#define CID_ESP     EP_CID
+#define ESP_BLE_MESH_VND_MODEL_ID_CLIENT    EP_VND_MODEL_ID_CLIENT
+#define ESP_BLE_MESH_VND_MODEL_ID_SERVER    EP_VND_MODEL_ID_SERVER
+#define ESP_BLE_MESH_VND_MODEL_OP_SEND      ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_SEND, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_STATUS    ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_STATUS, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_BLK_START ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_BLK_START, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_BLK_DATA  ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_BLK_DATA, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_BLK_ACK   ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_BLK_ACK, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_OTA_START  ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_OTA_START, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_OTA_DATA   ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_OTA_DATA, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_OTA_STATUS ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_OTA_STATUS, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_DIGEST_GET ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_DIGEST_GET, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_DIGEST     ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_DIGEST, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_FPROV_SET      ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_FPROV_SET, CID_ESP)
+#define ESP_BLE_MESH_VND_MODEL_OP_FPROV_NODE_ACK ESP_BLE_MESH_MODEL_OP_3(EP_VND_OP_FPROV_NODE_ACK, CID_ESP)
+
+/* Buffer blob (ảnh nén epd_codec ~1-3 KB, dư cho template/font nhỏ) */
+#define BLOB_BUF_SIZE   (12 * 1024)
+/* Blob dở mà gateway im quá lâu -> tag ngủ sâu được ngủ (gateway gửi lại từ đầu) */
+#define BLK_RX_IDLE_MS  10000
 
 /* ePaper: CS=5, DC=17, RST=16, BUSY=4 (khớp phần cứng) */
 static PriceTagEPD g_tag(5, 17, 16, 4);
@@ -45,6 +71,10 @@ static uint8_t dev_uuid[ESP_BLE_MESH_OCTET16_LEN] = {
 
 static uint16_t g_my_primary_addr = 0x0000;
 
+/* key dùng để trả OTA_STATUS (lấy từ OTA_START gần nhất) */
+static uint16_t s_ota_net_idx = 0;
+static uint16_t s_ota_app_idx = 0;
+
 /* ===== Forward declarations ===== */
 static void example_ble_mesh_provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
                                              esp_ble_mesh_prov_cb_param_t *param);
@@ -52,6 +82,10 @@ static void example_ble_mesh_config_server_cb(esp_ble_mesh_cfg_server_cb_event_t
                                               esp_ble_mesh_cfg_server_cb_param_t *param);
 static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event,
                                              esp_ble_mesh_model_cb_param_t *param);
+#if CONFIG_BLE_MESH_FAST_PROV
+static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
+                                              esp_ble_mesh_cfg_client_cb_param_t *param);
+#endif
 
 /* --------- Packet sau parse (log + render) --------- */
 typedef struct {
@@ -60,6 +94,9 @@ typedef struct {
     char     ean13[14];    /* 13 digits + '\0' */
     bool     has_sale;     /* true nếu gói 14B và sale != 0xFF */
     uint8_t  sale;         /* 0..100 */
+    const uint8_t *title;  /* tên nén ep_title (trỏ vào msg), NULL nếu không có */
+    uint8_t  title_len;
+    int16_t  gack_log;     /* log2(số slot) ACK nhóm, -1 nếu gói không có */
 } rx_packet_t;
 
 /* BCD(7) -> 13 số */
@@ -92,15 +129,35 @@ static bool parse_vendor_payload(const uint8_t *msg, uint16_t len, rx_packet_t *
         out->has_sale = false;
         out->sale = 0;
     }
+
+    /* Mở rộng: TLEN(1) + title nén */
+    out->title     = NULL;
+    out->title_len = 0;
+    if (len > EP_SEND_TITLE_OFF + 1) {
+        uint8_t tlen = msg[EP_SEND_TITLE_OFF];
+        if (tlen > 0 && EP_SEND_TITLE_OFF + 1 + tlen <= len) {
+            out->title     = &msg[EP_SEND_TITLE_OFF + 1];
+            out->title_len = tlen;
+        }
+    }
+
+    /* Gói gửi group: byte GACK sau tên */
+    uint16_t gack = ep_send_gack_off(msg, len);
+    out->gack_log = gack ? msg[gack] : -1;
     return true;
 }
 
+
 /* ----- Model / Composition ----- */
 static esp_ble_mesh_cfg_srv_t config_server = {
     .net_transmit = ESP_BLE_MESH_TRANSMIT(2, 20),
     .relay = ESP_BLE_MESH_RELAY_DISABLED,
     .relay_retransmit = ESP_BLE_MESH_TRANSMIT(2, 20),
+#if defined(CONFIG_BLE_MESH_LOW_POWER)
+    .beacon = ESP_BLE_MESH_BEACON_DISABLED,     /* LPN: Friend báo IV / key refresh */
+#else
     .beacon = ESP_BLE_MESH_BEACON_ENABLED,
+#endif
 #if defined(CONFIG_BLE_MESH_GATT_PROXY_SERVER)
     .gatt_proxy = ESP_BLE_MESH_GATT_PROXY_ENABLED,
 #else
@@ -114,13 +171,28 @@ static esp_ble_mesh_cfg_srv_t config_server = {
     .default_ttl = 7,
 };
 
+#if CONFIG_BLE_MESH_FAST_PROV
+/* Config Client: fast prov (fprov) tự gửi AppKey Add / Model App Bind cho tag mới */
+static esp_ble_mesh_client_t config_client;
+#endif
+
 static esp_ble_mesh_model_t root_models[] = {
     ESP_BLE_MESH_MODEL_CFG_SRV(&config_server),
+#if CONFIG_BLE_MESH_FAST_PROV
+    ESP_BLE_MESH_MODEL_CFG_CLI(&config_client),
+#endif
 };
 
 /* min-len = 13 để nhận cả 13/14 byte */
 static esp_ble_mesh_model_op_t vnd_op[] = {
-    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_SEND, 13),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_SEND, EP_SEND_MIN_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_BLK_START, EP_BLK_START_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_BLK_DATA, EP_BLK_DATA_HDR_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_OTA_START, EP_OTA_START_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_OTA_DATA, EP_OTA_DATA_HDR_LEN + 1),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_DIGEST_GET, 0),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_FPROV_SET, EP_FPROV_SET_LEN),
+    ESP_BLE_MESH_MODEL_OP(ESP_BLE_MESH_VND_MODEL_OP_FPROV_NODE_ACK, EP_FPROV_NODE_ACK_LEN),
     ESP_BLE_MESH_MODEL_OP_END,
 };
 
@@ -143,6 +215,41 @@ static esp_ble_mesh_prov_t provision = {
     .uuid = dev_uuid,
 };
 
+/* ----- Mesh OTA ----- */
+/* Vendor server nghe group OTA; với BLE_MESH_SETTINGS subscription được lưu */
+static void ota_subscribe_group(void)
+{
+    esp_err_t err = esp_ble_mesh_model_subscribe_group_addr(g_my_primary_addr, CID_ESP,
+                        ESP_BLE_MESH_VND_MODEL_ID_SERVER, EP_OTA_GROUP_ADDR);
+    if (err) ESP_LOGE(TAG, "Subscribe OTA group 0x%04x failed (err 0x%x)", EP_OTA_GROUP_ADDR, err);
+}
+
+static void ota_send_status(uint16_t dst, const uint8_t *data, uint16_t len)
+{
+    esp_ble_mesh_msg_ctx_t ctx = {};
+    ctx.net_idx  = s_ota_net_idx;
+    ctx.app_idx  = s_ota_app_idx;
+    ctx.addr     = dst;
+    ctx.send_ttl = EP_NODE_REPLY_TTL;
+    esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], &ctx,
+                        ESP_BLE_MESH_VND_MODEL_OP_OTA_STATUS, len, (uint8_t *)data);
+    if (err) ESP_LOGE(TAG, "Failed to send OTA_STATUS (err 0x%x)", err);
+}
+
+/* ----- Fast provisioning (delegate) ----- */
+static void fprov_send(uint16_t dst, uint16_t net_idx, uint16_t app_idx,
+                       uint8_t op, const uint8_t *data, uint16_t len)
+{
+    esp_ble_mesh_msg_ctx_t ctx = {};
+    ctx.net_idx  = net_idx;
+    ctx.app_idx  = app_idx;
+    ctx.addr     = dst;
+    ctx.send_ttl = EP_NODE_REPLY_TTL;
+    esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], &ctx,
+                        ESP_BLE_MESH_MODEL_OP_3(op, CID_ESP), len, (uint8_t *)data);
+    if (err) ESP_LOGE(TAG, "Failed to send fast prov op 0x%02x (err 0x%x)", op, err);
+}
+
 /* ----- Provisioning callbacks ----- */
 static void prov_complete(uint16_t net_idx, uint16_t addr, uint8_t flags, uint32_t iv_index)
 {
@@ -150,6 +257,16 @@ static void prov_complete(uint16_t net_idx, uint16_t addr, uint8_t flags, uint32
     ESP_LOGI(TAG, "flags 0x%02x, iv_index 0x%08" PRIx32, flags, iv_index);
     g_my_primary_addr = addr;
     ESP_LOGI(TAG, "=== MY UNICAST ADDR: 0x%04x ===", g_my_primary_addr);
+    ota_subscribe_group();
+    fprov_on_self_provisioned(flags, iv_index);
+    lpn_on_provisioned();
+
+    dsleep_mesh_t m = {};
+    m.addr     = addr;
+    m.gw_addr  = DSLEEP_GW_ADDR;
+    m.net_idx  = net_idx;
+    m.iv_index = iv_index;
+    dsleep_set_mesh(&m);
 }
 
 static void example_ble_mesh_provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
@@ -176,6 +293,9 @@ static void example_ble_mesh_provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
                       param->node_prov_complete.flags, param->node_prov_complete.iv_index);
         break;
     default:
+        if (lpn_on_prov_evt(event, param)) break;
+        /* sự kiện vai trò provisioner khi đang fast prov */
+        fprov_on_prov_evt(event, param);
         break;
     }
 }
@@ -199,39 +319,326 @@ static String fmt_vnd(uint32_t v) {
 
 
 /* ---------- Render queue & task ---------- */
+typedef enum {
+  RENDER_PRICE = 0,    // các trường text bên dưới
+  RENDER_IMAGE,        // stream epd_codec trong s_blob_buf
+} RenderKind;
+
 typedef struct {
-  char title[32];
+  uint8_t  kind;       // RenderKind
+  uint16_t blob_id;    // RENDER_IMAGE: blob cần vẽ
+  char title[EP_TITLE_MAX_LEN];
   char sale[16];
   char price_orig[24];
   char price_final[24];
   char ean13[16];
+  bool     report;     // lệnh unicast: báo STATUS "đã vẽ" cho gateway
+  uint16_t tid;
+  esp_ble_mesh_msg_ctx_t ctx;
 } RenderMsg;
 
 static QueueHandle_t s_render_q = nullptr;
 
+/* Tên gần nhất: gói chỉ có giá (không kèm title) giữ tên cũ */
+static char s_title[EP_TITLE_MAX_LEN] = "";
+
+/* Digest nội dung đang hiển thị (EP_VND_OP_DIGEST): gateway so với trạng thái
+ * nó tin là tag đang có. Chỉ RAM: sau reboot = 0 -> gateway gửi lại */
+static volatile uint32_t s_content_h;
+static volatile uint32_t s_title_h;
+static volatile uint16_t s_renders;
+static volatile bool     s_render_pending;
+
+/* Tag ngủ sâu: nội dung đang trên panel giữ ở RTC -> thức dậy trả digest
+ * đúng mà không init panel / vẽ lại */
+typedef struct {
+  uint32_t content_h;
+  uint32_t title_h;
+  uint16_t renders;
+  char     title[EP_TITLE_MAX_LEN];
+} RtcTag;
+#if CONFIG_EP_DEEP_SLEEP
+static RTC_DATA_ATTR RtcTag s_rtc_tag;
+#endif
+
+/* g_tag.begin đã chạy: boot nguội ở app_main, thức từ deep sleep thì chỉ
+ * khi có gì cần vẽ */
+static bool s_panel_on;
+
+static void panel_on(void) {
+  if (s_panel_on) return;
+  g_tag.begin(3, false);    // panel đang giữ hình, không xoá
+  s_panel_on = true;
+}
+
+static void rtc_tag_save(void) {
+#if CONFIG_EP_DEEP_SLEEP
+  s_rtc_tag.content_h = s_content_h;
+  s_rtc_tag.title_h   = s_title_h;
+  s_rtc_tag.renders   = s_renders;
+  memcpy(s_rtc_tag.title, s_title, sizeof(s_rtc_tag.title));
+#endif
+}
+
+static void rtc_tag_restore(void) {
+#if CONFIG_EP_DEEP_SLEEP
+  s_content_h = s_rtc_tag.content_h;
+  s_title_h   = s_rtc_tag.title_h;
+  s_renders   = s_rtc_tag.renders;
+  memcpy(s_title, s_rtc_tag.title, sizeof(s_title));
+#endif
+}
+
+/* ---------- Block transfer (nhận blob) ---------- */
+/* s_blob_lock: mesh callback chỉ try-lock (không block stack mesh); khi
+ * render_task đang giải nén từ buffer thì chunk bị bỏ, gateway sẽ gửi lại
+ * theo ACK. Refresh panel không giữ lock. */
+static uint8_t           s_blob_buf[BLOB_BUF_SIZE];
+static EPBlkRx           s_blk_rx;
+static SemaphoreHandle_t s_blob_lock = nullptr;
+static volatile uint32_t s_blk_rx_ms;     /* chunk gần nhất (esp_timer, ms) */
+
+static void render_image(uint16_t blob_id) {
+  /* chỉ giữ lock lúc giải nén vào RAM panel (SPI, vài chục ms); refresh
+   * (vài giây) chạy sau khi nhả -> blob kế tiếp nhận song song */
+  xSemaphoreTake(s_blob_lock, portMAX_DELAY);
+  bool ok = s_blk_rx.complete && s_blk_rx.blob_id == blob_id;
+  EPCStatus st = EPC_OK;
+  if (ok) {
+    g_tag.beginImage();
+    st = g_tag.feedImage(s_blob_buf, s_blk_rx.total_len);
+  }
+  xSemaphoreGive(s_blob_lock);
+
+  if (!ok) {
+    ESP_LOGW("RENDER", "image blob 0x%04x replaced, skip", blob_id);
+    return;
+  }
+  g_tag.endImage();
+  if (st < 0) ESP_LOGE("RENDER", "image blob 0x%04x decode err %d", blob_id, st);
+}
+
 static void render_task(void *arg) {
   RenderMsg msg;
   for (;;) {
     if (xQueueReceive(s_render_q, &msg, portMAX_DELAY) == pdTRUE) {
+      panel_on();
+      if (msg.kind == RENDER_IMAGE) {
+        ESP_LOGI("RENDER", "start: image blob 0x%04x", msg.blob_id);
+        render_image(msg.blob_id);
+        ESP_LOGI("RENDER", "done");
+        continue;
+      }
       ESP_LOGI("RENDER", "start: title=%s sale=%s orig=%s final=%s ean=%s",
                msg.title, msg.sale, msg.price_orig, msg.price_final, msg.ean13);
 
+      int64_t t0 = esp_timer_get_time();
       g_tag.renderTag(String(msg.title), String(msg.sale),
                       String(msg.price_orig), String(msg.price_final),
                       String(msg.ean13));
-
-      ESP_LOGI("RENDER", "done");
+      uint32_t ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+
+      ESP_LOGI("RENDER", "done (%" PRIu32 " ms)", ms);
+      ++s_renders;
+      rtc_tag_save();
+      if (uxQueueMessagesWaiting(s_render_q) == 0) s_render_pending = false;
+      if (msg.report) {
+        uint8_t st[EP_STATUS_EXT_LEN];
+        ep_put_le16(&st[0], msg.tid);
+        st[2] = EP_STATUS_F_RENDERED;
+        ep_put_le16(&st[3], ms > 0xFFFF ? 0xFFFF : (uint16_t)ms);
+        esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], &msg.ctx,
+                            ESP_BLE_MESH_VND_MODEL_OP_STATUS, sizeof(st), st);
+        if (err) ESP_LOGE("RENDER", "Failed to send rendered STATUS (err 0x%x)", err);
+      }
     }
   }
 }
 
+static void digest_send(esp_ble_mesh_msg_ctx_t *ctx, uint8_t flags) {
+    uint8_t d[EP_DIGEST_LEN];
+    ep_put_le32(&d[0], s_content_h);
+    ep_put_le32(&d[4], s_title_h);
+    ep_put_le16(&d[8], s_renders);
+    d[10] = flags | (s_render_pending ? EP_DIGEST_F_RENDERING : 0);
+    esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], ctx,
+                        ESP_BLE_MESH_VND_MODEL_OP_DIGEST, sizeof(d), d);
+    if (err) ESP_LOGE(TAG, "Failed to send DIGEST (err 0x%x)", err);
+}
+
+static void blk_send_ack(esp_ble_mesh_msg_ctx_t *ctx, const EPBlkAck *ack) {
+    uint8_t buf[EP_BLK_ACK_LEN];
+    ep_blk_pack_ack(ack, buf);
+    esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], ctx,
+                        ESP_BLE_MESH_VND_MODEL_OP_BLK_ACK, sizeof(buf), buf);
+    if (err) ESP_LOGE(TAG, "Failed to send BLK_ACK (err 0x%x)", err);
+}
+
+static void blk_on_complete(void) {
+    ESP_LOGI(TAG, "Blob 0x%04x kind %u complete: %" PRIu32 " B",
+             s_blk_rx.blob_id, s_blk_rx.kind, s_blk_rx.total_len);
+    if (s_blk_rx.kind == EP_BLK_KIND_IMAGE) {
+        RenderMsg m = {0};
+        m.kind    = RENDER_IMAGE;
+        m.blob_id = s_blk_rx.blob_id;
+        if (s_render_q) xQueueOverwrite(s_render_q, &m);
+    } else {
+        ESP_LOGW(TAG, "Blob kind %u: chưa có consumer", s_blk_rx.kind);
+    }
+}
+
+static void blk_handle(uint32_t opcode, esp_ble_mesh_msg_ctx_t *ctx,
+                       const uint8_t *msg, uint16_t len) {
+    if (!s_blob_lock || xSemaphoreTake(s_blob_lock, 0) != pdTRUE) {
+        return;   // đang render từ buffer, bỏ frame này
+    }
+    s_blk_rx_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    EPBlkAck ack;
+    bool     send_ack = false;
+    bool     was_complete = s_blk_rx.complete;
+
+    if (opcode == ESP_BLE_MESH_VND_MODEL_OP_BLK_START) {
+        EPBlkStart st;
+        if (ep_blk_parse_start(msg, len, &st)) {
+            ep_blk_rx_start(&s_blk_rx, &st, &ack);
+            send_ack = true;
+        }
+    } else {
+        send_ack = ep_blk_rx_data(&s_blk_rx, msg, len, &ack);
+    }
+    bool completed = !was_complete && s_blk_rx.complete;
+    xSemaphoreGive(s_blob_lock);
+
+    if (send_ack) blk_send_ack(ctx, &ack);
+    if (completed) blk_on_complete();
+}
+
+/* ----- ACK nhóm: STATUS trễ theo slot, tránh cả nhóm trả lời cùng lúc ----- */
+static esp_timer_handle_t     s_gack_timer;
+static esp_ble_mesh_msg_ctx_t s_gack_ctx;
+static uint16_t               s_gack_tid;
+
+static void gack_send(void *arg)
+{
+    esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], &s_gack_ctx,
+                        ESP_BLE_MESH_VND_MODEL_OP_STATUS, sizeof(s_gack_tid), (uint8_t *)&s_gack_tid);
+    if (err) ESP_LOGE(TAG, "Failed to send group STATUS (err 0x%x)", err);
+    else     ESP_LOGI(TAG, "ACKed group TID 0x%04x", s_gack_tid);
+}
+
+/* true nếu đã hẹn STATUS; false -> trả ngay như gói unicast */
+static bool gack_schedule(const esp_ble_mesh_msg_ctx_t *ctx, uint16_t tid, int16_t slots_log)
+{
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(ctx->recv_dst)) {
+        /* unicast bù cho đúng TID đang hẹn -> trả luôn, bỏ hẹn */
+        if (s_gack_timer && tid == s_gack_tid) esp_timer_stop(s_gack_timer);
+        return false;
+    }
+    if (slots_log < 0) return false;
+    if (!s_gack_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = gack_send,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "gack",
+            .skip_unhandled_events = true,
+        };
+        if (esp_timer_create(&args, &s_gack_timer) != ESP_OK) return false;
+    }
+    esp_timer_stop(s_gack_timer);          /* lệnh nhóm mới hơn thay lệnh đang hẹn */
+    s_gack_ctx = *ctx;
+    s_gack_tid = tid;
+    uint32_t ms = ep_gack_delay_ms(g_my_primary_addr, (uint8_t)slots_log, esp_random());
+    esp_timer_start_once(s_gack_timer, (uint64_t)ms * 1000);
+    return true;
+}
+
+/* ----- Deep sleep (CONFIG_EP_DEEP_SLEEP): việc còn dở, báo thức ----- */
+/* gateway + key của lệnh gần nhất: DIGEST F_AWAKE đi thẳng tới đó khi thức */
+static void rtc_remember_gw(const esp_ble_mesh_msg_ctx_t *ctx)
+{
+    dsleep_mesh_t m = {};
+    dsleep_get_mesh(&m);
+    if (m.gw_addr == ctx->addr && m.net_idx == ctx->net_idx && m.app_idx == ctx->app_idx) return;
+    m.addr    = g_my_primary_addr;
+    m.gw_addr = ctx->addr;
+    m.net_idx = ctx->net_idx;
+    m.app_idx = ctx->app_idx;
+    dsleep_set_mesh(&m);
+}
+
+static bool node_busy(void)
+{
+    if (s_render_pending || uxQueueMessagesWaiting(s_render_q)) return true;
+    if (s_gack_timer && esp_timer_is_active(s_gack_timer)) return true;
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    if (s_blk_rx.active && !s_blk_rx.complete && now - s_blk_rx_ms < BLK_RX_IDLE_MS) return true;
+    return ota_rx_busy();
+}
+
+static void node_prepare_sleep(void)
+{
+    if (s_panel_on) g_tag.hibernate();
+}
+
+#if CONFIG_EP_DEEP_SLEEP
+/* Thức dậy: DIGEST tự phát -> gateway gửi ngay lệnh nó còn giữ cho tag */
+static void awake_announce(void)
+{
+    dsleep_mesh_t m = {};
+    if (!dsleep_get_mesh(&m)) m.gw_addr = DSLEEP_GW_ADDR;
+    if (m.addr && m.addr != g_my_primary_addr) {
+        ESP_LOGW(TAG, "RTC addr 0x%04x != restored 0x%04x", m.addr, g_my_primary_addr);
+    }
+    esp_ble_mesh_msg_ctx_t ctx = {};
+    ctx.net_idx  = m.net_idx;
+    ctx.app_idx  = m.app_idx;
+    ctx.addr     = m.gw_addr;
+    ctx.send_ttl = EP_NODE_REPLY_TTL;
+    digest_send(&ctx, EP_DIGEST_F_AWAKE);
+}
+#endif
+
+static const dsleep_ops_t dsleep_ops = {
+    .busy    = node_busy,
+    .prepare = node_prepare_sleep,
+    .report  = nullptr,
+};
+
 /* ----- Vendor model callback (RECV & ACK) ----- */
 static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event,
                                              esp_ble_mesh_model_cb_param_t *param)
 {
     switch (event) {
     case ESP_BLE_MESH_MODEL_OPERATION_EVT:
-        if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_SEND) {
+        lpn_on_rx();
+        dsleep_touch();
+        if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_SEND ||
+            param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_DIGEST_GET) {
+            rtc_remember_gw(param->model_operation.ctx);
+        }
+        // mọi phản hồi dùng chung ctx này: TTL cố định để gateway đếm được hop
+        param->model_operation.ctx->send_ttl = EP_NODE_REPLY_TTL;
+        if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_BLK_START ||
+            param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_BLK_DATA) {
+            blk_handle(param->model_operation.opcode, param->model_operation.ctx,
+                       param->model_operation.msg, param->model_operation.length);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_DIGEST_GET) {
+            digest_send(param->model_operation.ctx, 0);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_FPROV_SET) {
+            fprov_on_set(param->model_operation.ctx,
+                         param->model_operation.msg, param->model_operation.length);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_FPROV_NODE_ACK) {
+            fprov_on_node_ack(param->model_operation.msg, param->model_operation.length);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_OTA_DATA) {
+            ota_rx_on_data(param->model_operation.msg, param->model_operation.length);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_OTA_START) {
+            s_ota_net_idx = param->model_operation.ctx->net_idx;
+            s_ota_app_idx = param->model_operation.ctx->app_idx;
+            ota_rx_on_start(param->model_operation.ctx->addr,
+                            param->model_operation.msg, param->model_operation.length);
+        } else if (param->model_operation.opcode == ESP_BLE_MESH_VND_MODEL_OP_SEND) {
             const uint8_t *msg = param->model_operation.msg;
             uint16_t       len = param->model_operation.length;
 
@@ -254,7 +661,6 @@ static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event
                 }
 
                 // Build strings để render
-                String title   = "IPHONE 17";
                 String saleStr = rx.has_sale ? (String((int)rx.sale) + "%") : String("-");
                 String codeTop = rx.has_sale ? fmt_vnd(rx.price) : String("");
                 uint32_t unit_after = rx.has_sale ? (rx.price * (100 - rx.sale)) / 100 : rx.price;
@@ -263,15 +669,33 @@ static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event
 
                 // Enqueue sang render task (queue len = 1 → overwrite)
                 RenderMsg m = {0};
-                strncpy(m.title,       title.c_str(),    sizeof(m.title) - 1);
+                m.kind = RENDER_PRICE;
+                // title giải nén thẳng vào slot; font GFX 7-bit -> bỏ dấu
+                if (rx.title &&
+                    ep_title_decode(rx.title, rx.title_len, m.title, sizeof(m.title),
+                                    EP_TITLE_F_ASCII) >= 0) {
+                    memcpy(s_title, m.title, sizeof(s_title));
+                    s_title_h = ep_hash32(rx.title, rx.title_len, 0);
+                } else {
+                    if (rx.title) ESP_LOGW(TAG, "Bad title (%u B), keep last", rx.title_len);
+                    memcpy(m.title, s_title, sizeof(m.title));
+                }
                 strncpy(m.sale,        saleStr.c_str(),  sizeof(m.sale) - 1);
                 strncpy(m.price_orig,  codeTop.c_str(),  sizeof(m.price_orig) - 1);
                 strncpy(m.price_final, codeBot.c_str(),  sizeof(m.price_final) - 1);
                 strncpy(m.ean13,       ean.c_str(),      sizeof(m.ean13) - 1);
 
+                // lệnh nhóm: không báo "đã vẽ" (cả nhóm sẽ trả lời cùng lúc)
+                m.report = ESP_BLE_MESH_ADDR_IS_UNICAST(param->model_operation.ctx->recv_dst);
+                m.tid    = rx.tid;
+                m.ctx    = *param->model_operation.ctx;
+
+                s_content_h      = ep_content_hash(msg, len);
+                s_render_pending = true;
                 if (s_render_q) xQueueOverwrite(s_render_q, &m);
 
-                // ACK theo TID
+                // ACK theo TID (gói group: hẹn theo slot)
+                if (gack_schedule(param->model_operation.ctx, rx.tid, rx.gack_log)) break;
                 esp_err_t err = esp_ble_mesh_server_model_send_msg(
                                     &vnd_models[0], param->model_operation.ctx,
                                     ESP_BLE_MESH_VND_MODEL_OP_STATUS,
@@ -295,6 +719,7 @@ static void example_ble_mesh_custom_model_cb(esp_ble_mesh_model_cb_event_t event
         break;
 
     case ESP_BLE_MESH_MODEL_SEND_COMP_EVT:
+        dsleep_touch();
         if (param->model_send_comp.err_code)
             ESP_LOGE(TAG, "Failed to send message 0x%06" PRIx32,
                      (unsigned long)param->model_send_comp.opcode);
@@ -328,6 +753,8 @@ static void example_ble_mesh_config_server_cb(esp_ble_mesh_cfg_server_cb_event_t
                      param->value.state_change.mod_app_bind.app_idx,
                      param->value.state_change.mod_app_bind.company_id,
                      param->value.state_change.mod_app_bind.model_id);
+            lpn_on_configured();     /* bước cuối gateway cần tag nghe liên tục */
+            dsleep_ready();
             break;
         default:
             break;
@@ -335,6 +762,17 @@ static void example_ble_mesh_config_server_cb(esp_ble_mesh_cfg_server_cb_event_t
     }
 }
 
+#if CONFIG_BLE_MESH_FAST_PROV
+/* ----- Config client callback (chỉ dùng cho tag mới của fast prov) ----- */
+static void example_ble_mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
+                                              esp_ble_mesh_cfg_client_cb_param_t *param)
+{
+    ESP_LOGI(TAG, "Config client, err_code %d, event %u, addr 0x%04x, opcode 0x%04" PRIx32,
+             param->error_code, event, param->params->ctx.addr, param->params->opcode);
+    fprov_on_cfg_client_evt(event, param);
+}
+#endif
+
 /* ----- Init & app_main ----- */
 static esp_err_t ble_mesh_init(void)
 {
@@ -343,6 +781,9 @@ static esp_err_t ble_mesh_init(void)
     esp_ble_mesh_register_prov_callback(example_ble_mesh_provisioning_cb);
     esp_ble_mesh_register_config_server_callback(example_ble_mesh_config_server_cb);
     esp_ble_mesh_register_custom_model_callback(example_ble_mesh_custom_model_cb);
+#if CONFIG_BLE_MESH_FAST_PROV
+    esp_ble_mesh_register_config_client_callback(example_ble_mesh_config_client_cb);
+#endif
 
     err = esp_ble_mesh_init(&provision, &composition);
     if (err != ESP_OK) {
@@ -350,12 +791,25 @@ static esp_err_t ble_mesh_init(void)
         return err;
     }
 
+    /* Đã provision (khôi phục từ NVS): không có PROV_COMPLETE_EVT */
+    if (esp_ble_mesh_node_is_provisioned()) {
+        g_my_primary_addr = esp_ble_mesh_get_primary_element_address();
+        ESP_LOGI(TAG, "=== MY UNICAST ADDR: 0x%04x (restored) ===", g_my_primary_addr);
+    }
+
     err = esp_ble_mesh_node_prov_enable((esp_ble_mesh_prov_bearer_t)
             (ESP_BLE_MESH_PROV_ADV | ESP_BLE_MESH_PROV_GATT));
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to enable mesh node");
         return err;
     }
+    if (esp_ble_mesh_node_is_provisioned()) {
+        lpn_on_configured();
+#if CONFIG_EP_DEEP_SLEEP
+        awake_announce();
+        dsleep_ready();
+#endif
+    }
 
     ESP_LOGI(TAG, "BLE Mesh Node initialized");
     return ESP_OK;
@@ -374,6 +828,10 @@ extern "C" void app_main(void)
         ESP_ERROR_CHECK(nvs_flash_init());
     }
 
+    // Deep sleep: đọc RTC trước khi quyết định init panel
+    err = dsleep_init(&dsleep_ops);
+    if (err) ESP_LOGE(TAG, "dsleep_init failed (err %d)", err);
+
     // Bluetooth
     err = bluetooth_init();
     if (err) {
@@ -390,14 +848,39 @@ extern "C" void app_main(void)
     SPI.begin(18, -1, 23, 5);
     ESP_LOGI(TAG, "After SPI.begin");
 
-    ESP_LOGI(TAG, "Before g_tag.begin");
-    g_tag.begin(3);  // rotation = 3
-    ESP_LOGI(TAG, "After g_tag.begin");
+    if (dsleep_woke()) {
+        // panel vẫn giữ hình: chỉ init khi có lệnh vẽ mới
+        rtc_tag_restore();
+        ESP_LOGI(TAG, "Woke from deep sleep, content 0x%08" PRIx32 ", %u renders",
+                 (uint32_t)s_content_h, s_renders);
+    } else {
+        ESP_LOGI(TAG, "Before g_tag.begin");
+        g_tag.begin(3);  // rotation = 3
+        s_panel_on = true;
+        ESP_LOGI(TAG, "After g_tag.begin");
+    }
 
     // Render queue + task (len=1 để xQueueOverwrite)
     s_render_q = xQueueCreate(1, sizeof(RenderMsg));
     configASSERT(s_render_q != nullptr);
 
+    s_blob_lock = xSemaphoreCreateMutex();
+    configASSERT(s_blob_lock != nullptr);
+    ep_blk_rx_init(&s_blk_rx, s_blob_buf, sizeof(s_blob_buf));
+
+    err = ota_rx_init(ota_send_status);
+    if (err) ESP_LOGE(TAG, "ota_rx_init failed (err %d)", err);
+
+#if CONFIG_BLE_MESH_FAST_PROV
+    err = fprov_init(fprov_send, dev_uuid, &config_client);
+#else
+    err = fprov_init(fprov_send, dev_uuid, NULL);
+#endif
+    if (err) ESP_LOGE(TAG, "fprov_init failed (err %d)", err);
+
+    err = lpn_init();
+    if (err) ESP_LOGE(TAG, "lpn_init failed (err %d)", err);
+
     // Pin task sang core 1 (APP CPU) & tăng stack
     xTaskCreatePinnedToCore(render_task, "render_task", 8192, nullptr, 4, nullptr, 1);
 